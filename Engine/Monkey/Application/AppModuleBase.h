@@ -22,7 +22,7 @@ public:
 		, m_Title(title)
 		, m_DepthStencilImage(VK_NULL_HANDLE)
 		, m_DepthStencilView(VK_NULL_HANDLE)
-		, m_DepthStencilMemory(VK_NULL_HANDLE)
+		, m_DepthStencilMemory(nullptr)
 		, m_RenderPass(VK_NULL_HANDLE)
 		, m_SampleCount(VK_SAMPLE_COUNT_1_BIT)
 		, m_DepthFormat(PF_DepthStencil)
@@ -138,15 +138,8 @@ protected:
 		
 		VkMemoryRequirements memRequire;
 		vkGetImageMemoryRequirements(device, m_DepthStencilImage, &memRequire);
-		uint32 memoryTypeIndex = 0;
-		VERIFYVULKANRESULT(GetVulkanRHI()->GetDevice()->GetMemoryManager().GetMemoryTypeFromProperties(memRequire.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex));
-		
-		VkMemoryAllocateInfo memAllocateInfo;
-		ZeroVulkanStruct(memAllocateInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
-		memAllocateInfo.allocationSize  = memRequire.size;
-		memAllocateInfo.memoryTypeIndex = memoryTypeIndex;
-		vkAllocateMemory(device, &memAllocateInfo, VULKAN_CPU_ALLOCATOR, &m_DepthStencilMemory);
-		vkBindImageMemory(device, m_DepthStencilImage, m_DepthStencilMemory, 0);
+		m_DepthStencilMemory = GetVulkanRHI()->GetDevice()->GetMemoryManager().Alloc(false, memRequire.size, memRequire.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, nullptr, __FILE__, __LINE__);
+		vkBindImageMemory(device, m_DepthStencilImage, m_DepthStencilMemory->GetHandle(), 0);
 
 		VkImageViewCreateInfo imageViewCreateInfo;
 		ZeroVulkanStruct(imageViewCreateInfo, VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO);
@@ -259,10 +252,8 @@ protected:
 	{
 		VkDevice device = GetVulkanRHI()->GetDevice()->GetInstanceHandle();
 
-		if (m_DepthStencilMemory != VK_NULL_HANDLE) 
-		{
-			vkFreeMemory(device, m_DepthStencilMemory, VULKAN_CPU_ALLOCATOR);
-			m_DepthStencilMemory = VK_NULL_HANDLE;
+		if (m_DepthStencilMemory != nullptr) {
+			GetVulkanRHI()->GetDevice()->GetMemoryManager().Free(m_DepthStencilMemory);
 		}
 
 		if (m_DepthStencilView != VK_NULL_HANDLE) 
@@ -293,7 +284,7 @@ protected:
     
     VkImage						m_DepthStencilImage;
     VkImageView					m_DepthStencilView;
-    VkDeviceMemory				m_DepthStencilMemory;
+    VulkanDeviceMemoryAllocation*	m_DepthStencilMemory;
 
 	VkRenderPass				m_RenderPass;
 	VkSampleCountFlagBits		m_SampleCount;
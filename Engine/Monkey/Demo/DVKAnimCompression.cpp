@@ -0,0 +1,316 @@
+﻿#include "DVKAnimCompression.h"
+
+#include <algorithm>
+
+namespace vk_demo
+{
+
+	static FORCEINLINE Vector3 InterpolateValue(const Vector3& a, const Vector3& b, float alpha)
+	{
+		return MMath::Lerp(a, b, alpha);
+	}
+
+	// 与运行时的插值保持一致
+	static FORCEINLINE Quat InterpolateValue(const Quat& a, const Quat& b, float alpha)
+	{
+		Quat result = Quat::FastLerp(a, b, alpha);
+		result.Normalize();
+		return result;
+	}
+
+	static FORCEINLINE float ValueError(const Vector3& a, const Vector3& b)
+	{
+		return (a - b).Size();
+	}
+
+	// 两个旋转之间的夹角
+	static FORCEINLINE float ValueError(const Quat& a, const Quat& b)
+	{
+		float dot = MMath::Abs(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+		return 2.0f * MMath::Acos(MMath::Min(dot, 1.0f));
+	}
+
+	template<class ValueType>
+	static ValueType SampleKeys(const std::vector<float>& keys, const std::vector<ValueType>& values, float time)
+	{
+		if (time <= keys.front()) {
+			return values.front();
+		}
+		if (time >= keys.back()) {
+			return values.back();
+		}
+
+		int32 frame = std::lower_bound(keys.begin(), keys.end(), time) - keys.begin() - 1;
+		float alpha = (time - keys[frame]) / (keys[frame + 1] - keys[frame]);
+		return InterpolateValue(values[frame], values[frame + 1], alpha);
+	}
+
+	template<class ValueType>
+	static bool IsConstant(const std::vector<ValueType>& values, float tolerance)
+	{
+		for (int32 i = 1; i < values.size(); ++i) {
+			if (ValueError(values[0], values[i]) > tolerance) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// 从第一个关键帧开始，尽量让当前保留的关键帧与更远的关键帧直接插值，
+	// 中间任何一个原始关键帧的误差超过容差时保留前一个关键帧。
+	template<class ValueType>
+	static void ReduceKeys(const std::vector<float>& keys, const std::vector<ValueType>& values, float tolerance, std::vector<int32>& outKept)
+	{
+		outKept.clear();
+
+		int32 count = keys.size();
+
+		outKept.push_back(0);
+		if (count == 1 || IsConstant(values, tolerance)) {
+			return;
+		}
+
+		int32 start = 0;
+		for (int32 end = start + 2; end < count; ++end)
+		{
+			bool valid = true;
+			for (int32 i = start + 1; i < end && valid; ++i)
+			{
+				float alpha = (keys[i] - keys[start]) / (keys[end] - keys[start]);
+				valid = ValueError(InterpolateValue(values[start], values[end], alpha), values[i]) <= tolerance;
+			}
+
+			if (!valid)
+			{
+				start = end - 1;
+				outKept.push_back(start);
+			}
+		}
+
+		outKept.push_back(count - 1);
+	}
+
+	// 均匀采样时按sampleRate重新采样，否则删减关键帧，结果写入outKeys/outValues。返回是否为均匀采样。
+	template<class ValueType>
+	static bool PrepareKeys(const std::vector<float>& keys, const std::vector<ValueType>& values, float tolerance, float sampleRate, std::vector<float>& outKeys, std::vector<ValueType>& outValues)
+	{
+		outKeys.clear();
+		outValues.clear();
+
+		float duration = keys.back() - keys.front();
+
+		if (sampleRate > 0.0f && duration > 0.0f)
+		{
+			int32 count = MMath::Max(MMath::CeilToInt(duration * sampleRate) + 1, 2);
+			std::vector<float>     sampleKeys(count);
+			std::vector<ValueType> sampleValues(count);
+			for (int32 i = 0; i < count; ++i)
+			{
+				sampleKeys[i]   = i < count - 1 ? keys.front() + duration * i / (count - 1) : keys.back();
+				sampleValues[i] = SampleKeys(keys, values, sampleKeys[i]);
+			}
+
+			// 均匀采样不删减关键帧，只检查是否为常量
+			if (IsConstant(sampleValues, tolerance))
+			{
+				outKeys.push_back(sampleKeys[0]);
+				outValues.push_back(sampleValues[0]);
+				return false;
+			}
+
+			outKeys.swap(sampleKeys);
+			outValues.swap(sampleValues);
+			return true;
+		}
+
+		std::vector<int32> kept;
+		ReduceKeys(keys, values, tolerance, kept);
+		if (duration <= 0.0f) {
+			kept.resize(1);
+		}
+
+		for (int32 i = 0; i < kept.size(); ++i)
+		{
+			outKeys.push_back(keys[kept[i]]);
+			outValues.push_back(values[kept[i]]);
+		}
+		return false;
+	}
+
+	static void QuantizeTimes(const std::vector<float>& keys, bool uniform, DVKCompressedChannel& outChannel)
+	{
+		outChannel.startTime = keys.front();
+		outChannel.timeStep  = 0.0f;
+		outChannel.times.clear();
+
+		if (keys.size() < 2) {
+			return;
+		}
+
+		float duration = keys.back() - keys.front();
+		if (uniform)
+		{
+			outChannel.timeStep = duration / (keys.size() - 1);
+			return;
+		}
+
+		outChannel.timeStep = duration / 65535.0f;
+		outChannel.times.resize(keys.size());
+		for (int32 i = 0; i < keys.size(); ++i) {
+			outChannel.times[i] = MMath::Clamp(MMath::RoundToInt((keys[i] - outChannel.startTime) / outChannel.timeStep), 0, 65535);
+		}
+	}
+
+	void DVKAnimCompressor::Compress(const std::vector<float>& keys, const std::vector<Vector3>& values, float tolerance, float sampleRate, DVKCompressedChannel& outChannel)
+	{
+		outChannel = DVKCompressedChannel();
+		if (keys.size() == 0) {
+			return;
+		}
+
+		std::vector<float>   outKeys;
+		std::vector<Vector3> outValues;
+		bool uniform = PrepareKeys(keys, values, tolerance, sampleRate, outKeys, outValues);
+		QuantizeTimes(outKeys, uniform, outChannel);
+
+		Vector3 mmin = outValues[0];
+		Vector3 mmax = outValues[0];
+		for (int32 i = 1; i < outValues.size(); ++i)
+		{
+			mmin = Vector3::Min(mmin, outValues[i]);
+			mmax = Vector3::Max(mmax, outValues[i]);
+		}
+
+		float ranges[3] = { mmax.x - mmin.x, mmax.y - mmin.y, mmax.z - mmin.z };
+		outChannel.rangeMin[0] = mmin.x;
+		outChannel.rangeMin[1] = mmin.y;
+		outChannel.rangeMin[2] = mmin.z;
+		for (int32 i = 0; i < 3; ++i) {
+			outChannel.rangeStep[i] = ranges[i] / 65535.0f;
+		}
+
+		outChannel.values.resize(outValues.size() * 3);
+		for (int32 i = 0; i < outValues.size(); ++i)
+		{
+			float value[3] = { outValues[i].x, outValues[i].y, outValues[i].z };
+			for (int32 j = 0; j < 3; ++j)
+			{
+				int32 quantized = 0;
+				if (outChannel.rangeStep[j] > 0.0f) {
+					quantized = MMath::RoundToInt((value[j] - outChannel.rangeMin[j]) / outChannel.rangeStep[j]);
+				}
+				outChannel.values[i * 3 + j] = MMath::Clamp(quantized, 0, 65535);
+			}
+		}
+	}
+
+	void DVKAnimCompressor::Compress(const std::vector<float>& keys, const std::vector<Quat>& values, float tolerance, float sampleRate, DVKCompressedChannel& outChannel)
+	{
+		outChannel = DVKCompressedChannel();
+		if (keys.size() == 0) {
+			return;
+		}
+
+		std::vector<Quat> normalized(values.size());
+		for (int32 i = 0; i < values.size(); ++i) {
+			normalized[i] = values[i].GetNormalized();
+		}
+
+		std::vector<float> outKeys;
+		std::vector<Quat>  outValues;
+		bool uniform = PrepareKeys(keys, normalized, tolerance, sampleRate, outKeys, outValues);
+		QuantizeTimes(outKeys, uniform, outChannel);
+
+		// smallest-three：丢掉绝对值最大的分量(保证它为正，解码时由其余三个分量算出)，
+		// 其余三个分量在[-1/√2, 1/√2]之间，各量化为15位，最大分量的序号放在前两个分量的最高位。
+		const float scale = 32767.0f * 0.5f * MMath::Sqrt(2.0f);
+		const float bias  = 1.0f / MMath::Sqrt(2.0f);
+
+		outChannel.values.resize(outValues.size() * 3);
+		for (int32 i = 0; i < outValues.size(); ++i)
+		{
+			const Quat& quat = outValues[i];
+			float components[4] = { quat.x, quat.y, quat.z, quat.w };
+
+			int32 largest = 0;
+			for (int32 j = 1; j < 4; ++j) {
+				if (MMath::Abs(components[j]) > MMath::Abs(components[largest])) {
+					largest = j;
+				}
+			}
+
+			float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+			int32 quantized[3];
+			for (int32 j = 0, k = 0; j < 4; ++j)
+			{
+				if (j == largest) {
+					continue;
+				}
+				quantized[k++] = MMath::Clamp(MMath::RoundToInt((components[j] * sign + bias) * scale), 0, 32767);
+			}
+
+			outChannel.values[i * 3 + 0] = ((largest >> 1) << 15) | quantized[0];
+			outChannel.values[i * 3 + 1] = ((largest & 1) << 15) | quantized[1];
+			outChannel.values[i * 3 + 2] = quantized[2];
+		}
+	}
+
+	int32 DVKCompressedChannel::FindFrame(float time, int32& inOutCursor, float& outAlpha) const
+	{
+		int32 last     = GetKeyCount() - 2;
+		float position = (time - startTime) / timeStep;
+
+		// 均匀采样直接算出所在的关键帧
+		if (times.empty())
+		{
+			if (position <= 0.0f)
+			{
+				outAlpha = 0.0f;
+				return 0;
+			}
+
+			int32 frame = (int32)position;
+			if (frame > last)
+			{
+				outAlpha = 1.0f;
+				return last;
+			}
+
+			outAlpha = position - frame;
+			return frame;
+		}
+
+		if (position <= times.front())
+		{
+			outAlpha = 0.0f;
+			return 0;
+		}
+
+		if (position >= times.back())
+		{
+			outAlpha = 1.0f;
+			return last;
+		}
+
+		// 与DVKAnimChannel::FindFrame相同，先检查游标所在以及下一个区间
+		int32 frame = MMath::Clamp(inOutCursor, 0, last);
+		if (!(times[frame] < position && position <= times[frame + 1]))
+		{
+			if (frame < last && times[frame + 1] < position && position <= times[frame + 2]) {
+				frame += 1;
+			}
+			else
+			{
+				frame = std::lower_bound(times.begin(), times.end(), position, [](uint16 t, float p) {
+					return t < p;
+				}) - times.begin() - 1;
+				frame = MMath::Clamp(frame, 0, last);
+			}
+			inOutCursor = frame;
+		}
+
+		outAlpha = (position - times[frame]) / (times[frame + 1] - times[frame]);
+		return frame;
+	}
+
+}
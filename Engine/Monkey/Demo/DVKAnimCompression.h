@@ -0,0 +1,154 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Vector3.h"
+#include "Math/Quat.h"
+
+#include <string>
+#include <vector>
+
+namespace vk_demo
+{
+
+	struct DVKAnimCompressionSettings
+	{
+		// 删除关键帧时允许的插值误差。位移和缩放为绝对值，单位与模型一致；旋转为弧度。
+		float positionTolerance = 0.01f;
+		float scaleTolerance    = 0.001f;
+		float rotationTolerance = 0.0005f;
+		// 大于0时按这个频率重新均匀采样，不再保存每个关键帧的时间，也不再删减关键帧
+		float sampleRate        = 0.0f;
+		// 统计误差时在每个节点局部空间中距原点errorDistance的虚拟顶点，单位与模型一致
+		float errorDistance     = 1.0f;
+	};
+
+	struct DVKAnimCompressionStats
+	{
+		std::string	name;
+		uint32		rawKeys = 0;
+		uint32		compressedKeys = 0;
+		uint32		rawSize = 0;
+		uint32		compressedSize = 0;
+		// 模型空间中虚拟顶点的最大偏移，以及出现最大偏移的节点
+		float		maxError = 0.0f;
+		std::string	maxErrorNode;
+	};
+
+	// 压缩后的一个通道。位移和缩放按通道的取值范围量化为3个uint16(rangeMin + q * rangeStep)，旋转使用smallest-three量化为48位。
+	// times不为空时关键帧时间为startTime + times[i] * timeStep；
+	// times为空时为均匀采样，第i个关键帧的时间为startTime + i * timeStep。
+	struct DVKCompressedChannel
+	{
+		float				startTime = 0.0f;
+		float				timeStep = 0.0f;
+		float				rangeMin[3] = { 0.0f, 0.0f, 0.0f };
+		float				rangeStep[3] = { 0.0f, 0.0f, 0.0f };
+		std::vector<uint16>	times;
+		std::vector<uint16>	values;
+		int32				cursor = 0;
+
+		FORCEINLINE int32 GetKeyCount() const
+		{
+			return values.size() / 3;
+		}
+
+		FORCEINLINE Vector3 DecodeVector3(int32 index) const
+		{
+			const uint16* data = values.data() + index * 3;
+			return Vector3(
+				rangeMin[0] + data[0] * rangeStep[0],
+				rangeMin[1] + data[1] * rangeStep[1],
+				rangeMin[2] + data[2] * rangeStep[2]
+			);
+		}
+
+		FORCEINLINE Quat DecodeQuat(int32 index) const
+		{
+			const uint16* data = values.data() + index * 3;
+			const float scale = 1.0f / (32767.0f * 0.5f * MMath::Sqrt(2.0f));
+			const float bias  = 1.0f / MMath::Sqrt(2.0f);
+
+			int32 largest = ((data[0] >> 15) << 1) | (data[1] >> 15);
+			float a = (data[0] & 0x7FFF) * scale - bias;
+			float b = (data[1] & 0x7FFF) * scale - bias;
+			float c = (data[2] & 0x7FFF) * scale - bias;
+			float d = MMath::Sqrt(MMath::Max(1.0f - a * a - b * b - c * c, 0.0f));
+
+			switch (largest)
+			{
+				case 0:  return Quat(d, a, b, c);
+				case 1:  return Quat(a, d, b, c);
+				case 2:  return Quat(a, b, d, c);
+				default: return Quat(a, b, c, d);
+			}
+		}
+
+		// 返回time之前的关键帧序号和插值系数，关键帧数不少于2
+		int32 FindFrame(float time, int32& inOutCursor, float& outAlpha) const;
+
+		template<class ValueType>
+		void GetValue(float time, int32& inOutCursor, ValueType& outPrevValue, ValueType& outNextValue, float& outAlpha) const
+		{
+			outAlpha = 0.0f;
+
+			int32 count = GetKeyCount();
+			if (count == 0) {
+				return;
+			}
+
+			int32 frame = 0;
+			if (count > 1) {
+				frame = FindFrame(time, inOutCursor, outAlpha);
+			}
+
+			Decode(frame, outPrevValue);
+			Decode(MMath::Min(frame + 1, count - 1), outNextValue);
+		}
+
+		template<class ValueType>
+		void GetValue(float time, ValueType& outPrevValue, ValueType& outNextValue, float& outAlpha)
+		{
+			GetValue(time, cursor, outPrevValue, outNextValue, outAlpha);
+		}
+
+		FORCEINLINE void Decode(int32 index, Vector3& outValue) const
+		{
+			outValue = DecodeVector3(index);
+		}
+
+		FORCEINLINE void Decode(int32 index, Quat& outValue) const
+		{
+			// Quat只声明了拷贝构造，逐个分量赋值
+			const Quat value = DecodeQuat(index);
+			outValue.x = value.x;
+			outValue.y = value.y;
+			outValue.z = value.z;
+			outValue.w = value.w;
+		}
+
+		// 关键帧数据加上解码参数的字节数
+		uint32 GetMemorySize() const
+		{
+			return sizeof(float) * 8 + (times.size() + values.size()) * sizeof(uint16);
+		}
+	};
+
+	struct DVKCompressedClip
+	{
+		DVKCompressedChannel	positions;
+		DVKCompressedChannel	scales;
+		DVKCompressedChannel	rotations;
+	};
+
+	// 关键帧精简：删除能被相邻关键帧插值还原(误差在容差以内)的关键帧，所有关键帧都相同时只保留一个。
+	// 之后再量化写入DVKCompressedChannel。
+	class DVKAnimCompressor
+	{
+	public:
+		static void Compress(const std::vector<float>& keys, const std::vector<Vector3>& values, float tolerance, float sampleRate, DVKCompressedChannel& outChannel);
+
+		static void Compress(const std::vector<float>& keys, const std::vector<Quat>& values, float tolerance, float sampleRate, DVKCompressedChannel& outChannel);
+	};
+
+}
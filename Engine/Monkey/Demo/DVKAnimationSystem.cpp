@@ -0,0 +1,441 @@
+﻿#include "DVKAnimationSystem.h"
+
+#include <unordered_map>
+
+namespace vk_demo
+{
+
+	enum AnimationLayerSlot
+	{
+		LayerBase = 0,
+		LayerFadeFrom,
+		LayerAdditive,
+		LayerCount
+	};
+
+	// 等价于SetIdentity、AppendScale、Append(rotation)、AppendTranslation
+	FORCEINLINE static void ComposeMatrix(const Vector3& position, const Quat& rotation, const Vector3& scale, Matrix4x4& outMatrix)
+	{
+		rotation.ToMatrix(outMatrix);
+		for (int32 i = 0; i < 3; ++i)
+		{
+			outMatrix.m[0][i] *= scale.x;
+			outMatrix.m[1][i] *= scale.y;
+			outMatrix.m[2][i] *= scale.z;
+		}
+		outMatrix.m[3][0] = position.x;
+		outMatrix.m[3][1] = position.y;
+		outMatrix.m[3][2] = position.z;
+	}
+
+	FORCEINLINE static Quat NLerp(const Quat& a, const Quat& b, float alpha)
+	{
+		Quat result = Quat::FastLerp(a, b, alpha);
+		result.Normalize();
+		return result;
+	}
+
+	DVKAnimationSystem::DVKAnimationSystem()
+	{
+		paletteTransform.SetIdentity();
+	}
+
+	DVKAnimationSystem::~DVKAnimationSystem()
+	{
+		if (paletteBuffer)
+		{
+			paletteBuffer->UnMap();
+			delete paletteBuffer;
+			paletteBuffer = nullptr;
+		}
+		palette = nullptr;
+	}
+
+	DVKAnimationSystem* DVKAnimationSystem::Create(DVKModel* model, std::shared_ptr<VulkanDevice> vulkanDevice, int32 maxInstances)
+	{
+		DVKAnimationSystem* system = new DVKAnimationSystem();
+		system->model        = model;
+		system->maxInstances = MMath::Max(maxInstances, 1);
+
+		// 节点层级与静止姿态
+		const std::vector<DVKNode*>& nodes = model->linearNodes;
+		std::unordered_map<const DVKNode*, int32> nodeIndices;
+		for (int32 i = 0; i < nodes.size(); ++i) {
+			nodeIndices.insert(std::make_pair(nodes[i], i));
+		}
+
+		int32 nodeCount = nodes.size();
+		system->parents.resize(nodeCount);
+		system->restMatrices.resize(nodeCount);
+		system->restPositions.resize(nodeCount);
+		system->restRotations.resize(nodeCount);
+		system->restScales.resize(nodeCount);
+		for (int32 i = 0; i < nodeCount; ++i)
+		{
+			auto it = nodes[i]->parent ? nodeIndices.find(nodes[i]->parent) : nodeIndices.end();
+			system->parents[i] = it != nodeIndices.end() ? it->second : -1;
+			if (system->parents[i] >= i) {
+				MLOGE("Node %s is listed before its parent.", nodes[i]->name.c_str());
+			}
+
+			const Matrix4x4& local = nodes[i]->localMatrix;
+			system->restMatrices[i]  = local;
+			system->restPositions[i] = local.GetOrigin();
+			system->restScales[i]    = local.GetScaleVector();
+			system->restRotations[i] = local.GetMatrixWithoutScale().ToQuat();
+		}
+
+		// 骨骼
+		system->boneCount = model->bones.size();
+		system->boneNodes.resize(system->boneCount);
+		system->inverseBindPoses.resize(system->boneCount);
+		for (int32 i = 0; i < system->boneCount; ++i)
+		{
+			system->boneNodes[i]        = model->bones[i]->nodeIndex;
+			system->inverseBindPoses[i] = model->bones[i]->inverseBindPose;
+		}
+
+		// 叠加层使用的第一帧姿态
+		system->referencePoses.resize(model->animations.size());
+		for (int32 i = 0; i < model->animations.size(); ++i)
+		{
+			const DVKAnimation& animation = model->animations[i];
+			ReferencePose& reference = system->referencePoses[i];
+
+			int32 clipCount = animation.boundClips.size();
+			reference.positions.resize(clipCount);
+			reference.inverseRotations.resize(clipCount);
+			reference.scales.resize(clipCount);
+			for (int32 j = 0; j < clipCount; ++j)
+			{
+				int32 cursor[3] = { 0, 0, 0 };
+				Quat rotation;
+				if (animation.compressedClips.size() > 0) {
+					SampleAnimationClip(animation.compressedClips[j], 0.0f, cursor[0], cursor[1], cursor[2], reference.positions[j], rotation, reference.scales[j]);
+				}
+				else {
+					SampleAnimationClip(*animation.boundClips[j], 0.0f, cursor[0], cursor[1], cursor[2], reference.positions[j], rotation, reference.scales[j]);
+				}
+				reference.inverseRotations[j] = rotation.Inverse();
+			}
+
+			system->maxClips = MMath::Max(system->maxClips, clipCount);
+		}
+
+		system->instances.reserve(system->maxInstances);
+		system->cursors.reserve(system->maxInstances * LayerCount * system->maxClips * 3);
+
+		// 骨骼矩阵，每帧整块重写，使用常驻映射的HostCoherent内存
+		VkDeviceSize paletteSize = sizeof(Matrix4x4) * MMath::Max(system->boneCount, 1) * system->maxInstances;
+		if (vulkanDevice)
+		{
+			system->paletteBuffer = DVKBuffer::CreateBuffer(
+				vulkanDevice,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				paletteSize
+			);
+			system->paletteBuffer->Map();
+			system->palette = (Matrix4x4*)system->paletteBuffer->mapped;
+		}
+		else
+		{
+			system->paletteData.resize(MMath::Max(system->boneCount, 1) * system->maxInstances);
+			system->palette = system->paletteData.data();
+		}
+
+		return system;
+	}
+
+	int32 DVKAnimationSystem::AddInstance(int32 animation, float time, float speed)
+	{
+		if (instances.size() >= maxInstances) {
+			MLOGE("Too many animation instances, max %d.", maxInstances);
+			return -1;
+		}
+
+		DVKAnimationInstance instance;
+		instance.base.animation = animation;
+		instance.base.time      = time;
+		instance.base.speed     = speed;
+		instances.push_back(instance);
+
+		cursors.resize(cursors.size() + LayerCount * maxClips * 3, 0);
+
+		return instances.size() - 1;
+	}
+
+	void DVKAnimationSystem::SetAnimation(int32 instance, int32 animation, float time)
+	{
+		DVKAnimationInstance& state = instances[instance];
+		state.base.animation     = animation;
+		state.base.time          = time;
+		state.fadeFrom.animation = -1;
+	}
+
+	void DVKAnimationSystem::CrossFade(int32 instance, int32 animation, float duration, float time)
+	{
+		DVKAnimationInstance& state = instances[instance];
+		if (duration <= 0.0f || state.base.animation < 0)
+		{
+			SetAnimation(instance, animation, time);
+			return;
+		}
+
+		// 上一次过渡还没结束时直接从当前动画开始过渡
+		state.fadeFrom       = state.base;
+		state.fadeDuration   = duration;
+		state.fadeElapsed    = 0.0f;
+		state.base.animation = animation;
+		state.base.time      = time;
+
+		// 游标跟着层走，交换后不需要重新查找
+		int32* baseCursors = GetCursors(instance, LayerBase);
+		int32* fadeCursors = GetCursors(instance, LayerFadeFrom);
+		std::swap_ranges(baseCursors, baseCursors + maxClips * 3, fadeCursors);
+	}
+
+	void DVKAnimationSystem::SetAdditive(int32 instance, int32 animation, float weight, float time)
+	{
+		DVKAnimationLayer& additive = instances[instance].additive;
+		additive.animation = animation;
+		additive.weight    = weight;
+		additive.time      = time;
+	}
+
+	void DVKAnimationSystem::SetSpeed(int32 instance, float speed)
+	{
+		instances[instance].base.speed = speed;
+	}
+
+	void DVKAnimationSystem::SetPaletteTransform(const Matrix4x4& transform)
+	{
+		paletteTransform    = transform;
+		hasPaletteTransform = !transform.Equals(Matrix4x4::Identity);
+	}
+
+	int32* DVKAnimationSystem::GetCursors(int32 instance, int32 layer)
+	{
+		return cursors.data() + (instance * LayerCount + layer) * maxClips * 3;
+	}
+
+	void DVKAnimationSystem::Update(float delta, DVKJobPool* pool, int32 batchSize)
+	{
+		if (instances.size() == 0) {
+			return;
+		}
+
+		DVKJobPool::BatchFunc func = [this, delta](int32 begin, int32 end) {
+			UpdateBatch(delta, begin, end);
+		};
+
+		if (pool) {
+			pool->ParallelFor(instances.size(), batchSize, func);
+		}
+		else {
+			func(0, instances.size());
+		}
+	}
+
+	void DVKAnimationSystem::UpdateBatch(float delta, int32 begin, int32 end)
+	{
+		Scratch scratch;
+		int32 nodeCount = parents.size();
+		for (int32 i = 0; i < 2; ++i)
+		{
+			scratch.positions[i].resize(nodeCount);
+			scratch.rotations[i].resize(nodeCount);
+			scratch.scales[i].resize(nodeCount);
+			scratch.animated[i].resize(nodeCount);
+		}
+		scratch.globals.resize(nodeCount);
+
+		for (int32 i = begin; i < end; ++i)
+		{
+			DVKAnimationInstance& state = instances[i];
+			AdvanceLayer(state.base, delta);
+			AdvanceLayer(state.additive, delta);
+			if (state.fadeFrom.animation >= 0)
+			{
+				AdvanceLayer(state.fadeFrom, delta);
+				state.fadeElapsed += delta;
+				if (state.fadeElapsed >= state.fadeDuration) {
+					state.fadeFrom.animation = -1;
+				}
+			}
+
+			ComputeInstance(i, scratch);
+		}
+	}
+
+	void DVKAnimationSystem::AdvanceLayer(DVKAnimationLayer& layer, float delta)
+	{
+		if (layer.animation < 0) {
+			return;
+		}
+
+		float duration = model->animations[layer.animation].duration;
+		if (duration <= 0.0f) {
+			layer.time = 0.0f;
+			return;
+		}
+
+		layer.time = MMath::Fmod(layer.time + delta * layer.speed, duration);
+		if (layer.time < 0.0f) {
+			layer.time += duration;
+		}
+	}
+
+	void DVKAnimationSystem::SampleLayer(const DVKAnimationLayer& layer, int32* cursors, Vector3* positions, Quat* rotations, Vector3* scales, uint8* animated)
+	{
+		const DVKAnimation& animation = model->animations[layer.animation];
+		bool compressed = animation.compressedClips.size() > 0;
+
+		for (int32 i = 0; i < animation.boundClips.size(); ++i)
+		{
+			int32 node = animation.boundClips[i]->nodeIndex;
+			int32* cursor = cursors + i * 3;
+			if (compressed) {
+				SampleAnimationClip(animation.compressedClips[i], layer.time, cursor[0], cursor[1], cursor[2], positions[node], rotations[node], scales[node]);
+			}
+			else {
+				SampleAnimationClip(*animation.boundClips[i], layer.time, cursor[0], cursor[1], cursor[2], positions[node], rotations[node], scales[node]);
+			}
+			animated[node] = 1;
+		}
+	}
+
+	void DVKAnimationSystem::ApplyAdditive(const DVKAnimationLayer& layer, int32* cursors, Scratch& scratch)
+	{
+		const DVKAnimation& animation = model->animations[layer.animation];
+		const ReferencePose& reference = referencePoses[layer.animation];
+		bool compressed = animation.compressedClips.size() > 0;
+		float weight = layer.weight;
+
+		Vector3* positions = scratch.positions[0].data();
+		Quat*    rotations = scratch.rotations[0].data();
+		Vector3* scales    = scratch.scales[0].data();
+		uint8*   animated  = scratch.animated[0].data();
+
+		for (int32 i = 0; i < animation.boundClips.size(); ++i)
+		{
+			int32 node = animation.boundClips[i]->nodeIndex;
+			int32* cursor = cursors + i * 3;
+
+			Vector3 position;
+			Quat    rotation;
+			Vector3 scale;
+			if (compressed) {
+				SampleAnimationClip(animation.compressedClips[i], layer.time, cursor[0], cursor[1], cursor[2], position, rotation, scale);
+			}
+			else {
+				SampleAnimationClip(*animation.boundClips[i], layer.time, cursor[0], cursor[1], cursor[2], position, rotation, scale);
+			}
+
+			if (!animated[node])
+			{
+				positions[node] = restPositions[node];
+				rotations[node] = restRotations[node];
+				scales[node]    = restScales[node];
+				animated[node]  = 1;
+			}
+
+			// 相对第一帧的差值，旋转先做base再做差值
+			Quat delta = rotation * reference.inverseRotations[i];
+			rotations[node] = NLerp(Quat::Identity, delta, weight) * rotations[node];
+			rotations[node].Normalize();
+			positions[node] += (position - reference.positions[i]) * weight;
+
+			const Vector3& refScale = reference.scales[i];
+			Vector3 scaleDelta(
+				refScale.x != 0.0f ? scale.x / refScale.x : 1.0f,
+				refScale.y != 0.0f ? scale.y / refScale.y : 1.0f,
+				refScale.z != 0.0f ? scale.z / refScale.z : 1.0f
+			);
+			scales[node] *= MMath::Lerp(Vector3(1.0f, 1.0f, 1.0f), scaleDelta, weight);
+		}
+	}
+
+	void DVKAnimationSystem::ComputeInstance(int32 instance, Scratch& scratch)
+	{
+		const DVKAnimationInstance& state = instances[instance];
+		int32 nodeCount = parents.size();
+
+		Vector3* positions = scratch.positions[0].data();
+		Quat*    rotations = scratch.rotations[0].data();
+		Vector3* scales    = scratch.scales[0].data();
+		uint8*   animated  = scratch.animated[0].data();
+		memset(animated, 0, nodeCount);
+
+		if (state.base.animation >= 0) {
+			SampleLayer(state.base, GetCursors(instance, LayerBase), positions, rotations, scales, animated);
+		}
+
+		// 过渡：两层都没有驱动的节点保持静止姿态，只有一层驱动的节点与静止姿态混合
+		if (state.fadeFrom.animation >= 0)
+		{
+			Vector3* fromPositions = scratch.positions[1].data();
+			Quat*    fromRotations = scratch.rotations[1].data();
+			Vector3* fromScales    = scratch.scales[1].data();
+			uint8*   fromAnimated  = scratch.animated[1].data();
+			memset(fromAnimated, 0, nodeCount);
+
+			SampleLayer(state.fadeFrom, GetCursors(instance, LayerFadeFrom), fromPositions, fromRotations, fromScales, fromAnimated);
+
+			float alpha = MMath::Clamp(state.fadeElapsed / state.fadeDuration, 0.0f, 1.0f);
+			for (int32 i = 0; i < nodeCount; ++i)
+			{
+				if (!animated[i] && !fromAnimated[i]) {
+					continue;
+				}
+
+				const Vector3& fromPos   = fromAnimated[i] ? fromPositions[i] : restPositions[i];
+				const Quat&    fromRot   = fromAnimated[i] ? fromRotations[i] : restRotations[i];
+				const Vector3& fromScale = fromAnimated[i] ? fromScales[i]    : restScales[i];
+				const Vector3& toPos     = animated[i] ? positions[i] : restPositions[i];
+				const Quat&    toRot     = animated[i] ? rotations[i] : restRotations[i];
+				const Vector3& toScale   = animated[i] ? scales[i]    : restScales[i];
+
+				positions[i] = MMath::Lerp(fromPos, toPos, alpha);
+				rotations[i] = NLerp(fromRot, toRot, alpha);
+				scales[i]    = MMath::Lerp(fromScale, toScale, alpha);
+				animated[i]  = 1;
+			}
+		}
+
+		if (state.additive.animation >= 0 && state.additive.weight > 0.0f) {
+			ApplyAdditive(state.additive, GetCursors(instance, LayerAdditive), scratch);
+		}
+
+		// 父节点在前，一遍线性计算完模型空间矩阵
+		Matrix4x4* globals = scratch.globals.data();
+		for (int32 i = 0; i < nodeCount; ++i)
+		{
+			if (animated[i]) {
+				ComposeMatrix(positions[i], rotations[i], scales[i], globals[i]);
+			}
+			else {
+				globals[i] = restMatrices[i];
+			}
+
+			if (parents[i] >= 0) {
+				globals[i].Append(globals[parents[i]]);
+			}
+		}
+
+		// 整个矩阵在栈上算好再写入映射内存，不读回映射内存
+		Matrix4x4* output = palette + instance * boneCount;
+		for (int32 i = 0; i < boneCount; ++i)
+		{
+			Matrix4x4 matrix = inverseBindPoses[i];
+			if (boneNodes[i] >= 0) {
+				matrix.Append(globals[boneNodes[i]]);
+			}
+			if (hasPaletteTransform) {
+				matrix.Append(paletteTransform);
+			}
+			output[i] = matrix;
+		}
+	}
+
+}
@@ -0,0 +1,162 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Vector3.h"
+#include "Math/Quat.h"
+#include "Math/Matrix4x4.h"
+
+#include "DVKModel.h"
+#include "DVKBuffer.h"
+#include "DVKJobPool.h"
+
+#include <vector>
+#include <memory>
+
+namespace vk_demo
+{
+
+	struct DVKAnimationLayer
+	{
+		int32	animation = -1;
+		float	time = 0.0f;
+		float	speed = 1.0f;
+		float	weight = 1.0f;
+	};
+
+	struct DVKAnimationInstance
+	{
+		// 当前播放的动画
+		DVKAnimationLayer	base;
+		// 过渡中的上一个动画，过渡结束后animation为-1
+		DVKAnimationLayer	fadeFrom;
+		float				fadeDuration = 0.0f;
+		float				fadeElapsed = 0.0f;
+		// 叠加层，相对于动画第一帧的差值按weight叠加到base上
+		DVKAnimationLayer	additive;
+	};
+
+	// 同一个模型的大量实例各自播放、过渡、叠加动画。
+	// Update把实例切成批次交给DVKJobPool，每个批次独立完成推进时间、采样、混合、计算层级和骨骼矩阵，
+	// 批次之间没有共享的可写数据。骨骼矩阵直接写入常驻映射的StorageBuffer，每个实例GetBoneCount()个矩阵。
+	class DVKAnimationSystem
+	{
+	private:
+		DVKAnimationSystem();
+
+	public:
+		~DVKAnimationSystem();
+
+		// model提供节点层级、骨骼和动画，必须比DVKAnimationSystem活得更久，Create时节点的localMatrix作为静止姿态。
+		// vulkanDevice为空时骨骼矩阵只保存在内存中。
+		static DVKAnimationSystem* Create(DVKModel* model, std::shared_ptr<VulkanDevice> vulkanDevice, int32 maxInstances);
+
+		// 返回实例序号，超过maxInstances时返回-1
+		int32 AddInstance(int32 animation, float time = 0.0f, float speed = 1.0f);
+
+		// 立即切换，没有过渡
+		void SetAnimation(int32 instance, int32 animation, float time = 0.0f);
+
+		// 在duration秒内从当前动画过渡到animation
+		void CrossFade(int32 instance, int32 animation, float duration, float time = 0.0f);
+
+		// animation小于0时关闭叠加层
+		void SetAdditive(int32 instance, int32 animation, float weight, float time = 0.0f);
+
+		void SetSpeed(int32 instance, float speed);
+
+		// 推进时间并计算所有实例的骨骼矩阵，pool为空时在调用线程中完成
+		void Update(float delta, DVKJobPool* pool = nullptr, int32 batchSize = 16);
+
+		// 骨骼矩阵最后再乘上transform，例如蒙皮网格所在节点的逆矩阵
+		void SetPaletteTransform(const Matrix4x4& transform);
+
+		FORCEINLINE const DVKAnimationInstance& GetInstance(int32 instance) const
+		{
+			return instances[instance];
+		}
+
+		FORCEINLINE const Matrix4x4* GetPalette(int32 instance) const
+		{
+			return palette + instance * boneCount;
+		}
+
+		// 没有vulkanDevice时为空
+		FORCEINLINE DVKBuffer* GetPaletteBuffer() const
+		{
+			return paletteBuffer;
+		}
+
+		FORCEINLINE int32 GetBoneCount() const
+		{
+			return boneCount;
+		}
+
+		FORCEINLINE int32 GetNumInstances() const
+		{
+			return instances.size();
+		}
+
+	private:
+
+		// 一个批次使用的临时数据
+		struct Scratch
+		{
+			std::vector<Vector3>	positions[2];
+			std::vector<Quat>		rotations[2];
+			std::vector<Vector3>	scales[2];
+			std::vector<uint8>		animated[2];
+			std::vector<Matrix4x4>	globals;
+		};
+
+		void UpdateBatch(float delta, int32 begin, int32 end);
+
+		void AdvanceLayer(DVKAnimationLayer& layer, float delta);
+
+		int32* GetCursors(int32 instance, int32 layer);
+
+		// 采样一层动画，写入被动画驱动的节点并标记animated
+		void SampleLayer(const DVKAnimationLayer& layer, int32* cursors, Vector3* positions, Quat* rotations, Vector3* scales, uint8* animated);
+
+		void ApplyAdditive(const DVKAnimationLayer& layer, int32* cursors, Scratch& scratch);
+
+		void ComputeInstance(int32 instance, Scratch& scratch);
+
+	private:
+
+		DVKModel*					model = nullptr;
+
+		// 与model->linearNodes一一对应
+		std::vector<int32>			parents;
+		std::vector<Matrix4x4>		restMatrices;
+		std::vector<Vector3>		restPositions;
+		std::vector<Quat>			restRotations;
+		std::vector<Vector3>		restScales;
+
+		int32						boneCount = 0;
+		std::vector<int32>			boneNodes;
+		std::vector<Matrix4x4>		inverseBindPoses;
+		Matrix4x4					paletteTransform;
+		bool						hasPaletteTransform = false;
+
+		// 每个动画第一帧的姿态，与DVKAnimation::boundClips一一对应，叠加层用它求差值
+		struct ReferencePose
+		{
+			std::vector<Vector3>	positions;
+			std::vector<Quat>		inverseRotations;
+			std::vector<Vector3>	scales;
+		};
+		std::vector<ReferencePose>	referencePoses;
+
+		int32						maxInstances = 0;
+		std::vector<DVKAnimationInstance>	instances;
+		// 每个实例每一层每个clip的三个通道游标
+		int32						maxClips = 0;
+		std::vector<int32>			cursors;
+
+		DVKBuffer*					paletteBuffer = nullptr;
+		std::vector<Matrix4x4>		paletteData;
+		Matrix4x4*					palette = nullptr;
+	};
+
+}
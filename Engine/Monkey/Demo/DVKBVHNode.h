@@ -0,0 +1,129 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Vector3.h"
+#include "Math/VectorRegister.h"
+
+namespace vk_demo
+{
+
+	// 遍历栈中的一项，child为子节点的编码，distance为射线进入包围盒的距离
+	struct DVKBVHEntry
+	{
+		uint32	child;
+		float	distance;
+	};
+
+	// 射线的SIMD数据，每次遍历计算一次
+	struct DVKBVHRay
+	{
+		VectorRegister	originX;
+		VectorRegister	originY;
+		VectorRegister	originZ;
+		VectorRegister	invDirX;
+		VectorRegister	invDirY;
+		VectorRegister	invDirZ;
+
+		DVKBVHRay(const Vector3& origin, const Vector3& direction)
+		{
+			// 方向分量为0时用很大的数代替无穷大，避免0 * inf得到NaN
+			originX = VectorSetFloat1(origin.x);
+			originY = VectorSetFloat1(origin.y);
+			originZ = VectorSetFloat1(origin.z);
+			invDirX = VectorSetFloat1(direction.x != 0.0f ? 1.0f / direction.x : MAX_flt);
+			invDirY = VectorSetFloat1(direction.y != 0.0f ? 1.0f / direction.y : MAX_flt);
+			invDirZ = VectorSetFloat1(direction.z != 0.0f ? 1.0f / direction.z : MAX_flt);
+		}
+	};
+
+	// 4叉BVH的节点，DVKTriangleBVH和光线追踪示例的PrimitiveBVH共用。按SoA保存4个子节点的包围盒，一次SIMD测试4个包围盒。
+	// 子节点的编码：最高位为0时是节点序号；为1时是叶子，其余位的含义由使用者决定，但不能全为1。
+	// 空的子节点为EmptyChild，只出现在末尾。空的包围盒是反的，但在每个轴上得到的区间都是[-MAX, MAX]，仍会通过slab测试，
+	// 所以IntersectChildren用GetChildMask去掉空的子节点。节点是POD，可以直接写入烘焙文件。
+	struct DVKBVHNode
+	{
+		enum : uint32
+		{
+			LeafFlag   = 0x80000000,
+			EmptyChild = 0xFFFFFFFF,
+		};
+
+		float	boundsMinX[4];
+		float	boundsMinY[4];
+		float	boundsMinZ[4];
+		float	boundsMaxX[4];
+		float	boundsMaxY[4];
+		float	boundsMaxZ[4];
+		uint32	children[4];
+
+		FORCEINLINE void SetChild(int32 index, uint32 child, const Vector3& boundsMin, const Vector3& boundsMax)
+		{
+			boundsMinX[index] = boundsMin.x;
+			boundsMinY[index] = boundsMin.y;
+			boundsMinZ[index] = boundsMin.z;
+			boundsMaxX[index] = boundsMax.x;
+			boundsMaxY[index] = boundsMax.y;
+			boundsMaxZ[index] = boundsMax.z;
+			children[index]   = child;
+		}
+
+		FORCEINLINE void SetEmpty(int32 index)
+		{
+			SetChild(index, EmptyChild, Vector3(MAX_flt, MAX_flt, MAX_flt), Vector3(-MAX_flt, -MAX_flt, -MAX_flt));
+		}
+
+		// 非空子节点的掩码，第i位对应children[i]
+		FORCEINLINE int32 GetChildMask() const
+		{
+			return (children[0] != EmptyChild ? 1 : 0) | (children[1] != EmptyChild ? 2 : 0) | (children[2] != EmptyChild ? 4 : 0) | (children[3] != EmptyChild ? 8 : 0);
+		}
+
+		// 测试4个子节点的包围盒，只保留距离在[0, closest]之间的非空子节点。
+		// 命中的子节点按距离从远到近写入outEntries，依次入栈之后近的先出栈。返回命中的数量。
+		FORCEINLINE int32 IntersectChildren(const DVKBVHRay& ray, float closest, DVKBVHEntry outEntries[4]) const
+		{
+			VectorRegister t0 = VectorMultiply(VectorSubtract(VectorLoad(boundsMinX), ray.originX), ray.invDirX);
+			VectorRegister t1 = VectorMultiply(VectorSubtract(VectorLoad(boundsMaxX), ray.originX), ray.invDirX);
+			VectorRegister tNear = VectorMax(VectorMin(t0, t1), VectorZero());
+			VectorRegister tFar  = VectorMax(t0, t1);
+
+			t0 = VectorMultiply(VectorSubtract(VectorLoad(boundsMinY), ray.originY), ray.invDirY);
+			t1 = VectorMultiply(VectorSubtract(VectorLoad(boundsMaxY), ray.originY), ray.invDirY);
+			tNear = VectorMax(tNear, VectorMin(t0, t1));
+			tFar  = VectorMin(tFar,  VectorMax(t0, t1));
+
+			t0 = VectorMultiply(VectorSubtract(VectorLoad(boundsMinZ), ray.originZ), ray.invDirZ);
+			t1 = VectorMultiply(VectorSubtract(VectorLoad(boundsMaxZ), ray.originZ), ray.invDirZ);
+			tNear = VectorMax(tNear, VectorMin(t0, t1));
+			tFar  = VectorMin(VectorMin(tFar, VectorMax(t0, t1)), VectorSetFloat1(closest));
+
+			int32 mask = VectorMaskBits(VectorCompareLE(tNear, tFar)) & GetChildMask();
+			if (mask == 0) {
+				return 0;
+			}
+
+			float distances[4];
+			VectorStore(tNear, distances);
+
+			int32 hitCount = 0;
+			while (mask)
+			{
+				int32 i = MMath::CountTrailingZeros(mask);
+				mask &= mask - 1;
+
+				DVKBVHEntry child = { children[i], distances[i] };
+				int32 j = hitCount++;
+				while (j > 0 && outEntries[j - 1].distance < child.distance)
+				{
+					outEntries[j] = outEntries[j - 1];
+					j -= 1;
+				}
+				outEntries[j] = child;
+			}
+
+			return hitCount;
+		}
+	};
+
+}
@@ -5,6 +5,48 @@
 
 namespace vk_demo
 {
+	// 延迟释放队列里的Buffer，到期之后销毁句柄并归还内存
+	class DVKBufferRelease : public RefCount
+	{
+	public:
+		DVKBufferRelease(VkDevice inDevice, VkBuffer inBuffer, VulkanResourceAllocation* inAllocation)
+			: device(inDevice)
+			, buffer(inBuffer)
+			, allocation(inAllocation)
+		{
+
+		}
+
+		virtual ~DVKBufferRelease()
+		{
+			if (buffer != VK_NULL_HANDLE) {
+				vkDestroyBuffer(device, buffer, VULKAN_CPU_ALLOCATOR);
+			}
+			delete allocation;
+		}
+
+	private:
+		VkDevice					device;
+		VkBuffer					buffer;
+		VulkanResourceAllocation*	allocation;
+	};
+
+	DVKBuffer::~DVKBuffer()
+	{
+		UnMap();
+
+		if (allocation) {
+			vulkanDevice->GetResourceHeapManager().ReleaseDeferred(new DVKBufferRelease(device, buffer, allocation));
+		}
+		else if (buffer != VK_NULL_HANDLE) {
+			vkDestroyBuffer(device, buffer, VULKAN_CPU_ALLOCATOR);
+		}
+
+		buffer     = VK_NULL_HANDLE;
+		memory     = VK_NULL_HANDLE;
+		allocation = nullptr;
+	}
+
 	DVKBuffer* DVKBuffer::CreateBuffer(std::shared_ptr<VulkanDevice> vulkanDevice, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, void *data)
 	{
 		DVKBuffer* dvkBuffer = new DVKBuffer();
@@ -12,11 +54,13 @@ namespace vk_demo
 		
 		VkDevice vkDevice = vulkanDevice->GetInstanceHandle();
 		
-		uint32 memoryTypeIndex = 0;
 		VkMemoryRequirements memReqs = {};
-		VkMemoryAllocateInfo memAlloc;
-		ZeroVulkanStruct(memAlloc, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
 		
+		// Device Local的Buffer在碎片整理时需要作为拷贝的源和目标
+		if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0) {
+			usageFlags |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		}
+
 		VkBufferCreateInfo bufferCreateInfo;
 		ZeroVulkanStruct(bufferCreateInfo, VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO);
 		bufferCreateInfo.usage = usageFlags;
@@ -24,13 +68,12 @@ namespace vk_demo
 		vkCreateBuffer(vkDevice, &bufferCreateInfo, nullptr, &(dvkBuffer->buffer));
 
 		vkGetBufferMemoryRequirements(vkDevice, dvkBuffer->buffer, &memReqs);
-		vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, memoryPropertyFlags, &memoryTypeIndex);
-		memAlloc.allocationSize  = memReqs.size;
-		memAlloc.memoryTypeIndex = memoryTypeIndex;
-		
-		vkAllocateMemory(vkDevice, &memAlloc, nullptr, &dvkBuffer->memory);
+		dvkBuffer->vulkanDevice = vulkanDevice.get();
+		dvkBuffer->allocation   = vulkanDevice->GetResourceHeapManager().AllocateBufferMemory(memReqs, memoryPropertyFlags, __FILE__, __LINE__);
+		dvkBuffer->memory       = dvkBuffer->allocation->GetHandle();
 
-		dvkBuffer->size       = memAlloc.allocationSize;
+		dvkBuffer->size       = memReqs.size;
+		dvkBuffer->bufferSize = size;
 		dvkBuffer->alignment  = memReqs.alignment;
 		dvkBuffer->usageFlags = usageFlags;
 		dvkBuffer->memoryPropertyFlags = memoryPropertyFlags;
@@ -56,21 +99,22 @@ namespace vk_demo
 		if (mapped) {
 			return VK_SUCCESS;
 		}
-		return vkMapMemory(device, memory, offset, size, 0, &mapped);
+		// Host可见的页在分配时已经整体映射，这里只需要加上偏移
+		if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0) {
+			return VK_ERROR_MEMORY_MAP_FAILED;
+		}
+		mapped = (uint8*)allocation->GetMappedPointer() + offset;
+		return VK_SUCCESS;
 	}
 
 	void DVKBuffer::UnMap()
 	{
-		if (!mapped) {
-			return;
-		}
-		vkUnmapMemory(device, memory);
 		mapped = nullptr;
 	}
 
 	VkResult DVKBuffer::Bind(VkDeviceSize offset)
 	{
-		return vkBindBufferMemory(device, buffer, memory, offset);
+		return vkBindBufferMemory(device, buffer, memory, allocation->GetOffset() + offset);
 	}
 
 	void DVKBuffer::SetupDescriptor(VkDeviceSize size, VkDeviceSize offset)
@@ -88,24 +132,72 @@ namespace vk_demo
 		memcpy(mapped, data, size);
 	}
 
+	// Buffer与其它分配共用一块VkDeviceMemory，由分配负责把范围对齐到nonCoherentAtomSize
 	VkResult DVKBuffer::Flush(VkDeviceSize size, VkDeviceSize offset)
 	{
-		VkMappedMemoryRange mappedRange = {};
-		mappedRange.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-		mappedRange.memory = memory;
-		mappedRange.offset = offset;
-		mappedRange.size   = size;
-		return vkFlushMappedMemoryRanges(device, 1, &mappedRange);
+		return allocation->FlushMappedMemory(offset, size);
 	}
 
 	VkResult DVKBuffer::Invalidate(VkDeviceSize size, VkDeviceSize offset)
 	{
-		VkMappedMemoryRange mappedRange = {};
-		mappedRange.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-		mappedRange.memory = memory;
-		mappedRange.offset = offset;
-		mappedRange.size   = size;
-		return vkInvalidateMappedMemoryRanges(device, 1, &mappedRange);
+		return allocation->InvalidateMappedMemory(offset, size);
+	}
+
+	bool DVKBuffer::EnableDefragment()
+	{
+		// Host可见的Buffer可能被调用者缓存了映射地址，不能移动
+		if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0) {
+			return false;
+		}
+		allocation->SetMoveHandler(this);
+		return true;
+	}
+
+	bool DVKBuffer::OnMove(VulkanResourceAllocation* oldAllocation, VulkanResourceAllocation* newAllocation, VkCommandBuffer cmdBuffer)
+	{
+		VkBufferCreateInfo bufferCreateInfo;
+		ZeroVulkanStruct(bufferCreateInfo, VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO);
+		bufferCreateInfo.usage = usageFlags;
+		bufferCreateInfo.size  = bufferSize;
+
+		VkBuffer newBuffer = VK_NULL_HANDLE;
+		if (vkCreateBuffer(device, &bufferCreateInfo, VULKAN_CPU_ALLOCATOR, &newBuffer) != VK_SUCCESS) {
+			return false;
+		}
+
+		// 失败时不能录制任何命令，新分配由Heap回收
+		VkMemoryRequirements memReqs = {};
+		vkGetBufferMemoryRequirements(device, newBuffer, &memReqs);
+		if (memReqs.size > newAllocation->GetSize() || (newAllocation->GetOffset() % memReqs.alignment) != 0)
+		{
+			vkDestroyBuffer(device, newBuffer, VULKAN_CPU_ALLOCATOR);
+			return false;
+		}
+		newAllocation->BindBuffer(vulkanDevice, newBuffer);
+
+		VkBufferCopy copyRegion = {};
+		copyRegion.size = bufferSize;
+		vkCmdCopyBuffer(cmdBuffer, buffer, newBuffer, 1, &copyRegion);
+
+		VkBufferMemoryBarrier barrier;
+		ZeroVulkanStruct(barrier, VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER);
+		barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask       = VK_ACCESS_MEMORY_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer              = newBuffer;
+		barrier.size                = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+		// 旧的内存由Heap延迟释放，旧的句柄也要等GPU用完
+		vulkanDevice->GetResourceHeapManager().ReleaseDeferred(new DVKBufferRelease(device, buffer, nullptr));
+
+		buffer     = newBuffer;
+		memory     = newAllocation->GetHandle();
+		allocation = newAllocation;
+		SetupDescriptor(descriptor.range, descriptor.offset);
+
+		return true;
 	}
 
-}
+}
\ No newline at end of file
@@ -11,11 +11,12 @@
 #include <memory>
 
 class VulkanDevice;
+class VulkanResourceAllocation;
 
 namespace vk_demo
 {
 	
-	class DVKBuffer
+	class DVKBuffer : public VulkanResourceMoveHandler
 	{
 	private:
 		DVKBuffer()
@@ -23,27 +24,24 @@ namespace vk_demo
 
 		}
 	public:
-		~DVKBuffer()
-		{
-			if (buffer != VK_NULL_HANDLE) {
-				vkDestroyBuffer(device, buffer, nullptr);
-				buffer = VK_NULL_HANDLE;
-			}
-			if (memory != VK_NULL_HANDLE) {
-				vkFreeMemory(device, memory, nullptr);
-				memory = VK_NULL_HANDLE;
-			}
-		}
+		// GPU可能仍在使用，Buffer和内存交给延迟释放队列
+		~DVKBuffer();
+
 	public:
 
 		VkDevice				device = VK_NULL_HANDLE;
+		VulkanDevice*			vulkanDevice = nullptr;
 
 		VkBuffer				buffer = VK_NULL_HANDLE;
+		// 内存来自VulkanResourceHeapManager，memory是所在页的句柄，偏移为allocation->GetOffset()
 		VkDeviceMemory			memory = VK_NULL_HANDLE;
+		VulkanResourceAllocation*	allocation = nullptr;
 
 		VkDescriptorBufferInfo	descriptor;
 
+		// 内存需求的大小，bufferSize是创建VkBuffer时的大小
 		VkDeviceSize			size = 0;
+		VkDeviceSize			bufferSize = 0;
 		VkDeviceSize			alignment = 0;
 
 		void*					mapped = nullptr;
@@ -68,6 +66,12 @@ namespace vk_demo
 		VkResult Flush(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
 
 		VkResult Invalidate(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+
+		// 允许VulkanResourceHeapManager::Defragment移动这个Buffer，只支持Device Local的Buffer。
+		// 移动之后buffer句柄会变，调用者需要每帧重新录制用到它的命令，已经写入描述符的需要重新写入。
+		bool EnableDefragment();
+
+		virtual bool OnMove(VulkanResourceAllocation* oldAllocation, VulkanResourceAllocation* newAllocation, VkCommandBuffer cmdBuffer) override;
 	};
 
 };
\ No newline at end of file
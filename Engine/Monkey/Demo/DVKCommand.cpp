@@ -1,5 +1,7 @@
 ﻿#include "DVKCommand.h"
+#include "DVKBuffer.h"
 
+#include "Utils/Alignment.h"
 #include "Vulkan/VulkanCommon.h"
 
 namespace vk_demo
@@ -8,6 +10,16 @@ namespace vk_demo
 	{
 		VkDevice device = vulkanDevice->GetInstanceHandle();
 
+		WaitBatch();
+		ReleaseStaging();
+
+		if (stagingBuffer)
+		{
+			stagingBuffer->UnMap();
+			delete stagingBuffer;
+			stagingBuffer = nullptr;
+		}
+
 		if (cmdBuffer != VK_NULL_HANDLE) 
 		{
 			vkFreeCommandBuffers(device, commandPool, 1, &cmdBuffer);
@@ -30,6 +42,17 @@ namespace vk_demo
 	}
 
 	void DVKCommandBuffer::Submit(VkSemaphore* signalSemaphore)
+	{
+		// 批量模式下继续录制，由FlushBatch统一提交
+		if (isBatching) {
+			return;
+		}
+
+		SubmitNoWait(signalSemaphore);
+		WaitBatch();
+	}
+
+	void DVKCommandBuffer::SubmitNoWait(VkSemaphore* signalSemaphore)
 	{
 		End();
 
@@ -49,7 +72,130 @@ namespace vk_demo
 
 		vkResetFences(vulkanDevice->GetInstanceHandle(), 1, &fence);
 		vkQueueSubmit(queue->GetHandle(), 1, &submitInfo, fence);
+
+		isPending = true;
+	}
+
+	void DVKCommandBuffer::BeginBatch()
+	{
+		if (isBatching) {
+			return;
+		}
+
+		WaitBatch();
+		isBatching = true;
+	}
+
+	void DVKCommandBuffer::FlushBatch(bool waitForCompletion)
+	{
+		isBatching = false;
+
+		if (isBegun) {
+			SubmitNoWait(nullptr);
+		}
+		else if (!isPending) {
+			// 没有录制任何命令，Staging可以直接回收
+			ReleaseStaging();
+		}
+
+		if (waitForCompletion) {
+			WaitBatch();
+		}
+	}
+
+	bool DVKCommandBuffer::IsBatchComplete()
+	{
+		if (!isPending) {
+			return true;
+		}
+
+		if (vkGetFenceStatus(vulkanDevice->GetInstanceHandle(), fence) != VK_SUCCESS) {
+			return false;
+		}
+
+		WaitBatch();
+		return true;
+	}
+
+	void DVKCommandBuffer::WaitBatch()
+	{
+		if (!isPending) {
+			return;
+		}
+
 		vkWaitForFences(vulkanDevice->GetInstanceHandle(), 1, &fence, true, MAX_uint64);
+		isPending = false;
+
+		ReleaseStaging();
+	}
+
+	DVKStagingRegion DVKCommandBuffer::AcquireStaging(uint64 size, uint64 alignment)
+	{
+		// 上一个批次仍在执行，CommandBuffer和Staging都不能复用
+		WaitBatch();
+
+		DVKStagingRegion region;
+		region.size = size;
+
+		// 超大的数据单独创建Staging，随批次一起释放
+		if (size > STAGING_BUFFER_SIZE)
+		{
+			DVKBuffer* dedicated = DVKBuffer::CreateBuffer(
+				vulkanDevice,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				size
+			);
+			dedicated->Map();
+			dedicatedStagings.push_back(dedicated);
+
+			region.buffer = dedicated->buffer;
+			region.mapped = (uint8*)dedicated->mapped;
+			return region;
+		}
+
+		if (stagingBuffer == nullptr)
+		{
+			stagingBuffer = DVKBuffer::CreateBuffer(
+				vulkanDevice,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				STAGING_BUFFER_SIZE
+			);
+			stagingBuffer->Map();
+		}
+
+		uint64 offset = Align<uint64>(stagingOffset, alignment);
+
+		// 空间不足，先提交已经录制的上传并等待完成，然后从头开始使用
+		if (offset + size > STAGING_BUFFER_SIZE)
+		{
+			bool wasBatching = isBatching;
+			FlushBatch(true);
+			if (wasBatching) {
+				BeginBatch();
+			}
+			offset = 0;
+		}
+
+		stagingOffset = offset + size;
+
+		region.buffer = stagingBuffer->buffer;
+		region.offset = offset;
+		region.mapped = (uint8*)stagingBuffer->mapped + offset;
+		return region;
+	}
+
+	void DVKCommandBuffer::ReleaseStaging()
+	{
+		stagingOffset = 0;
+
+		for (int32 i = 0; i < dedicatedStagings.size(); ++i)
+		{
+			dedicatedStagings[i]->UnMap();
+			delete dedicatedStagings[i];
+		}
+		dedicatedStagings.clear();
 	}
 
 	void DVKCommandBuffer::Begin()
@@ -57,6 +203,8 @@ namespace vk_demo
 		if (isBegun) {
 			return;
 		}
+
+		WaitBatch();
 		isBegun = true;
 
 		VkCommandBufferBeginInfo cmdBufBeginInfo;
@@ -68,7 +216,7 @@ namespace vk_demo
 
 	void DVKCommandBuffer::End()
 	{
-		if (!isBegun) {
+		if (!isBegun || isBatching) {
 			return;
 		}
 
@@ -16,6 +16,16 @@ class VulkanDevice;
 
 namespace vk_demo
 {
+	class DVKBuffer;
+
+	// Staging数据在Buffer中的一段区域，mapped指向offset处
+	struct DVKStagingRegion
+	{
+		VkBuffer	buffer = VK_NULL_HANDLE;
+		uint64		offset = 0;
+		uint64		size = 0;
+		uint8*		mapped = nullptr;
+	};
 
     class DVKCommandBuffer
 	{
@@ -32,6 +42,25 @@ namespace vk_demo
 
 		void Submit(VkSemaphore* signalSemaphore = nullptr);
 
+		// 批量模式：期间的End/Submit只继续录制，FlushBatch时一次提交，整个批次只等待一个Fence
+		void BeginBatch();
+
+		// waitForCompletion为false时只提交不等待，之后通过IsBatchComplete轮询或WaitBatch等待
+		void FlushBatch(bool waitForCompletion = true);
+
+		bool IsBatchComplete();
+
+		void WaitBatch();
+
+		// 从持久的Staging Buffer中分配上传用的空间，GPU执行完成之后自动回收。
+		// 空间不足时会先提交并等待当前批次，所以必须在录制该资源的命令之前调用。
+		DVKStagingRegion AcquireStaging(uint64 size, uint64 alignment = 16);
+
+		inline bool IsBatching() const
+		{
+			return isBatching;
+		}
+
 		static DVKCommandBuffer* Create(std::shared_ptr<VulkanDevice> vulkanDevice, VkCommandPool commandPool, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY, std::shared_ptr<VulkanQueue> queue = nullptr);
 
 	public:
@@ -45,6 +74,26 @@ namespace vk_demo
 		std::vector<VkSemaphore>			waitSemaphores;
 
 		bool								isBegun;
+
+	private:
+
+		void SubmitNoWait(VkSemaphore* signalSemaphore);
+
+		void ReleaseStaging();
+
+	private:
+
+		enum
+		{
+			STAGING_BUFFER_SIZE = 16 * 1024 * 1024,
+		};
+
+		DVKBuffer*							stagingBuffer = nullptr;
+		uint64								stagingOffset = 0;
+		std::vector<DVKBuffer*>				dedicatedStagings;
+
+		bool								isBatching = false;
+		bool								isPending = false;
 	};
 
 }
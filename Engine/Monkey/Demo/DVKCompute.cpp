@@ -8,18 +8,8 @@ namespace vk_demo
     
     void DVKCompute::InitRingBuffer(std::shared_ptr<VulkanDevice> vulkanDevice)
     {
-        ringBuffer = new DVKRingBuffer();
-        ringBuffer->device       = vulkanDevice->GetInstanceHandle();
-        ringBuffer->bufferSize   = 8 * 1024 * 1024; // 8MB
-        ringBuffer->bufferOffset = ringBuffer->bufferSize;
-        ringBuffer->minAlignment = vulkanDevice->GetLimits().minUniformBufferOffsetAlignment;
-        ringBuffer->realBuffer   = vk_demo::DVKBuffer::CreateBuffer(
-            vulkanDevice,
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            ringBuffer->bufferSize
-        );
-        ringBuffer->realBuffer->Map();
+        // 初始1MB，按64KB切分给各帧，不够时自动扩容
+        ringBuffer = new DVKRingBuffer(vulkanDevice, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 64 * 1024, 16);
         ringBufferRefCount = 0;
     }
     
@@ -30,11 +20,23 @@ namespace vk_demo
         ringBufferRefCount = 0;
     }
     
+    void DVKCompute::BeginRingBufferFrame(int32 frameIndex, VkFence fence)
+    {
+        if (ringBuffer) {
+            ringBuffer->BeginFrame(frameIndex, fence);
+        }
+    }
+    
     DVKCompute::~DVKCompute()
     {
         delete descriptorSet;
         descriptorSet = nullptr;
         
+        for (int32 i = 0; i < retiredDescriptorSets.size(); ++i) {
+            delete retiredDescriptorSets[i];
+        }
+        retiredDescriptorSets.clear();
+        
         textures.clear();
         uniformBuffers.clear();
         
@@ -84,7 +86,7 @@ namespace vk_demo
             uboBuffer.stageFlags     = it->second.stageFlags;
             uboBuffer.dataSize       = it->second.bufferSize;
             uboBuffer.bufferInfo     = {};
-            uboBuffer.bufferInfo.buffer = ringBuffer->realBuffer->buffer;
+            uboBuffer.bufferInfo.buffer = ringBuffer->GetBuffer();
             uboBuffer.bufferInfo.offset = 0;
             uboBuffer.bufferInfo.range  = uboBuffer.dataSize;
 
@@ -97,6 +99,7 @@ namespace vk_demo
 			else if (it->second.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
 				it->second.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC)
 			{
+				uboBuffer.bufferInfo.buffer = VK_NULL_HANDLE;
 				storageBuffers.insert(std::make_pair(it->first, uboBuffer));
 			}
         }
@@ -125,6 +128,7 @@ namespace vk_demo
             }
         }
         dynamicOffsets.resize(dynamicOffsetCount);
+        ringBufferGeneration = ringBuffer->GetGeneration();
         
         // 从Shader中获取Texture信息，包含attachment信息
         for (auto it = shader->imageParams.begin(); it != shader->imageParams.end(); ++it)
@@ -139,6 +143,39 @@ namespace vk_demo
         }
     }
     
+    void DVKCompute::UpdateRingBufferDescriptors()
+    {
+        if (ringBufferGeneration == ringBuffer->GetGeneration()) {
+            return;
+        }
+        ringBufferGeneration = ringBuffer->GetGeneration();
+        
+        // 旧的DescriptorSet可能已经录制进了当前的CommandBuffer，为新Buffer分配一个新的DescriptorSet
+        retiredDescriptorSets.push_back(descriptorSet);
+        descriptorSet = shader->AllocateDescriptorSet();
+        
+        for (auto it = uniformBuffers.begin(); it != uniformBuffers.end(); ++it)
+        {
+            it->second.bufferInfo.buffer = ringBuffer->GetBuffer();
+            descriptorSet->WriteBuffer(it->first, &(it->second.bufferInfo));
+        }
+        
+        for (auto it = storageBuffers.begin(); it != storageBuffers.end(); ++it)
+        {
+            if (it->second.bufferInfo.buffer != VK_NULL_HANDLE) {
+                descriptorSet->WriteBuffer(it->first, &(it->second.bufferInfo));
+            }
+        }
+        
+        for (auto it = textures.begin(); it != textures.end(); ++it)
+        {
+            if (it->second.texture) {
+                it->second.imageView = it->second.texture->imageView;
+                descriptorSet->WriteImage(it->first, it->second.texture);
+            }
+        }
+    }
+    
     void DVKCompute::PreparePipeline()
     {
         VkDevice device = vulkanDevice->GetInstanceHandle();
@@ -164,6 +201,8 @@ namespace vk_demo
     
     void DVKCompute::BindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint)
     {
+        UpdateRingBufferDescriptors();
+        
         uint32* dynOffsets = dynamicOffsets.data();
         
         vkCmdBindDescriptorSets(
@@ -216,8 +255,8 @@ namespace vk_demo
         }
         
         // 拷贝数据至ringbuffer
-        uint8* ringCPUData = (uint8*)(ringBuffer->GetMappedPointer());
         uint64 ringOffset  = ringBuffer->AllocateMemory(it->second.dataSize);
+        uint8* ringCPUData = (uint8*)(ringBuffer->GetMappedPointer());
         uint64 bufferSize  = it->second.dataSize;
         
         // 拷贝数据
@@ -247,9 +286,10 @@ namespace vk_demo
             return;
         }
         
-        if (it->second.texture != texture) 
+        if (it->second.texture != texture || it->second.imageView != texture->imageView) 
 		{
-            it->second.texture = texture;
+            it->second.texture   = texture;
+            it->second.imageView = texture->imageView;
             descriptorSet->WriteImage(name, texture);
         }
     }
@@ -47,6 +47,8 @@ namespace vk_demo
 
 		void SetStorageBuffer(const std::string& name, DVKBuffer* buffer);
         
+        static void BeginRingBufferFrame(int32 frameIndex, VkFence fence);
+        
         inline VkPipeline GetPipeline() const
         {
             return pipeline;
@@ -70,6 +72,8 @@ namespace vk_demo
         void Prepare();
         
         void PreparePipeline();
+        
+        void UpdateRingBufferDescriptors();
 
     private:
         
@@ -85,8 +89,10 @@ namespace vk_demo
         VkPipeline                  pipeline = VK_NULL_HANDLE;
         
         DVKDescriptorSet*           descriptorSet = nullptr;
+        std::vector<DVKDescriptorSet*>  retiredDescriptorSets;
         
         uint32                      dynamicOffsetCount;
+        uint32                      ringBufferGeneration = 0;
         std::vector<uint32>         dynamicOffsets;
         
 		BuffersMap					uniformBuffers;
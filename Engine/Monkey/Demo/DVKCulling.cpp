@@ -0,0 +1,219 @@
+﻿#include "DVKCulling.h"
+
+#include "Math/VectorRegister.h"
+
+#include <cstring>
+
+namespace vk_demo
+{
+
+	void DVKCullingSet::Reserve(int32 capacity)
+	{
+		capacity = (capacity + BlockSize - 1) / BlockSize * BlockSize;
+		centerX.reserve(capacity);
+		centerY.reserve(capacity);
+		centerZ.reserve(capacity);
+		radius.reserve(capacity);
+	}
+
+	void DVKCullingSet::Clear()
+	{
+		count = 0;
+		centerX.clear();
+		centerY.clear();
+		centerZ.clear();
+		radius.clear();
+		extentX.clear();
+		extentY.clear();
+		extentZ.clear();
+	}
+
+	int32 DVKCullingSet::AddSphere(const Vector3& center, float inRadius)
+	{
+		return Add(center, inRadius, Vector3::ZeroVector);
+	}
+
+	int32 DVKCullingSet::AddBox(const Vector3& boundsMin, const Vector3& boundsMax)
+	{
+		return Add((boundsMin + boundsMax) * 0.5f, 0.0f, (boundsMax - boundsMin) * 0.5f);
+	}
+
+	void DVKCullingSet::SetSphere(int32 index, const Vector3& center, float inRadius)
+	{
+		Set(index, center, inRadius, Vector3::ZeroVector);
+	}
+
+	void DVKCullingSet::SetBox(int32 index, const Vector3& boundsMin, const Vector3& boundsMax)
+	{
+		Set(index, (boundsMin + boundsMax) * 0.5f, 0.0f, (boundsMax - boundsMin) * 0.5f);
+	}
+
+	int32 DVKCullingSet::Add(const Vector3& center, float inRadius, const Vector3& extent)
+	{
+		// 每次补齐一整组
+		if (count % BlockSize == 0)
+		{
+			int32 size = count + BlockSize;
+			centerX.resize(size, 0.0f);
+			centerY.resize(size, 0.0f);
+			centerZ.resize(size, 0.0f);
+			radius.resize(size, -MAX_flt);
+			if (!extentX.empty())
+			{
+				extentX.resize(size, 0.0f);
+				extentY.resize(size, 0.0f);
+				extentZ.resize(size, 0.0f);
+			}
+		}
+
+		int32 index = count;
+		count += 1;
+		Set(index, center, inRadius, extent);
+		return index;
+	}
+
+	void DVKCullingSet::Set(int32 index, const Vector3& center, float inRadius, const Vector3& extent)
+	{
+		if (extentX.empty() && !extent.IsZero())
+		{
+			extentX.resize(centerX.size(), 0.0f);
+			extentY.resize(centerX.size(), 0.0f);
+			extentZ.resize(centerX.size(), 0.0f);
+		}
+
+		centerX[index] = center.x;
+		centerY[index] = center.y;
+		centerZ[index] = center.z;
+		radius[index]  = inRadius;
+		if (!extentX.empty())
+		{
+			extentX[index] = extent.x;
+			extentY[index] = extent.y;
+			extentZ[index] = extent.z;
+		}
+	}
+
+	// 只有包围球时没有半长，单独展开一份减少寄存器占用
+	template<bool HasExtents>
+	static int32 CullBlocks(const DVKFrustum& frustum, const float* const* data, int32 begin, int32 end, uint32* output)
+	{
+		VectorRegister planeX[6];
+		VectorRegister planeY[6];
+		VectorRegister planeZ[6];
+		VectorRegister planeW[6];
+		VectorRegister absPlaneX[6];
+		VectorRegister absPlaneY[6];
+		VectorRegister absPlaneZ[6];
+		for (int32 i = 0; i < 6; ++i)
+		{
+			planeX[i] = VectorSetFloat1(frustum.planes[i].x);
+			planeY[i] = VectorSetFloat1(frustum.planes[i].y);
+			planeZ[i] = VectorSetFloat1(frustum.planes[i].z);
+			planeW[i] = VectorSetFloat1(frustum.planes[i].w);
+			absPlaneX[i] = VectorSetFloat1(MMath::Abs(frustum.planes[i].x));
+			absPlaneY[i] = VectorSetFloat1(MMath::Abs(frustum.planes[i].y));
+			absPlaneZ[i] = VectorSetFloat1(MMath::Abs(frustum.planes[i].z));
+		}
+
+		const VectorRegister zero = VectorZero();
+		int32 visibleCount = 0;
+
+		for (int32 i = begin; i < end; i += DVKCullingSet::BlockSize)
+		{
+			VectorRegister x = VectorLoad(data[0] + i);
+			VectorRegister y = VectorLoad(data[1] + i);
+			VectorRegister z = VectorLoad(data[2] + i);
+			VectorRegister r = VectorLoad(data[3] + i);
+
+			VectorRegister ex = zero;
+			VectorRegister ey = zero;
+			VectorRegister ez = zero;
+			if (HasExtents)
+			{
+				ex = VectorLoad(data[4] + i);
+				ey = VectorLoad(data[5] + i);
+				ez = VectorLoad(data[6] + i);
+			}
+
+			// 中心到平面的距离加上半径，包围盒再加上半长在法线上的投影，任意一个平面上不大于0即不可见
+			VectorRegister visible = VectorCompareGE(zero, zero);
+			for (int32 p = 0; p < 6; ++p)
+			{
+				VectorRegister distance = VectorMultiplyAdd(x, planeX[p], VectorMultiplyAdd(y, planeY[p], VectorMultiplyAdd(z, planeZ[p], VectorAdd(planeW[p], r))));
+				if (HasExtents) {
+					distance = VectorMultiplyAdd(ex, absPlaneX[p], VectorMultiplyAdd(ey, absPlaneY[p], VectorMultiplyAdd(ez, absPlaneZ[p], distance)));
+				}
+				visible = VectorBitwiseAnd(visible, VectorCompareGT(distance, zero));
+			}
+
+			uint32 bits = VectorMaskBits(visible);
+			if (i + DVKCullingSet::BlockSize > end) {
+				bits &= (1 << (end - i)) - 1;
+			}
+
+			while (bits)
+			{
+				output[visibleCount++] = i + MMath::CountTrailingZeros(bits);
+				bits &= bits - 1;
+			}
+		}
+
+		return visibleCount;
+	}
+
+	int32 DVKCullingSet::CullRange(const DVKFrustum& frustum, int32 begin, int32 end, uint32* output) const
+	{
+		if (extentX.empty())
+		{
+			const float* data[4] = { centerX.data(), centerY.data(), centerZ.data(), radius.data() };
+			return CullBlocks<false>(frustum, data, begin, end, output);
+		}
+
+		const float* data[7] = { centerX.data(), centerY.data(), centerZ.data(), radius.data(), extentX.data(), extentY.data(), extentZ.data() };
+		return CullBlocks<true>(frustum, data, begin, end, output);
+	}
+
+	int32 DVKCullingSet::Cull(const DVKFrustum& frustum, std::vector<uint32>& outVisible, DVKJobPool* pool, int32 batchSize) const
+	{
+		outVisible.resize(count);
+		if (count == 0) {
+			return 0;
+		}
+
+		batchSize = MMath::Max((batchSize + BlockSize - 1) / BlockSize * BlockSize, (int32)BlockSize);
+		if (pool == nullptr || count <= batchSize)
+		{
+			int32 visibleCount = CullRange(frustum, 0, count, outVisible.data());
+			outVisible.resize(visibleCount);
+			return visibleCount;
+		}
+
+		// 每个批次先写到自己的区间内，最后按顺序压紧
+		int32 numBatches = (count + batchSize - 1) / batchSize;
+		std::vector<int32> batchCounts(numBatches, 0);
+		uint32* output = outVisible.data();
+
+		pool->ParallelFor(numBatches, 1, [&](int32 beginBatch, int32 endBatch) {
+			for (int32 batch = beginBatch; batch < endBatch; ++batch)
+			{
+				int32 begin = batch * batchSize;
+				int32 end   = MMath::Min(begin + batchSize, count);
+				batchCounts[batch] = CullRange(frustum, begin, end, output + begin);
+			}
+		});
+
+		int32 visibleCount = 0;
+		for (int32 batch = 0; batch < numBatches; ++batch)
+		{
+			int32 begin = batch * batchSize;
+			if (visibleCount != begin) {
+				memmove(output + visibleCount, output + begin, batchCounts[batch] * sizeof(uint32));
+			}
+			visibleCount += batchCounts[batch];
+		}
+
+		outVisible.resize(visibleCount);
+		return visibleCount;
+	}
+
+}
@@ -0,0 +1,68 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Vector3.h"
+
+#include "DVKFrustum.h"
+#include "DVKJobPool.h"
+
+#include <vector>
+
+namespace vk_demo
+{
+
+	// 按SoA保存的包围球/包围盒，一次测试4个物体的6个平面。
+	// 包围盒保存为中心和半长，与包围球共用中心，平面距离加上半径以及半长在法线上的投影。
+	// 数组长度补齐到4的整数倍，补齐的物体半径为负无穷，永远不可见。
+	class DVKCullingSet
+	{
+	public:
+		enum
+		{
+			BlockSize = 4,
+		};
+
+		void Reserve(int32 capacity);
+
+		void Clear();
+
+		// 返回物体序号
+		int32 AddSphere(const Vector3& center, float radius);
+
+		int32 AddBox(const Vector3& boundsMin, const Vector3& boundsMax);
+
+		void SetSphere(int32 index, const Vector3& center, float radius);
+
+		void SetBox(int32 index, const Vector3& boundsMin, const Vector3& boundsMax);
+
+		FORCEINLINE int32 Size() const
+		{
+			return count;
+		}
+
+		// 可见物体的序号按从小到大写入outVisible，返回可见数量。pool不为空时按batchSize个物体为一个批次并行。
+		int32 Cull(const DVKFrustum& frustum, std::vector<uint32>& outVisible, DVKJobPool* pool = nullptr, int32 batchSize = 16 * 1024) const;
+
+	private:
+
+		int32 Add(const Vector3& center, float radius, const Vector3& extent);
+
+		void Set(int32 index, const Vector3& center, float radius, const Vector3& extent);
+
+		// 测试[begin, end)，可见的序号从output开始写入，返回数量。begin必须是4的整数倍。
+		int32 CullRange(const DVKFrustum& frustum, int32 begin, int32 end, uint32* output) const;
+
+	private:
+		int32				count = 0;
+		std::vector<float>	centerX;
+		std::vector<float>	centerY;
+		std::vector<float>	centerZ;
+		std::vector<float>	radius;
+		// 只有包围球时为空，跳过半长的计算
+		std::vector<float>	extentX;
+		std::vector<float>	extentY;
+		std::vector<float>	extentZ;
+	};
+
+}
@@ -0,0 +1,62 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Vector3.h"
+#include "Math/Vector4.h"
+#include "Math/Matrix4x4.h"
+
+namespace vk_demo
+{
+
+	// 视锥体的六个平面，法线朝内并且已经归一化。
+	// 传入ViewProjection得到世界空间的平面，传入Model * ViewProjection得到模型空间的平面。
+	struct DVKFrustum
+	{
+		Vector4 planes[6];
+
+		DVKFrustum()
+		{
+
+		}
+
+		DVKFrustum(const Matrix4x4& matrix)
+		{
+			FromMatrix(matrix);
+		}
+
+		void FromMatrix(const Matrix4x4& matrix)
+		{
+			// left right
+			planes[0].Set(matrix.m[0][3] + matrix.m[0][0], matrix.m[1][3] + matrix.m[1][0], matrix.m[2][3] + matrix.m[2][0], matrix.m[3][3] + matrix.m[3][0]);
+			planes[1].Set(matrix.m[0][3] - matrix.m[0][0], matrix.m[1][3] - matrix.m[1][0], matrix.m[2][3] - matrix.m[2][0], matrix.m[3][3] - matrix.m[3][0]);
+
+			// top bottom
+			planes[2].Set(matrix.m[0][3] + matrix.m[0][1], matrix.m[1][3] + matrix.m[1][1], matrix.m[2][3] + matrix.m[2][1], matrix.m[3][3] + matrix.m[3][1]);
+			planes[3].Set(matrix.m[0][3] - matrix.m[0][1], matrix.m[1][3] - matrix.m[1][1], matrix.m[2][3] - matrix.m[2][1], matrix.m[3][3] - matrix.m[3][1]);
+
+			// near far，Vulkan的深度范围为[0, 1]
+			planes[4].Set(matrix.m[0][2], matrix.m[1][2], matrix.m[2][2], matrix.m[3][2]);
+			planes[5].Set(matrix.m[0][3] - matrix.m[0][2], matrix.m[1][3] - matrix.m[1][2], matrix.m[2][3] - matrix.m[2][2], matrix.m[3][3] - matrix.m[3][2]);
+
+			for (int32 i = 0; i < 6; ++i)
+			{
+				float length = MMath::Sqrt(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
+				planes[i] = planes[i] * (1.0f / length);
+			}
+		}
+
+		FORCEINLINE bool IntersectSphere(const Vector3& center, float radius) const
+		{
+			for (int32 i = 0; i < 6; ++i)
+			{
+				float distance = planes[i].x * center.x + planes[i].y * center.y + planes[i].z * center.z + planes[i].w;
+				if (distance + radius <= 0.0f) {
+					return false;
+				}
+			}
+			return true;
+		}
+	};
+
+}
@@ -4,80 +4,56 @@
 
 namespace vk_demo
 {
-	DVKIndexBuffer* DVKIndexBuffer::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, std::vector<uint32> indices)
+	DVKIndexBuffer* DVKIndexBuffer::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<uint32>& indices)
 	{
-		VkDevice device = vulkanDevice->GetInstanceHandle();
-
-		DVKIndexBuffer* indexBuffer = new DVKIndexBuffer();
-		indexBuffer->device = device;
-		indexBuffer->indexCount = indices.size();
-		indexBuffer->indexType = VK_INDEX_TYPE_UINT32;
-
-		vk_demo::DVKBuffer* indexStaging = vk_demo::DVKBuffer::CreateBuffer(
-			vulkanDevice, 
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-			indices.size() * sizeof(uint32), 
-			indices.data()
-		);
-
-		indexBuffer->dvkBuffer = vk_demo::DVKBuffer::CreateBuffer(
-			vulkanDevice, 
-			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
-			indices.size() * sizeof(uint32)
-		);
-
-		cmdBuffer->Begin();
-
-		VkBufferCopy copyRegion = {};
-		copyRegion.size = indices.size() * sizeof(uint32);
-
-		vkCmdCopyBuffer(cmdBuffer->cmdBuffer, indexStaging->buffer, indexBuffer->dvkBuffer->buffer, 1, &copyRegion);
+		return Create(vulkanDevice, cmdBuffer, indices.data(), indices.size(), VK_INDEX_TYPE_UINT32);
+	}
 
-		cmdBuffer->End();
-		cmdBuffer->Submit();
+	DVKIndexBuffer* DVKIndexBuffer::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<uint32>& indices, uint32 vertexCount)
+	{
+		if (vertexCount > 65536) {
+			return Create(vulkanDevice, cmdBuffer, indices);
+		}
 
-		delete indexStaging;
+		std::vector<uint16> shortIndices(indices.begin(), indices.end());
+		return Create(vulkanDevice, cmdBuffer, shortIndices);
+	}
 
-		return indexBuffer;
+	DVKIndexBuffer* DVKIndexBuffer::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<uint16>& indices)
+	{
+		return Create(vulkanDevice, cmdBuffer, indices.data(), indices.size(), VK_INDEX_TYPE_UINT16);
 	}
 
-	DVKIndexBuffer* DVKIndexBuffer::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, std::vector<uint16> indices)
+	DVKIndexBuffer* DVKIndexBuffer::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const void* indices, uint32 indexCount, VkIndexType indexType)
 	{
 		VkDevice device = vulkanDevice->GetInstanceHandle();
+		uint64 dataSize = indexCount * (indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16) : sizeof(uint32));
 
 		DVKIndexBuffer* indexBuffer = new DVKIndexBuffer();
 		indexBuffer->device = device;
-		indexBuffer->indexCount = indices.size();
-		indexBuffer->indexType = VK_INDEX_TYPE_UINT16;
-		
-		vk_demo::DVKBuffer* indexStaging = vk_demo::DVKBuffer::CreateBuffer(
-			vulkanDevice, 
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-			indices.size() * sizeof(uint16), 
-			indices.data()
-		);
+		indexBuffer->indexCount = indexCount;
+		indexBuffer->indexType = indexType;
+
+		DVKStagingRegion indexStaging = cmdBuffer->AcquireStaging(dataSize);
+		memcpy(indexStaging.mapped, indices, dataSize);
 
 		indexBuffer->dvkBuffer = vk_demo::DVKBuffer::CreateBuffer(
 			vulkanDevice, 
 			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
-			indices.size() * sizeof(uint16)
+			dataSize
 		);
 
 		cmdBuffer->Begin();
 
 		VkBufferCopy copyRegion = {};
-		copyRegion.size = indices.size() * sizeof(uint16);
+		copyRegion.srcOffset = indexStaging.offset;
+		copyRegion.size = dataSize;
+
+		vkCmdCopyBuffer(cmdBuffer->cmdBuffer, indexStaging.buffer, indexBuffer->dvkBuffer->buffer, 1, &copyRegion);
 
-		vkCmdCopyBuffer(cmdBuffer->cmdBuffer, indexStaging->buffer, indexBuffer->dvkBuffer->buffer, 1, &copyRegion);
-        
 		cmdBuffer->End();
 		cmdBuffer->Submit();
-        
-		delete indexStaging;
 
 		return indexBuffer;
 	}
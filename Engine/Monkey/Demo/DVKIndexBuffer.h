@@ -39,9 +39,15 @@ namespace vk_demo
 			vkCmdBindIndexBuffer(cmdBuffer, dvkBuffer->buffer, 0, indexType);
 		}
 
-		static DVKIndexBuffer* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, std::vector<uint16> indices);
+		static DVKIndexBuffer* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<uint16>& indices);
 
-		static DVKIndexBuffer* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, std::vector<uint32> indices);
+		static DVKIndexBuffer* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<uint32>& indices);
+
+		// 顶点数不超过65536时自动使用16位索引
+		static DVKIndexBuffer* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<uint32>& indices, uint32 vertexCount);
+
+		// 数据直接拷贝进Staging，例如来自映射的文件
+		static DVKIndexBuffer* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const void* indices, uint32 indexCount, VkIndexType indexType);
 
 	public:
 		VkDevice		device = VK_NULL_HANDLE;
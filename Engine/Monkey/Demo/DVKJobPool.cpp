@@ -0,0 +1,139 @@
+﻿#include "DVKJobPool.h"
+
+#include "Math/Math.h"
+
+namespace vk_demo
+{
+
+	DVKJobPool::DVKJobPool()
+		: nextIndex(0)
+		, pendingBatches(0)
+	{
+
+	}
+
+	DVKJobPool::~DVKJobPool()
+	{
+		{
+			std::lock_guard<std::mutex> lockGuard(mutex);
+			timeToDie = true;
+		}
+		startCondition.notify_all();
+
+		for (int32 i = 0; i < threads.size(); ++i)
+		{
+			threads[i]->join();
+			delete threads[i];
+		}
+		threads.clear();
+	}
+
+	DVKJobPool* DVKJobPool::Create(int32 numThreads)
+	{
+		if (numThreads < 0) {
+			numThreads = MMath::Max((int32)std::thread::hardware_concurrency() - 1, 0);
+		}
+
+		DVKJobPool* pool = new DVKJobPool();
+		for (int32 i = 0; i < numThreads; ++i) {
+			pool->threads.push_back(new std::thread(&DVKJobPool::WorkerThread, pool));
+		}
+
+		return pool;
+	}
+
+	void DVKJobPool::RunBatches()
+	{
+		while (true)
+		{
+			int32 begin = nextIndex.fetch_add(batchSize, std::memory_order_relaxed);
+			if (begin >= count) {
+				break;
+			}
+
+			(*func)(begin, MMath::Min(begin + batchSize, count));
+
+			if (pendingBatches.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				std::lock_guard<std::mutex> lockGuard(mutex);
+				finishCondition.notify_all();
+			}
+		}
+	}
+
+	void DVKJobPool::WorkerThread()
+	{
+		uint32 lastGeneration = 0;
+
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				startCondition.wait(lock, [&] {
+					return timeToDie || generation != lastGeneration;
+				});
+
+				if (timeToDie) {
+					return;
+				}
+
+				lastGeneration = generation;
+				activeWorkers += 1;
+			}
+
+			RunBatches();
+
+			{
+				std::lock_guard<std::mutex> lockGuard(mutex);
+				activeWorkers -= 1;
+			}
+			finishCondition.notify_all();
+		}
+	}
+
+	void DVKJobPool::ParallelFor(int32 inCount, int32 inBatchSize, const BatchFunc& inFunc)
+	{
+		if (inCount <= 0) {
+			return;
+		}
+
+		inBatchSize = MMath::Max(inBatchSize, 1);
+
+		// 只有一个批次或者没有工作线程时直接在调用线程执行
+		if (threads.size() == 0 || inCount <= inBatchSize)
+		{
+			for (int32 begin = 0; begin < inCount; begin += inBatchSize) {
+				inFunc(begin, MMath::Min(begin + inBatchSize, inCount));
+			}
+			return;
+		}
+
+		std::lock_guard<std::mutex> submitGuard(submitMutex);
+
+		{
+			// 醒得晚的工作线程可能还在上一个任务的RunBatches中，等它们退出之后再修改任务
+			std::unique_lock<std::mutex> lock(mutex);
+			finishCondition.wait(lock, [&] {
+				return activeWorkers == 0;
+			});
+
+			func      = &inFunc;
+			count     = inCount;
+			batchSize = inBatchSize;
+			nextIndex.store(0, std::memory_order_relaxed);
+			pendingBatches.store((inCount + inBatchSize - 1) / inBatchSize, std::memory_order_relaxed);
+			generation += 1;
+		}
+		startCondition.notify_all();
+
+		RunBatches();
+
+		// 等所有批次完成，并且工作线程都离开了RunBatches，才能安全地修改下一个任务
+		std::unique_lock<std::mutex> lock(mutex);
+		finishCondition.wait(lock, [&] {
+			return pendingBatches.load(std::memory_order_acquire) == 0 && activeWorkers == 0;
+		});
+		func = nullptr;
+	}
+
+}
@@ -0,0 +1,65 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+namespace vk_demo
+{
+
+	// 简单的并行循环：把[0, count)切成batchSize大小的批次，工作线程和调用线程一起领取批次执行，
+	// 所有批次完成之后ParallelFor才返回。同一时刻只执行一个任务，多个线程同时提交时会依次排队。
+	class DVKJobPool
+	{
+	public:
+		typedef std::function<void(int32 begin, int32 end)> BatchFunc;
+
+	private:
+		DVKJobPool();
+
+	public:
+		~DVKJobPool();
+
+		// numThreads为工作线程数(不包括调用线程)，小于0时使用硬件线程数减一
+		static DVKJobPool* Create(int32 numThreads = -1);
+
+		void ParallelFor(int32 count, int32 batchSize, const BatchFunc& func);
+
+		// 包括调用线程
+		inline int32 GetNumWorkers() const
+		{
+			return threads.size() + 1;
+		}
+
+	private:
+
+		void WorkerThread();
+
+		void RunBatches();
+
+	private:
+
+		std::vector<std::thread*>	threads;
+
+		// 当前任务，只在提交时修改
+		const BatchFunc*			func = nullptr;
+		int32						count = 0;
+		int32						batchSize = 1;
+		std::atomic<int32>			nextIndex;
+		std::atomic<int32>			pendingBatches;
+
+		std::mutex					submitMutex;
+		std::mutex					mutex;
+		std::condition_variable		startCondition;
+		std::condition_variable		finishCondition;
+		uint32						generation = 0;
+		int32						activeWorkers = 0;
+		bool						timeToDie = false;
+	};
+
+}
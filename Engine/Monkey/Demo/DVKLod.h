@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+
+#include <vector>
+
+namespace vk_demo
+{
+
+	// 一级LOD在IndexBuffer中的范围。error为简化带来的最大几何误差，单位与模型空间一致。
+	struct DVKLod
+	{
+		uint32	firstIndex = 0;
+		uint32	indexCount = 0;
+		float	error = 0.0f;
+	};
+
+	// 屏幕空间误差选择LOD：误差投影到屏幕上不超过threshold个像素时使用更粗糙的一级。
+	// Instance绘制和Indirect绘制都用它选择，保证两条路径的切换距离一致。
+	struct DVKLodSelector
+	{
+		// 距离为1时模型空间单位长度对应的像素数
+		float	projectionScale = 1.0f;
+		float	threshold = 1.0f;
+
+		DVKLodSelector()
+		{
+
+		}
+
+		DVKLodSelector(float fovy, float viewportHeight, float pixelThreshold)
+		{
+			Setup(fovy, viewportHeight, pixelThreshold);
+		}
+
+		void Setup(float fovy, float viewportHeight, float pixelThreshold)
+		{
+			projectionScale = viewportHeight * 0.5f / MMath::Tan(fovy * 0.5f);
+			threshold       = pixelThreshold;
+		}
+
+		FORCEINLINE float GetScreenError(float error, float distance) const
+		{
+			return error * projectionScale / MMath::Max(distance, 1e-6f);
+		}
+
+		// distance为相机到包围球表面的距离，scale为实例的缩放，返回LOD序号
+		FORCEINLINE int32 Select(const std::vector<DVKLod>& lods, float distance, float scale = 1.0f) const
+		{
+			for (int32 i = (int32)lods.size() - 1; i > 0; --i)
+			{
+				if (GetScreenError(lods[i].error * scale, distance) <= threshold) {
+					return i;
+				}
+			}
+			return 0;
+		}
+	};
+
+}
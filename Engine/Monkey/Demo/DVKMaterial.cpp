@@ -9,29 +9,26 @@ namespace vk_demo
     
 	void DVKMaterial::InitRingBuffer(std::shared_ptr<VulkanDevice> vulkanDevice)
 	{
-		ringBuffer = new DVKRingBuffer();
-		ringBuffer->device		 = vulkanDevice->GetInstanceHandle();
-		ringBuffer->bufferSize   = 32 * 1024 * 1024; // 32MB
-		ringBuffer->bufferOffset = ringBuffer->bufferSize;
-		ringBuffer->minAlignment = vulkanDevice->GetLimits().minUniformBufferOffsetAlignment;
-		ringBuffer->realBuffer   = vk_demo::DVKBuffer::CreateBuffer(
-			vulkanDevice,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			ringBuffer->bufferSize
-		);
-		ringBuffer->realBuffer->Map();
-
+		// 初始4MB，按256KB切分给各帧，不够时自动扩容
+		ringBuffer = new DVKRingBuffer(vulkanDevice, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 256 * 1024, 16);
 		ringBufferRefCount = 0;
 	}
 
 	void DVKMaterial::DestroyRingBuffer()
 	{
+		MLOG("Material RingBuffer: size=%llu, frame peak=%llu", ringBuffer->GetBufferSize(), ringBuffer->GetPeakSize());
 		delete ringBuffer;
 		ringBuffer = nullptr;
 		ringBufferRefCount = 0;
 	}
 
+	void DVKMaterial::BeginRingBufferFrame(int32 frameIndex, VkFence fence)
+	{
+		if (ringBuffer) {
+			ringBuffer->BeginFrame(frameIndex, fence);
+		}
+	}
+
 	DVKMaterial::~DVKMaterial()
 	{
 		shader = nullptr;
@@ -39,6 +36,11 @@ namespace vk_demo
 		delete descriptorSet;
 		descriptorSet = nullptr;
 
+		for (int32 i = 0; i < retiredDescriptorSets.size(); ++i) {
+			delete retiredDescriptorSets[i];
+		}
+		retiredDescriptorSets.clear();
+
 		textures.clear();
 		uniformBuffers.clear();
 
@@ -111,7 +113,7 @@ namespace vk_demo
 			uboBuffer.stageFlags     = it->second.stageFlags;
 			uboBuffer.dataSize       = it->second.bufferSize;
 			uboBuffer.bufferInfo     = {};
-			uboBuffer.bufferInfo.buffer = ringBuffer->realBuffer->buffer;
+			uboBuffer.bufferInfo.buffer = ringBuffer->GetBuffer();
 			uboBuffer.bufferInfo.offset = 0;
 			uboBuffer.bufferInfo.range  = uboBuffer.dataSize;
 
@@ -125,6 +127,7 @@ namespace vk_demo
 			else if (it->second.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
 					 it->second.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC)
 			{
+				uboBuffer.bufferInfo.buffer = VK_NULL_HANDLE;
 				storageBuffers.insert(std::make_pair(it->first, uboBuffer));
 			}
         }
@@ -153,6 +156,7 @@ namespace vk_demo
             }
         }
 		globalOffsets.resize(dynamicOffsetCount);
+		ringBufferGeneration = ringBuffer->GetGeneration();
         
 		// 从Shader中获取Texture信息，包含attachment信息
         for (auto it = shader->imageParams.begin(); it != shader->imageParams.end(); ++it)
@@ -167,6 +171,41 @@ namespace vk_demo
         }
 	}
     
+	void DVKMaterial::UpdateRingBufferDescriptors()
+	{
+		if (ringBufferGeneration == ringBuffer->GetGeneration()) {
+			return;
+		}
+		ringBufferGeneration = ringBuffer->GetGeneration();
+
+		// RingBuffer扩容换了新的VkBuffer，Offset不变。
+		// 旧的DescriptorSet可能已经录制进了当前的CommandBuffer，不能改写，为新Buffer分配一个新的DescriptorSet。
+		// 扩容次数很少，旧的DescriptorSet保留到材质销毁。
+		retiredDescriptorSets.push_back(descriptorSet);
+		descriptorSet = shader->AllocateDescriptorSet();
+
+		for (auto it = uniformBuffers.begin(); it != uniformBuffers.end(); ++it)
+		{
+			it->second.bufferInfo.buffer = ringBuffer->GetBuffer();
+			descriptorSet->WriteBuffer(it->first, &(it->second.bufferInfo));
+		}
+
+		for (auto it = storageBuffers.begin(); it != storageBuffers.end(); ++it)
+		{
+			if (it->second.bufferInfo.buffer != VK_NULL_HANDLE) {
+				descriptorSet->WriteBuffer(it->first, &(it->second.bufferInfo));
+			}
+		}
+
+		for (auto it = textures.begin(); it != textures.end(); ++it)
+		{
+			if (it->second.texture) {
+				it->second.imageView = it->second.texture->imageView;
+				descriptorSet->WriteImage(it->first, it->second.texture);
+			}
+		}
+	}
+    
     void DVKMaterial::PreparePipeline()
     {
         if (pipeline) 
@@ -196,6 +235,8 @@ namespace vk_demo
 		actived = true;
 		perObjectIndexes.clear();
 
+		UpdateRingBufferDescriptors();
+
 		// 重置GlobalOffsets数据
 		memset(globalOffsets.data(), MAX_uint32, sizeof(uint32) * globalOffsets.size());
 
@@ -206,8 +247,8 @@ namespace vk_demo
 				continue;
 			}
 			// 拷贝数据至ringbuffer
-			uint8* ringCPUData = (uint8*)(ringBuffer->GetMappedPointer());
 			uint64 ringOffset  = ringBuffer->AllocateMemory(it->second.dataSize);
+			uint8* ringCPUData = (uint8*)(ringBuffer->GetMappedPointer());
 			uint64 bufferSize  = it->second.dataSize;
 			// 拷贝数据
 			memcpy(ringCPUData + ringOffset, it->second.dataContent.data(), bufferSize);
@@ -219,6 +260,7 @@ namespace vk_demo
 	void DVKMaterial::EndFrame()
 	{
 		actived = false;
+		UpdateRingBufferDescriptors();
 	}
     
 	void DVKMaterial::BeginObject()
@@ -236,19 +278,19 @@ namespace vk_demo
 		}
 		
 		// 拷贝GlobalOffsets
-		for (int32 offsetIndex = offsetStart; offsetIndex < dynamicOffsetCount; ++offsetIndex) {
-			dynamicOffsets[offsetIndex] = globalOffsets[offsetIndex - offsetStart];
+		for (int32 i = 0; i < dynamicOffsetCount; ++i) {
+			dynamicOffsets[offsetStart + i] = globalOffsets[i];
 		}
 	}
 
 	void DVKMaterial::EndObject()
 	{
-		// 检查是否所有的Uniform数据都设置完成
-		for (int32 i = 0; i < perObjectIndexes.size(); ++i) 
+		// 检查当前Object的Uniform数据是否都设置完成
+		if (perObjectIndexes.size() > 0)
 		{
-			int32 offsetStart = i * dynamicOffsetCount;
-			for (int32 offsetIndex = offsetStart; offsetIndex < dynamicOffsetCount; ++offsetIndex) {
-				if (dynamicOffsets[offsetIndex] == MAX_uint32) {
+			int32 offsetStart = perObjectIndexes.back() * dynamicOffsetCount;
+			for (int32 i = 0; i < dynamicOffsetCount; ++i) {
+				if (dynamicOffsets[offsetStart + i] == MAX_uint32) {
 					MLOGE("Uniform not set\n");
 				}
 			}
@@ -266,6 +308,8 @@ namespace vk_demo
 
 	void DVKMaterial::BindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, int32 objIndex)
 	{
+		UpdateRingBufferDescriptors();
+
 		uint32* dynOffsets = nullptr;
 		if (objIndex < perObjectIndexes.size())
 		{
@@ -306,8 +350,8 @@ namespace vk_demo
 		uint32* dynOffsets = dynamicOffsets.data() + offsetStart;
 
 		// 拷贝数据至ringbuffer
-		uint8* ringCPUData = (uint8*)(ringBuffer->GetMappedPointer());
 		uint64 ringOffset  = ringBuffer->AllocateMemory(it->second.dataSize);
+		uint8* ringCPUData = (uint8*)(ringBuffer->GetMappedPointer());
 		uint64 bufferSize  = it->second.dataSize;
 		
 		// 拷贝数据
@@ -317,6 +361,55 @@ namespace vk_demo
 		dynOffsets[it->second.dynamicIndex] = ringOffset;
     }
 
+	void DVKMaterial::BeginObject(DVKMaterialContext& context)
+	{
+		context.dynamicOffsets.resize(dynamicOffsetCount);
+		for (int32 i = 0; i < dynamicOffsetCount; ++i) {
+			context.dynamicOffsets[i] = globalOffsets[i];
+		}
+	}
+
+	void DVKMaterial::SetLocalUniform(DVKMaterialContext& context, const std::string& name, void* dataPtr, uint32 size)
+	{
+		auto it = uniformBuffers.find(name);
+		if (it == uniformBuffers.end()) 
+		{
+			MLOGE("Uniform %s not found.", name.c_str());
+			return;
+		}
+
+		if (it->second.dataSize != size) 
+		{
+			MLOGE("Uniform %s size not match, dst=%ud src=%ud", name.c_str(), it->second.dataSize, size);
+			return;
+		}
+
+		// 从线程独占的Chunk中分配，不需要加锁
+		uint64 ringOffset  = context.ringContext.AllocateMemory(ringBuffer, it->second.dataSize);
+		uint8* ringCPUData = (uint8*)(ringBuffer->GetMappedPointer());
+
+		memcpy(ringCPUData + ringOffset, dataPtr, it->second.dataSize);
+
+		context.dynamicOffsets[it->second.dynamicIndex] = ringOffset;
+	}
+
+	void DVKMaterial::BindDescriptorSets(DVKMaterialContext& context, VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint)
+	{
+		// 多个线程共用同一个DescriptorSet，这里不能更新。Reserve之后RingBuffer不会再扩容，
+		// 只要主线程在Reserve之后调用BeginFrame，DescriptorSet就已经指向最新的Buffer。
+		if (ringBufferGeneration != ringBuffer->GetGeneration()) {
+			MLOGE("RingBuffer grew after BeginFrame, call Reserve before BeginFrame.");
+		}
+
+		vkCmdBindDescriptorSets(
+			commandBuffer, 
+			bindPoint, 
+			GetPipelineLayout(), 
+			0, GetDescriptorSets().size(), GetDescriptorSets().data(), 
+			dynamicOffsetCount, context.dynamicOffsets.data()
+		);
+	}
+
 	void DVKMaterial::SetGlobalUniform(const std::string& name, void* dataPtr, uint32 size)
 	{
 		auto it = uniformBuffers.find(name);
@@ -355,9 +448,10 @@ namespace vk_demo
 			return;
 		}
 
-        if (it->second.texture != texture) 
+        if (it->second.texture != texture || it->second.imageView != texture->imageView) 
 		{
-            it->second.texture = texture;
+            it->second.texture   = texture;
+            it->second.imageView = texture->imageView;
             descriptorSet->WriteImage(name, texture);
         }
     }
@@ -7,6 +7,7 @@
 
 #include "DVKUtils.h"
 #include "DVKBuffer.h"
+#include "DVKRingBuffer.h"
 #include "DVKTexture.h"
 #include "DVKShader.h"
 #include "DVKPipeline.h"
@@ -40,50 +41,18 @@ namespace vk_demo
         VkDescriptorType    descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
         VkShaderStageFlags  stageFlags = 0;
         DVKTexture*         texture = nullptr;
+        // 写入描述符时的View，Texture被碎片整理移动之后会变
+        VkImageView         imageView = VK_NULL_HANDLE;
     };
     
-	class DVKRingBuffer
+	// 多线程录制时每个线程持有一个，保存线程独占的RingBuffer Chunk以及当前Object的DynamicOffsets，
+	// 这样不同线程可以同时使用同一个Material而不需要加锁。
+	struct DVKMaterialContext
 	{
-	public:
-		DVKRingBuffer()
-		{
-
-		}
-
-		virtual ~DVKRingBuffer()
-		{
-			realBuffer->UnMap();
-			delete realBuffer;
-			realBuffer = nullptr;
-		}
-
-		void* GetMappedPointer()
-		{
-			return realBuffer->mapped;
-		}
-
-		uint64 AllocateMemory(uint64 size)
-		{
-			uint64 allocationOffset = Align<uint64>(bufferOffset, minAlignment);
-            
-			if (allocationOffset + size <= bufferSize) 
-			{
-				bufferOffset = allocationOffset + size;
-				return allocationOffset;
-			}
-
-			bufferOffset = 0;
-			return bufferOffset;
-		}
-        
-	public:
-		VkDevice		device = VK_NULL_HANDLE;
-		uint64			bufferSize = 0;
-		uint64			bufferOffset = 0;
-		uint32			minAlignment = 0;
-		DVKBuffer*		realBuffer = nullptr;
+		DVKRingBufferContext	ringContext;
+		std::vector<uint32>		dynamicOffsets;
 	};
-    
+
 	class DVKMaterial
 	{
 	private:
@@ -117,6 +86,14 @@ namespace vk_demo
 		void BindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, int32 objIndex);
 
         void SetLocalUniform(const std::string& name, void* dataPtr, uint32 size);
+
+		// 线程安全的版本，Object的数据保存在context中，设置完毕后立即Bind。
+		// 录制之前主线程需要先调用RingBuffer的Reserve，再调用BeginFrame准备Global数据。
+		void BeginObject(DVKMaterialContext& context);
+
+		void SetLocalUniform(DVKMaterialContext& context, const std::string& name, void* dataPtr, uint32 size);
+
+		void BindDescriptorSets(DVKMaterialContext& context, VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint);
         
         void SetTexture(const std::string& name, DVKTexture* texture);
 
@@ -126,6 +103,13 @@ namespace vk_demo
 
 		void SetInputAttachment(const std::string& name, DVKTexture* texture);
 
+		static void BeginRingBufferFrame(int32 frameIndex, VkFence fence);
+
+		static DVKRingBuffer* GetRingBuffer()
+		{
+			return ringBuffer;
+		}
+
 		inline VkPipeline GetPipeline() const
 		{
 			return pipeline->pipeline;
@@ -148,6 +132,8 @@ namespace vk_demo
 
 		void Prepare();
 
+		void UpdateRingBufferDescriptors();
+
 	private:
 
 		static DVKRingBuffer*	ringBuffer;
@@ -164,8 +150,10 @@ namespace vk_demo
         DVKGfxPipelineInfo      pipelineInfo;
         DVKGfxPipeline*         pipeline = nullptr;
         DVKDescriptorSet*		descriptorSet = nullptr;
+		std::vector<DVKDescriptorSet*>	retiredDescriptorSets;
 
 		uint32					dynamicOffsetCount;
+		uint32					ringBufferGeneration = 0;
 		std::vector<uint32>		globalOffsets;
         std::vector<uint32>     dynamicOffsets;
 		std::vector<uint32>		perObjectIndexes;
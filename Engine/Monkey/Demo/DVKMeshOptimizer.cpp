@@ -0,0 +1,447 @@
+﻿#include "DVKMeshOptimizer.h"
+
+#include "Math/Math.h"
+#include "Math/Vector3.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace vk_demo
+{
+
+	static const uint32 FETCH_CACHE_LINE  = 64;
+	static const uint32 FETCH_CACHE_LINES = 64;
+
+	// FIFO缓存：顶点的时间戳距当前不超过cacheSize即在缓存中，未命中时返回true
+	static inline bool CacheAccess(std::vector<uint32>& cacheTime, uint32& timestamp, uint32 cacheSize, uint32 index)
+	{
+		if (timestamp - cacheTime[index] > cacheSize)
+		{
+			cacheTime[index] = timestamp++;
+			return true;
+		}
+		return false;
+	}
+
+	static inline Vector3 GetPosition(const std::vector<float>& vertices, int32 stride, int32 positionOffset, uint32 index)
+	{
+		const float* position = vertices.data() + index * stride + positionOffset;
+		return Vector3(position[0], position[1], position[2]);
+	}
+
+	static inline uint32 HashVertex(const float* vertex, int32 stride)
+	{
+		const uint32* data = (const uint32*)vertex;
+		uint32 hash = 2166136261u;
+		for (int32 i = 0; i < stride; ++i) {
+			hash = (hash ^ data[i]) * 16777619u;
+		}
+		return hash ^ (hash >> 15);
+	}
+
+	uint32 DVKMeshOptimizer::WeldVertices(std::vector<float>& vertices, std::vector<uint32>& indices, int32 stride)
+	{
+		uint32 vertexCount = vertices.size() / stride;
+		uint32 newCount    = 0;
+
+		// 开放寻址的哈希表，保存新顶点的序号
+		uint32 bucketCount = 1;
+		while (bucketCount < vertexCount + vertexCount / 4) {
+			bucketCount *= 2;
+		}
+		std::vector<uint32> buckets(bucketCount, MAX_uint32);
+		std::vector<uint32> remap(vertexCount);
+		std::vector<float>  result;
+		result.reserve(vertices.size());
+
+		for (uint32 i = 0; i < vertexCount; ++i)
+		{
+			const float* vertex = vertices.data() + i * stride;
+			uint32 bucket = HashVertex(vertex, stride) & (bucketCount - 1);
+
+			while (buckets[bucket] != MAX_uint32 && memcmp(result.data() + buckets[bucket] * stride, vertex, stride * sizeof(float)) != 0) {
+				bucket = (bucket + 1) & (bucketCount - 1);
+			}
+
+			if (buckets[bucket] == MAX_uint32)
+			{
+				buckets[bucket] = newCount++;
+				result.insert(result.end(), vertex, vertex + stride);
+			}
+
+			remap[i] = buckets[bucket];
+		}
+
+		for (int32 i = 0; i < indices.size(); ++i) {
+			indices[i] = remap[indices[i]];
+		}
+
+		vertices.swap(result);
+
+		return newCount;
+	}
+
+	void DVKMeshOptimizer::OptimizeVertexCache(std::vector<uint32>& indices, uint32 vertexCount, uint32 cacheSize, std::vector<uint32>* outClusters)
+	{
+		uint32 triangleCount = indices.size() / 3;
+
+		if (outClusters) {
+			outClusters->clear();
+		}
+
+		if (triangleCount == 0) {
+			return;
+		}
+
+		// 顶点->三角形的邻接表
+		std::vector<uint32> offsets(vertexCount + 1, 0);
+		for (int32 i = 0; i < triangleCount * 3; ++i) {
+			offsets[indices[i] + 1] += 1;
+		}
+		for (int32 i = 0; i < vertexCount; ++i) {
+			offsets[i + 1] += offsets[i];
+		}
+
+		std::vector<uint32> adjacency(triangleCount * 3);
+		std::vector<uint32> fillOffsets(offsets.begin(), offsets.end() - 1);
+		for (int32 i = 0; i < triangleCount * 3; ++i) {
+			adjacency[fillOffsets[indices[i]]++] = i / 3;
+		}
+
+		// 每个顶点还没有输出的三角形数量
+		std::vector<uint32> liveCount(vertexCount);
+		for (int32 i = 0; i < vertexCount; ++i) {
+			liveCount[i] = offsets[i + 1] - offsets[i];
+		}
+
+		std::vector<uint32> cacheTime(vertexCount, 0);
+		std::vector<uint8>  emitted(triangleCount, 0);
+		std::vector<uint32> deadEnd;
+		std::vector<uint32> candidates;
+		std::vector<uint32> result;
+		deadEnd.reserve(triangleCount * 3);
+		result.reserve(triangleCount * 3);
+
+		uint32 timestamp = cacheSize + 1;
+		uint32 cursor    = 0;
+
+		while (cursor < vertexCount && liveCount[cursor] == 0) {
+			cursor += 1;
+		}
+
+		int64 current = cursor;
+
+		if (outClusters) {
+			outClusters->push_back(0);
+		}
+
+		while (current >= 0 && current < vertexCount)
+		{
+			// 输出当前顶点所有剩余的三角形
+			candidates.clear();
+			for (uint32 i = offsets[current]; i < offsets[current + 1]; ++i)
+			{
+				uint32 triangle = adjacency[i];
+				if (emitted[triangle]) {
+					continue;
+				}
+
+				// 三个顶点都不在缓存中说明缓存的内容已经和之前无关，作为Cluster的硬边界
+				uint32 misses = 0;
+				for (int32 j = 0; j < 3; ++j) {
+					misses += timestamp - cacheTime[indices[triangle * 3 + j]] > cacheSize ? 1 : 0;
+				}
+				if (misses == 3 && result.size() > 0 && outClusters) {
+					outClusters->push_back(result.size() / 3);
+				}
+
+				for (int32 j = 0; j < 3; ++j)
+				{
+					uint32 index = indices[triangle * 3 + j];
+					result.push_back(index);
+					deadEnd.push_back(index);
+					candidates.push_back(index);
+					liveCount[index] -= 1;
+					CacheAccess(cacheTime, timestamp, cacheSize, index);
+				}
+
+				emitted[triangle] = 1;
+			}
+
+			// 在刚输出的顶点里选下一个扇心：输出它的剩余三角形之后仍然留在缓存中的顶点里，选最早进入缓存的那个
+			int64 next = -1;
+			int64 bestPriority = -1;
+			for (int32 i = 0; i < candidates.size(); ++i)
+			{
+				uint32 index = candidates[i];
+				if (liveCount[index] == 0) {
+					continue;
+				}
+
+				int64 priority = 0;
+				if (timestamp - cacheTime[index] + 2 * liveCount[index] <= cacheSize) {
+					priority = timestamp - cacheTime[index];
+				}
+
+				if (priority > bestPriority)
+				{
+					bestPriority = priority;
+					next = index;
+				}
+			}
+
+			// 死路：先回溯最近输出过的顶点，再线性往后找
+			if (next < 0)
+			{
+				while (!deadEnd.empty())
+				{
+					uint32 index = deadEnd.back();
+					deadEnd.pop_back();
+					if (liveCount[index] > 0)
+					{
+						next = index;
+						break;
+					}
+				}
+
+				if (next < 0)
+				{
+					while (cursor < vertexCount && liveCount[cursor] == 0) {
+						cursor += 1;
+					}
+					next = cursor < vertexCount ? cursor : -1;
+				}
+			}
+
+			current = next;
+		}
+
+		indices.swap(result);
+	}
+
+	void DVKMeshOptimizer::OptimizeOverdraw(std::vector<uint32>& indices, const std::vector<float>& vertices, int32 stride, int32 positionOffset, const std::vector<uint32>& clusters, uint32 cacheSize, float threshold)
+	{
+		uint32 triangleCount = indices.size() / 3;
+		uint32 vertexCount   = vertices.size() / stride;
+
+		if (triangleCount == 0 || clusters.empty()) {
+			return;
+		}
+
+		// 硬边界之间再按ACMR切出软边界：从Cluster开头累计未命中数，一旦局部ACMR不超过整个Cluster的threshold倍就切开，
+		// 切开的位置缓存本来就接近稳定状态，改变绘制顺序几乎不影响ACMR
+		std::vector<uint32> softClusters;
+		std::vector<uint32> cacheTime(vertexCount, 0);
+		uint32 timestamp = cacheSize + 1;
+
+		for (int32 c = 0; c < clusters.size(); ++c)
+		{
+			uint32 start = clusters[c];
+			uint32 end   = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+			if (start >= end) {
+				continue;
+			}
+
+			// 时间戳跳过cacheSize相当于清空缓存
+			timestamp += cacheSize + 1;
+
+			uint32 clusterMisses = 0;
+			for (uint32 i = start * 3; i < end * 3; ++i) {
+				clusterMisses += CacheAccess(cacheTime, timestamp, cacheSize, indices[i]) ? 1 : 0;
+			}
+			float clusterACMR = (float)clusterMisses / (end - start);
+
+			timestamp += cacheSize + 1;
+			softClusters.push_back(start);
+
+			uint32 subStart  = start;
+			uint32 subMisses = 0;
+			for (uint32 t = start; t < end; ++t)
+			{
+				for (int32 j = 0; j < 3; ++j) {
+					subMisses += CacheAccess(cacheTime, timestamp, cacheSize, indices[t * 3 + j]) ? 1 : 0;
+				}
+
+				if (t + 1 < end && subMisses <= threshold * clusterACMR * (t - subStart + 1))
+				{
+					softClusters.push_back(t + 1);
+					subStart  = t + 1;
+					subMisses = 0;
+					timestamp += cacheSize + 1;
+				}
+			}
+		}
+
+		// 面积加权的Cluster中心和法线，Mesh中心取全部三角形的面积加权中心
+		uint32 clusterCount = softClusters.size();
+		std::vector<Vector3> centroids(clusterCount, Vector3(0, 0, 0));
+		std::vector<Vector3> normals(clusterCount, Vector3(0, 0, 0));
+		std::vector<float>   areas(clusterCount, 0.0f);
+		Vector3 meshCentroid(0, 0, 0);
+		float   meshArea = 0.0f;
+
+		for (int32 c = 0; c < clusterCount; ++c)
+		{
+			uint32 start = softClusters[c];
+			uint32 end   = c + 1 < clusterCount ? softClusters[c + 1] : triangleCount;
+
+			for (uint32 t = start; t < end; ++t)
+			{
+				Vector3 p0 = GetPosition(vertices, stride, positionOffset, indices[t * 3 + 0]);
+				Vector3 p1 = GetPosition(vertices, stride, positionOffset, indices[t * 3 + 1]);
+				Vector3 p2 = GetPosition(vertices, stride, positionOffset, indices[t * 3 + 2]);
+				Vector3 normal = Vector3::CrossProduct(p1 - p0, p2 - p0);
+				float area = normal.Size();
+
+				centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+				normals[c]   += normal;
+				areas[c]     += area;
+			}
+
+			meshCentroid += centroids[c];
+			meshArea     += areas[c];
+
+			if (areas[c] > 0.0f) {
+				centroids[c] = centroids[c] * (1.0f / areas[c]);
+			}
+		}
+
+		if (meshArea > 0.0f) {
+			meshCentroid = meshCentroid * (1.0f / meshArea);
+		}
+
+		// 越朝外的Cluster越容易遮挡其它Cluster，先绘制
+		std::vector<float>  sortKeys(clusterCount);
+		std::vector<uint32> order(clusterCount);
+		for (int32 c = 0; c < clusterCount; ++c)
+		{
+			normals[c].Normalize();
+			sortKeys[c] = Vector3::DotProduct(centroids[c] - meshCentroid, normals[c]);
+			order[c]    = c;
+		}
+
+		std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32 a, uint32 b) -> bool {
+			return sortKeys[a] > sortKeys[b];
+		});
+
+		std::vector<uint32> result;
+		result.reserve(indices.size());
+		for (int32 i = 0; i < clusterCount; ++i)
+		{
+			uint32 c     = order[i];
+			uint32 start = softClusters[c];
+			uint32 end   = c + 1 < clusterCount ? softClusters[c + 1] : triangleCount;
+			result.insert(result.end(), indices.begin() + start * 3, indices.begin() + end * 3);
+		}
+
+		indices.swap(result);
+	}
+
+	uint32 DVKMeshOptimizer::OptimizeVertexFetch(std::vector<float>& vertices, std::vector<uint32>& indices, int32 stride)
+	{
+		uint32 vertexCount = vertices.size() / stride;
+		uint32 newCount    = 0;
+
+		std::vector<uint32> remap(vertexCount, MAX_uint32);
+		std::vector<float>  result;
+		result.reserve(vertices.size());
+
+		for (int32 i = 0; i < indices.size(); ++i)
+		{
+			uint32 index = indices[i];
+			if (remap[index] == MAX_uint32)
+			{
+				remap[index] = newCount++;
+				result.insert(result.end(), vertices.begin() + index * stride, vertices.begin() + (index + 1) * stride);
+			}
+			indices[i] = remap[index];
+		}
+
+		vertices.swap(result);
+
+		return newCount;
+	}
+
+	void DVKMeshOptimizer::Optimize(std::vector<float>& vertices, std::vector<uint32>& indices, int32 stride, int32 positionOffset)
+	{
+		if (stride <= 0 || indices.size() < 3) {
+			return;
+		}
+
+		WeldVertices(vertices, indices, stride);
+
+		std::vector<uint32> clusters;
+		OptimizeVertexCache(indices, vertices.size() / stride, DefaultCacheSize, &clusters);
+
+		if (positionOffset >= 0 && positionOffset + 3 <= stride) {
+			OptimizeOverdraw(indices, vertices, stride, positionOffset, clusters);
+		}
+
+		OptimizeVertexFetch(vertices, indices, stride);
+	}
+
+	DVKVertexCacheStats DVKMeshOptimizer::AnalyzeVertexCache(const std::vector<uint32>& indices, uint32 vertexCount, uint32 cacheSize)
+	{
+		DVKVertexCacheStats stats;
+		stats.triangleCount = indices.size() / 3;
+
+		std::vector<uint32> cacheTime(vertexCount, 0);
+		std::vector<uint8>  referenced(vertexCount, 0);
+		uint32 timestamp = cacheSize + 1;
+
+		for (int32 i = 0; i < stats.triangleCount * 3; ++i)
+		{
+			uint32 index = indices[i];
+			if (CacheAccess(cacheTime, timestamp, cacheSize, index)) {
+				stats.transformedCount += 1;
+			}
+
+			if (!referenced[index])
+			{
+				referenced[index] = 1;
+				stats.vertexCount += 1;
+			}
+		}
+
+		stats.acmr = stats.triangleCount == 0 ? 0.0f : (float)stats.transformedCount / stats.triangleCount;
+		stats.atvr = stats.vertexCount   == 0 ? 0.0f : (float)stats.transformedCount / stats.vertexCount;
+
+		return stats;
+	}
+
+	DVKVertexFetchStats DVKMeshOptimizer::AnalyzeVertexFetch(const std::vector<uint32>& indices, uint32 vertexCount, uint32 vertexSize)
+	{
+		DVKVertexFetchStats stats;
+
+		uint32 lineCount = (uint64(vertexCount) * vertexSize + FETCH_CACHE_LINE - 1) / FETCH_CACHE_LINE;
+		std::vector<uint32> cacheTime(lineCount, 0);
+		std::vector<uint8>  referenced(vertexCount, 0);
+		uint32 timestamp  = FETCH_CACHE_LINES + 1;
+		uint32 usedCount  = 0;
+
+		for (int32 i = 0; i < indices.size(); ++i)
+		{
+			uint32 index = indices[i];
+			if (!referenced[index])
+			{
+				referenced[index] = 1;
+				usedCount += 1;
+			}
+
+			// 顶点可能跨越多条Cache Line
+			uint64 begin = uint64(index) * vertexSize;
+			uint64 end   = begin + vertexSize;
+			for (uint64 line = begin / FETCH_CACHE_LINE; line * FETCH_CACHE_LINE < end; ++line)
+			{
+				if (CacheAccess(cacheTime, timestamp, FETCH_CACHE_LINES, line)) {
+					stats.bytesFetched += FETCH_CACHE_LINE;
+				}
+			}
+		}
+
+		stats.overfetch = usedCount == 0 ? 0.0f : (float)stats.bytesFetched / (uint64(usedCount) * vertexSize);
+
+		return stats;
+	}
+
+}
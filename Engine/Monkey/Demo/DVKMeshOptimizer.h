@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+
+#include <vector>
+
+namespace vk_demo
+{
+	struct DVKVertexCacheStats
+	{
+		uint32	triangleCount = 0;
+		uint32	vertexCount = 0;
+		uint32	transformedCount = 0;
+
+		// average cache miss ratio，平均每个三角形的未命中次数，下限约0.5
+		float	acmr = 0.0f;
+
+		// average transformed vertex ratio，平均每个顶点被变换的次数，下限1.0
+		float	atvr = 0.0f;
+	};
+
+	struct DVKVertexFetchStats
+	{
+		uint64	bytesFetched = 0;
+
+		// 实际读取的字节数与顶点数据大小之比，下限1.0
+		float	overfetch = 0.0f;
+	};
+
+	// 导入或者烘焙时对索引和顶点重新排序：
+	// 0. 合并完全相同的顶点，Assimp默认为每个三角形的角输出独立的顶点，不合并的话顶点缓存完全无效；
+	// 1. Tipsify(Sander 2007)重排三角形，提高Post-Transform Cache命中率，同时输出Cluster边界；
+	// 2. 按Cluster朝外的程度排序，外侧的Cluster先绘制，减少Overdraw；
+	// 3. 按索引首次出现的顺序重排顶点，提高Vertex Fetch的局部性。
+	// vertices为交错排列的float数据，stride以float计。
+	class DVKMeshOptimizer
+	{
+	public:
+		enum
+		{
+			DefaultCacheSize = 16,
+		};
+
+		// 按字节比较合并相同的顶点，返回新的顶点数
+		static uint32 WeldVertices(std::vector<float>& vertices, std::vector<uint32>& indices, int32 stride);
+
+		// outClusters输出Cluster起始的三角形序号
+		static void OptimizeVertexCache(std::vector<uint32>& indices, uint32 vertexCount, uint32 cacheSize = DefaultCacheSize, std::vector<uint32>* outClusters = nullptr);
+
+		// clusters来自OptimizeVertexCache，Cluster内部的ACMR降到threshold倍以内时再细分，细分越多Overdraw越好、ACMR越差
+		static void OptimizeOverdraw(std::vector<uint32>& indices, const std::vector<float>& vertices, int32 stride, int32 positionOffset, const std::vector<uint32>& clusters, uint32 cacheSize = DefaultCacheSize, float threshold = 1.05f);
+
+		// 没有被索引引用的顶点会被丢弃，返回新的顶点数
+		static uint32 OptimizeVertexFetch(std::vector<float>& vertices, std::vector<uint32>& indices, int32 stride);
+
+		// 依次执行以上步骤，positionOffset小于0时跳过Overdraw优化
+		static void Optimize(std::vector<float>& vertices, std::vector<uint32>& indices, int32 stride, int32 positionOffset);
+
+		// 按FIFO缓存模拟
+		static DVKVertexCacheStats AnalyzeVertexCache(const std::vector<uint32>& indices, uint32 vertexCount, uint32 cacheSize = DefaultCacheSize);
+
+		// 按64字节Cache Line、4KB的FIFO缓存模拟，vertexSize以字节计
+		static DVKVertexFetchStats AnalyzeVertexFetch(const std::vector<uint32>& indices, uint32 vertexCount, uint32 vertexSize);
+	};
+
+}
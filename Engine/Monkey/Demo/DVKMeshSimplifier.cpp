@@ -0,0 +1,392 @@
+﻿#include "DVKMeshSimplifier.h"
+
+#include "Math/Math.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+namespace vk_demo
+{
+
+	// 对称矩阵A、向量b、常数c，误差为 pᵀAp + 2bᵀp + c，除以weight得到平方距离
+	struct SimplifyQuadric
+	{
+		double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+		double b0 = 0, b1 = 0, b2 = 0;
+		double c = 0;
+		double weight = 0;
+
+		void AddPlane(const Vector3& n, float d, float w)
+		{
+			a00 += w * n.x * n.x;
+			a11 += w * n.y * n.y;
+			a22 += w * n.z * n.z;
+			a01 += w * n.x * n.y;
+			a02 += w * n.x * n.z;
+			a12 += w * n.y * n.z;
+			b0  += w * n.x * d;
+			b1  += w * n.y * d;
+			b2  += w * n.z * d;
+			c   += w * d * d;
+			weight += w;
+		}
+
+		void Add(const SimplifyQuadric& other)
+		{
+			a00 += other.a00; a11 += other.a11; a22 += other.a22;
+			a01 += other.a01; a02 += other.a02; a12 += other.a12;
+			b0  += other.b0;  b1  += other.b1;  b2  += other.b2;
+			c   += other.c;
+			weight += other.weight;
+		}
+	};
+
+	struct SimplifyCollapse
+	{
+		uint32	from;
+		uint32	to;
+		float	error;
+
+		bool operator < (const SimplifyCollapse& other) const
+		{
+			return error < other.error;
+		}
+	};
+
+	static inline float QuadricError(const SimplifyQuadric& a, const SimplifyQuadric& b, const Vector3& p)
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double a00 = a.a00 + b.a00, a11 = a.a11 + b.a11, a22 = a.a22 + b.a22;
+		double a01 = a.a01 + b.a01, a02 = a.a02 + b.a02, a12 = a.a12 + b.a12;
+		double error =
+			a00 * x * x + a11 * y * y + a22 * z * z +
+			2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+			2.0 * ((a.b0 + b.b0) * x + (a.b1 + b.b1) * y + (a.b2 + b.b2) * z) +
+			a.c + b.c;
+		double weight = a.weight + b.weight;
+		return weight > 0.0 ? (float)MMath::Abs(error / weight) : 0.0f;
+	}
+
+	// from折叠到to之后，from周围不含to的三角形法线不能翻转。indices为按位置合并之后的索引。
+	static bool CollapseFlips(const std::vector<uint32>& indices, const std::vector<Vector3>& positions, const std::vector<uint32>& offsets, const std::vector<uint32>& adjacency, uint32 from, uint32 to)
+	{
+		for (uint32 i = offsets[from]; i < offsets[from + 1]; ++i)
+		{
+			const uint32* triangle = indices.data() + adjacency[i] * 3;
+			if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+				continue;
+			}
+
+			Vector3 p0 = positions[triangle[0]];
+			Vector3 p1 = positions[triangle[1]];
+			Vector3 p2 = positions[triangle[2]];
+			Vector3 oldNormal = Vector3::CrossProduct(p1 - p0, p2 - p0);
+
+			if (triangle[0] == from) p0 = positions[to];
+			if (triangle[1] == from) p1 = positions[to];
+			if (triangle[2] == from) p2 = positions[to];
+			Vector3 newNormal = Vector3::CrossProduct(p1 - p0, p2 - p0);
+
+			if (Vector3::DotProduct(oldNormal, newNormal) <= 0.0f) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// 位置完全相同的顶点合并为同一个拓扑顶点，返回每个顶点对应的代表顶点
+	static void BuildPositionRemap(const std::vector<Vector3>& positions, std::vector<uint32>& outRemap)
+	{
+		uint32 vertexCount = positions.size();
+		uint32 bucketCount = 1;
+		while (bucketCount < vertexCount + vertexCount / 4) {
+			bucketCount *= 2;
+		}
+
+		std::vector<uint32> buckets(bucketCount, MAX_uint32);
+		outRemap.resize(vertexCount);
+
+		for (uint32 i = 0; i < vertexCount; ++i)
+		{
+			const uint32* data = (const uint32*)&positions[i];
+			uint32 hash = ((data[0] * 73856093u) ^ (data[1] * 19349663u) ^ (data[2] * 83492791u));
+			uint32 bucket = hash & (bucketCount - 1);
+
+			while (true)
+			{
+				uint32 other = buckets[bucket];
+				if (other == MAX_uint32)
+				{
+					buckets[bucket] = i;
+					outRemap[i] = i;
+					break;
+				}
+				if (memcmp(&positions[other], &positions[i], sizeof(float) * 3) == 0)
+				{
+					outRemap[i] = other;
+					break;
+				}
+				bucket = (bucket + 1) & (bucketCount - 1);
+			}
+		}
+	}
+
+	float DVKMeshSimplifier::Simplify(const std::vector<uint32>& indices, const std::vector<Vector3>& positions, uint32 targetIndexCount, float targetError, std::vector<uint32>& outIndices, bool lockSeams)
+	{
+		outIndices = indices;
+
+		uint32 vertexCount = positions.size();
+
+		// 拓扑在按位置合并之后的顶点上计算，法线、UV不同的顶点不会被当成边界
+		std::vector<uint32> canonical;
+		BuildPositionRemap(positions, canonical);
+
+		std::vector<uint32> topology(indices.size());
+		for (int32 i = 0; i < indices.size(); ++i) {
+			topology[i] = canonical[indices[i]];
+		}
+
+		// 只被一个三角形使用的有向边为边界，边界上的顶点锁定
+		std::vector<uint8> locked(vertexCount, 0);
+		{
+			std::unordered_set<uint64> edges;
+			edges.reserve(topology.size());
+			for (int32 i = 0; i + 2 < topology.size(); i += 3)
+			{
+				for (int32 k = 0; k < 3; ++k) {
+					edges.insert(((uint64)topology[i + k] << 32) | topology[i + (k + 1) % 3]);
+				}
+			}
+			for (int32 i = 0; i + 2 < topology.size(); i += 3)
+			{
+				for (int32 k = 0; k < 3; ++k)
+				{
+					uint32 a = topology[i + k];
+					uint32 b = topology[i + (k + 1) % 3];
+					if (edges.find(((uint64)b << 32) | a) == edges.end())
+					{
+						locked[a] = 1;
+						locked[b] = 1;
+					}
+				}
+			}
+		}
+
+		// 每个顶点累加相邻三角形平面的二次误差，按面积加权
+		std::vector<SimplifyQuadric> quadrics(vertexCount);
+		for (int32 i = 0; i + 2 < topology.size(); i += 3)
+		{
+			const Vector3& p0 = positions[topology[i + 0]];
+			const Vector3& p1 = positions[topology[i + 1]];
+			const Vector3& p2 = positions[topology[i + 2]];
+			Vector3 normal = Vector3::CrossProduct(p1 - p0, p2 - p0);
+			float   area   = normal.Size() * 0.5f;
+			if (!normal.Normalize()) {
+				continue;
+			}
+
+			float d = -Vector3::DotProduct(normal, p0);
+			for (int32 k = 0; k < 3; ++k) {
+				quadrics[topology[i + k]].AddPlane(normal, d, area);
+			}
+		}
+
+		float maxError   = 0.0f;
+		float errorLimit = targetError * targetError;
+
+		std::vector<uint32> offsets(vertexCount + 1);
+		std::vector<uint32> fillOffsets(vertexCount);
+		std::vector<uint32> adjacency;
+		std::vector<uint32> remap(vertexCount);
+		std::vector<uint8>  touched(vertexCount);
+		std::vector<SimplifyCollapse> collapses;
+		std::vector<uint32> copies;
+
+		// 每一轮按误差从小到大折叠互不相邻的边，然后重建邻接关系
+		while (outIndices.size() > targetIndexCount)
+		{
+			uint32 triangleCount = outIndices.size() / 3;
+
+			std::fill(offsets.begin(), offsets.end(), 0);
+			for (uint32 i = 0; i < triangleCount * 3; ++i) {
+				offsets[topology[i] + 1] += 1;
+			}
+			for (uint32 i = 0; i < vertexCount; ++i) {
+				offsets[i + 1] += offsets[i];
+			}
+			adjacency.resize(triangleCount * 3);
+			std::copy(offsets.begin(), offsets.end() - 1, fillOffsets.begin());
+			for (uint32 i = 0; i < triangleCount * 3; ++i) {
+				adjacency[fillOffsets[topology[i]]++] = i / 3;
+			}
+
+			// 内部的边在两侧三角形中各出现一次，只取a < b的一次，折叠方向取误差较小的一端
+			collapses.clear();
+			for (uint32 i = 0; i < triangleCount * 3; i += 3)
+			{
+				for (int32 k = 0; k < 3; ++k)
+				{
+					uint32 a = topology[i + k];
+					uint32 b = topology[i + (k + 1) % 3];
+					if (a > b || (locked[a] && locked[b])) {
+						continue;
+					}
+
+					SimplifyCollapse collapse;
+					collapse.error = MAX_flt;
+					if (!locked[a])
+					{
+						collapse.from  = a;
+						collapse.to    = b;
+						collapse.error = QuadricError(quadrics[a], quadrics[b], positions[b]);
+					}
+					if (!locked[b])
+					{
+						float error = QuadricError(quadrics[a], quadrics[b], positions[a]);
+						if (error < collapse.error)
+						{
+							collapse.from  = b;
+							collapse.to    = a;
+							collapse.error = error;
+						}
+					}
+					collapses.push_back(collapse);
+				}
+			}
+
+			if (collapses.empty()) {
+				break;
+			}
+
+			std::sort(collapses.begin(), collapses.end());
+
+			for (uint32 i = 0; i < vertexCount; ++i) {
+				remap[i] = i;
+			}
+			std::fill(touched.begin(), touched.end(), 0);
+
+			uint32 budget  = (outIndices.size() - targetIndexCount) / 3;
+			uint32 removed = 0;
+			uint32 collapsed = 0;
+
+			for (int32 i = 0; i < collapses.size() && removed < budget; ++i)
+			{
+				const SimplifyCollapse& collapse = collapses[i];
+				if (collapse.error > errorLimit) {
+					break;
+				}
+				if (touched[collapse.from] || touched[collapse.to]) {
+					continue;
+				}
+				if (CollapseFlips(topology, positions, offsets, adjacency, collapse.from, collapse.to)) {
+					continue;
+				}
+
+				// from的每个副本折叠到与它共边的to的副本上，这样属性接缝两侧各自保持连续。
+				// 找不到共边的副本说明折叠会跨过接缝，lockSeams时放弃这次折叠。
+				copies.clear();
+				for (uint32 j = offsets[collapse.from]; j < offsets[collapse.from + 1]; ++j)
+				{
+					uint32 triangle = adjacency[j] * 3;
+					uint32 from = MAX_uint32;
+					uint32 to   = MAX_uint32;
+					for (int32 k = 0; k < 3; ++k)
+					{
+						if (topology[triangle + k] == collapse.from) from = outIndices[triangle + k];
+						if (topology[triangle + k] == collapse.to)   to   = outIndices[triangle + k];
+					}
+					if (to != MAX_uint32) {
+						copies.push_back(from);
+						copies.push_back(to);
+					}
+				}
+
+				bool seamBroken = false;
+				for (uint32 j = offsets[collapse.from]; j < offsets[collapse.from + 1] && !seamBroken; ++j)
+				{
+					uint32 triangle = adjacency[j] * 3;
+					for (int32 k = 0; k < 3; ++k)
+					{
+						if (topology[triangle + k] != collapse.from) {
+							continue;
+						}
+
+						uint32 from = outIndices[triangle + k];
+						uint32 to   = MAX_uint32;
+						for (int32 n = 0; n < copies.size(); n += 2)
+						{
+							if (copies[n] == from)
+							{
+								to = copies[n + 1];
+								break;
+							}
+						}
+
+						if (to == MAX_uint32)
+						{
+							if (lockSeams)
+							{
+								seamBroken = true;
+								break;
+							}
+							to = collapse.to;
+							copies.push_back(from);
+							copies.push_back(to);
+						}
+					}
+				}
+
+				if (seamBroken) {
+					continue;
+				}
+
+				for (int32 n = 0; n < copies.size(); n += 2) {
+					remap[copies[n]] = copies[n + 1];
+				}
+				quadrics[collapse.to].Add(quadrics[collapse.from]);
+				maxError = MMath::Max(maxError, collapse.error);
+				collapsed += 1;
+
+				// from的一环邻域本轮不再折叠，保证邻接关系和翻转检测仍然有效
+				for (uint32 j = offsets[collapse.from]; j < offsets[collapse.from + 1]; ++j)
+				{
+					const uint32* triangle = topology.data() + adjacency[j] * 3;
+					touched[triangle[0]] = 1;
+					touched[triangle[1]] = 1;
+					touched[triangle[2]] = 1;
+					if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+						removed += 1;
+					}
+				}
+			}
+
+			if (collapsed == 0) {
+				break;
+			}
+
+			// 应用折叠并去掉退化的三角形
+			uint32 writeIndex = 0;
+			for (uint32 i = 0; i < triangleCount * 3; i += 3)
+			{
+				uint32 a = remap[outIndices[i + 0]];
+				uint32 b = remap[outIndices[i + 1]];
+				uint32 c = remap[outIndices[i + 2]];
+				if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[a] == canonical[c]) {
+					continue;
+				}
+				topology[writeIndex] = canonical[a];
+				outIndices[writeIndex++] = a;
+				topology[writeIndex] = canonical[b];
+				outIndices[writeIndex++] = b;
+				topology[writeIndex] = canonical[c];
+				outIndices[writeIndex++] = c;
+			}
+			outIndices.resize(writeIndex);
+			topology.resize(writeIndex);
+		}
+
+		return MMath::Sqrt(maxError);
+	}
+
+}
@@ -0,0 +1,23 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Vector3.h"
+
+#include <vector>
+
+namespace vk_demo
+{
+
+	// 基于二次误差度量(Garland & Heckbert 1997)的边折叠简化，只生成新的索引，顶点保持不动，
+	// 简化结果可以和原始索引共用同一个VertexBuffer。
+	// 拓扑按位置合并之后计算，开放边界上的顶点不参与折叠。
+	class DVKMeshSimplifier
+	{
+	public:
+		// 三角形数降到targetIndexCount / 3，或者下一次折叠的误差超过targetError时停止。
+		// lockSeams为true时不允许跨过UV、法线等属性接缝折叠；硬边法线的模型(每个面的顶点都是独立的副本)需要传false才能简化。
+		// 返回简化的最大误差(距离)，单位与positions一致。
+		static float Simplify(const std::vector<uint32>& indices, const std::vector<Vector3>& positions, uint32 targetIndexCount, float targetError, std::vector<uint32>& outIndices, bool lockSeams = true);
+	};
+
+}
@@ -0,0 +1,296 @@
+﻿#include "DVKMeshlet.h"
+
+#include "Math/Math.h"
+
+namespace vk_demo
+{
+
+	void DVKMeshletBuilder::Build(std::vector<uint32>& indices, const std::vector<Vector3>& positions, std::vector<DVKMeshlet>& outMeshlets, uint32 maxVertices, uint32 maxTriangles)
+	{
+		outMeshlets.clear();
+
+		uint32 vertexCount   = positions.size();
+		uint32 triangleCount = indices.size() / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		// 顶点->三角形的邻接表
+		std::vector<uint32> offsets(vertexCount + 1, 0);
+		for (uint32 i = 0; i < triangleCount * 3; ++i) {
+			offsets[indices[i] + 1] += 1;
+		}
+		for (uint32 i = 0; i < vertexCount; ++i) {
+			offsets[i + 1] += offsets[i];
+		}
+
+		std::vector<uint32> adjacency(triangleCount * 3);
+		std::vector<uint32> fillOffsets(offsets.begin(), offsets.end() - 1);
+		for (uint32 i = 0; i < triangleCount * 3; ++i) {
+			adjacency[fillOffsets[indices[i]]++] = i / 3;
+		}
+
+		std::vector<Vector3> normals(triangleCount);
+		for (uint32 i = 0; i < triangleCount; ++i)
+		{
+			const Vector3& p0 = positions[indices[i * 3 + 0]];
+			const Vector3& p1 = positions[indices[i * 3 + 1]];
+			const Vector3& p2 = positions[indices[i * 3 + 2]];
+			normals[i] = Vector3::CrossProduct(p1 - p0, p2 - p0);
+			if (!normals[i].Normalize()) {
+				normals[i] = Vector3(0, 0, 0);
+			}
+		}
+
+		// 顶点是否已经在当前Meshlet中，换Meshlet时只重置用到的部分
+		std::vector<uint8>  used(vertexCount, 0);
+		std::vector<uint8>  emitted(triangleCount, 0);
+		std::vector<uint32> meshletVertices;
+		std::vector<uint32> result;
+		result.reserve(indices.size());
+
+		DVKMeshlet meshlet;
+		Vector3    coneSum(0, 0, 0);
+		uint32     cursor = 0;
+		int64      seed   = 0;
+
+		for (uint32 emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+		{
+			// 从与当前Meshlet共享顶点的三角形中挑选：新增顶点越少越好，其次法线与当前法线锥的轴越接近越好
+			int64 best = seed;
+			if (best < 0)
+			{
+				float bestScore = MAX_flt;
+				Vector3 axis = coneSum;
+				bool hasAxis = axis.Normalize();
+
+				for (int32 i = 0; i < meshletVertices.size(); ++i)
+				{
+					uint32 vertex = meshletVertices[i];
+					for (uint32 j = offsets[vertex]; j < offsets[vertex + 1]; ++j)
+					{
+						uint32 triangle = adjacency[j];
+						if (emitted[triangle]) {
+							continue;
+						}
+
+						uint32 extra = 0;
+						for (int32 k = 0; k < 3; ++k) {
+							extra += used[indices[triangle * 3 + k]] ? 0 : 1;
+						}
+						if (meshlet.vertexCount + extra > maxVertices) {
+							continue;
+						}
+
+						float alignment = hasAxis ? Vector3::DotProduct(normals[triangle], axis) : 1.0f;
+						float score     = extra + (1.0f - alignment) * 2.0f;
+						if (score < bestScore)
+						{
+							bestScore = score;
+							best = triangle;
+						}
+					}
+				}
+			}
+
+			// 没有相邻的三角形可以加入，或者Meshlet已满，开始新的Meshlet
+			if (best < 0 || meshlet.triangleCount >= maxTriangles)
+			{
+				ComputeBounds(meshlet, result, positions, meshletVertices);
+				outMeshlets.push_back(meshlet);
+
+				// 新Meshlet优先从上一个的边界上继续生长，保持空间上的连续
+				best = -1;
+				for (int32 i = 0; i < meshletVertices.size() && best < 0; ++i)
+				{
+					uint32 vertex = meshletVertices[i];
+					for (uint32 j = offsets[vertex]; j < offsets[vertex + 1]; ++j)
+					{
+						if (!emitted[adjacency[j]])
+						{
+							best = adjacency[j];
+							break;
+						}
+					}
+				}
+
+				for (int32 i = 0; i < meshletVertices.size(); ++i) {
+					used[meshletVertices[i]] = 0;
+				}
+				meshletVertices.clear();
+
+				meshlet = DVKMeshlet();
+				meshlet.firstIndex = result.size();
+				coneSum = Vector3(0, 0, 0);
+
+				if (best < 0)
+				{
+					while (emitted[cursor]) {
+						cursor += 1;
+					}
+					best = cursor;
+				}
+			}
+
+			uint32 triangle = best;
+			for (int32 k = 0; k < 3; ++k)
+			{
+				uint32 index = indices[triangle * 3 + k];
+				result.push_back(index);
+				if (!used[index])
+				{
+					used[index] = 1;
+					meshletVertices.push_back(index);
+				}
+			}
+
+			emitted[triangle]      = 1;
+			coneSum               += normals[triangle];
+			meshlet.vertexCount    = meshletVertices.size();
+			meshlet.triangleCount += 1;
+			seed = -1;
+		}
+
+		if (meshlet.triangleCount > 0)
+		{
+			ComputeBounds(meshlet, result, positions, meshletVertices);
+			outMeshlets.push_back(meshlet);
+		}
+
+		indices.swap(result);
+	}
+
+	void DVKMeshletBuilder::ComputeBounds(DVKMeshlet& meshlet, const std::vector<uint32>& indices, const std::vector<Vector3>& positions, const std::vector<uint32>& meshletVertices)
+	{
+		// Ritter包围球：先找距离最远的两个点作为初始的球，再逐个扩大
+		const Vector3& first = positions[meshletVertices[0]];
+		Vector3 pointA = first;
+		Vector3 pointB = first;
+		for (int32 i = 0; i < meshletVertices.size(); ++i)
+		{
+			const Vector3& position = positions[meshletVertices[i]];
+			if ((position - first).SizeSquared() > (pointA - first).SizeSquared()) {
+				pointA = position;
+			}
+		}
+		for (int32 i = 0; i < meshletVertices.size(); ++i)
+		{
+			const Vector3& position = positions[meshletVertices[i]];
+			if ((position - pointA).SizeSquared() > (pointB - pointA).SizeSquared()) {
+				pointB = position;
+			}
+		}
+
+		Vector3 center = (pointA + pointB) * 0.5f;
+		float   radius = (pointB - pointA).Size() * 0.5f;
+		for (int32 i = 0; i < meshletVertices.size(); ++i)
+		{
+			const Vector3& position = positions[meshletVertices[i]];
+			float distance = (position - center).Size();
+			if (distance > radius)
+			{
+				float newRadius = (radius + distance) * 0.5f;
+				center = center + (position - center) * ((newRadius - radius) / distance);
+				radius = newRadius;
+			}
+		}
+
+		meshlet.center   = center;
+		meshlet.radius   = radius;
+		meshlet.coneApex = center;
+		meshlet.coneAxis = Vector3(0, 0, 1);
+
+		// 法线锥：轴为三角形法线的平均方向，张角由偏离最大的法线决定
+		uint32 beginIndex = meshlet.firstIndex;
+		uint32 endIndex   = meshlet.firstIndex + meshlet.triangleCount * 3;
+
+		std::vector<Vector3> normals;
+		normals.reserve(meshlet.triangleCount);
+
+		Vector3 axis(0, 0, 0);
+		for (uint32 i = beginIndex; i < endIndex; i += 3)
+		{
+			const Vector3& p0 = positions[indices[i + 0]];
+			const Vector3& p1 = positions[indices[i + 1]];
+			const Vector3& p2 = positions[indices[i + 2]];
+			Vector3 normal = Vector3::CrossProduct(p1 - p0, p2 - p0);
+			if (!normal.Normalize()) {
+				normals.push_back(Vector3(0, 0, 0));
+				continue;
+			}
+			normals.push_back(normal);
+			axis += normal;
+		}
+
+		if (!axis.Normalize()) {
+			return;
+		}
+
+		float minDot = 1.0f;
+		for (int32 i = 0; i < normals.size(); ++i)
+		{
+			if (normals[i].SizeSquared() > 0.0f) {
+				minDot = MMath::Min(minDot, Vector3::DotProduct(normals[i], axis));
+			}
+		}
+
+		// 锥体接近半球时几乎不可能整体背向相机，不值得测试
+		if (minDot <= 0.1f) {
+			return;
+		}
+
+		// 锥顶沿轴向后退，保证所有三角形的平面都在锥顶之前
+		float maxT = 0.0f;
+		for (uint32 i = beginIndex, t = 0; i < endIndex; i += 3, ++t)
+		{
+			if (normals[t].SizeSquared() == 0.0f) {
+				continue;
+			}
+			const Vector3& p0 = positions[indices[i]];
+			float dc = Vector3::DotProduct(center - p0, normals[t]);
+			float dn = Vector3::DotProduct(axis, normals[t]);
+			maxT = MMath::Max(maxT, dc / dn);
+		}
+
+		meshlet.coneApex   = center - axis * maxT;
+		meshlet.coneAxis   = axis;
+		meshlet.coneCutoff = MMath::Sqrt(1.0f - minDot * minDot);
+	}
+
+	uint32 DVKMeshletCuller::Cull(const std::vector<DVKMeshlet>& meshlets, const DVKFrustum& frustum, const Vector3& cameraPosition, std::vector<VkDrawIndexedIndirectCommand>& outDraws)
+	{
+		uint32 visibleCount = 0;
+		bool   lastVisible  = false;
+
+		for (int32 i = 0; i < meshlets.size(); ++i)
+		{
+			const DVKMeshlet& meshlet = meshlets[i];
+			if (!IsVisible(meshlet, frustum, cameraPosition))
+			{
+				lastVisible = false;
+				continue;
+			}
+
+			visibleCount += 1;
+
+			if (lastVisible)
+			{
+				outDraws.back().indexCount += meshlet.triangleCount * 3;
+				continue;
+			}
+
+			VkDrawIndexedIndirectCommand draw;
+			draw.indexCount    = meshlet.triangleCount * 3;
+			draw.instanceCount = 1;
+			draw.firstIndex    = meshlet.firstIndex;
+			draw.vertexOffset  = 0;
+			draw.firstInstance = 0;
+			outDraws.push_back(draw);
+
+			lastVisible = true;
+		}
+
+		return visibleCount;
+	}
+
+}
@@ -0,0 +1,70 @@
+﻿#pragma once
+
+#include "DVKFrustum.h"
+
+#include "Common/Common.h"
+#include "Math/Vector3.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <vector>
+
+namespace vk_demo
+{
+
+	// 一个Meshlet是Primitive索引中连续的一段三角形，可以单独剔除、单独绘制
+	struct DVKMeshlet
+	{
+		uint32	firstIndex = 0;
+		uint32	triangleCount = 0;
+		uint32	vertexCount = 0;
+
+		// 包围球
+		Vector3	center;
+		float	radius = 0.0f;
+
+		// 法线锥，相机位于锥体之内时整个Meshlet都是背面。coneCutoff为1时不做背面剔除。
+		Vector3	coneApex;
+		Vector3	coneAxis;
+		float	coneCutoff = 1.0f;
+	};
+
+	class DVKMeshletBuilder
+	{
+	public:
+		// 贪心生长：每次从与当前Meshlet共享顶点的三角形中挑选新增顶点最少、法线最接近的一个，
+		// 顶点或者三角形数量超出限制时开始新的Meshlet。indices会被重排，每个Meshlet是其中连续的一段。
+		static void Build(std::vector<uint32>& indices, const std::vector<Vector3>& positions, std::vector<DVKMeshlet>& outMeshlets, uint32 maxVertices = 64, uint32 maxTriangles = 124);
+
+	private:
+		static void ComputeBounds(DVKMeshlet& meshlet, const std::vector<uint32>& indices, const std::vector<Vector3>& positions, const std::vector<uint32>& meshletVertices);
+	};
+
+	// 目前只有CPU剔除。GPU Compute剔除（每个线程剔除一个Meshlet，原子追加Indirect命令）暂缓：
+	// 仓库里的.spv都由glslangValidator编译，这里没有可用的编译器，手写的SPIR-V无法验证。
+	class DVKMeshletCuller
+	{
+	public:
+		// frustum和cameraPosition都在模型空间。可见的Meshlet写成Indirect命令，相邻的可见Meshlet合并为一条命令。
+		// 返回可见的Meshlet数量，outDraws可以直接拷贝进VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT的Buffer。
+		static uint32 Cull(const std::vector<DVKMeshlet>& meshlets, const DVKFrustum& frustum, const Vector3& cameraPosition, std::vector<VkDrawIndexedIndirectCommand>& outDraws);
+
+		static FORCEINLINE bool IsVisible(const DVKMeshlet& meshlet, const DVKFrustum& frustum, const Vector3& cameraPosition)
+		{
+			if (!frustum.IntersectSphere(meshlet.center, meshlet.radius)) {
+				return false;
+			}
+
+			if (meshlet.coneCutoff < 1.0f)
+			{
+				Vector3 direction = meshlet.coneApex - cameraPosition;
+				float   distance  = direction.Size();
+				if (Vector3::DotProduct(direction, meshlet.coneAxis) >= meshlet.coneCutoff * distance) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+	};
+
+}
@@ -1,7 +1,11 @@
 ﻿#include "DVKModel.h"
+#include "DVKMeshOptimizer.h"
+#include "DVKMeshSimplifier.h"
 
 #include "FileManager.h"
 #include "Math/Matrix4x4.h"
+#include "Math/VectorRegister.h"
+#include "Utils/Alignment.h"
 
 #include <assimp/Importer.hpp> 
 #include <assimp/scene.h>     
@@ -85,16 +89,23 @@ namespace vk_demo
 
         DVKPrimitive* primitive = new DVKPrimitive();
         primitive->vertices = vertices;
-        primitive->indices  = indices;
+        primitive->indices.assign(indices.begin(), indices.end());
 		primitive->vertexCount = vertices.size() / stride * 4;
 		
         if (cmdBuffer)
         {
+			bool batching = !cmdBuffer->IsBatching();
+			if (batching) {
+				cmdBuffer->BeginBatch();
+			}
 			if (vertices.size() > 0) {
 				primitive->vertexBuffer = DVKVertexBuffer::Create(vulkanDevice, cmdBuffer, primitive->vertices, attributes);
 			}
 			if (indices.size() > 0) {
-				primitive->indexBuffer = DVKIndexBuffer::Create(vulkanDevice, cmdBuffer, primitive->indices);
+				primitive->indexBuffer = DVKIndexBuffer::Create(vulkanDevice, cmdBuffer, indices);
+			}
+			if (batching) {
+				cmdBuffer->FlushBatch();
 			}
         }
         
@@ -111,11 +122,222 @@ namespace vk_demo
         
         model->rootNode = rootNode;
         model->meshes.push_back(mesh);
+		model->BuildTransforms();
         
         return model;
     }
 
+	// 从CPU端的顶点数据中取出位置，VA_PackedPosition按包围盒解码
+	static bool GetPrimitivePositions(const std::vector<VertexAttribute>& attributes, const DVKMesh* mesh, const DVKPrimitive* primitive, std::vector<Vector3>& outPositions)
+	{
+		int32 stride = 0;
+		int32 positionOffset = -1;
+		bool  packedPosition = false;
+		for (int32 i = 0; i < attributes.size(); ++i)
+		{
+			if (attributes[i] == VertexAttribute::VA_Position || attributes[i] == VertexAttribute::VA_PackedPosition)
+			{
+				positionOffset = stride;
+				packedPosition = attributes[i] == VertexAttribute::VA_PackedPosition;
+			}
+			stride += VertexAttributeToSize(attributes[i]) / sizeof(float);
+		}
+
+		if (positionOffset < 0 || primitive->indices.empty() || primitive->vertices.empty()) {
+			return false;
+		}
+
+		Vector3 scale;
+		Vector3 bias;
+		mesh->GetPositionDequantize(scale, bias);
+
+		uint32 vertexCount = primitive->vertices.size() / stride;
+		outPositions.resize(vertexCount);
+		for (uint32 v = 0; v < vertexCount; ++v)
+		{
+			const float* data = primitive->vertices.data() + v * stride + positionOffset;
+			if (packedPosition)
+			{
+				const uint16* quantized = (const uint16*)data;
+				outPositions[v] = Vector3(quantized[0], quantized[1], quantized[2]) * (1.0f / 65535.0f) * scale + bias;
+			}
+			else
+			{
+				outPositions[v] = Vector3(data[0], data[1], data[2]);
+			}
+		}
+
+		return true;
+	}
+
+	DVKIndexBuffer* DVKModel::CreateIndexBuffer(DVKPrimitive* primitive)
+	{
+		if (primitive->lodIndices.empty()) {
+			return DVKIndexBuffer::Create(device, cmdBuffer, primitive->indices, primitive->vertexCount);
+		}
+
+		std::vector<uint32> allIndices;
+		allIndices.reserve(primitive->indices.size() + primitive->lodIndices.size());
+		allIndices.insert(allIndices.end(), primitive->indices.begin(), primitive->indices.end());
+		allIndices.insert(allIndices.end(), primitive->lodIndices.begin(), primitive->lodIndices.end());
+
+		DVKIndexBuffer* indexBuffer = DVKIndexBuffer::Create(device, cmdBuffer, allIndices, primitive->vertexCount);
+		indexBuffer->indexCount = primitive->indices.size();
+		return indexBuffer;
+	}
+
+	void DVKModel::BuildMeshlets(uint32 maxVertices, uint32 maxTriangles)
+	{
+		std::vector<Vector3> positions;
+		for (int32 i = 0; i < meshes.size(); ++i)
+		{
+			DVKMesh* mesh = meshes[i];
+			for (int32 j = 0; j < mesh->primitives.size(); ++j)
+			{
+				DVKPrimitive* primitive = mesh->primitives[j];
+				if (!GetPrimitivePositions(attributes, mesh, primitive, positions)) {
+					continue;
+				}
+
+				DVKMeshletBuilder::Build(primitive->indices, positions, primitive->meshlets, maxVertices, maxTriangles);
+
+				// 三角形被重排了，已经上传的IndexBuffer需要重建
+				if (primitive->indexBuffer && cmdBuffer)
+				{
+					delete primitive->indexBuffer;
+					primitive->indexBuffer = CreateIndexBuffer(primitive);
+				}
+			}
+		}
+	}
+
+	void DVKModel::BuildTriangleBVHs(int32 maxLeafTriangles)
+	{
+		std::vector<Vector3> positions;
+		for (int32 i = 0; i < meshes.size(); ++i)
+		{
+			DVKMesh* mesh = meshes[i];
+			for (int32 j = 0; j < mesh->primitives.size(); ++j)
+			{
+				DVKPrimitive* primitive = mesh->primitives[j];
+				// 从烘焙文件加载的BVH不再重复构建
+				if (!primitive->triangleBVH.IsEmpty()) {
+					continue;
+				}
+				if (!GetPrimitivePositions(attributes, mesh, primitive, positions)) {
+					continue;
+				}
+				primitive->triangleBVH.Build(positions, primitive->indices, maxLeafTriangles);
+			}
+		}
+	}
+
+	bool DVKModel::GetPositions(const DVKMesh* mesh, const DVKPrimitive* primitive, std::vector<Vector3>& outPositions) const
+	{
+		return GetPrimitivePositions(attributes, mesh, primitive, outPositions);
+	}
+
+	void DVKModel::BuildLods(int32 maxLods, float reduction, float maxError, bool lockSeams)
+	{
+		std::vector<Vector3> positions;
+		std::vector<uint32>  lodIndices;
+		for (int32 i = 0; i < meshes.size(); ++i)
+		{
+			DVKMesh* mesh = meshes[i];
+			float errorLimit = (mesh->bounding.max - mesh->bounding.min).Size() * maxError;
+
+			for (int32 j = 0; j < mesh->primitives.size(); ++j)
+			{
+				DVKPrimitive* primitive = mesh->primitives[j];
+				if (!GetPrimitivePositions(attributes, mesh, primitive, positions)) {
+					continue;
+				}
+
+				primitive->lods.clear();
+				primitive->lodIndices.clear();
+
+				DVKLod lod;
+				lod.indexCount = primitive->indices.size();
+				primitive->lods.push_back(lod);
+
+				// 每一级从上一级简化，误差累加作为这一级相对原始模型的误差上界
+				const std::vector<uint32>* source = &(primitive->indices);
+				for (int32 level = 1; level < maxLods; ++level)
+				{
+					const DVKLod& prev = primitive->lods.back();
+					uint32 target = (uint32)(prev.indexCount / 3 * reduction) * 3;
+					float  error  = DVKMeshSimplifier::Simplify(*source, positions, target, MMath::Max(errorLimit - prev.error, 0.0f), lodIndices, lockSeams);
+
+					// 减少不到10%说明已经简化不动了
+					if (lodIndices.size() == 0 || lodIndices.size() > prev.indexCount * 0.9f) {
+						break;
+					}
+
+					lod.firstIndex = primitive->indices.size() + primitive->lodIndices.size();
+					lod.indexCount = lodIndices.size();
+					lod.error      = prev.error + error;
+					primitive->lods.push_back(lod);
+					primitive->lodIndices.insert(primitive->lodIndices.end(), lodIndices.begin(), lodIndices.end());
+
+					source = &lodIndices;
+				}
+
+				MLOG("BuildLods: %d levels, %d -> %d triangles, error %f.", (int32)primitive->lods.size(), (int32)primitive->lods.front().indexCount / 3, (int32)primitive->lods.back().indexCount / 3, primitive->lods.back().error);
+
+				if (primitive->indexBuffer && cmdBuffer)
+				{
+					delete primitive->indexBuffer;
+					primitive->indexBuffer = CreateIndexBuffer(primitive);
+				}
+			}
+		}
+	}
+
+	void DVKModel::Upload(DVKCommandBuffer* inCmdBuffer)
+	{
+		cmdBuffer = inCmdBuffer;
+
+		bool batching = !cmdBuffer->IsBatching();
+		if (batching) {
+			cmdBuffer->BeginBatch();
+		}
+
+		for (int32 i = 0; i < meshes.size(); ++i)
+		{
+			for (int32 j = 0; j < meshes[i]->primitives.size(); ++j)
+			{
+				DVKPrimitive* primitive = meshes[i]->primitives[j];
+				if (primitive->vertexBuffer == nullptr && primitive->vertices.size() > 0) {
+					primitive->vertexBuffer = DVKVertexBuffer::Create(device, cmdBuffer, primitive->vertices, attributes);
+				}
+				if (primitive->indexBuffer == nullptr && primitive->indices.size() > 0) {
+					primitive->indexBuffer = CreateIndexBuffer(primitive);
+				}
+			}
+		}
+
+		if (batching) {
+			cmdBuffer->FlushBatch();
+		}
+	}
+
 	DVKModel* DVKModel::LoadFromFile(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<VertexAttribute>& attributes)
+	{
+		std::string cookedFilename = GetCookedFilename(filename, attributes);
+		if (FileManager::FileExists(cookedFilename))
+		{
+			// 保留CPU端数据，与Assimp加载的行为保持一致
+			DVKModel* model = LoadFromCooked(cookedFilename, vulkanDevice, cmdBuffer, attributes, true);
+			if (model->rootNode) {
+				return model;
+			}
+			delete model;
+		}
+
+		return LoadFromAssimp(filename, vulkanDevice, cmdBuffer, attributes);
+	}
+
+	DVKModel* DVKModel::LoadFromAssimp(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<VertexAttribute>& attributes)
     {
         DVKModel* model   = new DVKModel();
         model->device     = vulkanDevice;
@@ -125,19 +347,19 @@ namespace vk_demo
         int assimpFlags = aiProcess_Triangulate | aiProcess_FlipUVs;
 		
         for (int32 i = 0; i < attributes.size(); ++i) {
-            if (attributes[i] == VertexAttribute::VA_Tangent) {
+            if (attributes[i] == VertexAttribute::VA_Tangent || attributes[i] == VertexAttribute::VA_PackedTangent) {
                 assimpFlags = assimpFlags | aiProcess_CalcTangentSpace;
             }
-            else if (attributes[i] == VertexAttribute::VA_UV0) {
+            else if (attributes[i] == VertexAttribute::VA_UV0 || attributes[i] == VertexAttribute::VA_PackedUV0) {
                 assimpFlags = assimpFlags | aiProcess_GenUVCoords;
             }
-            else if (attributes[i] == VertexAttribute::VA_Normal) {
+            else if (attributes[i] == VertexAttribute::VA_Normal || attributes[i] == VertexAttribute::VA_PackedNormal) {
                 assimpFlags = assimpFlags | aiProcess_GenSmoothNormals;
             }
-            else if (attributes[i] == VertexAttribute::VA_SkinIndex) {
+            else if (attributes[i] == VertexAttribute::VA_SkinIndex || attributes[i] == VertexAttribute::VA_PackedSkinIndex) {
                 model->loadSkin = true;
             }
-            else if (attributes[i] == VertexAttribute::VA_SkinWeight) {
+            else if (attributes[i] == VertexAttribute::VA_SkinWeight || attributes[i] == VertexAttribute::VA_PackedSkinWeight) {
                 model->loadSkin = true;
             }
 			else if (attributes[i] == VertexAttribute::VA_SkinPack) {
@@ -154,9 +376,20 @@ namespace vk_demo
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFileFromMemory(dataPtr, dataSize, assimpFlags);
         
+		// 所有Primitive的上传合并为一个批次，只提交一次、等待一次
+		bool batching = cmdBuffer && !cmdBuffer->IsBatching();
+		if (batching) {
+			cmdBuffer->BeginBatch();
+		}
+
 		model->LoadBones(scene);
 		model->LoadNode(scene->mRootNode, scene);
         model->LoadAnim(scene);
+		model->BuildTransforms();
+
+		if (batching) {
+			cmdBuffer->FlushBatch();
+		}
 
 		delete[] dataPtr;
         
@@ -258,6 +491,25 @@ namespace vk_demo
 			MMath::RandRange(0.0f, 1.0f), 
 			MMath::RandRange(0.0f, 1.0f)
 		);
+
+		// 压缩的位置按包围盒量化，需要预先算出包围盒
+		for (int32 j = 0; j < attributes.size(); ++j)
+		{
+			if (attributes[j] != VertexAttribute::VA_PackedPosition) {
+				continue;
+			}
+
+			for (int32 i = 0; i < aiMesh->mNumVertices; ++i)
+			{
+				mmin.x = MMath::Min(aiMesh->mVertices[i].x, mmin.x);
+				mmin.y = MMath::Min(aiMesh->mVertices[i].y, mmin.y);
+				mmin.z = MMath::Min(aiMesh->mVertices[i].z, mmin.z);
+				mmax.x = MMath::Max(aiMesh->mVertices[i].x, mmax.x);
+				mmax.y = MMath::Max(aiMesh->mVertices[i].y, mmax.y);
+				mmax.z = MMath::Max(aiMesh->mVertices[i].z, mmax.z);
+			}
+			break;
+		}
         
         for (int32 i = 0; i < aiMesh->mNumVertices; ++i)
         {
@@ -411,6 +663,62 @@ namespace vk_demo
                     vertices.push_back(0.0f);
                     vertices.push_back(0.0f);
                 }
+				else if (IsPackedVertexAttribute(attributes[j]))
+				{
+					float values[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+					if (attributes[j] == VertexAttribute::VA_PackedPosition)
+					{
+						values[0] = aiMesh->mVertices[i].x;
+						values[1] = aiMesh->mVertices[i].y;
+						values[2] = aiMesh->mVertices[i].z;
+					}
+					else if (attributes[j] == VertexAttribute::VA_PackedUV0 || attributes[j] == VertexAttribute::VA_PackedUV1)
+					{
+						int32 channel = attributes[j] == VertexAttribute::VA_PackedUV0 ? 0 : 1;
+						if (aiMesh->HasTextureCoords(channel))
+						{
+							values[0] = aiMesh->mTextureCoords[channel][i].x;
+							values[1] = aiMesh->mTextureCoords[channel][i].y;
+						}
+					}
+					else if (attributes[j] == VertexAttribute::VA_PackedNormal)
+					{
+						values[0] = aiMesh->mNormals[i].x;
+						values[1] = aiMesh->mNormals[i].y;
+						values[2] = aiMesh->mNormals[i].z;
+					}
+					else if (attributes[j] == VertexAttribute::VA_PackedTangent)
+					{
+						values[0] = aiMesh->mTangents[i].x;
+						values[1] = aiMesh->mTangents[i].y;
+						values[2] = aiMesh->mTangents[i].z;
+						values[3] = 1.0f;
+					}
+					else if (attributes[j] == VertexAttribute::VA_PackedSkinWeight)
+					{
+						values[0] = 1.0f;
+						if (mesh->isSkin)
+						{
+							DVKVertexSkin& skin = skinInfoMap[i];
+							for (int32 k = 0; k < 4; ++k) {
+								values[k] = skin.weights[k];
+							}
+						}
+					}
+					else if (attributes[j] == VertexAttribute::VA_PackedSkinIndex)
+					{
+						if (mesh->isSkin)
+						{
+							DVKVertexSkin& skin = skinInfoMap[i];
+							for (int32 k = 0; k < 4; ++k) {
+								values[k] = skin.indices[k];
+							}
+						}
+					}
+
+					PackVertexAttribute(attributes[j], values, mmin, mmax, vertices);
+				}
             }
         }
     }
@@ -429,66 +737,66 @@ namespace vk_demo
     {
         int32 stride = vertices.size() / aiMesh->mNumVertices;
 
-        if (indices.size() > 65535)
+		// 重排三角形和顶点，优化之后未被引用的顶点会被丢弃
+		int32 positionOffset = -1;
+		int32 attributeOffset = 0;
+		for (int32 i = 0; i < attributes.size(); ++i)
+		{
+			if (attributes[i] == VertexAttribute::VA_Position) {
+				positionOffset = attributeOffset;
+			}
+			attributeOffset += VertexAttributeToSize(attributes[i]) / sizeof(float);
+		}
+		DVKMeshOptimizer::Optimize(vertices, indices, stride, positionOffset);
+
+		uint32 vertexCount = vertices.size() / stride;
+
+		// 使用32位索引之后绝大多数Mesh只需要一个Primitive，只有超过设备的索引上限时才拆分
+		uint64 maxVertices = MAX_uint32;
+		if (device) {
+			maxVertices = (uint64)device->GetLimits().maxDrawIndexedIndexValue + 1;
+		}
+
+        if (vertexCount <= maxVertices)
+        {
+            DVKPrimitive* primitive = new DVKPrimitive();
+            primitive->vertices.swap(vertices);
+            primitive->indices.swap(indices);
+            mesh->primitives.push_back(primitive);
+        }
+        else
         {
-            std::unordered_map<uint32, uint32> indicesMap;
+			// 按三角形拆分，remap表按顶点数线性分配，拆分时只重置用到的部分
+            std::vector<uint32> remap(vertexCount, MAX_uint32);
+            std::vector<uint32> touched;
             DVKPrimitive* primitive = nullptr;
             
-            for (int32 i = 0; i < indices.size(); ++i) {
-                uint32 idx = indices[i];
-                if (primitive == nullptr) 
-				{
+            for (int32 i = 0; i + 2 < indices.size(); i += 3)
+            {
+                if (primitive == nullptr || primitive->vertices.size() / stride + 3 > maxVertices)
+                {
+                    for (int32 j = 0; j < touched.size(); ++j) {
+                        remap[touched[j]] = MAX_uint32;
+                    }
+                    touched.clear();
+
                     primitive = new DVKPrimitive();
-                    indicesMap.clear();
                     mesh->primitives.push_back(primitive);
                 }
-                
-                uint32 newIdx = 0;
-                auto it = indicesMap.find(idx);
-                if (it == indicesMap.end())
-                {
-                    uint32 start = idx * stride;
-                    newIdx = primitive->vertices.size() / stride;
-                    primitive->vertices.insert(primitive->vertices.end(), vertices.begin() + start, vertices.begin() + start + stride);
-                    indicesMap.insert(std::make_pair(idx, newIdx));
-                }
-                else
-                {
-                    newIdx = it->second;
-                }
-                
-                primitive->indices.push_back(newIdx);
-                
-                if (primitive->indices.size() == 65535) {
-                    primitive = nullptr;
-                }
-            }
-            
-            if (cmdBuffer)
-            {
-                for (int32 i = 0; i < mesh->primitives.size(); ++i)
+
+                for (int32 j = 0; j < 3; ++j)
                 {
-                    primitive = mesh->primitives[i];
-                    primitive->vertexBuffer = DVKVertexBuffer::Create(device, cmdBuffer, primitive->vertices, attributes);
-                    primitive->indexBuffer  = DVKIndexBuffer::Create(device, cmdBuffer, primitive->indices);
+                    uint32 idx = indices[i + j];
+                    if (remap[idx] == MAX_uint32)
+                    {
+                        remap[idx] = primitive->vertices.size() / stride;
+                        touched.push_back(idx);
+                        primitive->vertices.insert(primitive->vertices.end(), vertices.begin() + idx * stride, vertices.begin() + (idx + 1) * stride);
+                    }
+                    primitive->indices.push_back(remap[idx]);
                 }
             }
         }
-        else
-        {
-            DVKPrimitive* primitive = new DVKPrimitive();
-            primitive->vertices = vertices;
-            for (uint16 i = 0; i < indices.size(); ++i) {
-                primitive->indices.push_back(indices[i]);
-            }
-            mesh->primitives.push_back(primitive);
-            
-            if (cmdBuffer)
-            {
-                primitive->vertexBuffer = DVKVertexBuffer::Create(device, cmdBuffer, primitive->vertices, attributes);
-                primitive->indexBuffer  = DVKIndexBuffer::Create(device, cmdBuffer, primitive->indices);
-            }
-        }
         
         for (int32 i = 0; i < mesh->primitives.size(); ++i)
         {
@@ -498,6 +806,12 @@ namespace vk_demo
             
             mesh->vertexCount   += primitive->vertexCount;
             mesh->triangleCount += primitive->triangleNum;
+
+            if (cmdBuffer)
+            {
+                primitive->vertexBuffer = DVKVertexBuffer::Create(device, cmdBuffer, primitive->vertices, attributes);
+                primitive->indexBuffer  = DVKIndexBuffer::Create(device, cmdBuffer, primitive->indices, primitive->vertexCount);
+            }
         }
     }
     
@@ -601,6 +915,7 @@ namespace vk_demo
 
 			animations.push_back(DVKAnimation());
 			DVKAnimation& dvkAnimation = animations.back();
+			dvkAnimation.name = aianimation->mName.C_Str();
             
 			for (int32 j = 0; j < aianimation->mNumChannels; ++j)
             {
@@ -645,6 +960,13 @@ namespace vk_demo
         }
     }
 
+	// 单个模型播放时使用通道自带的游标
+	template<class ClipType>
+	static void SampleClip(ClipType& clip, float time, Vector3& outPosition, Quat& outRotation, Vector3& outScale)
+	{
+		SampleAnimationClip(clip, time, clip.positions.cursor, clip.rotations.cursor, clip.scales.cursor, outPosition, outRotation, outScale);
+	}
+
 	void DVKModel::GotoAnimation(float time)
 	{
 		if (animIndex == -1) {
@@ -655,115 +977,1250 @@ namespace vk_demo
         animation.time = MMath::Clamp(time, 0.0f, animation.duration);
         
 		// update nodes animation
-		for (auto it = animation.clips.begin(); it != animation.clips.end(); ++it)
+		bool compressed = animation.compressedClips.size() > 0;
+		for (int32 i = 0; i < animation.boundClips.size(); ++i)
 		{
-			vk_demo::DVKAnimationClip& clip = it->second;
-			vk_demo::DVKNode* node = nodesMap[clip.nodeName];
-            
-			float alpha = 0.0f;
-            
-			// rotation
-			Quat prevRot(0, 0, 0, 1);
-			Quat nextRot(0, 0, 0, 1);
-			clip.rotations.GetValue(animation.time, prevRot, nextRot, alpha);
-			Quat retRot = MMath::Lerp(prevRot, nextRot, alpha);
-            
-			// position
-			Vector3 prevPos(0, 0, 0);
-			Vector3 nextPos(0, 0, 0);
-			clip.positions.GetValue(animation.time, prevPos, nextPos, alpha);
-			Vector3 retPos = MMath::Lerp(prevPos, nextPos, alpha);
-            
-			// scale
-			Vector3 prevScale(1, 1, 1);
-			Vector3 nextScale(1, 1, 1);
-			clip.scales.GetValue(animation.time, prevScale, nextScale, alpha);
-			Vector3 retScale = MMath::Lerp(prevScale, nextScale, alpha);
+			vk_demo::DVKNode* node = linearNodes[animation.boundClips[i]->nodeIndex];
+
+			Vector3 retPos;
+			Vector3 retScale;
+			Quat    retRot;
+			if (compressed) {
+				SampleClip(animation.compressedClips[i], animation.time, retPos, retRot, retScale);
+			}
+			else {
+				SampleClip(*animation.boundClips[i], animation.time, retPos, retRot, retScale);
+			}
             
 			node->localMatrix.SetIdentity();
 			node->localMatrix.AppendScale(retScale);
 			node->localMatrix.Append(retRot.ToMatrix());
 			node->localMatrix.AppendTranslation(retPos);
+			node->MarkDirty();
 		}
 
 		// update bones
 		for (int32 i = 0; i < bones.size(); ++i)
 		{
 			DVKBone* bone = bones[i];
-			DVKNode* node = nodesMap[bone->name];
+			if (bone->nodeIndex < 0) {
+				continue;
+			}
+			DVKNode* node = linearNodes[bone->nodeIndex];
 			// 注意行列矩阵的区别
 			bone->finalTransform = bone->inverseBindPose;
 			bone->finalTransform.Append(node->GetGlobalMatrix());
 		}
 	}
-    
-	void DVKModel::Update(float time, float delta)
+
+	void DVKModel::BindAnimations()
 	{
-		if (animIndex == -1) {
-			return;
+		// 与nodesMap一致，重名时取第一个节点
+		std::unordered_map<std::string, int32> nodeIndices;
+		for (int32 i = 0; i < linearNodes.size(); ++i) {
+			nodeIndices.insert(std::make_pair(linearNodes[i]->name, i));
 		}
-        
-		DVKAnimation& animation = animations[animIndex];
-		animation.time += delta * animation.speed;
 
-		if (animation.time >= animation.duration) {
-			animation.time = animation.time - animation.duration;
+		for (int32 i = 0; i < bones.size(); ++i)
+		{
+			auto it = nodeIndices.find(bones[i]->name);
+			bones[i]->nodeIndex = it != nodeIndices.end() ? it->second : -1;
+		}
+
+		for (int32 i = 0; i < animations.size(); ++i)
+		{
+			DVKAnimation& animation = animations[i];
+			animation.boundClips.clear();
+
+			for (auto it = animation.clips.begin(); it != animation.clips.end(); ++it)
+			{
+				DVKAnimationClip& clip = it->second;
+				auto nodeIt = nodeIndices.find(clip.nodeName);
+				clip.nodeIndex = nodeIt != nodeIndices.end() ? nodeIt->second : -1;
+				if (clip.nodeIndex >= 0) {
+					animation.boundClips.push_back(&clip);
+				}
+			}
+
+			// linearNodes中父节点在前，按节点顺序写入层级
+			std::sort(animation.boundClips.begin(), animation.boundClips.end(), [](const DVKAnimationClip* a, const DVKAnimationClip* b) {
+				return a->nodeIndex < b->nodeIndex;
+			});
 		}
-        
-		GotoAnimation(animation.time);
 	}
 
-	void DVKModel::SetAnimation(int32 index)
+	void DVKAnimationPose::Resize(int32 inClipCount, int32 inInstanceCount)
 	{
-		if (index >= animations.size()) {
+		if (clipCount == inClipCount && instanceCount == inInstanceCount) {
 			return;
 		}
-		if (index < 0) {
-			return;
+
+		clipCount     = inClipCount;
+		instanceCount = inInstanceCount;
+
+		int32 size = clipCount * instanceCount;
+		for (int32 i = 0; i < 3; ++i) {
+			positions[i].resize(size);
+			scales[i].resize(size);
 		}
-		animIndex = index;
+		for (int32 i = 0; i < 4; ++i) {
+			rotations[i].resize(size);
+		}
+
+		cursors.assign(size * 3, 0);
+		frames.resize(instanceCount);
+		alphas.resize(instanceCount);
 	}
 
-	DVKAnimation& DVKModel::GetAnimation(int32 index)
+	void DVKAnimationPose::GetLocalMatrix(int32 clip, int32 instance, Matrix4x4& outMatrix) const
 	{
-		if (index == -1) {
-			index = animIndex;
-		}
-		return animations[index];
+		int32 index = clip * instanceCount + instance;
+		Quat rotation(rotations[0][index], rotations[1][index], rotations[2][index], rotations[3][index]);
+
+		outMatrix.SetIdentity();
+		outMatrix.AppendScale(Vector3(scales[0][index], scales[1][index], scales[2][index]));
+		outMatrix.Append(rotation.ToMatrix());
+		outMatrix.AppendTranslation(Vector3(positions[0][index], positions[1][index], positions[2][index]));
 	}
 
-	VkVertexInputBindingDescription DVKModel::GetInputBinding()
+	// 求出每个实例所在的帧和插值系数，超出范围时取两端的帧。通道至少需要两个关键帧。
+	template<class ValueType>
+	static void SampleFrames(const DVKAnimChannel<ValueType>& channel, const float* times, int32 count, int32* cursors, int32* outFrames, float* outAlphas)
 	{
-		int32 stride = 0;
-		for (int32 i = 0; i < attributes.size(); ++i) {
-			stride += VertexAttributeToSize(attributes[i]);
-		}
-
-		VkVertexInputBindingDescription vertexInputBinding = {};
-		vertexInputBinding.binding   = 0;
-		vertexInputBinding.stride    = stride;
-		vertexInputBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		const float* keys = channel.keys.data();
+		int32 last     = channel.keys.size() - 2;
+		float firstKey = keys[0];
+		float lastKey  = keys[last + 1];
 
-		return vertexInputBinding;
+		for (int32 i = 0; i < count; ++i)
+		{
+			float time = times[i];
+			if (time <= firstKey)
+			{
+				outFrames[i] = 0;
+				outAlphas[i] = 0.0f;
+			}
+			else if (time >= lastKey)
+			{
+				outFrames[i] = last;
+				outAlphas[i] = 1.0f;
+			}
+			else
+			{
+				int32 frame  = channel.FindFrame(time, cursors[i]);
+				outFrames[i] = frame;
+				outAlphas[i] = (time - keys[frame]) / (keys[frame + 1] - keys[frame]);
+			}
+		}
 	}
 
-	std::vector<VkVertexInputAttributeDescription> DVKModel::GetInputAttributes()
+	static void SampleChannel(const DVKAnimChannel<Vector3>& channel, const Vector3& defaultValue, const float* times, int32 count, int32* cursors, DVKAnimationPose& pose, std::vector<float>* outValues, int32 offset)
 	{
-		std::vector<VkVertexInputAttributeDescription> vertexInputAttributs;
-		int32 offset = 0;
+		float* outX = outValues[0].data() + offset;
+		float* outY = outValues[1].data() + offset;
+		float* outZ = outValues[2].data() + offset;
 
-		for (int32 i = 0; i < attributes.size(); ++i)
+		if (channel.keys.size() < 2)
 		{
-			VkVertexInputAttributeDescription inputAttribute = {};
-			inputAttribute.binding  = 0;
-			inputAttribute.location = i;
-			inputAttribute.format   = VertexAttributeToVkFormat(attributes[i]);
-			inputAttribute.offset   = offset;
-			offset += VertexAttributeToSize(attributes[i]);
-			vertexInputAttributs.push_back(inputAttribute);
+			Vector3 value = channel.keys.size() == 1 ? channel.values[0] : defaultValue;
+			std::fill(outX, outX + count, value.x);
+			std::fill(outY, outY + count, value.y);
+			std::fill(outZ, outZ + count, value.z);
+			return;
+		}
+
+		int32* frames = pose.frames.data();
+		float* alphas = pose.alphas.data();
+		SampleFrames(channel, times, count, cursors, frames, alphas);
+
+		// 查找与插值分开，插值部分没有分支，4个实例一组用SIMD计算
+		const Vector3* values = channel.values.data();
+		int32 i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const Vector3& a0 = values[frames[i + 0]];
+			const Vector3& a1 = values[frames[i + 1]];
+			const Vector3& a2 = values[frames[i + 2]];
+			const Vector3& a3 = values[frames[i + 3]];
+			const Vector3& b0 = values[frames[i + 0] + 1];
+			const Vector3& b1 = values[frames[i + 1] + 1];
+			const Vector3& b2 = values[frames[i + 2] + 1];
+			const Vector3& b3 = values[frames[i + 3] + 1];
+
+			VectorRegister alpha = VectorLoad(alphas + i);
+			VectorRegister ax = VectorSet(a0.x, a1.x, a2.x, a3.x);
+			VectorRegister ay = VectorSet(a0.y, a1.y, a2.y, a3.y);
+			VectorRegister az = VectorSet(a0.z, a1.z, a2.z, a3.z);
+			VectorRegister bx = VectorSet(b0.x, b1.x, b2.x, b3.x);
+			VectorRegister by = VectorSet(b0.y, b1.y, b2.y, b3.y);
+			VectorRegister bz = VectorSet(b0.z, b1.z, b2.z, b3.z);
+
+			VectorStore(VectorMultiplyAdd(VectorSubtract(bx, ax), alpha, ax), outX + i);
+			VectorStore(VectorMultiplyAdd(VectorSubtract(by, ay), alpha, ay), outY + i);
+			VectorStore(VectorMultiplyAdd(VectorSubtract(bz, az), alpha, az), outZ + i);
+		}
+
+		for (; i < count; ++i)
+		{
+			const Vector3& a = values[frames[i] + 0];
+			const Vector3& b = values[frames[i] + 1];
+			float alpha = alphas[i];
+			outX[i] = a.x + (b.x - a.x) * alpha;
+			outY[i] = a.y + (b.y - a.y) * alpha;
+			outZ[i] = a.z + (b.z - a.z) * alpha;
+		}
+	}
+
+	static void SampleChannel(const DVKAnimChannel<Quat>& channel, const Quat& defaultValue, const float* times, int32 count, int32* cursors, DVKAnimationPose& pose, std::vector<float>* outValues, int32 offset)
+	{
+		float* outX = outValues[0].data() + offset;
+		float* outY = outValues[1].data() + offset;
+		float* outZ = outValues[2].data() + offset;
+		float* outW = outValues[3].data() + offset;
+
+		if (channel.keys.size() < 2)
+		{
+			Quat value = channel.keys.size() == 1 ? channel.values[0].GetNormalized() : defaultValue;
+			std::fill(outX, outX + count, value.x);
+			std::fill(outY, outY + count, value.y);
+			std::fill(outZ, outZ + count, value.z);
+			std::fill(outW, outW + count, value.w);
+			return;
+		}
+
+		int32* frames = pose.frames.data();
+		float* alphas = pose.alphas.data();
+		SampleFrames(channel, times, count, cursors, frames, alphas);
+
+		// 与GotoAnimation一致，沿最短路径线性插值之后归一化(Quat::FastLerp)，4个实例一组用SIMD计算
+		const Quat* values = channel.values.data();
+		VectorRegister one      = VectorSetFloat1(1.0f);
+		VectorRegister minusOne = VectorSetFloat1(-1.0f);
+		int32 i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			// Quat是连续的4个float，载入后转置成x、y、z、w四组
+			VectorRegister ax = VectorLoad(&values[frames[i + 0]].x);
+			VectorRegister ay = VectorLoad(&values[frames[i + 1]].x);
+			VectorRegister az = VectorLoad(&values[frames[i + 2]].x);
+			VectorRegister aw = VectorLoad(&values[frames[i + 3]].x);
+			VectorRegister bx = VectorLoad(&values[frames[i + 0] + 1].x);
+			VectorRegister by = VectorLoad(&values[frames[i + 1] + 1].x);
+			VectorRegister bz = VectorLoad(&values[frames[i + 2] + 1].x);
+			VectorRegister bw = VectorLoad(&values[frames[i + 3] + 1].x);
+			VectorTranspose4(ax, ay, az, aw);
+			VectorTranspose4(bx, by, bz, bw);
+
+			VectorRegister alpha = VectorLoad(alphas + i);
+			VectorRegister dot   = VectorMultiplyAdd(ax, bx, VectorMultiplyAdd(ay, by, VectorMultiplyAdd(az, bz, VectorMultiply(aw, bw))));
+			VectorRegister sign  = VectorSelect(VectorCompareGE(dot, VectorZero()), one, minusOne);
+			VectorRegister scale = VectorMultiply(sign, VectorSubtract(one, alpha));
+
+			VectorRegister x = VectorMultiplyAdd(ax, scale, VectorMultiply(bx, alpha));
+			VectorRegister y = VectorMultiplyAdd(ay, scale, VectorMultiply(by, alpha));
+			VectorRegister z = VectorMultiplyAdd(az, scale, VectorMultiply(bz, alpha));
+			VectorRegister w = VectorMultiplyAdd(aw, scale, VectorMultiply(bw, alpha));
+			VectorRegister invLength = VectorReciprocalSqrt(VectorMultiplyAdd(x, x, VectorMultiplyAdd(y, y, VectorMultiplyAdd(z, z, VectorMultiply(w, w)))));
+
+			VectorStore(VectorMultiply(x, invLength), outX + i);
+			VectorStore(VectorMultiply(y, invLength), outY + i);
+			VectorStore(VectorMultiply(z, invLength), outZ + i);
+			VectorStore(VectorMultiply(w, invLength), outW + i);
+		}
+
+		for (; i < count; ++i)
+		{
+			const Quat& a = values[frames[i] + 0];
+			const Quat& b = values[frames[i] + 1];
+			float alpha = alphas[i];
+			float dot   = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+			float scale = (dot >= 0.0f ? 1.0f : -1.0f) * (1.0f - alpha);
+			float x = a.x * scale + b.x * alpha;
+			float y = a.y * scale + b.y * alpha;
+			float z = a.z * scale + b.z * alpha;
+			float w = a.w * scale + b.w * alpha;
+			float invLength = MMath::InvSqrt(x * x + y * y + z * z + w * w);
+			outX[i] = x * invLength;
+			outY[i] = y * invLength;
+			outZ[i] = z * invLength;
+			outW[i] = w * invLength;
+		}
+	}
+
+	static void SampleCompressedClip(const DVKCompressedClip& clip, const float* times, int32 count, int32* cursors, DVKAnimationPose& pose, int32 offset)
+	{
+		for (int32 i = 0; i < count; ++i)
+		{
+			float alpha = 0.0f;
+			int32 index = offset + i;
+
+			Vector3 prevPos(0, 0, 0);
+			Vector3 nextPos(0, 0, 0);
+			clip.positions.GetValue(times[i], cursors[count * 0 + i], prevPos, nextPos, alpha);
+			Vector3 position = MMath::Lerp(prevPos, nextPos, alpha);
+			pose.positions[0][index] = position.x;
+			pose.positions[1][index] = position.y;
+			pose.positions[2][index] = position.z;
+
+			Vector3 prevScale(1, 1, 1);
+			Vector3 nextScale(1, 1, 1);
+			clip.scales.GetValue(times[i], cursors[count * 1 + i], prevScale, nextScale, alpha);
+			Vector3 scale = MMath::Lerp(prevScale, nextScale, alpha);
+			pose.scales[0][index] = scale.x;
+			pose.scales[1][index] = scale.y;
+			pose.scales[2][index] = scale.z;
+
+			Quat prevRot(0, 0, 0, 1);
+			Quat nextRot(0, 0, 0, 1);
+			clip.rotations.GetValue(times[i], cursors[count * 2 + i], prevRot, nextRot, alpha);
+			Quat rotation = Quat::FastLerp(prevRot, nextRot, alpha);
+			rotation.Normalize();
+			pose.rotations[0][index] = rotation.x;
+			pose.rotations[1][index] = rotation.y;
+			pose.rotations[2][index] = rotation.z;
+			pose.rotations[3][index] = rotation.w;
+		}
+	}
+
+	void DVKAnimation::Sample(const float* times, int32 count, DVKAnimationPose& outPose) const
+	{
+		outPose.Resize(boundClips.size(), count);
+
+		if (compressedClips.size() > 0)
+		{
+			for (int32 i = 0; i < compressedClips.size(); ++i) {
+				SampleCompressedClip(compressedClips[i], times, count, outPose.cursors.data() + i * 3 * count, outPose, i * count);
+			}
+			return;
+		}
+
+		// 一个通道的关键帧连续处理所有实例，关键帧数据一直留在缓存里
+		for (int32 i = 0; i < boundClips.size(); ++i)
+		{
+			const DVKAnimationClip& clip = *boundClips[i];
+			int32  offset  = i * count;
+			int32* cursors = outPose.cursors.data() + i * 3 * count;
+			SampleChannel(clip.positions, Vector3(0, 0, 0),  times, count, cursors + count * 0, outPose, outPose.positions, offset);
+			SampleChannel(clip.scales,    Vector3(1, 1, 1),  times, count, cursors + count * 1, outPose, outPose.scales,    offset);
+			SampleChannel(clip.rotations, Quat(0, 0, 0, 1),  times, count, cursors + count * 2, outPose, outPose.rotations, offset);
+		}
+	}
+    
+	void DVKModel::BuildTransforms()
+	{
+		transforms.Clear();
+		if (rootNode == nullptr) {
+			return;
+		}
+
+		// 先序遍历，保证父节点的序号总是小于子节点
+		std::vector<DVKNode*> stack;
+		stack.push_back(rootNode);
+		while (!stack.empty())
+		{
+			DVKNode* node = stack.back();
+			stack.pop_back();
+
+			int32 parentIndex = node->parent && node->parent->transforms ? node->parent->transformIndex : -1;
+			node->transforms     = &transforms;
+			node->transformIndex = transforms.Add(parentIndex, node->localMatrix);
+
+			for (int32 i = node->children.size() - 1; i >= 0; --i) {
+				stack.push_back(node->children[i]);
+			}
+		}
+
+		// 加载完成时层级就是干净的，其它线程只读GetGlobalMatrix不会触发更新
+		transforms.Update();
+
+		BindAnimations();
+	}
+    
+	void DVKMesh::GetWorldBounds(Vector3& outMin, Vector3& outMax)
+	{
+		const Matrix4x4& matrix = linkNode->GetGlobalMatrix();
+
+		Vector3 center = matrix.TransformPosition((bounding.min + bounding.max) * 0.5f);
+		Vector3 extent = (bounding.max - bounding.min) * 0.5f;
+
+		// 半长在世界空间各轴上的投影
+		Vector3 worldExtent;
+		for (int32 i = 0; i < 3; ++i) {
+			worldExtent[i] = MMath::Abs(matrix.m[0][i]) * extent.x + MMath::Abs(matrix.m[1][i]) * extent.y + MMath::Abs(matrix.m[2][i]) * extent.z;
+		}
+
+		outMin = center - worldExtent;
+		outMax = center + worldExtent;
+	}
+
+	void DVKModel::BuildSceneIndex(float margin)
+	{
+		sceneIndex = DVKSceneBVH(margin);
+
+		for (int32 i = 0; i < meshes.size(); ++i)
+		{
+			Vector3 boundsMin;
+			Vector3 boundsMax;
+			meshes[i]->GetWorldBounds(boundsMin, boundsMax);
+			meshes[i]->sceneProxy = sceneIndex.Insert(boundsMin, boundsMax, i);
+		}
+	}
+
+	int32 DVKModel::UpdateSceneIndex()
+	{
+		int32 count = 0;
+		for (int32 i = 0; i < meshes.size(); ++i)
+		{
+			Vector3 boundsMin;
+			Vector3 boundsMax;
+			meshes[i]->GetWorldBounds(boundsMin, boundsMax);
+			if (sceneIndex.Update(meshes[i]->sceneProxy, boundsMin, boundsMax)) {
+				count += 1;
+			}
+		}
+		return count;
+	}
+
+	template<class ValueType>
+	static uint32 GetRawChannelSize(const DVKAnimChannel<ValueType>& channel)
+	{
+		return channel.keys.size() * sizeof(float) + channel.values.size() * sizeof(ValueType);
+	}
+
+	template<class ValueType>
+	static void ReleaseChannel(DVKAnimChannel<ValueType>& channel)
+	{
+		std::vector<float>().swap(channel.keys);
+		std::vector<ValueType>().swap(channel.values);
+		channel.cursor = 0;
+	}
+
+	std::vector<DVKAnimCompressionStats> DVKModel::CompressAnimations(const DVKAnimCompressionSettings& settings, bool releaseSource)
+	{
+		std::vector<DVKAnimCompressionStats> results;
+
+		// 节点的父节点序号，linearNodes中父节点在前
+		std::unordered_map<DVKNode*, int32> nodeIndices;
+		std::vector<int32> parents(linearNodes.size(), -1);
+		for (int32 i = 0; i < linearNodes.size(); ++i)
+		{
+			nodeIndices.insert(std::make_pair(linearNodes[i], i));
+			auto it = nodeIndices.find(linearNodes[i]->parent);
+			parents[i] = it != nodeIndices.end() ? it->second : -1;
+		}
+
+		for (int32 i = 0; i < animations.size(); ++i)
+		{
+			DVKAnimation& animation = animations[i];
+			if (animation.compressedClips.size() > 0) {
+				continue;
+			}
+
+			DVKAnimCompressionStats stats;
+			stats.name = animation.name;
+
+			std::vector<DVKCompressedClip> compressedClips(animation.boundClips.size());
+			for (int32 j = 0; j < animation.boundClips.size(); ++j)
+			{
+				DVKAnimationClip&  clip       = *animation.boundClips[j];
+				DVKCompressedClip& compressed = compressedClips[j];
+				DVKAnimCompressor::Compress(clip.positions.keys, clip.positions.values, settings.positionTolerance, settings.sampleRate, compressed.positions);
+				DVKAnimCompressor::Compress(clip.scales.keys,    clip.scales.values,    settings.scaleTolerance,    settings.sampleRate, compressed.scales);
+				DVKAnimCompressor::Compress(clip.rotations.keys, clip.rotations.values, settings.rotationTolerance, settings.sampleRate, compressed.rotations);
+
+				stats.rawKeys        += clip.positions.keys.size() + clip.scales.keys.size() + clip.rotations.keys.size();
+				stats.compressedKeys += compressed.positions.GetKeyCount() + compressed.scales.GetKeyCount() + compressed.rotations.GetKeyCount();
+				stats.rawSize        += GetRawChannelSize(clip.positions) + GetRawChannelSize(clip.scales) + GetRawChannelSize(clip.rotations);
+				stats.compressedSize += compressed.positions.GetMemorySize() + compressed.scales.GetMemorySize() + compressed.rotations.GetMemorySize();
+			}
+
+			// 按120Hz采样，比较原始数据和压缩数据在模型空间中的差别。
+			// 每个节点取原点以及局部坐标轴上距离为errorDistance的三个点。
+			std::vector<Matrix4x4> rawLocals(linearNodes.size());
+			std::vector<Matrix4x4> compressedLocals(linearNodes.size());
+			std::vector<Matrix4x4> rawGlobals(linearNodes.size());
+			std::vector<Matrix4x4> compressedGlobals(linearNodes.size());
+			for (int32 j = 0; j < linearNodes.size(); ++j)
+			{
+				rawLocals[j]        = linearNodes[j]->localMatrix;
+				compressedLocals[j] = linearNodes[j]->localMatrix;
+			}
+
+			const Vector3 points[4] = {
+				Vector3(0, 0, 0),
+				Vector3(settings.errorDistance, 0, 0),
+				Vector3(0, settings.errorDistance, 0),
+				Vector3(0, 0, settings.errorDistance)
+			};
+
+			int32 sampleCount = MMath::Max(MMath::CeilToInt(animation.duration * 120.0f), 1);
+			for (int32 sample = 0; sample <= sampleCount; ++sample)
+			{
+				float time = animation.duration * sample / sampleCount;
+
+				for (int32 j = 0; j < animation.boundClips.size(); ++j)
+				{
+					int32 nodeIndex = animation.boundClips[j]->nodeIndex;
+					Vector3 position;
+					Vector3 scale;
+					Quat    rotation;
+
+					SampleClip(*animation.boundClips[j], time, position, rotation, scale);
+					rawLocals[nodeIndex].SetIdentity();
+					rawLocals[nodeIndex].AppendScale(scale);
+					rawLocals[nodeIndex].Append(rotation.ToMatrix());
+					rawLocals[nodeIndex].AppendTranslation(position);
+
+					SampleClip(compressedClips[j], time, position, rotation, scale);
+					compressedLocals[nodeIndex].SetIdentity();
+					compressedLocals[nodeIndex].AppendScale(scale);
+					compressedLocals[nodeIndex].Append(rotation.ToMatrix());
+					compressedLocals[nodeIndex].AppendTranslation(position);
+				}
+
+				for (int32 j = 0; j < linearNodes.size(); ++j)
+				{
+					rawGlobals[j]        = rawLocals[j];
+					compressedGlobals[j] = compressedLocals[j];
+					if (parents[j] >= 0)
+					{
+						rawGlobals[j].Append(rawGlobals[parents[j]]);
+						compressedGlobals[j].Append(compressedGlobals[parents[j]]);
+					}
+
+					for (int32 k = 0; k < 4; ++k)
+					{
+						float error = (rawGlobals[j].TransformPosition(points[k]) - compressedGlobals[j].TransformPosition(points[k])).Size();
+						if (error > stats.maxError)
+						{
+							stats.maxError     = error;
+							stats.maxErrorNode = linearNodes[j]->name;
+						}
+					}
+				}
+			}
+
+			if (releaseSource)
+			{
+				for (int32 j = 0; j < animation.boundClips.size(); ++j)
+				{
+					ReleaseChannel(animation.boundClips[j]->positions);
+					ReleaseChannel(animation.boundClips[j]->scales);
+					ReleaseChannel(animation.boundClips[j]->rotations);
+				}
+			}
+
+			animation.compressedClips.swap(compressedClips);
+
+			float ratio = stats.compressedSize > 0 ? (float)stats.rawSize / stats.compressedSize : 0.0f;
+			MLOG("CompressAnimations %s : keys %u -> %u, %u -> %u bytes (%.1f:1), max error %f at %s", stats.name.c_str(), stats.rawKeys, stats.compressedKeys, stats.rawSize, stats.compressedSize, ratio, stats.maxError, stats.maxErrorNode.c_str());
+
+			results.push_back(stats);
+		}
+
+		return results;
+	}
+    
+	void DVKModel::Update(float time, float delta)
+	{
+		if (animIndex == -1) {
+			return;
+		}
+        
+		DVKAnimation& animation = animations[animIndex];
+		animation.time += delta * animation.speed;
+
+		if (animation.time >= animation.duration) {
+			animation.time = animation.time - animation.duration;
+		}
+        
+		GotoAnimation(animation.time);
+	}
+
+	void DVKModel::SetAnimation(int32 index)
+	{
+		if (index >= animations.size()) {
+			return;
+		}
+		if (index < 0) {
+			return;
+		}
+		animIndex = index;
+	}
+
+	DVKAnimation& DVKModel::GetAnimation(int32 index)
+	{
+		if (index == -1) {
+			index = animIndex;
+		}
+		return animations[index];
+	}
+
+	VkVertexInputBindingDescription DVKModel::GetInputBinding()
+	{
+		int32 stride = 0;
+		for (int32 i = 0; i < attributes.size(); ++i) {
+			stride += VertexAttributeToSize(attributes[i]);
+		}
+
+		VkVertexInputBindingDescription vertexInputBinding = {};
+		vertexInputBinding.binding   = 0;
+		vertexInputBinding.stride    = stride;
+		vertexInputBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		return vertexInputBinding;
+	}
+
+	std::vector<VkVertexInputAttributeDescription> DVKModel::GetInputAttributes()
+	{
+		std::vector<VkVertexInputAttributeDescription> vertexInputAttributs;
+		int32 offset = 0;
+
+		for (int32 i = 0; i < attributes.size(); ++i)
+		{
+			VkVertexInputAttributeDescription inputAttribute = {};
+			inputAttribute.binding  = 0;
+			inputAttribute.location = i;
+			inputAttribute.format   = VertexAttributeToVkFormat(attributes[i]);
+			inputAttribute.offset   = offset;
+			offset += VertexAttributeToSize(attributes[i]);
+			vertexInputAttributs.push_back(inputAttribute);
 		}
 
 		return vertexInputAttributs;
 	}
 
+	// 烘焙文件：按顺序写入的小端二进制数据，顶点和索引按COOKED_ALIGNMENT对齐，可以直接从映射的内存拷贝
+	enum
+	{
+		COOKED_MAGIC     = 0x4D4B5644, // "DVKM"
+		COOKED_VERSION   = 5,
+		COOKED_ALIGNMENT = 16,
+	};
+
+	class DVKCookedWriter
+	{
+	public:
+		DVKCookedWriter(std::vector<uint8>& inBuffer)
+			: buffer(inBuffer)
+		{
+
+		}
+
+		template<typename T>
+		void Write(const T& value)
+		{
+			WriteBytes(&value, sizeof(T));
+		}
+
+		void WriteBytes(const void* data, uint64 size)
+		{
+			const uint8* bytes = (const uint8*)data;
+			buffer.insert(buffer.end(), bytes, bytes + size);
+		}
+
+		void WriteString(const std::string& str)
+		{
+			Write<uint32>(str.size());
+			WriteBytes(str.data(), str.size());
+		}
+
+		void WriteVector3(const Vector3& value)
+		{
+			Write<float>(value.x);
+			Write<float>(value.y);
+			Write<float>(value.z);
+		}
+
+		void WriteQuat(const Quat& value)
+		{
+			Write<float>(value.x);
+			Write<float>(value.y);
+			Write<float>(value.z);
+			Write<float>(value.w);
+		}
+
+		void WriteMatrix(const Matrix4x4& value)
+		{
+			WriteBytes(&(value.m[0][0]), sizeof(float) * 16);
+		}
+
+		void Pad(uint64 alignment)
+		{
+			buffer.resize(Align<uint64>(buffer.size(), alignment), 0);
+		}
+
+	private:
+		std::vector<uint8>& buffer;
+	};
+
+	class DVKCookedReader
+	{
+	public:
+		DVKCookedReader(const uint8* inData, uint64 inSize)
+			: data(inData)
+			, size(inSize)
+		{
+
+		}
+
+		template<typename T>
+		T Read()
+		{
+			T value = T();
+			ReadBytes(&value, sizeof(T));
+			return value;
+		}
+
+		void ReadBytes(void* outData, uint64 count)
+		{
+			if (!valid || position + count > size)
+			{
+				valid = false;
+				return;
+			}
+			memcpy(outData, data + position, count);
+			position += count;
+		}
+
+		std::string ReadString()
+		{
+			uint32 length = Read<uint32>();
+			if (!valid || position + length > size)
+			{
+				valid = false;
+				return std::string();
+			}
+			std::string str((const char*)(data + position), length);
+			position += length;
+			return str;
+		}
+
+		Vector3 ReadVector3()
+		{
+			Vector3 value;
+			value.x = Read<float>();
+			value.y = Read<float>();
+			value.z = Read<float>();
+			return value;
+		}
+
+		Quat ReadQuat()
+		{
+			Quat value;
+			value.x = Read<float>();
+			value.y = Read<float>();
+			value.z = Read<float>();
+			value.w = Read<float>();
+			return value;
+		}
+
+		void ReadMatrix(Matrix4x4& outValue)
+		{
+			ReadBytes(&(outValue.m[0][0]), sizeof(float) * 16);
+		}
+
+		// 返回指向映射内存的指针，不做拷贝
+		const uint8* ReadBlob(uint64 count, uint64 alignment)
+		{
+			uint64 start = Align<uint64>(position, alignment);
+			if (!valid || start + count > size)
+			{
+				valid = false;
+				return nullptr;
+			}
+			position = start + count;
+			return data + start;
+		}
+
+		inline bool IsValid() const
+		{
+			return valid;
+		}
+
+	private:
+		const uint8*	data = nullptr;
+		uint64			size = 0;
+		uint64			position = 0;
+		bool			valid = true;
+	};
+
+	static void WriteAnimChannel(DVKCookedWriter& writer, const DVKAnimChannel<Vector3>& channel)
+	{
+		writer.Write<uint32>(channel.keys.size());
+		writer.WriteBytes(channel.keys.data(), channel.keys.size() * sizeof(float));
+		for (int32 i = 0; i < channel.values.size(); ++i) {
+			writer.WriteVector3(channel.values[i]);
+		}
+	}
+
+	static void WriteAnimChannel(DVKCookedWriter& writer, const DVKAnimChannel<Quat>& channel)
+	{
+		writer.Write<uint32>(channel.keys.size());
+		writer.WriteBytes(channel.keys.data(), channel.keys.size() * sizeof(float));
+		for (int32 i = 0; i < channel.values.size(); ++i) {
+			writer.WriteQuat(channel.values[i]);
+		}
+	}
+
+	static bool ReadAnimKeys(DVKCookedReader& reader, std::vector<float>& outKeys)
+	{
+		uint32 count = reader.Read<uint32>();
+		const uint8* keys = reader.ReadBlob(count * sizeof(float), 1);
+		if (!reader.IsValid()) {
+			return false;
+		}
+		outKeys.resize(count);
+		memcpy(outKeys.data(), keys, count * sizeof(float));
+		return true;
+	}
+
+	static void ReadAnimChannel(DVKCookedReader& reader, DVKAnimChannel<Vector3>& outChannel)
+	{
+		if (!ReadAnimKeys(reader, outChannel.keys)) {
+			return;
+		}
+		outChannel.values.resize(outChannel.keys.size());
+		for (int32 i = 0; i < outChannel.values.size(); ++i) {
+			outChannel.values[i] = reader.ReadVector3();
+		}
+	}
+
+	static void ReadAnimChannel(DVKCookedReader& reader, DVKAnimChannel<Quat>& outChannel)
+	{
+		if (!ReadAnimKeys(reader, outChannel.keys)) {
+			return;
+		}
+		outChannel.values.resize(outChannel.keys.size());
+		for (int32 i = 0; i < outChannel.values.size(); ++i) {
+			outChannel.values[i] = reader.ReadQuat();
+		}
+	}
+
+	std::string DVKModel::GetCookedFilename(const std::string& filename, const std::vector<VertexAttribute>& attributes)
+	{
+		// FNV-1a
+		uint32 hash = 2166136261u;
+		for (int32 i = 0; i < attributes.size(); ++i)
+		{
+			hash ^= (uint32)attributes[i];
+			hash *= 16777619u;
+		}
+
+		char buf[16];
+		sprintf(buf, ".%08x", hash);
+
+		return filename + buf + ".dvkmesh";
+	}
+
+	bool DVKModel::Cook(const std::string& filename, const std::vector<VertexAttribute>& attributes, bool buildTriangleBVH)
+	{
+		DVKModel* model = LoadFromAssimp(filename, nullptr, nullptr, attributes);
+		if (model->rootNode == nullptr)
+		{
+			delete model;
+			return false;
+		}
+
+		if (buildTriangleBVH) {
+			model->BuildTriangleBVHs();
+		}
+
+		// 统计优化之后的顶点缓存和顶点读取效率
+		uint32 vertexSize = model->GetInputBinding().stride;
+		uint64 triangleCount = 0;
+		uint64 vertexCount   = 0;
+		uint64 transformed   = 0;
+		uint64 bytesFetched  = 0;
+		for (int32 i = 0; i < model->meshes.size(); ++i)
+		{
+			for (int32 j = 0; j < model->meshes[i]->primitives.size(); ++j)
+			{
+				DVKPrimitive* primitive = model->meshes[i]->primitives[j];
+				DVKVertexCacheStats cacheStats = DVKMeshOptimizer::AnalyzeVertexCache(primitive->indices, primitive->vertexCount);
+				DVKVertexFetchStats fetchStats = DVKMeshOptimizer::AnalyzeVertexFetch(primitive->indices, primitive->vertexCount, vertexSize);
+				triangleCount += cacheStats.triangleCount;
+				vertexCount   += cacheStats.vertexCount;
+				transformed   += cacheStats.transformedCount;
+				bytesFetched  += fetchStats.bytesFetched;
+			}
+		}
+
+		if (triangleCount > 0 && vertexCount > 0)
+		{
+			MLOG("Cook %s : ACMR=%.3f ATVR=%.3f Overfetch=%.3f", filename.c_str(), (float)transformed / triangleCount, (float)transformed / vertexCount, (float)bytesFetched / (vertexCount * vertexSize));
+		}
+
+		std::vector<uint8> data;
+		model->SaveCookedData(data);
+		delete model;
+
+		std::string cookedFilename = GetCookedFilename(filename, attributes);
+		if (!FileManager::WriteFile(cookedFilename, data.data(), data.size())) {
+			return false;
+		}
+
+		MLOG("Cooked %s -> %s (%u bytes)", filename.c_str(), cookedFilename.c_str(), (uint32)data.size());
+
+		return true;
+	}
+
+	DVKModel* DVKModel::LoadFromCooked(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<VertexAttribute>& attributes, bool keepVertexData)
+	{
+		DVKModel* model   = new DVKModel();
+		model->device     = vulkanDevice;
+		model->attributes = attributes;
+		model->cmdBuffer  = cmdBuffer;
+
+		uint8* dataPtr  = nullptr;
+		uint32 dataSize = 0;
+		if (!FileManager::MapFile(filename, dataPtr, dataSize)) {
+			return model;
+		}
+
+		bool batching = cmdBuffer && !cmdBuffer->IsBatching();
+		if (batching) {
+			cmdBuffer->BeginBatch();
+		}
+
+		bool success = model->LoadCookedData(dataPtr, dataSize, keepVertexData || cmdBuffer == nullptr);
+
+		// 数据已经拷贝进Staging，提交之前就可以解除映射
+		FileManager::UnmapFile(dataPtr, dataSize);
+
+		if (batching) {
+			cmdBuffer->FlushBatch();
+		}
+
+		if (!success)
+		{
+			MLOGE("Invalid cooked model : %s", filename.c_str());
+			delete model;
+
+			model = new DVKModel();
+			model->device     = vulkanDevice;
+			model->attributes = attributes;
+			model->cmdBuffer  = cmdBuffer;
+		}
+		else {
+			model->BuildTransforms();
+		}
+
+		return model;
+	}
+
+	void DVKModel::SaveCookedData(std::vector<uint8>& outData)
+	{
+		DVKCookedWriter writer(outData);
+
+		writer.Write<uint32>(COOKED_MAGIC);
+		writer.Write<uint32>(COOKED_VERSION);
+
+		writer.Write<uint32>(attributes.size());
+		for (int32 i = 0; i < attributes.size(); ++i) {
+			writer.Write<int32>((int32)attributes[i]);
+		}
+
+		// bones
+		writer.Write<uint32>(bones.size());
+		for (int32 i = 0; i < bones.size(); ++i)
+		{
+			writer.WriteString(bones[i]->name);
+			writer.Write<int32>(bones[i]->index);
+			writer.Write<int32>(bones[i]->parent);
+			writer.WriteMatrix(bones[i]->inverseBindPose);
+		}
+
+		// nodes，linearNodes中父节点总是在子节点之前
+		std::unordered_map<DVKNode*, int32> nodeIndices;
+		std::unordered_map<DVKMesh*, int32> meshIndices;
+		for (int32 i = 0; i < meshes.size(); ++i) {
+			meshIndices.insert(std::make_pair(meshes[i], i));
+		}
+
+		writer.Write<uint32>(meshes.size());
+		writer.Write<uint32>(linearNodes.size());
+		for (int32 i = 0; i < linearNodes.size(); ++i)
+		{
+			DVKNode* node = linearNodes[i];
+			nodeIndices.insert(std::make_pair(node, i));
+
+			writer.WriteString(node->name);
+			writer.Write<int32>(node->parent ? nodeIndices[node->parent] : -1);
+			writer.WriteMatrix(node->localMatrix);
+			writer.Write<uint32>(node->meshes.size());
+			for (int32 j = 0; j < node->meshes.size(); ++j) {
+				writer.Write<int32>(meshIndices[node->meshes[j]]);
+			}
+		}
+
+		// meshes
+		for (int32 i = 0; i < meshes.size(); ++i)
+		{
+			DVKMesh* mesh = meshes[i];
+			writer.WriteVector3(mesh->bounding.min);
+			writer.WriteVector3(mesh->bounding.max);
+			writer.Write<uint8>(mesh->isSkin ? 1 : 0);
+			writer.Write<uint32>(mesh->bones.size());
+			writer.WriteBytes(mesh->bones.data(), mesh->bones.size() * sizeof(int32));
+			writer.WriteString(mesh->material.diffuse);
+			writer.WriteString(mesh->material.normalmap);
+			writer.WriteString(mesh->material.specular);
+			writer.Write<int32>(mesh->vertexCount);
+			writer.Write<int32>(mesh->triangleCount);
+
+			writer.Write<uint32>(mesh->primitives.size());
+			for (int32 j = 0; j < mesh->primitives.size(); ++j)
+			{
+				DVKPrimitive* primitive = mesh->primitives[j];
+				writer.Write<int32>(primitive->vertexCount);
+				writer.Write<int32>(primitive->triangleNum);
+				writer.Write<uint32>(primitive->vertices.size());
+				writer.Write<uint32>(primitive->indices.size());
+
+				// 与运行时的选择一致，顶点数不超过65536时存为16位索引
+				bool shortIndex = primitive->vertexCount <= 65536;
+				writer.Write<uint32>(shortIndex ? sizeof(uint16) : sizeof(uint32));
+
+				writer.Pad(COOKED_ALIGNMENT);
+				writer.WriteBytes(primitive->vertices.data(), primitive->vertices.size() * sizeof(float));
+				writer.Pad(COOKED_ALIGNMENT);
+				if (shortIndex)
+				{
+					for (int32 k = 0; k < primitive->indices.size(); ++k) {
+						writer.Write<uint16>(primitive->indices[k]);
+					}
+				}
+				else
+				{
+					writer.WriteBytes(primitive->indices.data(), primitive->indices.size() * sizeof(uint32));
+				}
+
+				// 没有构建时长度为0
+				std::vector<uint8> bvhData;
+				if (!primitive->triangleBVH.IsEmpty()) {
+					primitive->triangleBVH.Serialize(bvhData);
+				}
+				writer.Write<uint32>(bvhData.size());
+				writer.Pad(COOKED_ALIGNMENT);
+				writer.WriteBytes(bvhData.data(), bvhData.size());
+			}
+		}
+
+		// animations
+		writer.Write<uint32>(animations.size());
+		for (int32 i = 0; i < animations.size(); ++i)
+		{
+			DVKAnimation& animation = animations[i];
+			writer.WriteString(animation.name);
+			writer.Write<float>(animation.duration);
+			writer.Write<float>(animation.speed);
+			writer.Write<uint32>(animation.clips.size());
+
+			for (auto it = animation.clips.begin(); it != animation.clips.end(); ++it)
+			{
+				DVKAnimationClip& clip = it->second;
+				writer.WriteString(clip.nodeName);
+				writer.Write<float>(clip.duration);
+				WriteAnimChannel(writer, clip.positions);
+				WriteAnimChannel(writer, clip.scales);
+				WriteAnimChannel(writer, clip.rotations);
+			}
+		}
+	}
+
+	bool DVKModel::LoadCookedData(const uint8* data, uint32 dataSize, bool keepVertexData)
+	{
+		DVKCookedReader reader(data, dataSize);
+
+		if (reader.Read<uint32>() != COOKED_MAGIC || reader.Read<uint32>() != COOKED_VERSION) {
+			return false;
+		}
+
+		uint32 numAttributes = reader.Read<uint32>();
+		if (numAttributes != attributes.size()) {
+			return false;
+		}
+		for (int32 i = 0; i < numAttributes; ++i)
+		{
+			if (reader.Read<int32>() != (int32)attributes[i]) {
+				return false;
+			}
+		}
+
+		// bones
+		uint32 numBones = reader.Read<uint32>();
+		for (int32 i = 0; i < numBones && reader.IsValid(); ++i)
+		{
+			DVKBone* bone = new DVKBone();
+			bone->name   = reader.ReadString();
+			bone->index  = reader.Read<int32>();
+			bone->parent = reader.Read<int32>();
+			reader.ReadMatrix(bone->inverseBindPose);
+			bones.push_back(bone);
+			bonesMap.insert(std::make_pair(bone->name, bone));
+		}
+
+		// nodes。先创建Mesh再挂到节点上，失败时由rootNode统一释放。
+		uint32 numMeshes = reader.Read<uint32>();
+		uint32 numNodes  = reader.Read<uint32>();
+		if (!reader.IsValid() || numNodes == 0) {
+			return false;
+		}
+
+		meshes.resize(numMeshes, nullptr);
+
+		for (int32 i = 0; i < numNodes; ++i)
+		{
+			DVKNode* node = new DVKNode();
+			node->name = reader.ReadString();
+			int32 parentIndex = reader.Read<int32>();
+			reader.ReadMatrix(node->localMatrix);
+
+			if (parentIndex >= 0 && parentIndex < i)
+			{
+				node->parent = linearNodes[parentIndex];
+				node->parent->children.push_back(node);
+			}
+			else if (rootNode == nullptr) {
+				rootNode = node;
+			}
+			else
+			{
+				delete node;
+				return false;
+			}
+
+			nodesMap.insert(std::make_pair(node->name, node));
+			linearNodes.push_back(node);
+
+			uint32 numNodeMeshes = reader.Read<uint32>();
+			for (int32 j = 0; j < numNodeMeshes && reader.IsValid(); ++j)
+			{
+				int32 meshIndex = reader.Read<int32>();
+				if (meshIndex < 0 || meshIndex >= numMeshes || meshes[meshIndex] != nullptr) {
+					return false;
+				}
+				DVKMesh* mesh = new DVKMesh();
+				mesh->linkNode = node;
+				node->meshes.push_back(mesh);
+				meshes[meshIndex] = mesh;
+			}
+
+			if (!reader.IsValid()) {
+				return false;
+			}
+		}
+
+		for (int32 i = 0; i < numMeshes; ++i)
+		{
+			if (meshes[i] == nullptr) {
+				return false;
+			}
+		}
+
+		// meshes
+		for (int32 i = 0; i < numMeshes; ++i)
+		{
+			DVKMesh* mesh = meshes[i];
+			mesh->bounding.min = reader.ReadVector3();
+			mesh->bounding.max = reader.ReadVector3();
+			mesh->bounding.UpdateCorners();
+			mesh->isSkin = reader.Read<uint8>() != 0;
+
+			uint32 numMeshBones = reader.Read<uint32>();
+			const uint8* meshBones = reader.ReadBlob(numMeshBones * sizeof(int32), 1);
+			if (!reader.IsValid()) {
+				return false;
+			}
+			mesh->bones.resize(numMeshBones);
+			memcpy(mesh->bones.data(), meshBones, numMeshBones * sizeof(int32));
+
+			mesh->material.diffuse   = reader.ReadString();
+			mesh->material.normalmap = reader.ReadString();
+			mesh->material.specular  = reader.ReadString();
+			mesh->vertexCount        = reader.Read<int32>();
+			mesh->triangleCount      = reader.Read<int32>();
+
+			uint32 numPrimitives = reader.Read<uint32>();
+			for (int32 j = 0; j < numPrimitives && reader.IsValid(); ++j)
+			{
+				DVKPrimitive* primitive = new DVKPrimitive();
+				mesh->primitives.push_back(primitive);
+
+				primitive->vertexCount = reader.Read<int32>();
+				primitive->triangleNum = reader.Read<int32>();
+				uint32 numFloats   = reader.Read<uint32>();
+				uint32 numIndices  = reader.Read<uint32>();
+				uint32 indexStride = reader.Read<uint32>();
+				if (indexStride != sizeof(uint16) && indexStride != sizeof(uint32)) {
+					return false;
+				}
+
+				VkIndexType indexType = indexStride == sizeof(uint16) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+				const float* vertexData = (const float*)reader.ReadBlob(numFloats * sizeof(float), COOKED_ALIGNMENT);
+				const uint8* indexData  = reader.ReadBlob(numIndices * indexStride, COOKED_ALIGNMENT);
+				if (!reader.IsValid()) {
+					return false;
+				}
+
+				if (cmdBuffer)
+				{
+					if (numFloats > 0) {
+						primitive->vertexBuffer = DVKVertexBuffer::Create(device, cmdBuffer, vertexData, numFloats * sizeof(float), attributes);
+					}
+					if (numIndices > 0) {
+						primitive->indexBuffer = DVKIndexBuffer::Create(device, cmdBuffer, indexData, numIndices, indexType);
+					}
+				}
+
+				if (keepVertexData)
+				{
+					primitive->vertices.assign(vertexData, vertexData + numFloats);
+					if (indexType == VK_INDEX_TYPE_UINT16) {
+						primitive->indices.assign((const uint16*)indexData, (const uint16*)indexData + numIndices);
+					}
+					else {
+						primitive->indices.assign((const uint32*)indexData, (const uint32*)indexData + numIndices);
+					}
+				}
+
+				uint32 bvhSize = reader.Read<uint32>();
+				const uint8* bvhData = reader.ReadBlob(bvhSize, COOKED_ALIGNMENT);
+				if (!reader.IsValid()) {
+					return false;
+				}
+				if (bvhSize > 0 && !primitive->triangleBVH.Deserialize(bvhData, bvhSize)) {
+					return false;
+				}
+			}
+		}
+
+		// animations
+		uint32 numAnimations = reader.Read<uint32>();
+		for (int32 i = 0; i < numAnimations && reader.IsValid(); ++i)
+		{
+			animations.push_back(DVKAnimation());
+			DVKAnimation& animation = animations.back();
+			animation.name     = reader.ReadString();
+			animation.duration = reader.Read<float>();
+			animation.speed    = reader.Read<float>();
+
+			uint32 numClips = reader.Read<uint32>();
+			for (int32 j = 0; j < numClips && reader.IsValid(); ++j)
+			{
+				std::string nodeName = reader.ReadString();
+				DVKAnimationClip& clip = animation.clips[nodeName];
+				clip.nodeName = nodeName;
+				clip.duration = reader.Read<float>();
+				ReadAnimChannel(reader, clip.positions);
+				ReadAnimChannel(reader, clip.scales);
+				ReadAnimChannel(reader, clip.rotations);
+			}
+		}
+
+		return reader.IsValid();
+	}
+
 }
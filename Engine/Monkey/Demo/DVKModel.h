@@ -6,6 +6,12 @@
 #include "DVKBuffer.h"
 #include "DVKIndexBuffer.h"
 #include "DVKVertexBuffer.h"
+#include "DVKMeshlet.h"
+#include "DVKLod.h"
+#include "DVKTransform.h"
+#include "DVKAnimCompression.h"
+#include "DVKSceneBVH.h"
+#include "DVKTriangleBVH.h"
 
 #include "Common/Common.h"
 #include "Math/Math.h"
@@ -20,6 +26,7 @@
 #include <vector>
 #include <memory>
 #include <unordered_map>
+#include <algorithm>
 
 struct aiMesh;
 struct aiScene;
@@ -71,11 +78,22 @@ namespace vk_demo
 
 		std::vector<float>	vertices;
         std::vector<float>  instanceDatas;
-		std::vector<uint16>	indices;
+		std::vector<uint32>	indices;
         
         int32               vertexCount = 0;
         int32               triangleNum = 0;
 
+		// 由DVKModel::BuildMeshlets生成
+		std::vector<DVKMeshlet>	meshlets;
+
+		// 由DVKModel::BuildLods生成，lods[0]为indices本身。
+		// 更粗糙的LOD索引存放在lodIndices中，上传时接在indices之后，所有LOD共用一个IndexBuffer和VertexBuffer。
+		std::vector<DVKLod>		lods;
+		std::vector<uint32>		lodIndices;
+
+		// 由DVKModel::BuildTriangleBVHs生成或者从烘焙文件加载，用于射线拾取，位于Mesh的局部空间
+		DVKTriangleBVH			triangleBVH;
+
 		DVKPrimitive()
 		{
 
@@ -124,6 +142,51 @@ namespace vk_demo
 			}
 		}
 
+		// 只绘制索引的一部分，例如DVKMeshletCuller输出的可见范围。需要先BindOnly。
+		void DrawRanges(VkCommandBuffer cmdBuffer, const std::vector<VkDrawIndexedIndirectCommand>& draws)
+		{
+			for (int32 i = 0; i < draws.size(); ++i) {
+				vkCmdDrawIndexed(cmdBuffer, draws[i].indexCount, draws[i].instanceCount, draws[i].firstIndex, draws[i].vertexOffset, draws[i].firstInstance);
+			}
+		}
+
+		int32 GetLodCount() const
+		{
+			return lods.empty() ? 1 : lods.size();
+		}
+
+		// 没有生成LOD时第0级为全部索引
+		DVKLod GetLod(int32 lod) const
+		{
+			if (lods.empty())
+			{
+				DVKLod full;
+				full.indexCount = indices.size() > 0 ? indices.size() : (indexBuffer ? indexBuffer->indexCount : 0);
+				return full;
+			}
+			return lods[MMath::Clamp<int32>(lod, 0, lods.size() - 1)];
+		}
+
+		// Indirect绘制使用，vertexOffset由调用者根据合并后的VertexBuffer设置
+		VkDrawIndexedIndirectCommand GetLodDrawCommand(int32 lod, uint32 instanceCount = 1, uint32 firstInstance = 0) const
+		{
+			DVKLod range = GetLod(lod);
+			VkDrawIndexedIndirectCommand draw;
+			draw.indexCount    = range.indexCount;
+			draw.instanceCount = instanceCount;
+			draw.firstIndex    = range.firstIndex;
+			draw.vertexOffset  = 0;
+			draw.firstInstance = firstInstance;
+			return draw;
+		}
+
+		// Instance绘制使用，需要先BindOnly
+		void DrawLod(VkCommandBuffer cmdBuffer, int32 lod, uint32 instanceCount = 1, uint32 firstInstance = 0)
+		{
+			DVKLod range = GetLod(lod);
+			vkCmdDrawIndexed(cmdBuffer, range.indexCount, instanceCount, range.firstIndex, 0, firstInstance);
+		}
+
 		void BindDrawCmd(VkCommandBuffer cmdBuffer)
 		{
 			if (vertexBuffer) {
@@ -161,6 +224,8 @@ namespace vk_demo
         int32           parent = -1;
         Matrix4x4       inverseBindPose;
 		Matrix4x4		finalTransform;
+		// 骨骼对应的节点在linearNodes中的序号，加载时绑定
+		int32			nodeIndex = -1;
     };
 
 	struct DVKVertexSkin
@@ -175,8 +240,32 @@ namespace vk_demo
 	{
 		std::vector<float>	   keys;
 		std::vector<ValueType> values;
+		int32				   cursor = 0;
 
-		void GetValue(float key, ValueType& outPrevValue, ValueType& outNextValue, float& outAlpha)
+		// 返回满足keys[frame] < key <= keys[frame + 1]的frame，key必须在(keys.front(), keys.back())之内。
+		// 顺序播放时key几乎总是落在cursor所在或者下一个区间，否则二分查找。
+		int32 FindFrame(float key, int32& inOutCursor) const
+		{
+			int32 last  = keys.size() - 2;
+			int32 frame = MMath::Clamp(inOutCursor, 0, last);
+
+			if (keys[frame] < key && key <= keys[frame + 1]) {
+				return frame;
+			}
+
+			if (frame < last && keys[frame + 1] < key && key <= keys[frame + 2]) {
+				inOutCursor = frame + 1;
+				return frame + 1;
+			}
+
+			frame = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin() - 1;
+			frame = MMath::Clamp(frame, 0, last);
+			inOutCursor = frame;
+			return frame;
+		}
+
+		// 使用外部的游标，同一个通道可以被多个实例以不同的时间采样
+		void GetValue(float key, int32& inOutCursor, ValueType& outPrevValue, ValueType& outNextValue, float& outAlpha) const
 		{
 			outAlpha = 0.0f;
 
@@ -200,14 +289,7 @@ namespace vk_demo
 				return;
 			}
 
-			int32 frameIndex = 0;
-			for (int32 i = 0; i < keys.size() - 1; ++i) {
-				if (key <= keys[i + 1]) 
-				{
-					frameIndex = i;
-					break;
-				}
-			}
+			int32 frameIndex = FindFrame(key, inOutCursor);
             
 			outPrevValue = values[frameIndex + 0];
 			outNextValue = values[frameIndex + 1];
@@ -216,6 +298,11 @@ namespace vk_demo
 			float nextKey = keys[frameIndex + 1];
 			outAlpha      = (key - prevKey) / (nextKey - prevKey);
 		}
+
+		void GetValue(float key, ValueType& outPrevValue, ValueType& outNextValue, float& outAlpha)
+		{
+			GetValue(key, cursor, outPrevValue, outNextValue, outAlpha);
+		}
 	};
 
 	struct DVKAnimationClip
@@ -225,6 +312,58 @@ namespace vk_demo
 		DVKAnimChannel<Vector3>		positions;
 		DVKAnimChannel<Vector3>		scales;
 		DVKAnimChannel<Quat>		rotations;
+		// linearNodes中的序号，加载时绑定
+		int32						nodeIndex = -1;
+	};
+
+	// 采样一个clip的位移、旋转、缩放。DVKAnimationClip和DVKCompressedClip共用，三个通道各自使用外部的游标。
+	template<class ClipType>
+	inline void SampleAnimationClip(const ClipType& clip, float time, int32& positionCursor, int32& rotationCursor, int32& scaleCursor, Vector3& outPosition, Quat& outRotation, Vector3& outScale)
+	{
+		float alpha = 0.0f;
+
+		// rotation
+		Quat prevRot(0, 0, 0, 1);
+		Quat nextRot(0, 0, 0, 1);
+		clip.rotations.GetValue(time, rotationCursor, prevRot, nextRot, alpha);
+		// 相邻关键帧之间的夹角很小，归一化的线性插值与Slerp几乎没有差别，但不需要反三角函数
+		outRotation = Quat::FastLerp(prevRot, nextRot, alpha);
+		outRotation.Normalize();
+
+		// position
+		Vector3 prevPos(0, 0, 0);
+		Vector3 nextPos(0, 0, 0);
+		clip.positions.GetValue(time, positionCursor, prevPos, nextPos, alpha);
+		outPosition = MMath::Lerp(prevPos, nextPos, alpha);
+
+		// scale
+		Vector3 prevScale(1, 1, 1);
+		Vector3 nextScale(1, 1, 1);
+		clip.scales.GetValue(time, scaleCursor, prevScale, nextScale, alpha);
+		outScale = MMath::Lerp(prevScale, nextScale, alpha);
+	}
+
+	// 一批实例的局部姿态，各分量分开存放，下标为clip * instanceCount + instance。
+	// clip的顺序与DVKAnimation::boundClips一致。
+	struct DVKAnimationPose
+	{
+		int32				clipCount = 0;
+		int32				instanceCount = 0;
+
+		std::vector<float>	positions[3];
+		std::vector<float>	scales[3];
+		std::vector<float>	rotations[4];
+
+		// 每个实例每个通道一个游标，下标为(clip * 3 + channel) * instanceCount + instance
+		std::vector<int32>	cursors;
+
+		// 采样时的临时数据
+		std::vector<int32>	frames;
+		std::vector<float>	alphas;
+
+		void Resize(int32 inClipCount, int32 inInstanceCount);
+
+		void GetLocalMatrix(int32 clip, int32 instance, Matrix4x4& outMatrix) const;
 	};
 
 	struct DVKAnimation
@@ -234,6 +373,14 @@ namespace vk_demo
 		float       duration = 0.0f;
 		float		speed = 1.0f;
 		std::unordered_map<std::string, DVKAnimationClip> clips;
+		// 绑定到节点的clip，按节点在层级中的顺序排列，由DVKModel::BuildTransforms生成
+		std::vector<DVKAnimationClip*> boundClips;
+		// 与boundClips一一对应的压缩数据，不为空时采样只使用压缩数据，由DVKModel::CompressAnimations生成
+		std::vector<DVKCompressedClip> compressedClips;
+
+		// 一次采样count个实例，times[i]为第i个实例的时间，结果写入outPose。
+		// 每个实例的游标保存在outPose中，连续帧之间复用同一个outPose才能命中游标。
+		void Sample(const float* times, int32 count, DVKAnimationPose& outPose) const;
 	};
     
     struct DVKMesh
@@ -251,15 +398,29 @@ namespace vk_demo
         
 		int32				vertexCount;
 		int32				triangleCount;
+
+		// 在所属模型sceneIndex中的叶子序号
+		int32				sceneProxy;
         
         DVKMesh()
             : linkNode(nullptr)
 			, vertexCount(0)
 			, triangleCount(0)
+			, sceneProxy(-1)
         {
             
         }
 
+		// bounding变换到世界空间之后的包围盒，蒙皮Mesh使用绑定姿势的包围盒
+		void GetWorldBounds(Vector3& outMin, Vector3& outMax);
+
+		// VA_PackedPosition的解码参数：position = inPackedPosition.xyz * scale + bias
+		void GetPositionDequantize(Vector3& outScale, Vector3& outBias) const
+		{
+			outScale = bounding.max - bounding.min;
+			outBias  = bounding.min;
+		}
+
 		void BindOnly(VkCommandBuffer cmdBuffer)
 		{
 			for (int i = 0; i < primitives.size(); ++i) {
@@ -303,9 +464,15 @@ namespace vk_demo
         Matrix4x4					localMatrix;
         Matrix4x4					globalMatrix;
 
+		// 所属模型展开后的层级，由DVKModel::BuildTransforms设置
+		DVKTransformHierarchy*		transforms;
+		int32						transformIndex;
+
         DVKNode()
             : name("None")
             , parent(nullptr)
+			, transforms(nullptr)
+			, transformIndex(-1)
         {
             
         }
@@ -314,9 +481,27 @@ namespace vk_demo
         {
             return localMatrix;
         }
+
+		void SetLocalMatrix(const Matrix4x4& matrix)
+		{
+			localMatrix = matrix;
+			MarkDirty();
+		}
+
+		// 直接修改localMatrix之后需要调用，否则GetGlobalMatrix拿到的还是旧的结果
+		void MarkDirty()
+		{
+			if (transforms) {
+				transforms->SetLocal(transformIndex, localMatrix);
+			}
+		}
         
         Matrix4x4& GetGlobalMatrix()
         {
+			if (transforms) {
+				return transforms->GetWorld(transformIndex);
+			}
+
             globalMatrix = localMatrix;
             
             if (parent) {
@@ -326,6 +511,15 @@ namespace vk_demo
             return globalMatrix;
         }
 
+		// 缓存的逆矩阵，节点没有变化时不会重复求逆
+		Matrix4x4 GetInverseGlobalMatrix()
+		{
+			if (transforms) {
+				return transforms->GetInverseWorld(transformIndex);
+			}
+			return GetGlobalMatrix().Inverse();
+		}
+
 		void CalcBounds(DVKBoundingBox& outBounds)
 		{
 			if (meshes.size() > 0) 
@@ -409,11 +603,63 @@ namespace vk_demo
 
 		std::vector<VkVertexInputAttributeDescription> GetInputAttributes();
         
+        // 如果存在与attributes匹配的烘焙文件则直接加载它，否则通过Assimp解析
         static DVKModel* LoadFromFile(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<VertexAttribute>& attributes);
+
+		// 离线烘焙：用Assimp解析之后按attributes排列好顶点，连同节点、骨骼、动画一起写成二进制文件。
+		// buildTriangleBVH为true时同时烘焙每个Primitive的三角形BVH，加载之后不需要再构建。
+		static bool Cook(const std::string& filename, const std::vector<VertexAttribute>& attributes, bool buildTriangleBVH = false);
+
+		// 加载烘焙文件，文件被映射到内存，顶点和索引直接拷贝进Staging。
+		// keepVertexData为false时不保留CPU端的vertices/indices，没有cmdBuffer时总是保留。
+		static DVKModel* LoadFromCooked(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<VertexAttribute>& attributes, bool keepVertexData = false);
+
+		// 烘焙文件名包含attributes的签名，同一个模型可以按不同的顶点格式分别烘焙
+		static std::string GetCookedFilename(const std::string& filename, const std::vector<VertexAttribute>& attributes);
         
         static DVKModel* Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<float>& vertices, const std::vector<uint16>& indices, const std::vector<VertexAttribute>& attributes);
+
+		// 为所有保留了CPU端数据的Primitive生成Meshlet，用于按簇剔除
+		void BuildMeshlets(uint32 maxVertices = 64, uint32 maxTriangles = 124);
+
+		// 用二次误差简化为每个Primitive生成LOD链，每一级的三角形数约为上一级的reduction倍。
+		// maxError为相对于Mesh包围盒对角线的最大误差，达到误差上限或者无法继续简化时提前结束。
+		// 硬边法线的模型lockSeams需要传false，参见DVKMeshSimplifier。
+		void BuildLods(int32 maxLods = 4, float reduction = 0.5f, float maxError = 0.05f, bool lockSeams = true);
+
+		// 按父节点在前的顺序把节点展开到transforms中，并把动画和骨骼绑定到节点序号，加载和Create之后会自动调用。
+		// 手动增删节点之后需要重新调用。
+		void BuildTransforms();
+
+		// 压缩所有动画，之后GotoAnimation和DVKAnimation::Sample使用压缩数据。
+		// 返回每个动画的压缩率和模型空间误差，同时输出到日志。
+		// releaseSource为true时释放原始关键帧，clips中的keys/values会被清空，之后不能再次压缩。
+		std::vector<DVKAnimCompressionStats> CompressAnimations(const DVKAnimCompressionSettings& settings = DVKAnimCompressionSettings(), bool releaseSource = false);
+
+		// 为所有保留了CPU端数据的Primitive构建三角形BVH，需要在BuildMeshlets、BuildLods之后调用。
+		// 已经有BVH的Primitive(例如从烘焙文件加载)会被跳过，需要重建时先调用triangleBVH.Clear()。
+		void BuildTriangleBVHs(int32 maxLeafTriangles = 4);
+
+		// 取出Primitive在Mesh局部空间的顶点位置(VA_PackedPosition会被解码)，没有保留CPU端数据时返回false
+		bool GetPositions(const DVKMesh* mesh, const DVKPrimitive* primitive, std::vector<Vector3>& outPositions) const;
+
+		// 把所有Mesh的世界空间包围盒插入sceneIndex，userData为Mesh在meshes中的序号。
+		// 之后可以用sceneIndex做视锥剔除、射线以及相交查询，margin参见DVKSceneBVH。
+		void BuildSceneIndex(float margin = 0.1f);
+
+		// 节点移动之后调用，只有离开了放大包围盒的Mesh才会重新插入，返回重新插入的数量
+		int32 UpdateSceneIndex();
+
+		// 为还没有GPU Buffer的Primitive创建Vertex/Index Buffer，用于不带CommandBuffer加载(例如在工作线程解析)的模型
+		void Upload(DVKCommandBuffer* inCmdBuffer);
         
     protected:
+
+		static DVKModel* LoadFromAssimp(const std::string& filename, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<VertexAttribute>& attributes);
+
+		void SaveCookedData(std::vector<uint8>& outData);
+
+		bool LoadCookedData(const uint8* data, uint32 dataSize, bool keepVertexData);
         
         DVKNode* LoadNode(const aiNode* node, const aiScene* scene);
         
@@ -430,6 +676,12 @@ namespace vk_demo
         void LoadPrimitives(std::vector<float>& vertices, std::vector<uint32>& indices, DVKMesh* mesh, const aiMesh* aiMesh, const aiScene* aiScene);
         
         void LoadAnim(const aiScene* aiScene);
+
+		// 用节点序号替换名字查找，GotoAnimation中不再查询nodesMap
+		void BindAnimations();
+
+		// indices与lodIndices合并上传，indexCount仍为第0级的索引数，原有的绘制路径不受影响
+		DVKIndexBuffer* CreateIndexBuffer(DVKPrimitive* primitive);
         
     public:
         typedef std::unordered_map<std::string, DVKNode*> NodesMap;
@@ -439,7 +691,9 @@ namespace vk_demo
         
         DVKNode*						rootNode;
         std::vector<DVKNode*>			linearNodes;
+		DVKTransformHierarchy			transforms;
         std::vector<DVKMesh*>			meshes;
+		DVKSceneBVH						sceneIndex;
 
 		NodesMap						nodesMap;
 
@@ -0,0 +1,293 @@
+﻿#include "DVKRingBuffer.h"
+
+#include "Math/Math.h"
+
+#include <cassert>
+
+namespace vk_demo
+{
+
+	DVKRingBuffer::DVKRingBuffer(std::shared_ptr<VulkanDevice> inVulkanDevice, VkBufferUsageFlags inUsageFlags, uint64 inChunkSize, int32 numChunks)
+	{
+		vulkanDevice = inVulkanDevice;
+		device       = vulkanDevice->GetInstanceHandle();
+		usageFlags   = inUsageFlags;
+		minAlignment = vulkanDevice->GetLimits().minUniformBufferOffsetAlignment;
+		chunkSize    = Align<uint64>(inChunkSize, minAlignment);
+		bufferSize   = chunkSize * numChunks;
+		realBuffer   = DVKBuffer::CreateBuffer(
+			vulkanDevice,
+			usageFlags,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			bufferSize
+		);
+		realBuffer->Map();
+
+		for (int32 i = 0; i < numChunks; ++i)
+		{
+			Chunk chunk;
+			chunk.offset = i * chunkSize;
+			chunk.size   = chunkSize;
+			chunks.push_back(chunk);
+			freeChunks.push_back(i);
+		}
+
+		// 在第一次BeginFrame之前(例如加载阶段)分配的数据归入0号帧
+		segments.resize(1);
+		reservedCursor.store(0);
+	}
+
+	DVKRingBuffer::~DVKRingBuffer()
+	{
+		ReleaseRetiredBuffers(true);
+
+		realBuffer->UnMap();
+		delete realBuffer;
+		realBuffer = nullptr;
+
+		vulkanDevice = nullptr;
+	}
+
+	void DVKRingBuffer::BeginFrame(int32 frameIndex, VkFence fence)
+	{
+		// 上一帧的录制已经结束，结算预留的Chunk
+		FlushReservedChunks();
+
+		if (frameIndex >= segments.size()) {
+			segments.resize(frameIndex + 1);
+		}
+
+		FrameSegment& segment = segments[frameIndex];
+
+		// 等待GPU使用完该帧上一次的数据，然后回收它的Chunk
+		if (segment.fence != VK_NULL_HANDLE) {
+			vkWaitForFences(device, 1, &(segment.fence), VK_TRUE, MAX_uint64);
+		}
+
+		for (int32 i = 0; i < segment.chunks.size(); ++i) {
+			freeChunks.push_back(segment.chunks[i]);
+		}
+
+		segment.chunks.clear();
+		segment.fence        = fence;
+		segment.currentChunk = Chunk();
+		segment.chunkOffset  = 0;
+		segment.usedSize     = 0;
+
+		currentFrame = frameIndex;
+		frameNumber += 1;
+
+		ReleaseRetiredBuffers(false);
+
+		// 按该帧历史峰值提前扩容，稳定状态下帧内不会再发生扩容
+		uint64 freeSize = GetFreeSize();
+		if (freeSize < segment.peakSize) {
+			Grow(MMath::Max(bufferSize, Align<uint64>(segment.peakSize - freeSize, chunkSize)), chunkSize);
+		}
+	}
+
+	void DVKRingBuffer::Reserve(uint64 size)
+	{
+		// 同一帧内再次Reserve时先结算之前的预留，此时不能有Context在录制
+		FlushReservedChunks();
+
+		// 额外留一个Chunk给主线程在录制期间的分配
+		uint64 freeSize = GetFreeSize();
+		if (freeSize < size + chunkSize) {
+			Grow(Align<uint64>(size + chunkSize - freeSize, chunkSize), chunkSize);
+		}
+
+		uint64 reservedSize = 0;
+		while (reservedSize < size)
+		{
+			int32 chunkIndex = AcquireFreeChunk(chunkSize);
+			reservedChunks.push_back(chunkIndex);
+			reservedSize += chunks[chunkIndex].size;
+		}
+
+		reservedCursor.store(0, std::memory_order_release);
+	}
+
+	uint64 DVKRingBuffer::AllocateMemory(uint64 size)
+	{
+		FrameSegment& segment = segments[currentFrame];
+
+		uint64 alignedOffset = Align<uint64>(segment.chunkOffset, minAlignment);
+		if (alignedOffset + size > segment.currentChunk.size)
+		{
+			int32 chunkIndex = AcquireFreeChunk(size);
+
+			// 统计以Chunk为粒度
+			segment.chunks.push_back(chunkIndex);
+			segment.usedSize    += chunks[chunkIndex].size;
+			segment.peakSize     = MMath::Max(segment.peakSize, segment.usedSize);
+			segment.currentChunk = chunks[chunkIndex];
+			alignedOffset = 0;
+		}
+
+		segment.chunkOffset = alignedOffset + size;
+
+		return segment.currentChunk.offset + alignedOffset;
+	}
+
+	uint64 DVKRingBuffer::GetPeakSize() const
+	{
+		uint64 peakSize = 0;
+		for (int32 i = 0; i < segments.size(); ++i) {
+			peakSize = MMath::Max(peakSize, segments[i].peakSize);
+		}
+		return peakSize;
+	}
+
+	uint64 DVKRingBuffer::GetFreeSize() const
+	{
+		uint64 freeSize = 0;
+		for (int32 i = 0; i < freeChunks.size(); ++i) {
+			freeSize += chunks[freeChunks[i]].size;
+		}
+		return freeSize;
+	}
+
+	DVKRingBuffer::Chunk DVKRingBuffer::AcquireChunk(uint64 size)
+	{
+		// 预留的Chunk列表在录制期间只读，原子加即可在多个线程之间分配
+		int32 index = reservedCursor.fetch_add(1, std::memory_order_relaxed);
+		if (index >= (int32)reservedChunks.size() || chunks[reservedChunks[index]].size < size)
+		{
+			MLOGE("RingBuffer reserved chunks exhausted, reserved=%d, index=%d, size=%llu", (int32)reservedChunks.size(), index, size);
+			assert(false);
+			return Chunk();
+		}
+
+		return chunks[reservedChunks[index]];
+	}
+
+	void DVKRingBuffer::FlushReservedChunks()
+	{
+		if (reservedChunks.size() == 0) {
+			return;
+		}
+
+		// 被Context领取过的Chunk归入当前帧，等该帧的Fence之后回收；没有用到的直接放回空闲列表
+		int32 numUsed = MMath::Min(reservedCursor.load(std::memory_order_acquire), (int32)reservedChunks.size());
+		FrameSegment& segment = segments[currentFrame];
+		for (int32 i = 0; i < reservedChunks.size(); ++i)
+		{
+			if (i < numUsed)
+			{
+				segment.chunks.push_back(reservedChunks[i]);
+				segment.usedSize += chunks[reservedChunks[i]].size;
+			}
+			else
+			{
+				freeChunks.push_back(reservedChunks[i]);
+			}
+		}
+		segment.peakSize = MMath::Max(segment.peakSize, segment.usedSize);
+
+		reservedChunks.clear();
+		reservedCursor.store(0, std::memory_order_relaxed);
+	}
+
+	int32 DVKRingBuffer::AcquireFreeChunk(uint64 size)
+	{
+		for (int32 i = 0; i < freeChunks.size(); ++i)
+		{
+			int32 chunkIndex = freeChunks[i];
+			if (chunks[chunkIndex].size >= size)
+			{
+				freeChunks[i] = freeChunks.back();
+				freeChunks.pop_back();
+				return chunkIndex;
+			}
+		}
+
+		// 空闲Chunk不足，扩容之后必然能够找到
+		uint64 firstChunkSize = MMath::Max(chunkSize, Align<uint64>(size, chunkSize));
+		Grow(MMath::Max(bufferSize, firstChunkSize), firstChunkSize);
+		return AcquireFreeChunk(size);
+	}
+
+	void DVKRingBuffer::Grow(uint64 growSize, uint64 firstChunkSize)
+	{
+		// 有预留说明Context可能正在录制，它们读取的Buffer和映射指针不能被替换
+		if (reservedChunks.size() > 0)
+		{
+			MLOGE("RingBuffer can't grow while reserved chunks are in use, Reserve more before recording.");
+			assert(false);
+		}
+
+		uint64 newBufferSize = bufferSize + growSize;
+
+		MLOG("RingBuffer grow %llu -> %llu bytes", bufferSize, newBufferSize);
+
+		DVKBuffer* newBuffer = DVKBuffer::CreateBuffer(
+			vulkanDevice,
+			usageFlags,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			newBufferSize
+		);
+		newBuffer->Map();
+
+		// 原样拷贝旧数据，已经分配出去的Offset在新Buffer中依然有效
+		memcpy(newBuffer->mapped, realBuffer->mapped, bufferSize);
+
+		// 旧Buffer可能仍被飞行中的帧引用，等所有帧都轮转一遍之后再释放
+		RetiredBuffer retired;
+		retired.buffer      = realBuffer;
+		retired.frameNumber = frameNumber;
+		retiredBuffers.push_back(retired);
+
+		uint64 offset = bufferSize;
+		while (offset < newBufferSize)
+		{
+			Chunk chunk;
+			chunk.offset = offset;
+			chunk.size   = offset == bufferSize ? firstChunkSize : MMath::Min(chunkSize, newBufferSize - offset);
+			offset      += chunk.size;
+			freeChunks.push_back(chunks.size());
+			chunks.push_back(chunk);
+		}
+
+		realBuffer  = newBuffer;
+		bufferSize  = newBufferSize;
+		generation += 1;
+	}
+
+	void DVKRingBuffer::ReleaseRetiredBuffers(bool immediately)
+	{
+		for (int32 i = retiredBuffers.size() - 1; i >= 0; --i)
+		{
+			if (immediately || frameNumber > retiredBuffers[i].frameNumber + segments.size())
+			{
+				retiredBuffers[i].buffer->UnMap();
+				delete retiredBuffers[i].buffer;
+				retiredBuffers.erase(retiredBuffers.begin() + i);
+			}
+		}
+	}
+
+	uint64 DVKRingBufferContext::AllocateMemory(DVKRingBuffer* ringBuffer, uint64 size)
+	{
+		// 新的一帧，上一帧的Chunk已经被RingBuffer回收
+		if (frameNumber != ringBuffer->GetFrameNumber())
+		{
+			frameNumber = ringBuffer->GetFrameNumber();
+			chunkSize   = 0;
+		}
+
+		uint64 alignedOffset = Align<uint64>(chunkOffset, ringBuffer->GetMinAlignment());
+		if (alignedOffset + size > chunkSize)
+		{
+			DVKRingBuffer::Chunk chunk = ringBuffer->AcquireChunk(size);
+			chunkBase     = chunk.offset;
+			chunkSize     = chunk.size;
+			alignedOffset = 0;
+		}
+
+		chunkOffset = alignedOffset + size;
+
+		return chunkBase + alignedOffset;
+	}
+
+}
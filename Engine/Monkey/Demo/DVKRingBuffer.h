@@ -0,0 +1,170 @@
+﻿#pragma once
+
+#include "DVKBuffer.h"
+
+#include "Common/Common.h"
+#include "Utils/Alignment.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <vector>
+#include <memory>
+#include <atomic>
+
+namespace vk_demo
+{
+	class DVKRingBuffer;
+
+	// 每个录制线程持有一个Context，独占一个Chunk，Chunk内的分配不需要任何同步。
+	// Chunk用完时从主线程Reserve好的Chunk里用一次原子加领取下一个，不需要加锁。
+	class DVKRingBufferContext
+	{
+	public:
+		DVKRingBufferContext()
+		{
+
+		}
+
+		uint64 AllocateMemory(DVKRingBuffer* ringBuffer, uint64 size);
+
+	private:
+		uint64	chunkBase = 0;
+		uint64	chunkSize = 0;
+		uint64	chunkOffset = 0;
+		uint64	frameNumber = 0;
+	};
+
+	// RingBuffer按Chunk切分，每个飞行中的帧(Frame)持有自己的Chunk列表。
+	// 帧开始时等待该帧的Fence，然后回收它上一次使用的Chunk；Chunk不足时扩容而不是回绕覆盖。
+	// 除AcquireChunk之外的接口都只能在主线程调用。Reserve之后到下一次BeginFrame之间有Context在录制，
+	// 这期间禁止扩容，否则其它线程读到的Buffer和映射指针会失效。
+	class DVKRingBuffer
+	{
+	public:
+
+		struct Chunk
+		{
+			uint64	offset = 0;
+			uint64	size = 0;
+		};
+
+		struct FrameSegment
+		{
+			VkFence				fence = VK_NULL_HANDLE;
+			std::vector<int32>	chunks;
+			Chunk				currentChunk;
+			uint64				chunkOffset = 0;
+			uint64				usedSize = 0;
+			uint64				peakSize = 0;
+		};
+
+		struct RetiredBuffer
+		{
+			DVKBuffer*	buffer = nullptr;
+			uint64		frameNumber = 0;
+		};
+
+		DVKRingBuffer(std::shared_ptr<VulkanDevice> vulkanDevice, VkBufferUsageFlags usageFlags, uint64 chunkSize, int32 numChunks);
+
+		virtual ~DVKRingBuffer();
+
+		void BeginFrame(int32 frameIndex, VkFence fence);
+
+		// 为Context预留至少size字节的Chunk，多线程录制之前在主线程调用。
+		// 预留之后到下一次BeginFrame之间不能再扩容，主线程的分配也只能使用剩余的空闲Chunk。
+		void Reserve(uint64 size);
+
+		// 主线程的分配路径
+		uint64 AllocateMemory(uint64 size);
+
+		// 从预留的Chunk中领取一个，供Context在任意线程调用，size不能超过Chunk大小
+		Chunk AcquireChunk(uint64 size);
+
+		inline uint64 GetChunkSize() const
+		{
+			return chunkSize;
+		}
+
+		inline uint32 GetMinAlignment() const
+		{
+			return minAlignment;
+		}
+
+		inline uint64 GetFrameNumber() const
+		{
+			return frameNumber;
+		}
+
+		inline void* GetMappedPointer()
+		{
+			return realBuffer->mapped;
+		}
+
+		inline VkBuffer GetBuffer() const
+		{
+			return realBuffer->buffer;
+		}
+
+		inline uint64 GetBufferSize() const
+		{
+			return bufferSize;
+		}
+
+		// Buffer扩容后递增，使用者据此刷新DescriptorSet
+		inline uint32 GetGeneration() const
+		{
+			return generation;
+		}
+
+		inline int32 GetFrameCount() const
+		{
+			return segments.size();
+		}
+
+		inline uint64 GetFrameUsedSize(int32 frameIndex) const
+		{
+			return segments[frameIndex].usedSize;
+		}
+
+		inline uint64 GetFramePeakSize(int32 frameIndex) const
+		{
+			return segments[frameIndex].peakSize;
+		}
+
+		uint64 GetPeakSize() const;
+
+	private:
+
+		int32 AcquireFreeChunk(uint64 size);
+
+		void FlushReservedChunks();
+
+		uint64 GetFreeSize() const;
+
+		void Grow(uint64 growSize, uint64 firstChunkSize);
+
+		void ReleaseRetiredBuffers(bool immediately);
+
+	private:
+
+		std::shared_ptr<VulkanDevice>	vulkanDevice;
+		VkDevice						device = VK_NULL_HANDLE;
+		VkBufferUsageFlags				usageFlags = 0;
+		uint64							bufferSize = 0;
+		uint64							chunkSize = 0;
+		uint32							minAlignment = 0;
+		uint32							generation = 0;
+		uint64							frameNumber = 0;
+		int32							currentFrame = 0;
+		DVKBuffer*						realBuffer = nullptr;
+
+		// Reserve时写入，录制期间只读，领取位置用原子加推进
+		std::vector<int32>				reservedChunks;
+		std::atomic<int32>				reservedCursor;
+
+		std::vector<Chunk>				chunks;
+		std::vector<int32>				freeChunks;
+		std::vector<FrameSegment>		segments;
+		std::vector<RetiredBuffer>		retiredBuffers;
+	};
+
+}
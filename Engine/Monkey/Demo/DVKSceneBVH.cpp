@@ -0,0 +1,617 @@
+﻿#include "DVKSceneBVH.h"
+#include "DVKTraversalStack.h"
+
+namespace vk_demo
+{
+
+	// 一半的表面积，只用于比较大小
+	static FORCEINLINE float GetArea(const Vector3& boundsMin, const Vector3& boundsMax)
+	{
+		Vector3 size = boundsMax - boundsMin;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	static FORCEINLINE bool Contains(const Vector3& outerMin, const Vector3& outerMax, const Vector3& innerMin, const Vector3& innerMax)
+	{
+		return outerMin.x <= innerMin.x && outerMin.y <= innerMin.y && outerMin.z <= innerMin.z &&
+			   outerMax.x >= innerMax.x && outerMax.y >= innerMax.y && outerMax.z >= innerMax.z;
+	}
+
+	static FORCEINLINE bool Overlaps(const Vector3& aMin, const Vector3& aMax, const Vector3& bMin, const Vector3& bMax)
+	{
+		return aMin.x <= bMax.x && aMin.y <= bMax.y && aMin.z <= bMax.z &&
+			   aMax.x >= bMin.x && aMax.y >= bMin.y && aMax.z >= bMin.z;
+	}
+
+	// slab测试，相交时返回进入距离，否则返回负数
+	static FORCEINLINE float IntersectRay(const Vector3& boundsMin, const Vector3& boundsMax, const Vector3& origin, const Vector3& invDirection, float maxDistance)
+	{
+		float tx0 = (boundsMin.x - origin.x) * invDirection.x;
+		float tx1 = (boundsMax.x - origin.x) * invDirection.x;
+		float ty0 = (boundsMin.y - origin.y) * invDirection.y;
+		float ty1 = (boundsMax.y - origin.y) * invDirection.y;
+		float tz0 = (boundsMin.z - origin.z) * invDirection.z;
+		float tz1 = (boundsMax.z - origin.z) * invDirection.z;
+
+		float tmin = MMath::Max(MMath::Max(MMath::Min(tx0, tx1), MMath::Min(ty0, ty1)), MMath::Max(MMath::Min(tz0, tz1), 0.0f));
+		float tmax = MMath::Min(MMath::Min(MMath::Max(tx0, tx1), MMath::Max(ty0, ty1)), MMath::Min(MMath::Max(tz0, tz1), maxDistance));
+
+		return tmin <= tmax ? tmin : -1.0f;
+	}
+
+	static FORCEINLINE Vector3 GetInvDirection(const Vector3& direction)
+	{
+		return Vector3(
+			direction.x != 0.0f ? 1.0f / direction.x : MAX_flt,
+			direction.y != 0.0f ? 1.0f / direction.y : MAX_flt,
+			direction.z != 0.0f ? 1.0f / direction.z : MAX_flt
+		);
+	}
+
+	DVKSceneBVH::DVKSceneBVH(float inMargin)
+		: root(-1)
+		, freeList(-1)
+		, leafCount(0)
+		, margin(inMargin)
+	{
+
+	}
+
+	void DVKSceneBVH::Clear()
+	{
+		nodes.clear();
+		root      = -1;
+		freeList  = -1;
+		leafCount = 0;
+	}
+
+	int32 DVKSceneBVH::AllocateNode()
+	{
+		int32 index = freeList;
+		if (index == -1)
+		{
+			index = nodes.size();
+			nodes.push_back(Node());
+		}
+		else
+		{
+			freeList = nodes[index].parent;
+		}
+
+		Node& node    = nodes[index];
+		node.parent   = -1;
+		node.child1   = -1;
+		node.child2   = -1;
+		node.height   = 0;
+		node.userData = -1;
+		return index;
+	}
+
+	void DVKSceneBVH::FreeNode(int32 index)
+	{
+		nodes[index].parent = freeList;
+		nodes[index].height = -1;
+		freeList = index;
+	}
+
+	int32 DVKSceneBVH::Insert(const Vector3& boundsMin, const Vector3& boundsMax, int32 userData)
+	{
+		int32 proxy = AllocateNode();
+		Vector3 extent = (boundsMax - boundsMin) * margin;
+
+		Node& node     = nodes[proxy];
+		node.boundsMin = boundsMin - extent;
+		node.boundsMax = boundsMax + extent;
+		node.userData  = userData;
+
+		InsertLeaf(proxy);
+		leafCount += 1;
+
+		return proxy;
+	}
+
+	void DVKSceneBVH::Remove(int32 proxy)
+	{
+		RemoveLeaf(proxy);
+		FreeNode(proxy);
+		leafCount -= 1;
+	}
+
+	bool DVKSceneBVH::Update(int32 proxy, const Vector3& boundsMin, const Vector3& boundsMax)
+	{
+		Node& node = nodes[proxy];
+		if (Contains(node.boundsMin, node.boundsMax, boundsMin, boundsMax)) {
+			return false;
+		}
+
+		RemoveLeaf(proxy);
+
+		Vector3 extent = (boundsMax - boundsMin) * margin;
+		nodes[proxy].boundsMin = boundsMin - extent;
+		nodes[proxy].boundsMax = boundsMax + extent;
+
+		InsertLeaf(proxy);
+
+		return true;
+	}
+
+	void DVKSceneBVH::InsertLeaf(int32 leaf)
+	{
+		if (root == -1)
+		{
+			root = leaf;
+			nodes[root].parent = -1;
+			return;
+		}
+
+		// 从根节点向下，选择把叶子挂在哪个节点旁边面积增加最少
+		const Vector3 leafMin = nodes[leaf].boundsMin;
+		const Vector3 leafMax = nodes[leaf].boundsMax;
+
+		int32 index = root;
+		while (!nodes[index].IsLeaf())
+		{
+			const Node& node = nodes[index];
+
+			float area         = GetArea(node.boundsMin, node.boundsMax);
+			float combinedArea = GetArea(Vector3::Min(node.boundsMin, leafMin), Vector3::Max(node.boundsMax, leafMax));
+
+			// 在这里新建父节点的代价
+			float cost = 2.0f * combinedArea;
+			// 继续向下时这个节点增加的面积
+			float inheritanceCost = 2.0f * (combinedArea - area);
+
+			float costs[2];
+			int32 children[2] = { node.child1, node.child2 };
+			for (int32 i = 0; i < 2; ++i)
+			{
+				const Node& child = nodes[children[i]];
+				float childArea = GetArea(Vector3::Min(child.boundsMin, leafMin), Vector3::Max(child.boundsMax, leafMax));
+				if (child.IsLeaf()) {
+					costs[i] = childArea + inheritanceCost;
+				}
+				else {
+					costs[i] = childArea - GetArea(child.boundsMin, child.boundsMax) + inheritanceCost;
+				}
+			}
+
+			if (cost < costs[0] && cost < costs[1]) {
+				break;
+			}
+
+			index = costs[0] < costs[1] ? children[0] : children[1];
+		}
+
+		int32 sibling   = index;
+		int32 oldParent = nodes[sibling].parent;
+		int32 newParent = AllocateNode();
+
+		nodes[newParent].parent    = oldParent;
+		nodes[newParent].boundsMin = Vector3::Min(leafMin, nodes[sibling].boundsMin);
+		nodes[newParent].boundsMax = Vector3::Max(leafMax, nodes[sibling].boundsMax);
+		nodes[newParent].height    = nodes[sibling].height + 1;
+		nodes[newParent].child1    = sibling;
+		nodes[newParent].child2    = leaf;
+		nodes[sibling].parent      = newParent;
+		nodes[leaf].parent         = newParent;
+
+		if (oldParent != -1)
+		{
+			if (nodes[oldParent].child1 == sibling) {
+				nodes[oldParent].child1 = newParent;
+			}
+			else {
+				nodes[oldParent].child2 = newParent;
+			}
+		}
+		else
+		{
+			root = newParent;
+		}
+
+		// 向上更新高度和包围盒
+		index = nodes[leaf].parent;
+		while (index != -1)
+		{
+			index = Balance(index);
+
+			Node& node = nodes[index];
+			const Node& child1 = nodes[node.child1];
+			const Node& child2 = nodes[node.child2];
+			node.height    = 1 + MMath::Max(child1.height, child2.height);
+			node.boundsMin = Vector3::Min(child1.boundsMin, child2.boundsMin);
+			node.boundsMax = Vector3::Max(child1.boundsMax, child2.boundsMax);
+
+			index = node.parent;
+		}
+	}
+
+	void DVKSceneBVH::RemoveLeaf(int32 leaf)
+	{
+		if (leaf == root)
+		{
+			root = -1;
+			return;
+		}
+
+		int32 parent      = nodes[leaf].parent;
+		int32 grandParent = nodes[parent].parent;
+		int32 sibling     = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+		FreeNode(parent);
+
+		if (grandParent == -1)
+		{
+			root = sibling;
+			nodes[sibling].parent = -1;
+			return;
+		}
+
+		// 用兄弟节点替换父节点
+		if (nodes[grandParent].child1 == parent) {
+			nodes[grandParent].child1 = sibling;
+		}
+		else {
+			nodes[grandParent].child2 = sibling;
+		}
+		nodes[sibling].parent = grandParent;
+
+		int32 index = grandParent;
+		while (index != -1)
+		{
+			index = Balance(index);
+
+			Node& node = nodes[index];
+			const Node& child1 = nodes[node.child1];
+			const Node& child2 = nodes[node.child2];
+			node.height    = 1 + MMath::Max(child1.height, child2.height);
+			node.boundsMin = Vector3::Min(child1.boundsMin, child2.boundsMin);
+			node.boundsMax = Vector3::Max(child1.boundsMax, child2.boundsMax);
+
+			index = node.parent;
+		}
+	}
+
+	// 左右子树高度差超过1时把较高的子节点旋转上来，返回旋转之后位于原位置的节点
+	int32 DVKSceneBVH::Balance(int32 indexA)
+	{
+		Node& a = nodes[indexA];
+		if (a.IsLeaf() || a.height < 2) {
+			return indexA;
+		}
+
+		int32 indexB = a.child1;
+		int32 indexC = a.child2;
+		Node& b = nodes[indexB];
+		Node& c = nodes[indexC];
+
+		int32 balance = c.height - b.height;
+		if (balance >= -1 && balance <= 1) {
+			return indexA;
+		}
+
+		// 较高的子节点记为up，另一个记为down
+		int32 indexUp   = balance > 1 ? indexC : indexB;
+		int32 indexDown = balance > 1 ? indexB : indexC;
+		Node& up = nodes[indexUp];
+
+		int32 indexF = up.child1;
+		int32 indexG = up.child2;
+		Node& f = nodes[indexF];
+		Node& g = nodes[indexG];
+
+		// up替换a的位置
+		up.child1 = indexA;
+		up.parent = a.parent;
+		a.parent  = indexUp;
+
+		if (up.parent != -1)
+		{
+			if (nodes[up.parent].child1 == indexA) {
+				nodes[up.parent].child1 = indexUp;
+			}
+			else {
+				nodes[up.parent].child2 = indexUp;
+			}
+		}
+		else
+		{
+			root = indexUp;
+		}
+
+		// up较高的子节点留在up下，较低的子节点挂到a下
+		int32 indexHigh = f.height > g.height ? indexF : indexG;
+		int32 indexLow  = f.height > g.height ? indexG : indexF;
+		Node& high = nodes[indexHigh];
+		Node& low  = nodes[indexLow];
+		const Node& down = nodes[indexDown];
+
+		up.child2  = indexHigh;
+		low.parent = indexA;
+		if (balance > 1) {
+			a.child2 = indexLow;
+		}
+		else {
+			a.child1 = indexLow;
+		}
+
+		a.boundsMin  = Vector3::Min(down.boundsMin, low.boundsMin);
+		a.boundsMax  = Vector3::Max(down.boundsMax, low.boundsMax);
+		a.height     = 1 + MMath::Max(down.height, low.height);
+
+		up.boundsMin = Vector3::Min(a.boundsMin, high.boundsMin);
+		up.boundsMax = Vector3::Max(a.boundsMax, high.boundsMax);
+		up.height    = 1 + MMath::Max(a.height, high.height);
+
+		return indexUp;
+	}
+
+	void DVKSceneBVH::CollectLeaves(int32 index, std::vector<int32>& outUserDatas) const
+	{
+		DVKTraversalStack<int32> stack;
+		stack.Push(index);
+
+		while (!stack.IsEmpty())
+		{
+			const Node& node = nodes[stack.Pop()];
+			if (node.IsLeaf())
+			{
+				outUserDatas.push_back(node.userData);
+				continue;
+			}
+			stack.Push(node.child1);
+			stack.Push(node.child2);
+		}
+	}
+
+	int32 DVKSceneBVH::QueryFrustum(const DVKFrustum& frustum, std::vector<int32>& outUserDatas) const
+	{
+		outUserDatas.clear();
+		if (root == -1) {
+			return 0;
+		}
+
+		Vector4 absPlanes[6];
+		for (int32 i = 0; i < 6; ++i) {
+			absPlanes[i].Set(MMath::Abs(frustum.planes[i].x), MMath::Abs(frustum.planes[i].y), MMath::Abs(frustum.planes[i].z), 0.0f);
+		}
+
+		struct Entry
+		{
+			int32 index;
+			int32 planeMask;
+		};
+
+		DVKTraversalStack<Entry> stack;
+		stack.Push({ root, (1 << 6) - 1 });
+
+		while (!stack.IsEmpty())
+		{
+			Entry entry = stack.Pop();
+			const Node& node = nodes[entry.index];
+
+			Vector3 center = (node.boundsMin + node.boundsMax) * 0.5f;
+			Vector3 extent = (node.boundsMax - node.boundsMin) * 0.5f;
+
+			bool outside = false;
+			for (int32 i = 0; i < 6; ++i)
+			{
+				if ((entry.planeMask & (1 << i)) == 0) {
+					continue;
+				}
+
+				const Vector4& plane = frustum.planes[i];
+				float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+				float radius   = absPlanes[i].x * extent.x + absPlanes[i].y * extent.y + absPlanes[i].z * extent.z;
+				if (distance + radius <= 0.0f)
+				{
+					outside = true;
+					break;
+				}
+				// 完全在这个平面内侧，子节点不再测试它
+				if (distance - radius > 0.0f) {
+					entry.planeMask &= ~(1 << i);
+				}
+			}
+
+			if (outside) {
+				continue;
+			}
+
+			if (node.IsLeaf()) {
+				outUserDatas.push_back(node.userData);
+			}
+			else if (entry.planeMask == 0) {
+				CollectLeaves(entry.index, outUserDatas);
+			}
+			else
+			{
+				stack.Push({ node.child1, entry.planeMask });
+				stack.Push({ node.child2, entry.planeMask });
+			}
+		}
+
+		return outUserDatas.size();
+	}
+
+	int32 DVKSceneBVH::QueryBox(const Vector3& boundsMin, const Vector3& boundsMax, std::vector<int32>& outUserDatas) const
+	{
+		outUserDatas.clear();
+		if (root == -1) {
+			return 0;
+		}
+
+		DVKTraversalStack<int32> stack;
+		stack.Push(root);
+
+		while (!stack.IsEmpty())
+		{
+			const Node& node = nodes[stack.Pop()];
+			if (!Overlaps(node.boundsMin, node.boundsMax, boundsMin, boundsMax)) {
+				continue;
+			}
+
+			if (node.IsLeaf()) {
+				outUserDatas.push_back(node.userData);
+			}
+			else
+			{
+				stack.Push(node.child1);
+				stack.Push(node.child2);
+			}
+		}
+
+		return outUserDatas.size();
+	}
+
+	int32 DVKSceneBVH::QuerySphere(const Vector3& center, float radius, std::vector<int32>& outUserDatas) const
+	{
+		outUserDatas.clear();
+		if (root == -1) {
+			return 0;
+		}
+
+		float radiusSquared = radius * radius;
+
+		DVKTraversalStack<int32> stack;
+		stack.Push(root);
+
+		while (!stack.IsEmpty())
+		{
+			const Node& node = nodes[stack.Pop()];
+
+			// 包围盒上离球心最近的点
+			Vector3 closest = Vector3::Min(Vector3::Max(center, node.boundsMin), node.boundsMax);
+			if ((closest - center).SizeSquared() > radiusSquared) {
+				continue;
+			}
+
+			if (node.IsLeaf()) {
+				outUserDatas.push_back(node.userData);
+			}
+			else
+			{
+				stack.Push(node.child1);
+				stack.Push(node.child2);
+			}
+		}
+
+		return outUserDatas.size();
+	}
+
+	int32 DVKSceneBVH::QueryRay(const Vector3& origin, const Vector3& direction, float maxDistance, std::vector<int32>& outUserDatas) const
+	{
+		outUserDatas.clear();
+		if (root == -1) {
+			return 0;
+		}
+
+		Vector3 invDirection = GetInvDirection(direction);
+
+		DVKTraversalStack<int32> stack;
+		stack.Push(root);
+
+		while (!stack.IsEmpty())
+		{
+			const Node& node = nodes[stack.Pop()];
+			if (IntersectRay(node.boundsMin, node.boundsMax, origin, invDirection, maxDistance) < 0.0f) {
+				continue;
+			}
+
+			if (node.IsLeaf()) {
+				outUserDatas.push_back(node.userData);
+			}
+			else
+			{
+				stack.Push(node.child1);
+				stack.Push(node.child2);
+			}
+		}
+
+		return outUserDatas.size();
+	}
+
+	float DVKSceneBVH::RayCast(const Vector3& origin, const Vector3& direction, float maxDistance, const RayFunc& func, int32* outUserData) const
+	{
+		if (root == -1) {
+			return -1.0f;
+		}
+
+		Vector3 invDirection = GetInvDirection(direction);
+
+		float rootDistance = IntersectRay(nodes[root].boundsMin, nodes[root].boundsMax, origin, invDirection, maxDistance);
+		if (rootDistance < 0.0f) {
+			return -1.0f;
+		}
+
+		struct Entry
+		{
+			int32 index;
+			float distance;
+		};
+
+		DVKTraversalStack<Entry> stack;
+		stack.Push({ root, rootDistance });
+
+		float closest  = maxDistance;
+		int32 hitData  = -1;
+		bool  hit      = false;
+
+		while (!stack.IsEmpty())
+		{
+			Entry entry = stack.Pop();
+			// 已经找到更近的相交
+			if (entry.distance > closest) {
+				continue;
+			}
+
+			const Node& node = nodes[entry.index];
+			if (node.IsLeaf())
+			{
+				float distance = func(node.userData, closest);
+				if (distance >= 0.0f && distance <= closest)
+				{
+					closest = distance;
+					hitData = node.userData;
+					hit     = true;
+				}
+				continue;
+			}
+
+			float distance1 = IntersectRay(nodes[node.child1].boundsMin, nodes[node.child1].boundsMax, origin, invDirection, closest);
+			float distance2 = IntersectRay(nodes[node.child2].boundsMin, nodes[node.child2].boundsMax, origin, invDirection, closest);
+
+			// 近的后入栈，先被访问
+			if (distance1 >= 0.0f && distance2 >= 0.0f)
+			{
+				if (distance1 > distance2)
+				{
+					stack.Push({ node.child1, distance1 });
+					stack.Push({ node.child2, distance2 });
+				}
+				else
+				{
+					stack.Push({ node.child2, distance2 });
+					stack.Push({ node.child1, distance1 });
+				}
+			}
+			else if (distance1 >= 0.0f) {
+				stack.Push({ node.child1, distance1 });
+			}
+			else if (distance2 >= 0.0f) {
+				stack.Push({ node.child2, distance2 });
+			}
+		}
+
+		if (!hit) {
+			return -1.0f;
+		}
+
+		if (outUserData) {
+			*outUserData = hitData;
+		}
+
+		return closest;
+	}
+
+}
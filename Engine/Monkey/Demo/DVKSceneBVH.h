@@ -0,0 +1,114 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Vector3.h"
+
+#include "DVKFrustum.h"
+
+#include <vector>
+#include <functional>
+
+namespace vk_demo
+{
+
+	// 动态AABB树，用于场景物体的视锥剔除、射线查询以及包围盒/包围球相交查询。
+	// 叶子保存放大(fat)之后的包围盒，物体移动时只要还在放大的包围盒内就不需要修改树。
+	// 插入时按表面积代价选择兄弟节点，插入和删除之后沿父节点旋转保持平衡。
+	class DVKSceneBVH
+	{
+	public:
+		// 返回射线与userData对应物体的精确相交距离，不相交时返回负数
+		typedef std::function<float(int32 userData, float maxDistance)> RayFunc;
+
+		// margin为叶子包围盒每一边放大的比例(相对于包围盒的尺寸)
+		DVKSceneBVH(float inMargin = 0.1f);
+
+		void Clear();
+
+		// 返回叶子的序号(proxy)，之后用它更新或者删除
+		int32 Insert(const Vector3& boundsMin, const Vector3& boundsMax, int32 userData);
+
+		void Remove(int32 proxy);
+
+		// 新的包围盒仍然在放大的包围盒内时直接返回false，否则重新插入并返回true
+		bool Update(int32 proxy, const Vector3& boundsMin, const Vector3& boundsMax);
+
+		FORCEINLINE int32 GetUserData(int32 proxy) const
+		{
+			return nodes[proxy].userData;
+		}
+
+		FORCEINLINE void GetFatBounds(int32 proxy, Vector3& outMin, Vector3& outMax) const
+		{
+			outMin = nodes[proxy].boundsMin;
+			outMax = nodes[proxy].boundsMax;
+		}
+
+		FORCEINLINE int32 Size() const
+		{
+			return leafCount;
+		}
+
+		// 根节点的高度，空树为-1
+		FORCEINLINE int32 GetHeight() const
+		{
+			return root == -1 ? -1 : nodes[root].height;
+		}
+
+		// 以下查询把结果的userData写入outUserDatas(会先清空)，返回数量。
+		// 视锥查询记录每个节点已经完全位于哪些平面内侧，子树完全在视锥内时直接收集所有叶子，不再测试。
+		int32 QueryFrustum(const DVKFrustum& frustum, std::vector<int32>& outUserDatas) const;
+
+		int32 QueryBox(const Vector3& boundsMin, const Vector3& boundsMax, std::vector<int32>& outUserDatas) const;
+
+		int32 QuerySphere(const Vector3& center, float radius, std::vector<int32>& outUserDatas) const;
+
+		// 包围盒与线段[origin, origin + direction * maxDistance]相交的所有叶子，direction不需要归一化
+		int32 QueryRay(const Vector3& origin, const Vector3& direction, float maxDistance, std::vector<int32>& outUserDatas) const;
+
+		// 最近相交：由近到远访问子节点，func返回的距离会缩短射线，跳过更远的子树。
+		// 返回最近的距离并把对应的userData写入outUserData，没有相交时返回负数。
+		float RayCast(const Vector3& origin, const Vector3& direction, float maxDistance, const RayFunc& func, int32* outUserData = nullptr) const;
+
+	private:
+		struct Node
+		{
+			Vector3	boundsMin;
+			Vector3	boundsMax;
+			// 空闲节点中保存下一个空闲节点
+			int32	parent;
+			int32	child1;
+			int32	child2;
+			// 叶子为0，空闲节点为-1
+			int32	height;
+			int32	userData;
+
+			FORCEINLINE bool IsLeaf() const
+			{
+				return child1 == -1;
+			}
+		};
+
+		int32 AllocateNode();
+
+		void FreeNode(int32 index);
+
+		void InsertLeaf(int32 leaf);
+
+		void RemoveLeaf(int32 leaf);
+
+		int32 Balance(int32 index);
+
+		// 把index子树中的所有叶子写入outUserDatas
+		void CollectLeaves(int32 index, std::vector<int32>& outUserDatas) const;
+
+	private:
+		std::vector<Node>	nodes;
+		int32				root;
+		int32				freeList;
+		int32				leafCount;
+		float				margin;
+	};
+
+}
@@ -0,0 +1,497 @@
+﻿#include "DVKSkinning.h"
+
+#include "Math/VectorRegister.h"
+
+namespace vk_demo
+{
+
+	DVKDualQuat DVKDualQuat::FromMatrix(const Matrix4x4& matrix)
+	{
+		Quat    rotation = matrix.ToQuat();
+		Vector3 position = matrix.GetOrigin();
+
+		DVKDualQuat result;
+		result.real   = rotation;
+		result.dual.x = (+0.5f) * ( position.x * rotation.w + position.y * rotation.z - position.z * rotation.y);
+		result.dual.y = (+0.5f) * (-position.x * rotation.z + position.y * rotation.w + position.z * rotation.x);
+		result.dual.z = (+0.5f) * ( position.x * rotation.y - position.y * rotation.x + position.z * rotation.w);
+		result.dual.w = (-0.5f) * ( position.x * rotation.x + position.y * rotation.y + position.z * rotation.z);
+		return result;
+	}
+
+	void DVKSkinVertices::Resize(int32 inVertexCount, bool hasNormals, bool hasTangents)
+	{
+		vertexCount = inVertexCount;
+		int32 blockCount = GetBlockCount();
+		positions.resize(blockCount * VectorStride);
+		normals.resize(hasNormals ? blockCount * VectorStride : 0);
+		tangents.resize(hasTangents ? blockCount * TangentStride : 0);
+	}
+
+	// ---------------------------------------- 顶点解码 ----------------------------------------
+
+	static FORCEINLINE uint32 FloatBits(float value)
+	{
+		uint32 bits = 0;
+		memcpy(&bits, &value, sizeof(float));
+		return bits;
+	}
+
+	static FORCEINLINE float SNorm16ToFloat(uint32 value)
+	{
+		return MMath::Max((int16)(value & 0xFFFF) / 32767.0f, -1.0f);
+	}
+
+	static Vector3 OctDecode(float x, float y)
+	{
+		Vector3 normal(x, y, 1.0f - MMath::Abs(x) - MMath::Abs(y));
+		float t = MMath::Max(-normal.z, 0.0f);
+		normal.x -= normal.x >= 0.0f ? t : -t;
+		normal.y -= normal.y >= 0.0f ? t : -t;
+		return normal.GetSafeNormal();
+	}
+
+	static void WriteLane(float* block, int32 lane, int32 components, const float* values)
+	{
+		for (int32 i = 0; i < components; ++i) {
+			block[lane + i * DVKSkinVertices::BlockSize] = values[i];
+		}
+	}
+
+	bool DVKSkinSource::Build(const std::vector<VertexAttribute>& attributes, const DVKMesh* mesh, const DVKPrimitive* primitive, DVKSkinSource& outSource)
+	{
+		int32 stride = 0;
+		int32 offsets[VertexAttribute::VA_Count];
+		for (int32 i = 0; i < VertexAttribute::VA_Count; ++i) {
+			offsets[i] = -1;
+		}
+		for (int32 i = 0; i < attributes.size(); ++i)
+		{
+			offsets[attributes[i]] = stride;
+			stride += VertexAttributeToSize(attributes[i]) / sizeof(float);
+		}
+
+		int32 positionOffset = MMath::Max(offsets[VA_Position], offsets[VA_PackedPosition]);
+		int32 normalOffset   = MMath::Max(offsets[VA_Normal], offsets[VA_PackedNormal]);
+		int32 tangentOffset  = MMath::Max(offsets[VA_Tangent], offsets[VA_PackedTangent]);
+		bool  hasSkin        = offsets[VA_SkinPack] >= 0 || ((offsets[VA_SkinIndex] >= 0 || offsets[VA_PackedSkinIndex] >= 0) && (offsets[VA_SkinWeight] >= 0 || offsets[VA_PackedSkinWeight] >= 0));
+		if (stride == 0 || positionOffset < 0 || !hasSkin || !mesh->isSkin || mesh->bones.empty() || primitive->vertices.empty()) {
+			return false;
+		}
+
+		Vector3 positionScale;
+		Vector3 positionBias;
+		mesh->GetPositionDequantize(positionScale, positionBias);
+
+		int32 vertexCount = primitive->vertices.size() / stride;
+		outSource.bindPose.Resize(vertexCount, normalOffset >= 0, tangentOffset >= 0);
+
+		int32 blockCount = outSource.bindPose.GetBlockCount();
+		outSource.boneIndices.assign(blockCount * BlockSize * MaxInfluences, 0);
+		outSource.boneWeights.assign(blockCount * BlockSize * MaxInfluences, 0.0f);
+		outSource.influences.assign(blockCount, 1);
+
+		// 补齐的顶点重复第一个顶点
+		for (int32 v = 0; v < blockCount * BlockSize; ++v)
+		{
+			const float* data = primitive->vertices.data() + (v < vertexCount ? v : 0) * stride;
+			int32 block = v / BlockSize;
+			int32 lane  = v % BlockSize;
+
+			float position[3];
+			if (offsets[VA_PackedPosition] >= 0)
+			{
+				uint32 xy = FloatBits(data[positionOffset + 0]);
+				uint32 z  = FloatBits(data[positionOffset + 1]);
+				position[0] = (xy & 0xFFFF) / 65535.0f * positionScale.x + positionBias.x;
+				position[1] = (xy >> 16)    / 65535.0f * positionScale.y + positionBias.y;
+				position[2] = (z  & 0xFFFF) / 65535.0f * positionScale.z + positionBias.z;
+			}
+			else
+			{
+				memcpy(position, data + positionOffset, sizeof(float) * 3);
+			}
+			WriteLane(outSource.bindPose.positions.data() + block * DVKSkinVertices::VectorStride, lane, 3, position);
+
+			if (normalOffset >= 0)
+			{
+				float normal[3];
+				if (offsets[VA_PackedNormal] >= 0)
+				{
+					uint32 bits = FloatBits(data[normalOffset]);
+					Vector3 decoded = OctDecode(SNorm16ToFloat(bits), SNorm16ToFloat(bits >> 16));
+					normal[0] = decoded.x;
+					normal[1] = decoded.y;
+					normal[2] = decoded.z;
+				}
+				else
+				{
+					memcpy(normal, data + normalOffset, sizeof(float) * 3);
+				}
+				WriteLane(outSource.bindPose.normals.data() + block * DVKSkinVertices::VectorStride, lane, 3, normal);
+			}
+
+			if (tangentOffset >= 0)
+			{
+				float tangent[4];
+				if (offsets[VA_PackedTangent] >= 0)
+				{
+					uint32 bits = FloatBits(data[tangentOffset]);
+					float y = SNorm16ToFloat(bits >> 16);
+					Vector3 decoded = OctDecode(SNorm16ToFloat(bits), MMath::Abs(y) * 2.0f - 1.0f);
+					tangent[0] = decoded.x;
+					tangent[1] = decoded.y;
+					tangent[2] = decoded.z;
+					tangent[3] = y < 0.0f ? -1.0f : 1.0f;
+				}
+				else
+				{
+					memcpy(tangent, data + tangentOffset, sizeof(float) * 4);
+				}
+				WriteLane(outSource.bindPose.tangents.data() + block * DVKSkinVertices::TangentStride, lane, 4, tangent);
+			}
+
+			// 骨骼
+			int32 indices[MaxInfluences] = { 0, 0, 0, 0 };
+			float weights[MaxInfluences] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			if (offsets[VA_SkinPack] >= 0)
+			{
+				// 与Shader中的UnPackUInt32To4Byte、UnPackUInt32To2Short一致
+				const float* pack = data + offsets[VA_SkinPack];
+				uint32 packIndex   = (uint32)pack[0];
+				uint32 packWeight0 = (uint32)pack[1];
+				uint32 packWeight1 = (uint32)pack[2];
+				for (int32 k = 0; k < MaxInfluences; ++k) {
+					indices[k] = (packIndex >> (24 - k * 8)) & 0xFF;
+				}
+				weights[0] = (packWeight0 >> 16)    / 65535.0f;
+				weights[1] = (packWeight0 & 0xFFFF) / 65535.0f;
+				weights[2] = (packWeight1 >> 16)    / 65535.0f;
+				weights[3] = (packWeight1 & 0xFFFF) / 65535.0f;
+			}
+			else
+			{
+				if (offsets[VA_PackedSkinIndex] >= 0)
+				{
+					uint32 bits = FloatBits(data[offsets[VA_PackedSkinIndex]]);
+					for (int32 k = 0; k < MaxInfluences; ++k) {
+						indices[k] = (bits >> (k * 8)) & 0xFF;
+					}
+				}
+				else
+				{
+					for (int32 k = 0; k < MaxInfluences; ++k) {
+						indices[k] = (int32)data[offsets[VA_SkinIndex] + k];
+					}
+				}
+
+				if (offsets[VA_PackedSkinWeight] >= 0)
+				{
+					uint32 bits = FloatBits(data[offsets[VA_PackedSkinWeight]]);
+					for (int32 k = 0; k < MaxInfluences; ++k) {
+						weights[k] = ((bits >> (k * 8)) & 0xFF) / 255.0f;
+					}
+				}
+				else
+				{
+					memcpy(weights, data + offsets[VA_SkinWeight], sizeof(float) * MaxInfluences);
+				}
+			}
+
+			// 权重归一化，没有骨骼的顶点跟随第0个骨骼
+			float sum = weights[0] + weights[1] + weights[2] + weights[3];
+			if (sum <= 0.0f)
+			{
+				weights[0] = 1.0f;
+				sum = 1.0f;
+			}
+
+			int32 used = 0;
+			for (int32 k = 0; k < MaxInfluences; ++k)
+			{
+				int32 index = block * BlockSize * MaxInfluences + k * BlockSize + lane;
+				outSource.boneIndices[index] = indices[k];
+				outSource.boneWeights[index] = weights[k] / sum;
+				if (weights[k] > 0.0f) {
+					used = k + 1;
+				}
+			}
+			outSource.influences[block] = MMath::Max<int32>(outSource.influences[block], used);
+		}
+
+		return true;
+	}
+
+	// ---------------------------------------- 蒙皮 ----------------------------------------
+
+	void DVKSkinning::BuildPalette(const DVKModel* model, const DVKMesh* mesh, std::vector<Matrix4x4>& outPalette)
+	{
+		outPalette.resize(mesh->bones.size());
+		for (int32 i = 0; i < mesh->bones.size(); ++i) {
+			outPalette[i] = model->bones[mesh->bones[i]]->finalTransform;
+		}
+	}
+
+	void DVKSkinning::BuildPalette(const std::vector<Matrix4x4>& matrices, std::vector<DVKDualQuat>& outPalette)
+	{
+		outPalette.resize(matrices.size());
+		for (int32 i = 0; i < matrices.size(); ++i) {
+			outPalette[i] = DVKDualQuat::FromMatrix(matrices[i]);
+		}
+	}
+
+	// SoA的xyz归一化
+	static FORCEINLINE void NormalizeSoA(VectorRegister& x, VectorRegister& y, VectorRegister& z)
+	{
+		VectorRegister lengthSquared = VectorMultiplyAdd(x, x, VectorMultiplyAdd(y, y, VectorMultiply(z, z)));
+		VectorRegister invLength = VectorReciprocalSqrt(VectorMax(lengthSquared, VectorSetFloat1(1e-20f)));
+		x = VectorMultiply(x, invLength);
+		y = VectorMultiply(y, invLength);
+		z = VectorMultiply(z, invLength);
+	}
+
+	static FORCEINLINE void StoreSoA(float* block, const VectorRegister& x, const VectorRegister& y, const VectorRegister& z)
+	{
+		VectorStore(x, block + 0);
+		VectorStore(y, block + 4);
+		VectorStore(z, block + 8);
+	}
+
+	// 每个顶点先在寄存器中按行混合出3x4矩阵(一行一个寄存器)，变换后的4个顶点再转置回SoA
+	static void SkinMatrixBlocks(const DVKSkinSource& source, const Matrix4x4* palette, DVKSkinVertices& output, int32 beginBlock, int32 endBlock)
+	{
+		const DVKSkinVertices& bindPose = source.bindPose;
+		bool hasNormals  = !bindPose.normals.empty();
+		bool hasTangents = !bindPose.tangents.empty();
+
+		for (int32 block = beginBlock; block < endBlock; ++block)
+		{
+			const uint16* indices   = source.boneIndices.data() + block * 16;
+			const float*  weights   = source.boneWeights.data() + block * 16;
+			const float*  positions = bindPose.positions.data() + block * DVKSkinVertices::VectorStride;
+			const float*  normals   = hasNormals  ? bindPose.normals.data()  + block * DVKSkinVertices::VectorStride  : nullptr;
+			const float*  tangents  = hasTangents ? bindPose.tangents.data() + block * DVKSkinVertices::TangentStride : nullptr;
+			int32 influences = source.influences[block];
+
+			VectorRegister outPositions[4];
+			VectorRegister outNormals[4];
+			VectorRegister outTangents[4];
+
+			for (int32 lane = 0; lane < 4; ++lane)
+			{
+				VectorRegister row0 = VectorZero();
+				VectorRegister row1 = VectorZero();
+				VectorRegister row2 = VectorZero();
+				VectorRegister row3 = VectorZero();
+				for (int32 k = 0; k < influences; ++k)
+				{
+					const Matrix4x4& bone = palette[indices[k * 4 + lane]];
+					VectorRegister weight = VectorLoadFloat1(weights + k * 4 + lane);
+					row0 = VectorMultiplyAdd(VectorLoad(bone.m[0]), weight, row0);
+					row1 = VectorMultiplyAdd(VectorLoad(bone.m[1]), weight, row1);
+					row2 = VectorMultiplyAdd(VectorLoad(bone.m[2]), weight, row2);
+					row3 = VectorMultiplyAdd(VectorLoad(bone.m[3]), weight, row3);
+				}
+
+				// 行向量：v * M
+				VectorRegister x = VectorLoadFloat1(positions + lane + 0);
+				VectorRegister y = VectorLoadFloat1(positions + lane + 4);
+				VectorRegister z = VectorLoadFloat1(positions + lane + 8);
+				outPositions[lane] = VectorMultiplyAdd(x, row0, VectorMultiplyAdd(y, row1, VectorMultiplyAdd(z, row2, row3)));
+
+				if (normals)
+				{
+					x = VectorLoadFloat1(normals + lane + 0);
+					y = VectorLoadFloat1(normals + lane + 4);
+					z = VectorLoadFloat1(normals + lane + 8);
+					outNormals[lane] = VectorMultiplyAdd(x, row0, VectorMultiplyAdd(y, row1, VectorMultiply(z, row2)));
+				}
+
+				if (tangents)
+				{
+					x = VectorLoadFloat1(tangents + lane + 0);
+					y = VectorLoadFloat1(tangents + lane + 4);
+					z = VectorLoadFloat1(tangents + lane + 8);
+					outTangents[lane] = VectorMultiplyAdd(x, row0, VectorMultiplyAdd(y, row1, VectorMultiply(z, row2)));
+				}
+			}
+
+			VectorTranspose4(outPositions[0], outPositions[1], outPositions[2], outPositions[3]);
+			StoreSoA(output.positions.data() + block * DVKSkinVertices::VectorStride, outPositions[0], outPositions[1], outPositions[2]);
+
+			if (normals)
+			{
+				VectorTranspose4(outNormals[0], outNormals[1], outNormals[2], outNormals[3]);
+				NormalizeSoA(outNormals[0], outNormals[1], outNormals[2]);
+				StoreSoA(output.normals.data() + block * DVKSkinVertices::VectorStride, outNormals[0], outNormals[1], outNormals[2]);
+			}
+
+			if (tangents)
+			{
+				float* outBlock = output.tangents.data() + block * DVKSkinVertices::TangentStride;
+				VectorTranspose4(outTangents[0], outTangents[1], outTangents[2], outTangents[3]);
+				NormalizeSoA(outTangents[0], outTangents[1], outTangents[2]);
+				StoreSoA(outBlock, outTangents[0], outTangents[1], outTangents[2]);
+				VectorStore(VectorLoad(tangents + 12), outBlock + 12);
+			}
+		}
+	}
+
+	// SoA的叉积
+	static FORCEINLINE void CrossSoA(const VectorRegister& ax, const VectorRegister& ay, const VectorRegister& az, const VectorRegister& bx, const VectorRegister& by, const VectorRegister& bz, VectorRegister& outX, VectorRegister& outY, VectorRegister& outZ)
+	{
+		outX = VectorSubtract(VectorMultiply(ay, bz), VectorMultiply(az, by));
+		outY = VectorSubtract(VectorMultiply(az, bx), VectorMultiply(ax, bz));
+		outZ = VectorSubtract(VectorMultiply(ax, by), VectorMultiply(ay, bx));
+	}
+
+	// v + 2 * r.xyz x (r.xyz x v + r.w * v)
+	static FORCEINLINE void RotateSoA(const VectorRegister* real, VectorRegister& x, VectorRegister& y, VectorRegister& z)
+	{
+		VectorRegister cx, cy, cz;
+		CrossSoA(real[0], real[1], real[2], x, y, z, cx, cy, cz);
+		cx = VectorMultiplyAdd(real[3], x, cx);
+		cy = VectorMultiplyAdd(real[3], y, cy);
+		cz = VectorMultiplyAdd(real[3], z, cz);
+
+		VectorRegister dx, dy, dz;
+		CrossSoA(real[0], real[1], real[2], cx, cy, cz, dx, dy, dz);
+
+		VectorRegister two = VectorSetFloat1(2.0f);
+		x = VectorMultiplyAdd(dx, two, x);
+		y = VectorMultiplyAdd(dy, two, y);
+		z = VectorMultiplyAdd(dz, two, z);
+	}
+
+	// 4个顶点的对偶四元数直接按SoA混合：每个骨骼读入4个顶点的四元数后转置
+	static void SkinDualQuatBlocks(const DVKSkinSource& source, const DVKDualQuat* palette, DVKSkinVertices& output, int32 beginBlock, int32 endBlock)
+	{
+		const DVKSkinVertices& bindPose = source.bindPose;
+		bool hasNormals  = !bindPose.normals.empty();
+		bool hasTangents = !bindPose.tangents.empty();
+
+		for (int32 block = beginBlock; block < endBlock; ++block)
+		{
+			const uint16* indices = source.boneIndices.data() + block * 16;
+			const float*  weights = source.boneWeights.data() + block * 16;
+			int32 influences = source.influences[block];
+
+			VectorRegister real[4];
+			VectorRegister dual[4];
+			VectorRegister pivot[4];
+			for (int32 k = 0; k < influences; ++k)
+			{
+				const DVKDualQuat& dq0 = palette[indices[k * 4 + 0]];
+				const DVKDualQuat& dq1 = palette[indices[k * 4 + 1]];
+				const DVKDualQuat& dq2 = palette[indices[k * 4 + 2]];
+				const DVKDualQuat& dq3 = palette[indices[k * 4 + 3]];
+
+				VectorRegister r[4] = { VectorLoad(&dq0.real.x), VectorLoad(&dq1.real.x), VectorLoad(&dq2.real.x), VectorLoad(&dq3.real.x) };
+				VectorRegister d[4] = { VectorLoad(&dq0.dual.x), VectorLoad(&dq1.dual.x), VectorLoad(&dq2.dual.x), VectorLoad(&dq3.dual.x) };
+				VectorTranspose4(r[0], r[1], r[2], r[3]);
+				VectorTranspose4(d[0], d[1], d[2], d[3]);
+
+				VectorRegister weight = VectorLoad(weights + k * 4);
+				if (k == 0)
+				{
+					for (int32 i = 0; i < 4; ++i)
+					{
+						pivot[i] = r[i];
+						real[i]  = VectorMultiply(r[i], weight);
+						dual[i]  = VectorMultiply(d[i], weight);
+					}
+					continue;
+				}
+
+				// 与第一个骨骼不在同一半球时取反，保证走最短路径
+				VectorRegister dot = VectorMultiplyAdd(r[0], pivot[0], VectorMultiplyAdd(r[1], pivot[1], VectorMultiplyAdd(r[2], pivot[2], VectorMultiply(r[3], pivot[3]))));
+				weight = VectorSelect(VectorCompareLT(dot, VectorZero()), VectorSubtract(VectorZero(), weight), weight);
+				for (int32 i = 0; i < 4; ++i)
+				{
+					real[i] = VectorMultiplyAdd(r[i], weight, real[i]);
+					dual[i] = VectorMultiplyAdd(d[i], weight, dual[i]);
+				}
+			}
+
+			// 归一化
+			VectorRegister lengthSquared = VectorMultiplyAdd(real[0], real[0], VectorMultiplyAdd(real[1], real[1], VectorMultiplyAdd(real[2], real[2], VectorMultiply(real[3], real[3]))));
+			VectorRegister invLength = VectorReciprocalSqrt(VectorMax(lengthSquared, VectorSetFloat1(1e-20f)));
+			for (int32 i = 0; i < 4; ++i)
+			{
+				real[i] = VectorMultiply(real[i], invLength);
+				dual[i] = VectorMultiply(dual[i], invLength);
+			}
+
+			// translation = 2 * (r.w * d.xyz - d.w * r.xyz + r.xyz x d.xyz)
+			VectorRegister tx, ty, tz;
+			CrossSoA(real[0], real[1], real[2], dual[0], dual[1], dual[2], tx, ty, tz);
+			tx = VectorMultiplyAdd(real[3], dual[0], VectorSubtract(tx, VectorMultiply(dual[3], real[0])));
+			ty = VectorMultiplyAdd(real[3], dual[1], VectorSubtract(ty, VectorMultiply(dual[3], real[1])));
+			tz = VectorMultiplyAdd(real[3], dual[2], VectorSubtract(tz, VectorMultiply(dual[3], real[2])));
+
+			const float* positions = bindPose.positions.data() + block * DVKSkinVertices::VectorStride;
+			VectorRegister x = VectorLoad(positions + 0);
+			VectorRegister y = VectorLoad(positions + 4);
+			VectorRegister z = VectorLoad(positions + 8);
+			RotateSoA(real, x, y, z);
+			VectorRegister two = VectorSetFloat1(2.0f);
+			x = VectorMultiplyAdd(tx, two, x);
+			y = VectorMultiplyAdd(ty, two, y);
+			z = VectorMultiplyAdd(tz, two, z);
+			StoreSoA(output.positions.data() + block * DVKSkinVertices::VectorStride, x, y, z);
+
+			if (hasNormals)
+			{
+				const float* normals = bindPose.normals.data() + block * DVKSkinVertices::VectorStride;
+				x = VectorLoad(normals + 0);
+				y = VectorLoad(normals + 4);
+				z = VectorLoad(normals + 8);
+				RotateSoA(real, x, y, z);
+				StoreSoA(output.normals.data() + block * DVKSkinVertices::VectorStride, x, y, z);
+			}
+
+			if (hasTangents)
+			{
+				const float* tangents = bindPose.tangents.data() + block * DVKSkinVertices::TangentStride;
+				float* outBlock = output.tangents.data() + block * DVKSkinVertices::TangentStride;
+				x = VectorLoad(tangents + 0);
+				y = VectorLoad(tangents + 4);
+				z = VectorLoad(tangents + 8);
+				RotateSoA(real, x, y, z);
+				StoreSoA(outBlock, x, y, z);
+				VectorStore(VectorLoad(tangents + 12), outBlock + 12);
+			}
+		}
+	}
+
+	template<class PaletteType>
+	static void SkinBlocks(const DVKSkinSource& source, const PaletteType* palette, DVKSkinVertices& output, DVKJobPool* pool, int32 batchBlocks, void (*kernel)(const DVKSkinSource&, const PaletteType*, DVKSkinVertices&, int32, int32))
+	{
+		const DVKSkinVertices& bindPose = source.bindPose;
+		if (output.vertexCount != bindPose.vertexCount || output.normals.size() != bindPose.normals.size() || output.tangents.size() != bindPose.tangents.size()) {
+			output.Resize(bindPose.vertexCount, !bindPose.normals.empty(), !bindPose.tangents.empty());
+		}
+
+		int32 blockCount = bindPose.GetBlockCount();
+		if (pool == nullptr)
+		{
+			kernel(source, palette, output, 0, blockCount);
+			return;
+		}
+
+		pool->ParallelFor(blockCount, batchBlocks, [&](int32 begin, int32 end) {
+			kernel(source, palette, output, begin, end);
+		});
+	}
+
+	void DVKSkinning::Skin(const DVKSkinSource& source, const Matrix4x4* palette, DVKSkinVertices& output, DVKJobPool* pool, int32 batchBlocks)
+	{
+		SkinBlocks(source, palette, output, pool, batchBlocks, SkinMatrixBlocks);
+	}
+
+	void DVKSkinning::Skin(const DVKSkinSource& source, const DVKDualQuat* palette, DVKSkinVertices& output, DVKJobPool* pool, int32 batchBlocks)
+	{
+		SkinBlocks(source, palette, output, pool, batchBlocks, SkinDualQuatBlocks);
+	}
+
+}
@@ -0,0 +1,114 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Vector3.h"
+#include "Math/Vector4.h"
+#include "Math/Quat.h"
+#include "Math/Matrix4x4.h"
+
+#include "DVKModel.h"
+#include "DVKJobPool.h"
+
+#include <vector>
+
+namespace vk_demo
+{
+
+	// 对偶四元数，与SkeletonQuatDemo上传给Shader的格式一致：dual = 0.5 * (translation, 0) * real
+	struct DVKDualQuat
+	{
+		Quat	real;
+		Quat	dual;
+
+		// 矩阵中的缩放会被丢弃
+		static DVKDualQuat FromMatrix(const Matrix4x4& matrix);
+	};
+
+	// 按4个顶点一组存放的SoA数据，每组依次为x[4] y[4] z[4]，切线多一个w[4]。
+	// 顶点数不是4的整数倍时最后一组用第一个顶点补齐。
+	struct DVKSkinVertices
+	{
+		enum
+		{
+			BlockSize       = 4,
+			VectorStride    = 12,
+			TangentStride   = 16,
+		};
+
+		int32				vertexCount = 0;
+		std::vector<float>	positions;
+		std::vector<float>	normals;
+		std::vector<float>	tangents;
+
+		FORCEINLINE int32 GetBlockCount() const
+		{
+			return (vertexCount + BlockSize - 1) / BlockSize;
+		}
+
+		FORCEINLINE Vector3 GetPosition(int32 index) const
+		{
+			return GetVector(positions.data() + (index / BlockSize) * VectorStride, index % BlockSize);
+		}
+
+		FORCEINLINE Vector3 GetNormal(int32 index) const
+		{
+			return GetVector(normals.data() + (index / BlockSize) * VectorStride, index % BlockSize);
+		}
+
+		FORCEINLINE Vector4 GetTangent(int32 index) const
+		{
+			const float* block = tangents.data() + (index / BlockSize) * TangentStride;
+			int32 lane = index % BlockSize;
+			return Vector4(block[lane], block[lane + 4], block[lane + 8], block[lane + 12]);
+		}
+
+		void Resize(int32 inVertexCount, bool hasNormals, bool hasTangents);
+
+	private:
+		static FORCEINLINE Vector3 GetVector(const float* block, int32 lane)
+		{
+			return Vector3(block[lane], block[lane + 4], block[lane + 8]);
+		}
+	};
+
+	// 蒙皮的输入：绑定姿态以及每个顶点4个骨骼的序号和权重。
+	// 骨骼序号与顶点数据一致，是DVKMesh::bones中的序号。
+	struct DVKSkinSource
+	{
+		enum
+		{
+			BlockSize     = DVKSkinVertices::BlockSize,
+			MaxInfluences = 4,
+		};
+
+		DVKSkinVertices		bindPose;
+		// 每组16个，第k个骨骼第l个顶点的数据在k * 4 + l
+		std::vector<uint16>	boneIndices;
+		std::vector<float>	boneWeights;
+		// 每组顶点中最多的骨骼数，蒙皮时跳过全为0的权重
+		std::vector<uint8>	influences;
+
+		// 从CPU端的顶点数据中拆出位置、法线、切线和骨骼，支持VA_Packed*格式。
+		// 没有位置、没有骨骼权重或者网格没有骨骼时返回false。
+		static bool Build(const std::vector<VertexAttribute>& attributes, const DVKMesh* mesh, const DVKPrimitive* primitive, DVKSkinSource& outSource);
+	};
+
+	// CPU蒙皮，用于离线处理、物理代理以及拾取动画模型等不经过GPU的场合。
+	// 使用VectorRegister(SSE/NEON)，pool不为空时按batchBlocks组顶点为一个批次并行。
+	class DVKSkinning
+	{
+	public:
+		// palette[i]为DVKMesh::bones[i]的DVKBone::finalTransform，结果在模型空间
+		static void BuildPalette(const DVKModel* model, const DVKMesh* mesh, std::vector<Matrix4x4>& outPalette);
+
+		static void BuildPalette(const std::vector<Matrix4x4>& matrices, std::vector<DVKDualQuat>& outPalette);
+
+		// 线性混合矩阵，法线和切线使用同一个矩阵变换后重新归一化
+		static void Skin(const DVKSkinSource& source, const Matrix4x4* palette, DVKSkinVertices& output, DVKJobPool* pool = nullptr, int32 batchBlocks = 256);
+
+		// 对偶四元数混合，没有缩放，关节处不会塌陷
+		static void Skin(const DVKSkinSource& source, const DVKDualQuat* palette, DVKSkinVertices& output, DVKJobPool* pool = nullptr, int32 batchBlocks = 256);
+	};
+
+}
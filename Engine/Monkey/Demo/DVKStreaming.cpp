@@ -0,0 +1,400 @@
+﻿#include "DVKStreaming.h"
+#include "FileManager.h"
+
+#include "Loader/ImageLoader.h"
+
+#include <algorithm>
+
+namespace vk_demo
+{
+
+	DVKStreamingModel::~DVKStreamingModel()
+	{
+		delete model;
+		model = nullptr;
+
+		delete placeholder;
+		placeholder = nullptr;
+	}
+
+	bool DVKStreamingModel::LoadOnWorker(std::shared_ptr<VulkanDevice> vulkanDevice)
+	{
+		// 不传CommandBuffer，只解析出CPU端的顶点和索引
+		model = DVKModel::LoadFromFile(filename, vulkanDevice, nullptr, attributes);
+		if (model->rootNode == nullptr) {
+			return false;
+		}
+
+		if (prepare) {
+			prepare(model);
+		}
+
+		return true;
+	}
+
+	uint64 DVKStreamingModel::UploadOnRenderThread(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer)
+	{
+		model->Upload(cmdBuffer);
+		bounds = model->rootNode->GetBounds();
+
+		uint64 size = 0;
+		for (int32 i = 0; i < model->meshes.size(); ++i)
+		{
+			for (int32 j = 0; j < model->meshes[i]->primitives.size(); ++j)
+			{
+				DVKPrimitive* primitive = model->meshes[i]->primitives[j];
+				size += primitive->vertices.size() * sizeof(float);
+				if (primitive->indexBuffer) {
+					size += primitive->indexBuffer->indexCount * (primitive->indexBuffer->indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16) : sizeof(uint32));
+				}
+			}
+		}
+		return size;
+	}
+
+	DVKModel* DVKStreamingModel::CreatePlaceholder(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const DVKBoundingBox& bounds, const std::vector<VertexAttribute>& attributes)
+	{
+		// 每个面4个角点，角点索引的bit0/1/2分别对应max的x/y/z
+		static const int32 faceCorners[6][4] = {
+			{ 1, 3, 7, 5 }, { 0, 4, 6, 2 },
+			{ 2, 6, 7, 3 }, { 0, 1, 5, 4 },
+			{ 4, 5, 7, 6 }, { 0, 2, 3, 1 },
+		};
+		static const float faceNormals[6][3] = {
+			{  1,  0,  0 }, { -1,  0,  0 },
+			{  0,  1,  0 }, {  0, -1,  0 },
+			{  0,  0,  1 }, {  0,  0, -1 },
+		};
+
+		std::vector<float>  vertices;
+		std::vector<uint16> indices;
+
+		for (int32 face = 0; face < 6; ++face)
+		{
+			uint16 base = face * 4;
+			for (int32 corner = 0; corner < 4; ++corner)
+			{
+				const Vector3& position = bounds.corners[faceCorners[face][corner]];
+
+				// 替身只需要位置和法线，其它属性填0，保证与真实模型的顶点格式一致
+				for (int32 i = 0; i < attributes.size(); ++i)
+				{
+					if (attributes[i] == VertexAttribute::VA_Position)
+					{
+						vertices.push_back(position.x);
+						vertices.push_back(position.y);
+						vertices.push_back(position.z);
+					}
+					else if (attributes[i] == VertexAttribute::VA_Normal)
+					{
+						vertices.push_back(faceNormals[face][0]);
+						vertices.push_back(faceNormals[face][1]);
+						vertices.push_back(faceNormals[face][2]);
+					}
+					else if (attributes[i] == VertexAttribute::VA_PackedPosition)
+					{
+						float values[3] = { position.x, position.y, position.z };
+						PackVertexAttribute(attributes[i], values, bounds.min, bounds.max, vertices);
+					}
+					else if (attributes[i] == VertexAttribute::VA_PackedNormal)
+					{
+						PackVertexAttribute(attributes[i], faceNormals[face], bounds.min, bounds.max, vertices);
+					}
+					else
+					{
+						int32 count = VertexAttributeToSize(attributes[i]) / sizeof(float);
+						for (int32 j = 0; j < count; ++j) {
+							vertices.push_back(0.0f);
+						}
+					}
+				}
+			}
+
+			indices.push_back(base + 0);
+			indices.push_back(base + 1);
+			indices.push_back(base + 2);
+			indices.push_back(base + 0);
+			indices.push_back(base + 2);
+			indices.push_back(base + 3);
+		}
+
+		DVKModel* placeholder = DVKModel::Create(vulkanDevice, cmdBuffer, vertices, indices, attributes);
+		placeholder->meshes[0]->bounding.min = bounds.min;
+		placeholder->meshes[0]->bounding.max = bounds.max;
+
+		return placeholder;
+	}
+
+	DVKStreamingTexture::~DVKStreamingTexture()
+	{
+		if (rgbaData)
+		{
+			StbImage::Free(rgbaData);
+			rgbaData = nullptr;
+		}
+
+		delete texture;
+		texture = nullptr;
+	}
+
+	bool DVKStreamingTexture::LoadOnWorker(std::shared_ptr<VulkanDevice> vulkanDevice)
+	{
+		uint32 dataSize = 0;
+		uint8* dataPtr  = nullptr;
+		if (!FileManager::ReadFile(filename, dataPtr, dataSize)) {
+			return false;
+		}
+
+		int32 comp = 0;
+		rgbaData = StbImage::LoadFromMemory(dataPtr, dataSize, &width, &height, &comp, 4);
+
+		delete[] dataPtr;
+
+		return rgbaData != nullptr;
+	}
+
+	uint64 DVKStreamingTexture::UploadOnRenderThread(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer)
+	{
+		uint64 size = width * height * 4;
+
+		texture = DVKTexture::Create2D(rgbaData, size, VK_FORMAT_R8G8B8A8_UNORM, width, height, vulkanDevice, cmdBuffer);
+
+		// 数据已经拷贝进Staging，CPU端的像素可以释放了
+		StbImage::Free(rgbaData);
+		rgbaData = nullptr;
+
+		return size;
+	}
+
+	DVKStreamingManager::DVKStreamingManager()
+		: cameraPosition(0, 0, 0)
+		, completedHead(nullptr)
+		, numLoading(0)
+	{
+
+	}
+
+	DVKStreamingManager::~DVKStreamingManager()
+	{
+		{
+			std::lock_guard<std::mutex> lockGuard(pendingMutex);
+			timeToDie = true;
+		}
+		pendingCondition.notify_all();
+
+		// 工作线程会先做完手上的请求再退出
+		for (int32 i = 0; i < threads.size(); ++i)
+		{
+			threads[i]->join();
+			delete threads[i];
+		}
+		threads.clear();
+
+		// 析构时会等待飞行中的上传批次
+		delete cmdBuffer;
+		cmdBuffer = nullptr;
+
+		for (int32 i = 0; i < assets.size(); ++i) {
+			delete assets[i];
+		}
+		assets.clear();
+
+		vulkanDevice = nullptr;
+	}
+
+	DVKStreamingManager* DVKStreamingManager::Create(std::shared_ptr<VulkanDevice> vulkanDevice, VkCommandPool commandPool, int32 numThreads)
+	{
+		DVKStreamingManager* manager = new DVKStreamingManager();
+		manager->vulkanDevice = vulkanDevice;
+		manager->cmdBuffer    = DVKCommandBuffer::Create(vulkanDevice, commandPool);
+
+		for (int32 i = 0; i < MMath::Max(numThreads, 1); ++i) {
+			manager->threads.push_back(new std::thread(&DVKStreamingManager::WorkerThread, manager));
+		}
+
+		return manager;
+	}
+
+	DVKStreamingModel* DVKStreamingManager::LoadModel(const std::string& filename, const std::vector<VertexAttribute>& attributes, const Vector3& position, const DVKBoundingBox& placeholderBounds, DVKStreamingModel::PrepareFunc prepare)
+	{
+		DVKStreamingModel* asset = new DVKStreamingModel(filename, attributes, position);
+		asset->prepare = prepare;
+		asset->bounds = placeholderBounds;
+		asset->bounds.UpdateCorners();
+
+		// 没有给出有效包围盒时不创建替身
+		if (placeholderBounds.min.x <= placeholderBounds.max.x) {
+			asset->placeholder = DVKStreamingModel::CreatePlaceholder(vulkanDevice, cmdBuffer, asset->bounds, attributes);
+		}
+
+		AddRequest(asset);
+
+		return asset;
+	}
+
+	DVKStreamingTexture* DVKStreamingManager::LoadTexture(const std::string& filename, const Vector3& position, DVKTexture* placeholder)
+	{
+		DVKStreamingTexture* asset = new DVKStreamingTexture(filename, position, placeholder);
+
+		AddRequest(asset);
+
+		return asset;
+	}
+
+	void DVKStreamingManager::AddRequest(DVKStreamingAsset* asset)
+	{
+		asset->distance = (asset->position - cameraPosition).SizeSquared();
+
+		assets.push_back(asset);
+		numLoading.fetch_add(1, std::memory_order_relaxed);
+
+		{
+			std::lock_guard<std::mutex> lockGuard(pendingMutex);
+			pendingAssets.push_back(asset);
+		}
+		pendingCondition.notify_one();
+	}
+
+	void DVKStreamingManager::Update(const Vector3& inCameraPosition)
+	{
+		cameraPosition = inCameraPosition;
+
+		// 相机移动之后刷新等待队列的优先级
+		{
+			std::lock_guard<std::mutex> lockGuard(pendingMutex);
+			for (int32 i = 0; i < pendingAssets.size(); ++i) {
+				pendingAssets[i]->distance = (pendingAssets[i]->position - cameraPosition).SizeSquared();
+			}
+		}
+
+		FinishInFlightUploads();
+
+		DVKStreamingAsset* completed = PopAllCompleted();
+		while (completed)
+		{
+			uploadQueue.push_back(completed);
+			completed = completed->next;
+		}
+
+		// 上一个批次还没有完成，或者没有需要上传的资源
+		if (inFlightUploads.size() > 0 || uploadQueue.size() == 0) {
+			return;
+		}
+
+		for (int32 i = 0; i < uploadQueue.size(); ++i) {
+			uploadQueue[i]->distance = (uploadQueue[i]->position - cameraPosition).SizeSquared();
+		}
+
+		std::sort(uploadQueue.begin(), uploadQueue.end(), [](const DVKStreamingAsset* a, const DVKStreamingAsset* b) -> bool {
+			return a->distance < b->distance;
+		});
+
+		// 近处的资源先上传，每帧的上传量受预算限制，至少上传一个
+		cmdBuffer->BeginBatch();
+
+		uint64 uploadedSize = 0;
+		int32  numUploaded  = 0;
+		while (numUploaded < uploadQueue.size() && uploadedSize < uploadBudget)
+		{
+			DVKStreamingAsset* asset = uploadQueue[numUploaded];
+			uploadedSize += asset->UploadOnRenderThread(vulkanDevice, cmdBuffer);
+			inFlightUploads.push_back(asset);
+			numUploaded += 1;
+		}
+
+		uploadQueue.erase(uploadQueue.begin(), uploadQueue.begin() + numUploaded);
+
+		// 不等待，下一帧通过Fence状态判断是否完成
+		cmdBuffer->FlushBatch(false);
+	}
+
+	void DVKStreamingManager::Flush()
+	{
+		while (GetNumLoading() > 0)
+		{
+			Update(cameraPosition);
+
+			if (inFlightUploads.size() > 0) {
+				cmdBuffer->WaitBatch();
+			}
+			else {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void DVKStreamingManager::FinishInFlightUploads()
+	{
+		if (inFlightUploads.size() == 0 || !cmdBuffer->IsBatchComplete()) {
+			return;
+		}
+
+		for (int32 i = 0; i < inFlightUploads.size(); ++i) {
+			inFlightUploads[i]->state.store(StreamingState::Ready, std::memory_order_release);
+		}
+
+		numLoading.fetch_sub(inFlightUploads.size(), std::memory_order_relaxed);
+		inFlightUploads.clear();
+	}
+
+	void DVKStreamingManager::WorkerThread()
+	{
+		while (true)
+		{
+			DVKStreamingAsset* asset = nullptr;
+
+			{
+				std::unique_lock<std::mutex> lock(pendingMutex);
+				pendingCondition.wait(lock, [this]() -> bool {
+					return timeToDie || pendingAssets.size() > 0;
+				});
+
+				if (timeToDie) {
+					return;
+				}
+
+				// 取离相机最近的请求
+				int32 nearest = 0;
+				for (int32 i = 1; i < pendingAssets.size(); ++i)
+				{
+					if (pendingAssets[i]->distance < pendingAssets[nearest]->distance) {
+						nearest = i;
+					}
+				}
+
+				asset = pendingAssets[nearest];
+				pendingAssets[nearest] = pendingAssets.back();
+				pendingAssets.pop_back();
+			}
+
+			asset->state.store(StreamingState::Loading, std::memory_order_release);
+
+			if (asset->LoadOnWorker(vulkanDevice))
+			{
+				asset->state.store(StreamingState::Uploading, std::memory_order_release);
+				PushCompleted(asset);
+			}
+			else
+			{
+				MLOGE("Failed stream asset : %s", asset->filename.c_str());
+				asset->state.store(StreamingState::Failed, std::memory_order_release);
+				numLoading.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void DVKStreamingManager::PushCompleted(DVKStreamingAsset* asset)
+	{
+		// 多个工作线程入栈，渲染线程一次取走全部，不存在ABA问题
+		DVKStreamingAsset* head = completedHead.load(std::memory_order_relaxed);
+		do {
+			asset->next = head;
+		} while (!completedHead.compare_exchange_weak(head, asset, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	DVKStreamingAsset* DVKStreamingManager::PopAllCompleted()
+	{
+		return completedHead.exchange(nullptr, std::memory_order_acquire);
+	}
+
+}
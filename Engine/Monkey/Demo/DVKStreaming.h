@@ -0,0 +1,267 @@
+﻿#pragma once
+
+#include "Engine.h"
+#include "DVKCommand.h"
+#include "DVKModel.h"
+#include "DVKTexture.h"
+
+#include "Common/Common.h"
+#include "Math/Vector3.h"
+#include "Vulkan/VulkanCommon.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+namespace vk_demo
+{
+	class DVKStreamingManager;
+
+	enum class StreamingState
+	{
+		Queued = 0,
+		Loading,
+		Uploading,
+		Ready,
+		Failed,
+	};
+
+	// 流式加载的资源。文件读取和解析在工作线程完成，GPU上传在渲染线程完成。
+	class DVKStreamingAsset
+	{
+		friend class DVKStreamingManager;
+
+	public:
+
+		virtual ~DVKStreamingAsset()
+		{
+
+		}
+
+		inline StreamingState GetState() const
+		{
+			return state.load(std::memory_order_acquire);
+		}
+
+		inline bool IsReady() const
+		{
+			return GetState() == StreamingState::Ready;
+		}
+
+		inline const std::string& GetFilename() const
+		{
+			return filename;
+		}
+
+		// 资源在世界中的位置，离相机越近越先加载。只能在渲染线程调用。
+		inline void SetPosition(const Vector3& inPosition)
+		{
+			position = inPosition;
+		}
+
+		inline const Vector3& GetPosition() const
+		{
+			return position;
+		}
+
+	protected:
+
+		DVKStreamingAsset(const std::string& inFilename, const Vector3& inPosition)
+			: filename(inFilename)
+			, position(inPosition)
+			, state(StreamingState::Queued)
+		{
+
+		}
+
+		// 工作线程：读取文件并准备好CPU端数据，失败返回false
+		virtual bool LoadOnWorker(std::shared_ptr<VulkanDevice> vulkanDevice) = 0;
+
+		// 渲染线程：在上传批次中录制GPU上传，返回上传的字节数
+		virtual uint64 UploadOnRenderThread(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer) = 0;
+
+	protected:
+
+		std::string						filename;
+		Vector3							position;
+		float							distance = 0.0f;
+		std::atomic<StreamingState>		state;
+
+		// 完成队列的链接，只在入队和出队时访问
+		DVKStreamingAsset*				next = nullptr;
+	};
+
+	class DVKStreamingModel : public DVKStreamingAsset
+	{
+		friend class DVKStreamingManager;
+
+	public:
+
+		// 在工作线程上处理解析出来的CPU端数据，例如BuildLods，此时还没有创建GPU资源
+		typedef std::function<void(DVKModel*)> PrepareFunc;
+
+		virtual ~DVKStreamingModel();
+
+		// 加载完成之前返回包围盒替身，替身和模型使用相同的顶点格式，可以直接用同一个Pipeline绘制
+		inline DVKModel* GetDrawModel() const
+		{
+			return IsReady() ? model : placeholder;
+		}
+
+		inline DVKModel* GetModel() const
+		{
+			return IsReady() ? model : nullptr;
+		}
+
+		// 加载完成之前为请求时给出的包围盒，完成后为模型真实的包围盒
+		inline const DVKBoundingBox& GetBounds() const
+		{
+			return bounds;
+		}
+
+	protected:
+
+		DVKStreamingModel(const std::string& inFilename, const std::vector<VertexAttribute>& inAttributes, const Vector3& inPosition)
+			: DVKStreamingAsset(inFilename, inPosition)
+			, attributes(inAttributes)
+		{
+
+		}
+
+		virtual bool LoadOnWorker(std::shared_ptr<VulkanDevice> vulkanDevice) override;
+
+		virtual uint64 UploadOnRenderThread(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer) override;
+
+		static DVKModel* CreatePlaceholder(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const DVKBoundingBox& bounds, const std::vector<VertexAttribute>& attributes);
+
+	protected:
+
+		std::vector<VertexAttribute>	attributes;
+		PrepareFunc						prepare;
+		DVKBoundingBox					bounds;
+		DVKModel*						model = nullptr;
+		DVKModel*						placeholder = nullptr;
+	};
+
+	class DVKStreamingTexture : public DVKStreamingAsset
+	{
+		friend class DVKStreamingManager;
+
+	public:
+
+		virtual ~DVKStreamingTexture();
+
+		// 加载完成之前返回替身贴图
+		inline DVKTexture* GetDrawTexture() const
+		{
+			return IsReady() ? texture : placeholder;
+		}
+
+		inline DVKTexture* GetTexture() const
+		{
+			return IsReady() ? texture : nullptr;
+		}
+
+	protected:
+
+		DVKStreamingTexture(const std::string& inFilename, const Vector3& inPosition, DVKTexture* inPlaceholder)
+			: DVKStreamingAsset(inFilename, inPosition)
+			, placeholder(inPlaceholder)
+		{
+
+		}
+
+		virtual bool LoadOnWorker(std::shared_ptr<VulkanDevice> vulkanDevice) override;
+
+		virtual uint64 UploadOnRenderThread(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer) override;
+
+	protected:
+
+		uint8*							rgbaData = nullptr;
+		int32							width = 0;
+		int32							height = 0;
+		DVKTexture*						texture = nullptr;
+		DVKTexture*						placeholder = nullptr;
+	};
+
+	// 后台流式加载：
+	// 1. 等待队列按到相机的距离排序，工作线程总是先取最近的资源进行读取和解析；
+	// 2. 解析完成的资源通过无锁队列交给渲染线程；
+	// 3. 渲染线程在Update中把它们合并到一个上传批次，批次的Fence完成之后资源变为Ready。
+	class DVKStreamingManager
+	{
+	private:
+		DVKStreamingManager();
+
+	public:
+		~DVKStreamingManager();
+
+		static DVKStreamingManager* Create(std::shared_ptr<VulkanDevice> vulkanDevice, VkCommandPool commandPool, int32 numThreads = 2);
+
+		// placeholderBounds为加载完成之前绘制的包围盒，例如来自场景数据。返回的对象由Manager持有。
+		// prepare在工作线程上、上传之前调用，可以为空。
+		DVKStreamingModel* LoadModel(const std::string& filename, const std::vector<VertexAttribute>& attributes, const Vector3& position, const DVKBoundingBox& placeholderBounds, DVKStreamingModel::PrepareFunc prepare = nullptr);
+
+		// placeholder由调用者持有，例如DVKDefaultRes::texture2D
+		DVKStreamingTexture* LoadTexture(const std::string& filename, const Vector3& position, DVKTexture* placeholder);
+
+		// 渲染线程每帧调用一次
+		void Update(const Vector3& cameraPosition);
+
+		// 阻塞直到所有请求都完成
+		void Flush();
+
+		inline void SetUploadBudget(uint64 bytesPerFrame)
+		{
+			uploadBudget = bytesPerFrame;
+		}
+
+		inline int32 GetNumLoading() const
+		{
+			return numLoading.load(std::memory_order_relaxed);
+		}
+
+	private:
+
+		void WorkerThread();
+
+		void PushCompleted(DVKStreamingAsset* asset);
+
+		DVKStreamingAsset* PopAllCompleted();
+
+		void AddRequest(DVKStreamingAsset* asset);
+
+		void FinishInFlightUploads();
+
+	private:
+
+		std::shared_ptr<VulkanDevice>		vulkanDevice = nullptr;
+		DVKCommandBuffer*					cmdBuffer = nullptr;
+		uint64								uploadBudget = 32 * 1024 * 1024;
+		Vector3								cameraPosition;
+
+		std::vector<DVKStreamingAsset*>		assets;
+
+		// 等待工作线程处理的请求，受pendingMutex保护
+		std::vector<DVKStreamingAsset*>		pendingAssets;
+		std::mutex							pendingMutex;
+		std::condition_variable				pendingCondition;
+		bool								timeToDie = false;
+
+		// 工作线程 -> 渲染线程的无锁队列
+		std::atomic<DVKStreamingAsset*>		completedHead;
+		std::atomic<int32>					numLoading;
+
+		// 以下只在渲染线程访问
+		std::vector<DVKStreamingAsset*>		uploadQueue;
+		std::vector<DVKStreamingAsset*>		inFlightUploads;
+
+		std::vector<std::thread*>			threads;
+	};
+
+}
@@ -8,21 +8,69 @@
 
 namespace vk_demo
 {
+	// 延迟释放队列里的Texture，到期之后销毁句柄并归还内存
+	class DVKTextureRelease : public RefCount
+	{
+	public:
+		DVKTextureRelease(VkDevice inDevice, VkImage inImage, VkImageView inImageView, VkSampler inImageSampler, VulkanResourceAllocation* inAllocation)
+			: device(inDevice)
+			, image(inImage)
+			, imageView(inImageView)
+			, imageSampler(inImageSampler)
+			, allocation(inAllocation)
+		{
+
+		}
+
+		virtual ~DVKTextureRelease()
+		{
+			if (imageView != VK_NULL_HANDLE) {
+				vkDestroyImageView(device, imageView, VULKAN_CPU_ALLOCATOR);
+			}
+			if (image != VK_NULL_HANDLE) {
+				vkDestroyImage(device, image, VULKAN_CPU_ALLOCATOR);
+			}
+			if (imageSampler != VK_NULL_HANDLE) {
+				vkDestroySampler(device, imageSampler, VULKAN_CPU_ALLOCATOR);
+			}
+			delete allocation;
+		}
+
+	private:
+		VkDevice					device;
+		VkImage						image;
+		VkImageView					imageView;
+		VkSampler					imageSampler;
+		VulkanResourceAllocation*	allocation;
+	};
+
+	DVKTexture::~DVKTexture()
+	{
+		DVKTextureRelease* release = new DVKTextureRelease(device, image, imageView, imageSampler, allocation);
+		if (vulkanDevice) {
+			vulkanDevice->GetResourceHeapManager().ReleaseDeferred(release);
+		}
+		else {
+			delete release;
+		}
+
+		image        = VK_NULL_HANDLE;
+		imageView    = VK_NULL_HANDLE;
+		imageSampler = VK_NULL_HANDLE;
+		imageMemory  = VK_NULL_HANDLE;
+		allocation   = nullptr;
+	}
     
+
 	DVKTexture* DVKTexture::Create2D(const uint8* rgbaData, uint32 size, VkFormat format, int32 width, int32 height, std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, VkImageUsageFlags imageUsageFlags, ImageLayoutBarrier imageLayout)
 	{
         int32 mipLevels = MMath::FloorToInt(MMath::Log2(MMath::Max(width, height))) + 1;
         VkDevice device = vulkanDevice->GetInstanceHandle();
         
-        DVKBuffer* stagingBuffer = DVKBuffer::CreateBuffer(vulkanDevice, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size);
-        stagingBuffer->Map();
-        stagingBuffer->CopyFrom((void*)rgbaData, size);
-		stagingBuffer->UnMap();
+        DVKStagingRegion staging = cmdBuffer->AcquireStaging(size);
+        memcpy(staging.mapped, rgbaData, size);
         
-        uint32 memoryTypeIndex = 0;
         VkMemoryRequirements memReqs = {};
-        VkMemoryAllocateInfo memAllocInfo;
-        ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
         
         // image info
         VkImage                         image = VK_NULL_HANDLE;
@@ -56,11 +104,9 @@ namespace vk_demo
         
         // bind image buffer
         vkGetImageMemoryRequirements(device, image, &memReqs);
-        vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
-        memAllocInfo.allocationSize  = memReqs.size;
-        memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-        VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &imageMemory));
-        VERIFYVULKANRESULT(vkBindImageMemory(device, image, imageMemory, 0));
+        VulkanResourceAllocation* allocation = vulkanDevice->GetResourceHeapManager().AllocateImageMemory(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, __FILE__, __LINE__);
+        allocation->BindImage(vulkanDevice.get(), image);
+        imageMemory = allocation->GetHandle();
         
 		// start record
 		cmdBuffer->Begin();
@@ -83,9 +129,10 @@ namespace vk_demo
         bufferCopyRegion.imageExtent.width  = width;
         bufferCopyRegion.imageExtent.height = height;
         bufferCopyRegion.imageExtent.depth  = 1;
+        bufferCopyRegion.bufferOffset       = staging.offset;
         
 		// copy buffer to image
-        vkCmdCopyBufferToImage(cmdBuffer->cmdBuffer, stagingBuffer->buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+        vkCmdCopyBufferToImage(cmdBuffer->cmdBuffer, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
         
 		// TransferDest to TransferSrc
 		vk_demo::ImagePipelineBarrier(cmdBuffer->cmdBuffer, image, ImageLayoutBarrier::TransferDest, ImageLayoutBarrier::TransferSource, subresourceRange);
@@ -139,8 +186,6 @@ namespace vk_demo
 		cmdBuffer->End();
 		cmdBuffer->Submit();
 
-		delete stagingBuffer;
-
 		VkSamplerCreateInfo samplerInfo;
 		ZeroVulkanStruct(samplerInfo, VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO);
 		samplerInfo.magFilter        = VK_FILTER_LINEAR;
@@ -179,6 +224,10 @@ namespace vk_demo
 		texture->image          = image;
 		texture->imageLayout    = GetImageLayout(imageLayout);
 		texture->imageMemory    = imageMemory;
+		texture->allocation     = allocation;
+		texture->vulkanDevice   = vulkanDevice.get();
+		texture->imageInfo      = imageCreateInfo;
+		texture->viewInfo       = viewInfo;
 		texture->imageSampler   = imageSampler;
 		texture->imageView      = imageView;
 		texture->device			= device;
@@ -236,10 +285,7 @@ namespace vk_demo
 			mipLevels = MMath::FloorToInt(MMath::Log2(MMath::Max(width, height))) + 1;
 		}
 
-		uint32 memoryTypeIndex = 0;
 		VkMemoryRequirements memReqs = {};
-		VkMemoryAllocateInfo memAllocInfo;
-		ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
 
 		// image info
 		VkImage                         image = VK_NULL_HANDLE;
@@ -266,11 +312,9 @@ namespace vk_demo
 
 		// bind image buffer
 		vkGetImageMemoryRequirements(device, image, &memReqs);
-		vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
-		memAllocInfo.allocationSize  = memReqs.size;
-		memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-		VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &imageMemory));
-		VERIFYVULKANRESULT(vkBindImageMemory(device, image, imageMemory, 0));
+		VulkanResourceAllocation* allocation = vulkanDevice->GetResourceHeapManager().AllocateImageMemory(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, __FILE__, __LINE__);
+		allocation->BindImage(vulkanDevice.get(), image);
+		imageMemory = allocation->GetHandle();
 
 		VkSamplerCreateInfo samplerInfo;
 		ZeroVulkanStruct(samplerInfo, VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO);
@@ -334,6 +378,10 @@ namespace vk_demo
 		texture->image          = image;
 		texture->imageLayout    = GetImageLayout(imageLayout);
 		texture->imageMemory    = imageMemory;
+		texture->allocation     = allocation;
+		texture->vulkanDevice   = vulkanDevice.get();
+		texture->imageInfo      = imageCreateInfo;
+		texture->viewInfo       = viewInfo;
 		texture->imageSampler   = imageSampler;
 		texture->imageView      = imageView;
 		texture->device			= device;
@@ -377,10 +425,7 @@ namespace vk_demo
 	{
 		VkDevice device = vulkanDevice->GetInstanceHandle();
 
-		uint32 memoryTypeIndex = 0;
 		VkMemoryRequirements memReqs = {};
-		VkMemoryAllocateInfo memAllocInfo;
-		ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
 
 		int32 mipLevels = 1;
 
@@ -408,11 +453,9 @@ namespace vk_demo
 
 		// bind image buffer
 		vkGetImageMemoryRequirements(device, image, &memReqs);
-		vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
-		memAllocInfo.allocationSize  = memReqs.size;
-		memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-		VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &imageMemory));
-		VERIFYVULKANRESULT(vkBindImageMemory(device, image, imageMemory, 0));
+		VulkanResourceAllocation* allocation = vulkanDevice->GetResourceHeapManager().AllocateImageMemory(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, __FILE__, __LINE__);
+		allocation->BindImage(vulkanDevice.get(), image);
+		imageMemory = allocation->GetHandle();
 
 		VkSamplerCreateInfo samplerInfo;
 		ZeroVulkanStruct(samplerInfo, VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO);
@@ -476,6 +519,10 @@ namespace vk_demo
 		texture->image          = image;
 		texture->imageLayout    = GetImageLayout(imageLayout);
 		texture->imageMemory    = imageMemory;
+		texture->allocation     = allocation;
+		texture->vulkanDevice   = vulkanDevice.get();
+		texture->imageInfo      = imageCreateInfo;
+		texture->viewInfo       = viewInfo;
 		texture->imageSampler   = imageSampler;
 		texture->imageView      = imageView;
 		texture->device			= device;
@@ -490,10 +537,7 @@ namespace vk_demo
 	{
 		VkDevice device = vulkanDevice->GetInstanceHandle();
 
-		uint32 memoryTypeIndex = 0;
 		VkMemoryRequirements memReqs = {};
-		VkMemoryAllocateInfo memAllocInfo;
-		ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
 
 		int32 mipLevels = 1;
 
@@ -521,11 +565,9 @@ namespace vk_demo
 
 		// bind image buffer
 		vkGetImageMemoryRequirements(device, image, &memReqs);
-		vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
-		memAllocInfo.allocationSize  = memReqs.size;
-		memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-		VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &imageMemory));
-		VERIFYVULKANRESULT(vkBindImageMemory(device, image, imageMemory, 0));
+		VulkanResourceAllocation* allocation = vulkanDevice->GetResourceHeapManager().AllocateImageMemory(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, __FILE__, __LINE__);
+		allocation->BindImage(vulkanDevice.get(), image);
+		imageMemory = allocation->GetHandle();
 
 		VkSamplerCreateInfo samplerInfo;
 		ZeroVulkanStruct(samplerInfo, VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO);
@@ -589,6 +631,10 @@ namespace vk_demo
 		texture->image          = image;
 		texture->imageLayout    = GetImageLayout(imageLayout);
 		texture->imageMemory    = imageMemory;
+		texture->allocation     = allocation;
+		texture->vulkanDevice   = vulkanDevice.get();
+		texture->imageInfo      = imageCreateInfo;
+		texture->viewInfo       = viewInfo;
 		texture->imageSampler   = imageSampler;
 		texture->imageView      = imageView;
 		texture->device			= device;
@@ -675,26 +721,16 @@ namespace vk_demo
 		int32 mipLevels = MMath::FloorToInt(MMath::Log2(MMath::Max(width, height))) + 1;
 		VkDevice device = vulkanDevice->GetInstanceHandle();
 
-		uint32 memoryTypeIndex = 0;
 		VkMemoryRequirements memReqs = {};
-		VkMemoryAllocateInfo memAllocInfo;
-		ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
 
 		// 准备stagingBuffer
-		DVKBuffer* stagingBuffer = DVKBuffer::CreateBuffer(
-			vulkanDevice, 
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-			images[0].size * 6
-		);
+		DVKStagingRegion staging = cmdBuffer->AcquireStaging(images[0].size * 6);
 
 		for (int32 i = 0; i < images.size(); ++i) 
 		{
 			uint8* src  = images[i].data;
 			uint32 size = images[i].size;
-			stagingBuffer->Map(size, size * i);
-			stagingBuffer->CopyFrom(src, size);
-			stagingBuffer->UnMap();
+			memcpy(staging.mapped + size * i, src, size);
 
 			StbImage::Free(src);
 		}
@@ -724,11 +760,9 @@ namespace vk_demo
 
 		// bind image buffer
 		vkGetImageMemoryRequirements(device, image, &memReqs);
-		vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
-		memAllocInfo.allocationSize  = memReqs.size;
-		memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-		VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &imageMemory));
-		VERIFYVULKANRESULT(vkBindImageMemory(device, image, imageMemory, 0));
+		VulkanResourceAllocation* allocation = vulkanDevice->GetResourceHeapManager().AllocateImageMemory(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, __FILE__, __LINE__);
+		allocation->BindImage(vulkanDevice.get(), image);
+		imageMemory = allocation->GetHandle();
 
 		// start record
 		cmdBuffer->Begin();
@@ -753,11 +787,11 @@ namespace vk_demo
 			bufferCopyRegion.imageExtent.width  = width;
 			bufferCopyRegion.imageExtent.height = height;
 			bufferCopyRegion.imageExtent.depth  = 1;
-			bufferCopyRegion.bufferOffset       = images[0].size * i;
+			bufferCopyRegion.bufferOffset       = staging.offset + images[0].size * i;
 			bufferCopyRegions.push_back(bufferCopyRegion);
 		}
 
-		vkCmdCopyBufferToImage(cmdBuffer->cmdBuffer, stagingBuffer->buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, bufferCopyRegions.size(), bufferCopyRegions.data());
+		vkCmdCopyBufferToImage(cmdBuffer->cmdBuffer, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, bufferCopyRegions.size(), bufferCopyRegions.data());
 
 		ImagePipelineBarrier(cmdBuffer->cmdBuffer, image, ImageLayoutBarrier::TransferDest, ImageLayoutBarrier::TransferSource, subresourceRange);
 
@@ -804,8 +838,6 @@ namespace vk_demo
 		cmdBuffer->End();
 		cmdBuffer->Submit();
 
-		delete stagingBuffer;
-
 		VkSamplerCreateInfo samplerInfo;
 		ZeroVulkanStruct(samplerInfo, VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO);
 		samplerInfo.magFilter        = VK_FILTER_LINEAR;
@@ -844,6 +876,10 @@ namespace vk_demo
 		texture->image          = image;
 		texture->imageLayout    = GetImageLayout(imageLayout);
 		texture->imageMemory    = imageMemory;
+		texture->allocation     = allocation;
+		texture->vulkanDevice   = vulkanDevice.get();
+		texture->imageInfo      = imageCreateInfo;
+		texture->viewInfo       = viewInfo;
 		texture->imageSampler   = imageSampler;
 		texture->imageView      = imageView;
 		texture->device			= device;
@@ -900,26 +936,16 @@ namespace vk_demo
         int32 mipLevels = MMath::FloorToInt(MMath::Log2(MMath::Max(width, height))) + 1;
         VkDevice device = vulkanDevice->GetInstanceHandle();
         
-		uint32 memoryTypeIndex = 0;
 		VkMemoryRequirements memReqs = {};
-		VkMemoryAllocateInfo memAllocInfo;
-		ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
         
 		// 准备stagingBuffer
-		DVKBuffer* stagingBuffer = DVKBuffer::CreateBuffer(
-			vulkanDevice, 
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-			width * height * 4 * numArray
-		);
+		DVKStagingRegion staging = cmdBuffer->AcquireStaging(width * height * 4 * numArray);
         
 		for (int32 i = 0; i < images.size(); ++i) 
 		{
 			uint8* src  = images[i].data;
 			uint32 size = width * height * 4;
-			stagingBuffer->Map(size, size * i);
-			stagingBuffer->CopyFrom(src, size);
-			stagingBuffer->UnMap();
+			memcpy(staging.mapped + size * i, src, size);
 
 			StbImage::Free(src);
 		}
@@ -948,11 +974,9 @@ namespace vk_demo
 
 		// bind image buffer
 		vkGetImageMemoryRequirements(device, image, &memReqs);
-		vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
-		memAllocInfo.allocationSize  = memReqs.size;
-		memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-		VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &imageMemory));
-		VERIFYVULKANRESULT(vkBindImageMemory(device, image, imageMemory, 0));
+		VulkanResourceAllocation* allocation = vulkanDevice->GetResourceHeapManager().AllocateImageMemory(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, __FILE__, __LINE__);
+		allocation->BindImage(vulkanDevice.get(), image);
+		imageMemory = allocation->GetHandle();
 
 		// start record
 		cmdBuffer->Begin();
@@ -977,11 +1001,11 @@ namespace vk_demo
 			bufferCopyRegion.imageExtent.width  = width;
 			bufferCopyRegion.imageExtent.height = height;
 			bufferCopyRegion.imageExtent.depth  = 1;
-			bufferCopyRegion.bufferOffset       = width * height * 4 * i;
+			bufferCopyRegion.bufferOffset       = staging.offset + width * height * 4 * i;
 			bufferCopyRegions.push_back(bufferCopyRegion);
 		}
 		
-		vkCmdCopyBufferToImage(cmdBuffer->cmdBuffer, stagingBuffer->buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, bufferCopyRegions.size(), bufferCopyRegions.data());
+		vkCmdCopyBufferToImage(cmdBuffer->cmdBuffer, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, bufferCopyRegions.size(), bufferCopyRegions.data());
         
 		ImagePipelineBarrier(cmdBuffer->cmdBuffer, image, ImageLayoutBarrier::TransferDest, ImageLayoutBarrier::TransferSource, subresourceRange);
         
@@ -1027,8 +1051,6 @@ namespace vk_demo
         
 		cmdBuffer->End();
 		cmdBuffer->Submit();
-
-		delete stagingBuffer;
         
 		VkSamplerCreateInfo samplerInfo;
 		ZeroVulkanStruct(samplerInfo, VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO);
@@ -1068,6 +1090,10 @@ namespace vk_demo
 		texture->image          = image;
 		texture->imageLayout    = GetImageLayout(imageLayout);
 		texture->imageMemory    = imageMemory;
+		texture->allocation     = allocation;
+		texture->vulkanDevice   = vulkanDevice.get();
+		texture->imageInfo      = imageCreateInfo;
+		texture->viewInfo       = viewInfo;
 		texture->imageSampler   = imageSampler;
 		texture->imageView      = imageView;
 		texture->device			= device;
@@ -1082,15 +1108,10 @@ namespace vk_demo
 	{
 		VkDevice device = vulkanDevice->GetInstanceHandle();
 
-		DVKBuffer* stagingBuffer = DVKBuffer::CreateBuffer(vulkanDevice, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size);
-        stagingBuffer->Map();
-        stagingBuffer->CopyFrom((void*)rgbaData, size);
-		stagingBuffer->UnMap();
+		DVKStagingRegion staging = cmdBuffer->AcquireStaging(size);
+		memcpy(staging.mapped, rgbaData, size);
         
-        uint32 memoryTypeIndex = 0;
         VkMemoryRequirements memReqs = {};
-        VkMemoryAllocateInfo memAllocInfo;
-        ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
 		
 		// image info
         VkImage                         image = VK_NULL_HANDLE;
@@ -1118,11 +1139,9 @@ namespace vk_demo
 		
 		// bind image buffer
         vkGetImageMemoryRequirements(device, image, &memReqs);
-        vulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
-        memAllocInfo.allocationSize  = memReqs.size;
-        memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-        VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &imageMemory));
-        VERIFYVULKANRESULT(vkBindImageMemory(device, image, imageMemory, 0));
+        VulkanResourceAllocation* allocation = vulkanDevice->GetResourceHeapManager().AllocateImageMemory(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, __FILE__, __LINE__);
+        allocation->BindImage(vulkanDevice.get(), image);
+        imageMemory = allocation->GetHandle();
         
         cmdBuffer->Begin();
         
@@ -1143,15 +1162,14 @@ namespace vk_demo
 		bufferCopyRegion.imageExtent.width  = width;
 		bufferCopyRegion.imageExtent.height = height;
 		bufferCopyRegion.imageExtent.depth  = depth;
+		bufferCopyRegion.bufferOffset       = staging.offset;
         
-		vkCmdCopyBufferToImage(cmdBuffer->cmdBuffer, stagingBuffer->buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+		vkCmdCopyBufferToImage(cmdBuffer->cmdBuffer, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
         
 		ImagePipelineBarrier(cmdBuffer->cmdBuffer, image, ImageLayoutBarrier::TransferDest, imageLayout, subresourceRange);
 		
 		cmdBuffer->End();
 		cmdBuffer->Submit();
-
-		delete stagingBuffer;
 		
 		// Create sampler
 		VkSamplerCreateInfo samplerInfo;
@@ -1203,6 +1221,10 @@ namespace vk_demo
 		texture->image          = image;
 		texture->imageLayout    = GetImageLayout(imageLayout);
 		texture->imageMemory    = imageMemory;
+		texture->allocation     = allocation;
+		texture->vulkanDevice   = vulkanDevice.get();
+		texture->imageInfo      = imageCreateInfo;
+		texture->viewInfo       = viewInfo;
 		texture->imageSampler   = imageSampler;
 		texture->imageView      = imageView;
 		texture->device			= device;
@@ -1212,4 +1234,99 @@ namespace vk_demo
         return texture;
 	}
 
+	bool DVKTexture::EnableDefragment()
+	{
+		VkImageUsageFlags transferUsage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		if ((imageInfo.usage & transferUsage) != transferUsage || viewInfo.subresourceRange.aspectMask != VK_IMAGE_ASPECT_COLOR_BIT) {
+			return false;
+		}
+		allocation->SetMoveHandler(this);
+		return true;
+	}
+
+	bool DVKTexture::OnMove(VulkanResourceAllocation* oldAllocation, VulkanResourceAllocation* newAllocation, VkCommandBuffer cmdBuffer)
+	{
+		VkImage newImage = VK_NULL_HANDLE;
+		if (vkCreateImage(device, &imageInfo, VULKAN_CPU_ALLOCATOR, &newImage) != VK_SUCCESS) {
+			return false;
+		}
+
+		// 失败时不能录制任何命令，新分配由Heap回收
+		VkMemoryRequirements memReqs = {};
+		vkGetImageMemoryRequirements(device, newImage, &memReqs);
+		if (memReqs.size > newAllocation->GetSize() || (newAllocation->GetOffset() % memReqs.alignment) != 0)
+		{
+			vkDestroyImage(device, newImage, VULKAN_CPU_ALLOCATOR);
+			return false;
+		}
+		newAllocation->BindImage(vulkanDevice, newImage);
+
+		VkImageView newImageView = VK_NULL_HANDLE;
+		VkImageViewCreateInfo newViewInfo = viewInfo;
+		newViewInfo.image = newImage;
+		if (vkCreateImageView(device, &newViewInfo, VULKAN_CPU_ALLOCATOR, &newImageView) != VK_SUCCESS)
+		{
+			vkDestroyImage(device, newImage, VULKAN_CPU_ALLOCATOR);
+			return false;
+		}
+
+		VkImageSubresourceRange subresourceRange = {};
+		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		subresourceRange.levelCount = imageInfo.mipLevels;
+		subresourceRange.layerCount = imageInfo.arrayLayers;
+
+		VkImageMemoryBarrier barriers[2];
+		ZeroVulkanStruct(barriers[0], VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER);
+		barriers[0].srcAccessMask       = VK_ACCESS_MEMORY_WRITE_BIT;
+		barriers[0].dstAccessMask       = VK_ACCESS_TRANSFER_READ_BIT;
+		barriers[0].oldLayout           = imageLayout;
+		barriers[0].newLayout           = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[0].image               = image;
+		barriers[0].subresourceRange    = subresourceRange;
+
+		barriers[1] = barriers[0];
+		barriers[1].srcAccessMask = 0;
+		barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barriers[1].oldLayout     = VK_IMAGE_LAYOUT_UNDEFINED;
+		barriers[1].newLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barriers[1].image         = newImage;
+
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+		std::vector<VkImageCopy> copyRegions(imageInfo.mipLevels);
+		for (uint32 i = 0; i < imageInfo.mipLevels; ++i)
+		{
+			VkImageCopy& region = copyRegions[i];
+			region = {};
+			region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.srcSubresource.mipLevel   = i;
+			region.srcSubresource.layerCount = imageInfo.arrayLayers;
+			region.dstSubresource            = region.srcSubresource;
+			region.extent.width  = MMath::Max<uint32>(imageInfo.extent.width  >> i, 1);
+			region.extent.height = MMath::Max<uint32>(imageInfo.extent.height >> i, 1);
+			region.extent.depth  = MMath::Max<uint32>(imageInfo.extent.depth  >> i, 1);
+		}
+		vkCmdCopyImage(cmdBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, newImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32)copyRegions.size(), copyRegions.data());
+
+		// 旧的Image之后不会再被使用，不需要转回原来的Layout
+		barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barriers[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		barriers[1].oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barriers[1].newLayout     = imageLayout;
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barriers[1]);
+
+		// 旧的内存由Heap延迟释放，旧的句柄也要等GPU用完，Sampler继续使用
+		vulkanDevice->GetResourceHeapManager().ReleaseDeferred(new DVKTextureRelease(device, image, imageView, VK_NULL_HANDLE, nullptr));
+
+		image       = newImage;
+		imageView   = newImageView;
+		imageMemory = newAllocation->GetHandle();
+		allocation  = newAllocation;
+		descriptorInfo.imageView = newImageView;
+
+		return true;
+	}
+
 };
@@ -13,7 +13,7 @@
 namespace vk_demo
 {
   
-    class DVKTexture
+    class DVKTexture : public VulkanResourceMoveHandler
     {
     public:
         DVKTexture()
@@ -21,32 +21,8 @@ namespace vk_demo
             
         }
         
-        ~DVKTexture()
-        {
-            if (imageView != VK_NULL_HANDLE) 
-			{
-                vkDestroyImageView(device, imageView, VULKAN_CPU_ALLOCATOR);
-                imageView = VK_NULL_HANDLE;
-            }
-            
-            if (image != VK_NULL_HANDLE) 
-			{
-                vkDestroyImage(device, image, VULKAN_CPU_ALLOCATOR);
-                image = VK_NULL_HANDLE;
-            }
-            
-            if (imageSampler != VK_NULL_HANDLE) 
-			{
-                vkDestroySampler(device, imageSampler, VULKAN_CPU_ALLOCATOR);
-                imageSampler = VK_NULL_HANDLE;
-            }
-            
-            if (imageMemory != VK_NULL_HANDLE) 
-			{
-                vkFreeMemory(device, imageMemory, VULKAN_CPU_ALLOCATOR);
-                imageMemory = VK_NULL_HANDLE;
-            }
-        }
+        // GPU可能仍在使用，Image、View、Sampler和内存交给延迟释放队列
+        ~DVKTexture();
 
 		void UpdateSampler(
 			VkFilter magFilter = VK_FILTER_LINEAR, 
@@ -172,10 +148,13 @@ namespace vk_demo
         
     public:
         VkDevice						device = nullptr;
+        VulkanDevice*					vulkanDevice = nullptr;
         
         VkImage                         image = VK_NULL_HANDLE;
         VkImageLayout                   imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        // 内存来自VulkanResourceHeapManager，imageMemory是所在页的句柄
         VkDeviceMemory                  imageMemory = VK_NULL_HANDLE;
+        VulkanResourceAllocation*       allocation = nullptr;
         VkImageView                     imageView = VK_NULL_HANDLE;
         VkSampler                       imageSampler = VK_NULL_HANDLE;
         VkDescriptorImageInfo           descriptorInfo;
@@ -189,6 +168,18 @@ namespace vk_demo
         VkFormat                        format = VK_FORMAT_R8G8B8A8_UNORM;
 
 		bool							isCubeMap = false;
+
+		// 碎片整理时按创建参数重建Image和View
+		VkImageCreateInfo				imageInfo;
+		VkImageViewCreateInfo			viewInfo;
+
+	public:
+
+		// 允许VulkanResourceHeapManager::Defragment移动这个Texture，只支持带TRANSFER_SRC/DST的颜色Image。
+		// 移动之后image和imageView会变，用到它的Material需要重新SetTexture。
+		bool EnableDefragment();
+
+		virtual bool OnMove(VulkanResourceAllocation* oldAllocation, VulkanResourceAllocation* newAllocation, VkCommandBuffer cmdBuffer) override;
     };
     
 };
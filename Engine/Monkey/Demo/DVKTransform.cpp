@@ -0,0 +1,65 @@
+﻿#include "DVKTransform.h"
+
+namespace vk_demo
+{
+
+	void DVKTransformHierarchy::Clear()
+	{
+		parents.clear();
+		locals.clear();
+		worlds.clear();
+		inverseWorlds.clear();
+		dirty.clear();
+		inverseValid.clear();
+		firstDirty = MAX_int32;
+	}
+
+	int32 DVKTransformHierarchy::Add(int32 parent, const Matrix4x4& local)
+	{
+		int32 index = parents.size();
+
+		parents.push_back(parent < index ? parent : -1);
+		locals.push_back(local);
+		worlds.push_back(local);
+		inverseWorlds.push_back(Matrix4x4());
+		dirty.push_back(1);
+		inverseValid.push_back(0);
+
+		firstDirty = MMath::Min(firstDirty, index);
+
+		return index;
+	}
+
+	void DVKTransformHierarchy::Update()
+	{
+		if (firstDirty >= parents.size()) {
+			return;
+		}
+
+		// 父节点先于子节点更新，父节点脏了子节点也跟着变脏
+		int32 count = parents.size();
+		for (int32 i = firstDirty; i < count; ++i)
+		{
+			int32 parent = parents[i];
+			if (parent >= 0 && dirty[parent]) {
+				dirty[i] = 1;
+			}
+
+			if (!dirty[i]) {
+				continue;
+			}
+
+			worlds[i] = locals[i];
+			if (parent >= 0) {
+				worlds[i].Append(worlds[parent]);
+			}
+			inverseValid[i] = 0;
+		}
+
+		for (int32 i = firstDirty; i < count; ++i) {
+			dirty[i] = 0;
+		}
+		firstDirty = MAX_int32;
+	}
+
+}
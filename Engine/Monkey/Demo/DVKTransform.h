@@ -0,0 +1,69 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Matrix4x4.h"
+
+#include <vector>
+
+namespace vk_demo
+{
+
+	// 展开成数组的节点层级，父节点总是排在子节点之前。
+	// 修改局部矩阵只标记脏，读取世界矩阵时按顺序线性更新一遍脏节点及其子孙，没有递归。
+	// 逆矩阵在第一次读取时计算并缓存，直到节点再次变脏。
+	class DVKTransformHierarchy
+	{
+	public:
+		void Clear();
+
+		// parent必须小于新节点的序号，返回新节点的序号
+		int32 Add(int32 parent, const Matrix4x4& local);
+
+		FORCEINLINE int32 Size() const
+		{
+			return parents.size();
+		}
+
+		FORCEINLINE void SetLocal(int32 index, const Matrix4x4& local)
+		{
+			locals[index] = local;
+			dirty[index]  = 1;
+			firstDirty    = MMath::Min(firstDirty, index);
+		}
+
+		FORCEINLINE const Matrix4x4& GetLocal(int32 index) const
+		{
+			return locals[index];
+		}
+
+		FORCEINLINE Matrix4x4& GetWorld(int32 index)
+		{
+			Update();
+			return worlds[index];
+		}
+
+		FORCEINLINE const Matrix4x4& GetInverseWorld(int32 index)
+		{
+			Update();
+			if (!inverseValid[index])
+			{
+				inverseWorlds[index] = worlds[index].Inverse();
+				inverseValid[index]  = 1;
+			}
+			return inverseWorlds[index];
+		}
+
+		// 没有脏节点时直接返回
+		void Update();
+
+	protected:
+		std::vector<int32>		parents;
+		std::vector<Matrix4x4>	locals;
+		std::vector<Matrix4x4>	worlds;
+		std::vector<Matrix4x4>	inverseWorlds;
+		std::vector<uint8>		dirty;
+		std::vector<uint8>		inverseValid;
+		int32					firstDirty = MAX_int32;
+	};
+
+}
@@ -0,0 +1,46 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+
+#include <vector>
+#include <algorithm>
+
+namespace vk_demo
+{
+
+	// 树遍历用的栈，不超过InlineSize时不分配堆内存
+	template<class ValueType, int32 InlineSize = 64>
+	struct DVKTraversalStack
+	{
+		ValueType				fixed[InlineSize];
+		std::vector<ValueType>	heap;
+		ValueType*				data = fixed;
+		int32					capacity = InlineSize;
+		int32					count = 0;
+
+		FORCEINLINE void Push(const ValueType& value)
+		{
+			if (count == capacity)
+			{
+				heap.resize(capacity * 2);
+				if (data == fixed) {
+					std::copy(fixed, fixed + count, heap.begin());
+				}
+				data = heap.data();
+				capacity = heap.size();
+			}
+			data[count++] = value;
+		}
+
+		FORCEINLINE ValueType Pop()
+		{
+			return data[--count];
+		}
+
+		FORCEINLINE bool IsEmpty() const
+		{
+			return count == 0;
+		}
+	};
+
+}
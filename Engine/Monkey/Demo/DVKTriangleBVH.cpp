@@ -0,0 +1,415 @@
+﻿#include "DVKTriangleBVH.h"
+#include "DVKTraversalStack.h"
+
+#include <cstring>
+#include <algorithm>
+
+namespace vk_demo
+{
+
+	// 一半的表面积，只用于比较大小
+	static FORCEINLINE float GetArea(const Vector3& boundsMin, const Vector3& boundsMax)
+	{
+		Vector3 size = boundsMax - boundsMin;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	// Möller-Trumbore，不区分正反面
+	static FORCEINLINE bool IntersectTriangle(const Vector3& origin, const Vector3& direction, const Vector3& v0, const Vector3& edge1, const Vector3& edge2, float maxDistance, float& outDistance, float& outU, float& outV)
+	{
+		Vector3 pvec = Vector3::CrossProduct(direction, edge2);
+		float det = Vector3::DotProduct(edge1, pvec);
+		if (MMath::Abs(det) < SMALL_NUMBER) {
+			return false;
+		}
+
+		float invDet = 1.0f / det;
+		Vector3 tvec = origin - v0;
+		float u = Vector3::DotProduct(tvec, pvec) * invDet;
+		if (u < 0.0f || u > 1.0f) {
+			return false;
+		}
+
+		Vector3 qvec = Vector3::CrossProduct(tvec, edge1);
+		float v = Vector3::DotProduct(direction, qvec) * invDet;
+		if (v < 0.0f || u + v > 1.0f) {
+			return false;
+		}
+
+		float t = Vector3::DotProduct(edge2, qvec) * invDet;
+		if (t < 0.0f || t > maxDistance) {
+			return false;
+		}
+
+		outDistance = t;
+		outU = u;
+		outV = v;
+		return true;
+	}
+
+	void DVKTriangleBVH::Clear()
+	{
+		nodes.clear();
+		triangles.clear();
+	}
+
+	void DVKTriangleBVH::Build(const std::vector<Vector3>& positions, const std::vector<uint32>& indices, int32 maxLeafTriangles)
+	{
+		Clear();
+
+		int32 triangleCount = indices.size() / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		maxLeafTriangles = MMath::Clamp<int32>(maxLeafTriangles, 1, MaxLeafTriangles);
+
+		std::vector<Vector3> centroids(triangleCount);
+		std::vector<Vector3> boundsMins(triangleCount);
+		std::vector<Vector3> boundsMaxs(triangleCount);
+		std::vector<uint32>  triangleIndices(triangleCount);
+		for (int32 i = 0; i < triangleCount; ++i)
+		{
+			const Vector3& p0 = positions[indices[i * 3 + 0]];
+			const Vector3& p1 = positions[indices[i * 3 + 1]];
+			const Vector3& p2 = positions[indices[i * 3 + 2]];
+			boundsMins[i] = Vector3::Min(Vector3::Min(p0, p1), p2);
+			boundsMaxs[i] = Vector3::Max(Vector3::Max(p0, p1), p2);
+			centroids[i]  = (boundsMins[i] + boundsMaxs[i]) * 0.5f;
+			triangleIndices[i] = i;
+		}
+
+		std::vector<BinaryNode> binaryNodes;
+		binaryNodes.reserve(triangleCount * 2);
+		int32 root = BuildBinary(binaryNodes, triangleIndices, centroids, boundsMins, boundsMaxs, 0, triangleCount, maxLeafTriangles);
+
+		// 三角形按叶子的顺序排列
+		triangles.resize(triangleCount);
+		for (int32 i = 0; i < triangleCount; ++i)
+		{
+			uint32 index = triangleIndices[i];
+			const Vector3& p0 = positions[indices[index * 3 + 0]];
+			const Vector3& p1 = positions[indices[index * 3 + 1]];
+			const Vector3& p2 = positions[indices[index * 3 + 2]];
+			triangles[i].v0    = p0;
+			triangles[i].edge1 = p1 - p0;
+			triangles[i].edge2 = p2 - p0;
+			triangles[i].index = index;
+		}
+
+		nodes.reserve(triangleCount / 2 + 1);
+		Collapse(binaryNodes, root);
+	}
+
+	int32 DVKTriangleBVH::BuildBinary(std::vector<BinaryNode>& binaryNodes, std::vector<uint32>& triangleIndices, const std::vector<Vector3>& centroids, const std::vector<Vector3>& boundsMins, const std::vector<Vector3>& boundsMaxs, int32 first, int32 count, int32 maxLeafTriangles)
+	{
+		BinaryNode node;
+		node.boundsMin = Vector3(MAX_flt, MAX_flt, MAX_flt);
+		node.boundsMax = Vector3(-MAX_flt, -MAX_flt, -MAX_flt);
+		node.left  = -1;
+		node.right = -1;
+		node.first = first;
+		node.count = count;
+
+		Vector3 centroidMin = node.boundsMin;
+		Vector3 centroidMax = node.boundsMax;
+		for (int32 i = first; i < first + count; ++i)
+		{
+			uint32 index = triangleIndices[i];
+			node.boundsMin = Vector3::Min(node.boundsMin, boundsMins[index]);
+			node.boundsMax = Vector3::Max(node.boundsMax, boundsMaxs[index]);
+			centroidMin    = Vector3::Min(centroidMin, centroids[index]);
+			centroidMax    = Vector3::Max(centroidMax, centroids[index]);
+		}
+
+		int32 nodeIndex = binaryNodes.size();
+		binaryNodes.push_back(node);
+
+		if (count == 1) {
+			return nodeIndex;
+		}
+
+		// 按重心分桶，计算每个分割位置的SAH代价：遍历的代价记为1，每个三角形的求交代价记为1
+		struct Bin
+		{
+			Vector3 boundsMin;
+			Vector3 boundsMax;
+			int32	count;
+		};
+
+		float nodeArea  = GetArea(node.boundsMin, node.boundsMax);
+		float bestCost  = MAX_flt;
+		int32 bestAxis  = -1;
+		int32 bestSplit = 0;
+
+		for (int32 axis = 0; axis < 3; ++axis)
+		{
+			float extent = centroidMax[axis] - centroidMin[axis];
+			if (extent <= 0.0f) {
+				continue;
+			}
+
+			Bin bins[NumBins];
+			for (int32 b = 0; b < NumBins; ++b)
+			{
+				bins[b].boundsMin = Vector3(MAX_flt, MAX_flt, MAX_flt);
+				bins[b].boundsMax = Vector3(-MAX_flt, -MAX_flt, -MAX_flt);
+				bins[b].count = 0;
+			}
+
+			float scale = NumBins / extent;
+			for (int32 i = first; i < first + count; ++i)
+			{
+				uint32 index = triangleIndices[i];
+				int32  b     = MMath::Min<int32>((centroids[index][axis] - centroidMin[axis]) * scale, NumBins - 1);
+				bins[b].boundsMin = Vector3::Min(bins[b].boundsMin, boundsMins[index]);
+				bins[b].boundsMax = Vector3::Max(bins[b].boundsMax, boundsMaxs[index]);
+				bins[b].count += 1;
+			}
+
+			// 从右向左累计右侧的面积和数量
+			float rightCosts[NumBins];
+			Vector3 rightMin = Vector3(MAX_flt, MAX_flt, MAX_flt);
+			Vector3 rightMax = Vector3(-MAX_flt, -MAX_flt, -MAX_flt);
+			int32 rightCount = 0;
+			for (int32 b = NumBins - 1; b > 0; --b)
+			{
+				rightMin = Vector3::Min(rightMin, bins[b].boundsMin);
+				rightMax = Vector3::Max(rightMax, bins[b].boundsMax);
+				rightCount += bins[b].count;
+				rightCosts[b] = rightCount > 0 ? GetArea(rightMin, rightMax) * rightCount : 0.0f;
+			}
+
+			Vector3 leftMin = Vector3(MAX_flt, MAX_flt, MAX_flt);
+			Vector3 leftMax = Vector3(-MAX_flt, -MAX_flt, -MAX_flt);
+			int32 leftCount = 0;
+			for (int32 b = 0; b < NumBins - 1; ++b)
+			{
+				leftMin = Vector3::Min(leftMin, bins[b].boundsMin);
+				leftMax = Vector3::Max(leftMax, bins[b].boundsMax);
+				leftCount += bins[b].count;
+				if (leftCount == 0 || leftCount == count) {
+					continue;
+				}
+
+				float cost = 1.0f + (GetArea(leftMin, leftMax) * leftCount + rightCosts[b + 1]) / nodeArea;
+				if (cost < bestCost)
+				{
+					bestCost  = cost;
+					bestAxis  = axis;
+					bestSplit = b;
+				}
+			}
+		}
+
+		bool fitsLeaf = count <= maxLeafTriangles;
+		if (fitsLeaf && (bestAxis == -1 || bestCost >= count)) {
+			return nodeIndex;
+		}
+
+		int32 middle = first + count / 2;
+		if (bestAxis != -1)
+		{
+			float scale = NumBins / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+			float start = centroidMin[bestAxis];
+			int32 split = bestSplit;
+			uint32* partition = std::partition(triangleIndices.data() + first, triangleIndices.data() + first + count, [&](uint32 index) {
+				return MMath::Min<int32>((centroids[index][bestAxis] - start) * scale, NumBins - 1) <= split;
+			});
+			middle = partition - triangleIndices.data();
+		}
+		else if (count <= MaxLeafTriangles)
+		{
+			// 所有重心重合，无法再分割
+			return nodeIndex;
+		}
+
+		int32 left  = BuildBinary(binaryNodes, triangleIndices, centroids, boundsMins, boundsMaxs, first, middle - first, maxLeafTriangles);
+		int32 right = BuildBinary(binaryNodes, triangleIndices, centroids, boundsMins, boundsMaxs, middle, first + count - middle, maxLeafTriangles);
+		binaryNodes[nodeIndex].left  = left;
+		binaryNodes[nodeIndex].right = right;
+
+		return nodeIndex;
+	}
+
+	uint32 DVKTriangleBVH::Collapse(const std::vector<BinaryNode>& binaryNodes, int32 index)
+	{
+		const BinaryNode& binaryNode = binaryNodes[index];
+		if (binaryNode.left == -1 && index != 0) {
+			return LeafFlag | (binaryNode.first << 4) | binaryNode.count;
+		}
+
+		// 不断展开面积最大的内部子节点，直到凑满4个
+		int32 children[4];
+		int32 childCount = 0;
+		if (binaryNode.left == -1) {
+			children[childCount++] = index;
+		}
+		else
+		{
+			children[childCount++] = binaryNode.left;
+			children[childCount++] = binaryNode.right;
+		}
+
+		while (childCount < 4)
+		{
+			int32 best = -1;
+			float bestArea = -1.0f;
+			for (int32 i = 0; i < childCount; ++i)
+			{
+				const BinaryNode& child = binaryNodes[children[i]];
+				if (child.left == -1) {
+					continue;
+				}
+				float area = GetArea(child.boundsMin, child.boundsMax);
+				if (area > bestArea)
+				{
+					bestArea = area;
+					best = i;
+				}
+			}
+
+			if (best == -1) {
+				break;
+			}
+
+			const BinaryNode& child = binaryNodes[children[best]];
+			children[best] = child.left;
+			children[childCount++] = child.right;
+		}
+
+		int32 nodeIndex = nodes.size();
+		nodes.push_back(Node());
+
+		uint32 encoded[4];
+		for (int32 i = 0; i < childCount; ++i)
+		{
+			const BinaryNode& child = binaryNodes[children[i]];
+			if (child.left == -1) {
+				encoded[i] = LeafFlag | (child.first << 4) | child.count;
+			}
+			else {
+				encoded[i] = Collapse(binaryNodes, children[i]);
+			}
+		}
+
+		// 递归之后nodes可能已经重新分配
+		Node& node = nodes[nodeIndex];
+		for (int32 i = 0; i < 4; ++i)
+		{
+			if (i < childCount) {
+				node.SetChild(i, encoded[i], binaryNodes[children[i]].boundsMin, binaryNodes[children[i]].boundsMax);
+			}
+			else {
+				node.SetEmpty(i);
+			}
+		}
+
+		return nodeIndex;
+	}
+
+	template<bool AnyHit>
+	bool DVKTriangleBVH::Traverse(const Vector3& origin, const Vector3& direction, float maxDistance, DVKTriangleHit& outHit) const
+	{
+		if (nodes.empty()) {
+			return false;
+		}
+
+		const DVKBVHRay ray(origin, direction);
+
+		DVKTraversalStack<DVKBVHEntry> stack;
+		stack.Push({ 0, 0.0f });
+
+		float closest = maxDistance;
+		bool  hit     = false;
+
+		while (!stack.IsEmpty())
+		{
+			DVKBVHEntry entry = stack.Pop();
+			if (entry.distance > closest) {
+				continue;
+			}
+
+			if (entry.child & LeafFlag)
+			{
+				uint32 first = (entry.child & ~LeafFlag) >> 4;
+				uint32 count = entry.child & 15;
+				for (uint32 i = first; i < first + count; ++i)
+				{
+					const Triangle& triangle = triangles[i];
+					float distance, u, v;
+					if (IntersectTriangle(origin, direction, triangle.v0, triangle.edge1, triangle.edge2, closest, distance, u, v))
+					{
+						hit = true;
+						closest = distance;
+						outHit.distance = distance;
+						outHit.triangle = triangle.index;
+						outHit.u = u;
+						outHit.v = v;
+						if (AnyHit) {
+							return true;
+						}
+					}
+				}
+				continue;
+			}
+
+			// 一次测试4个子节点的包围盒，按距离从远到近入栈，近的先出栈
+			DVKBVHEntry hits[4];
+			int32 hitCount = nodes[entry.child].IntersectChildren(ray, closest, hits);
+			for (int32 i = 0; i < hitCount; ++i) {
+				stack.Push(hits[i]);
+			}
+		}
+
+		return hit;
+	}
+
+	bool DVKTriangleBVH::RayCast(const Vector3& origin, const Vector3& direction, float maxDistance, DVKTriangleHit& outHit) const
+	{
+		return Traverse<false>(origin, direction, maxDistance, outHit);
+	}
+
+	bool DVKTriangleBVH::RayTest(const Vector3& origin, const Vector3& direction, float maxDistance) const
+	{
+		DVKTriangleHit hit;
+		return Traverse<true>(origin, direction, maxDistance, hit);
+	}
+
+	void DVKTriangleBVH::Serialize(std::vector<uint8>& outData) const
+	{
+		uint32 header[2] = { (uint32)nodes.size(), (uint32)triangles.size() };
+		uint32 nodeBytes     = nodes.size() * sizeof(Node);
+		uint32 triangleBytes = triangles.size() * sizeof(Triangle);
+
+		outData.resize(sizeof(header) + nodeBytes + triangleBytes);
+		memcpy(outData.data(), header, sizeof(header));
+		memcpy(outData.data() + sizeof(header), nodes.data(), nodeBytes);
+		memcpy(outData.data() + sizeof(header) + nodeBytes, triangles.data(), triangleBytes);
+	}
+
+	bool DVKTriangleBVH::Deserialize(const uint8* data, uint32 dataSize)
+	{
+		Clear();
+
+		uint32 header[2];
+		if (dataSize < sizeof(header)) {
+			return false;
+		}
+		memcpy(header, data, sizeof(header));
+
+		uint64 nodeBytes     = (uint64)header[0] * sizeof(Node);
+		uint64 triangleBytes = (uint64)header[1] * sizeof(Triangle);
+		if (sizeof(header) + nodeBytes + triangleBytes != dataSize) {
+			return false;
+		}
+
+		nodes.resize(header[0]);
+		triangles.resize(header[1]);
+		memcpy(nodes.data(), data + sizeof(header), nodeBytes);
+		memcpy(triangles.data(), data + sizeof(header) + nodeBytes, triangleBytes);
+
+		return true;
+	}
+
+}
@@ -0,0 +1,108 @@
+﻿#pragma once
+
+#include "DVKBVHNode.h"
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Vector3.h"
+
+#include <vector>
+
+namespace vk_demo
+{
+
+	struct DVKTriangleHit
+	{
+		float	distance = MAX_flt;
+		// 三角形在indices中的序号，即indices[triangle * 3 + 0..2]
+		uint32	triangle = 0;
+		// 重心坐标，交点 = v0 * (1 - u - v) + v1 * u + v2 * v
+		float	u = 0.0f;
+		float	v = 0.0f;
+	};
+
+	// 三角形的4叉BVH，用于射线拾取。
+	// 先按SAH分桶构建二叉树，再把二叉树折叠为4叉DVKBVHNode：一次SIMD测试4个子节点的包围盒。
+	// 三角形按叶子顺序重排并预先计算边向量，不再需要访问原始的顶点数据。
+	// 构建之后indices不能再被重排(BuildMeshlets、BuildLods需要在构建之前调用)，否则triangle会对应错误的三角形。
+	class DVKTriangleBVH
+	{
+	public:
+		enum
+		{
+			MaxLeafTriangles = 15,
+			NumBins          = 16,
+		};
+
+		// positions可以是任意顶点数据，只要indices指向它
+		void Build(const std::vector<Vector3>& positions, const std::vector<uint32>& indices, int32 maxLeafTriangles = 4);
+
+		void Clear();
+
+		FORCEINLINE bool IsEmpty() const
+		{
+			return nodes.empty();
+		}
+
+		FORCEINLINE int32 GetNodeCount() const
+		{
+			return nodes.size();
+		}
+
+		FORCEINLINE int32 GetTriangleCount() const
+		{
+			return triangles.size();
+		}
+
+		// 最近的相交，射线为origin + direction * t，t在[0, maxDistance]之间。三角形不区分正反面。
+		bool RayCast(const Vector3& origin, const Vector3& direction, float maxDistance, DVKTriangleHit& outHit) const;
+
+		// 任意相交，找到第一个交点就返回，用于遮挡测试
+		bool RayTest(const Vector3& origin, const Vector3& direction, float maxDistance) const;
+
+		// 节点和三角形都是POD数组，可以直接写入烘焙文件
+		void Serialize(std::vector<uint8>& outData) const;
+
+		bool Deserialize(const uint8* data, uint32 dataSize);
+
+	private:
+		// 叶子的编码：低4位为三角形数量，其余为第一个三角形的序号
+		typedef DVKBVHNode Node;
+
+		enum : uint32
+		{
+			LeafFlag = DVKBVHNode::LeafFlag,
+		};
+
+		struct Triangle
+		{
+			Vector3	v0;
+			Vector3	edge1;
+			Vector3	edge2;
+			uint32	index;
+		};
+
+		// 二叉树的构建结果，之后折叠为Node
+		struct BinaryNode
+		{
+			Vector3	boundsMin;
+			Vector3	boundsMax;
+			int32	left;
+			int32	right;
+			int32	first;
+			int32	count;
+		};
+
+		int32 BuildBinary(std::vector<BinaryNode>& binaryNodes, std::vector<uint32>& triangleIndices, const std::vector<Vector3>& centroids, const std::vector<Vector3>& boundsMins, const std::vector<Vector3>& boundsMaxs, int32 first, int32 count, int32 maxLeafTriangles);
+
+		uint32 Collapse(const std::vector<BinaryNode>& binaryNodes, int32 index);
+
+		template<bool AnyHit>
+		bool Traverse(const Vector3& origin, const Vector3& direction, float maxDistance, DVKTriangleHit& outHit) const;
+
+	private:
+		std::vector<Node>		nodes;
+		std::vector<Triangle>	triangles;
+	};
+
+}
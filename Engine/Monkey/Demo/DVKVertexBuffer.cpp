@@ -2,8 +2,156 @@
 
 namespace vk_demo
 {
+
+	static uint16 FloatToHalf(float value)
+	{
+		uint32 bits = 0;
+		memcpy(&bits, &value, sizeof(float));
+
+		uint32 sign     = (bits >> 16) & 0x8000;
+		int32  exponent = ((bits >> 23) & 0xFF) - 127 + 15;
+		uint32 mantissa = bits & 0x7FFFFF;
+
+		// NaN、Inf以及超出范围的值
+		if (exponent >= 31) {
+			return sign | (((bits & 0x7FFFFFFF) > 0x7F800000) ? 0x7E00 : 0x7C00);
+		}
+
+		// 非规格化数，太小的直接为0
+		if (exponent <= 0)
+		{
+			if (exponent < -10) {
+				return sign;
+			}
+			mantissa = (mantissa | 0x800000) >> (1 - exponent);
+			return sign | ((mantissa + 0x1000) >> 13);
+		}
+
+		// 四舍五入，进位可能溢出到指数
+		return sign | ((exponent << 10) + ((mantissa + 0x1000) >> 13));
+	}
+
+	static inline int16 FloatToSNorm16(float value)
+	{
+		return (int16)MMath::RoundToInt(MMath::Clamp(value, -1.0f, 1.0f) * 32767.0f);
+	}
+
+	static inline void PushBits(std::vector<float>& vertices, uint32 bits)
+	{
+		float value = 0;
+		memcpy(&value, &bits, sizeof(float));
+		vertices.push_back(value);
+	}
+
+	static inline uint32 PackPair(uint16 x, uint16 y)
+	{
+		return uint32(x) | (uint32(y) << 16);
+	}
+
+	// 八面体编码，返回[-1, 1]范围的两个分量
+	static void OctEncode(const float* normal, float& outX, float& outY)
+	{
+		float length = MMath::Abs(normal[0]) + MMath::Abs(normal[1]) + MMath::Abs(normal[2]);
+		if (length <= 0.0f)
+		{
+			outX = 0.0f;
+			outY = 0.0f;
+			return;
+		}
+
+		float x = normal[0] / length;
+		float y = normal[1] / length;
+		float z = normal[2] / length;
+
+		if (z < 0.0f)
+		{
+			float foldX = (1.0f - MMath::Abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float foldY = (1.0f - MMath::Abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = foldX;
+			y = foldY;
+		}
+
+		outX = x;
+		outY = y;
+	}
+
+	void PackVertexAttribute(VertexAttribute attribute, const float* values, const Vector3& boundsMin, const Vector3& boundsMax, std::vector<float>& vertices)
+	{
+		if (attribute == VertexAttribute::VA_PackedPosition)
+		{
+			uint16 quantized[3];
+			for (int32 i = 0; i < 3; ++i)
+			{
+				float extent = boundsMax[i] - boundsMin[i];
+				float t = extent > 0.0f ? (values[i] - boundsMin[i]) / extent : 0.0f;
+				quantized[i] = MMath::RoundToInt(MMath::Clamp(t, 0.0f, 1.0f) * 65535.0f);
+			}
+			PushBits(vertices, PackPair(quantized[0], quantized[1]));
+			PushBits(vertices, PackPair(quantized[2], 0));
+		}
+		else if (attribute == VertexAttribute::VA_PackedUV0 || attribute == VertexAttribute::VA_PackedUV1)
+		{
+			PushBits(vertices, PackPair(FloatToHalf(values[0]), FloatToHalf(values[1])));
+		}
+		else if (attribute == VertexAttribute::VA_PackedNormal)
+		{
+			float x, y;
+			OctEncode(values, x, y);
+			PushBits(vertices, PackPair(FloatToSNorm16(x), FloatToSNorm16(y)));
+		}
+		else if (attribute == VertexAttribute::VA_PackedTangent)
+		{
+			// y映射到[0, 1]之后用符号保存w，损失1bit精度
+			float x, y;
+			OctEncode(values, x, y);
+			y = MMath::Max(y * 0.5f + 0.5f, 1.0f / 32767.0f);
+			if (values[3] < 0.0f) {
+				y = -y;
+			}
+			PushBits(vertices, PackPair(FloatToSNorm16(x), FloatToSNorm16(y)));
+		}
+		else if (attribute == VertexAttribute::VA_PackedSkinWeight)
+		{
+			// 量化之后的误差补到最大的权重上，保证总和为255
+			int32 weights[4];
+			int32 sum = 0;
+			int32 maxIndex = 0;
+			for (int32 i = 0; i < 4; ++i)
+			{
+				weights[i] = MMath::RoundToInt(MMath::Clamp(values[i], 0.0f, 1.0f) * 255.0f);
+				sum += weights[i];
+				if (weights[i] > weights[maxIndex]) {
+					maxIndex = i;
+				}
+			}
+			if (sum > 0) {
+				weights[maxIndex] = MMath::Clamp(weights[maxIndex] + 255 - sum, 0, 255);
+			}
+			PushBits(vertices, uint32(weights[0]) | (uint32(weights[1]) << 8) | (uint32(weights[2]) << 16) | (uint32(weights[3]) << 24));
+		}
+		else if (attribute == VertexAttribute::VA_PackedSkinIndex)
+		{
+			uint32 indices[4];
+			for (int32 i = 0; i < 4; ++i)
+			{
+				int32 index = (int32)values[i];
+				if (index < 0 || index > 255)
+				{
+					MLOGE("Skin index %d out of range for VA_PackedSkinIndex.", index);
+					index = 0;
+				}
+				indices[i] = index;
+			}
+			PushBits(vertices, indices[0] | (indices[1] << 8) | (indices[2] << 16) | (indices[3] << 24));
+		}
+	}
 	
-	DVKVertexBuffer* DVKVertexBuffer::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, std::vector<float> vertices, const std::vector<VertexAttribute>& attributes)
+	DVKVertexBuffer* DVKVertexBuffer::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const std::vector<float>& vertices, const std::vector<VertexAttribute>& attributes)
+	{
+		return Create(vulkanDevice, cmdBuffer, vertices.data(), vertices.size() * sizeof(float), attributes);
+	}
+
+	DVKVertexBuffer* DVKVertexBuffer::Create(std::shared_ptr<VulkanDevice> vulkanDevice, DVKCommandBuffer* cmdBuffer, const void* vertices, uint64 dataSize, const std::vector<VertexAttribute>& attributes)
 	{
 		VkDevice device = vulkanDevice->GetInstanceHandle();
 
@@ -11,32 +159,26 @@ namespace vk_demo
 		vertexBuffer->device	 = device;
 		vertexBuffer->attributes = attributes;
 
-		vk_demo::DVKBuffer* vertexStaging = vk_demo::DVKBuffer::CreateBuffer(
-			vulkanDevice, 
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-			vertices.size() * sizeof(float), 
-			vertices.data()
-		);
+		DVKStagingRegion vertexStaging = cmdBuffer->AcquireStaging(dataSize);
+		memcpy(vertexStaging.mapped, vertices, dataSize);
 
 		vertexBuffer->dvkBuffer = vk_demo::DVKBuffer::CreateBuffer(
 			vulkanDevice, 
 			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
-			vertices.size() * sizeof(float)
+			dataSize
 		);
 
 		cmdBuffer->Begin();
 
 		VkBufferCopy copyRegion = {};
-		copyRegion.size = vertices.size() * sizeof(float);
-		vkCmdCopyBuffer(cmdBuffer->cmdBuffer, vertexStaging->buffer, vertexBuffer->dvkBuffer->buffer, 1, &copyRegion);
+		copyRegion.srcOffset = vertexStaging.offset;
+		copyRegion.size = dataSize;
+		vkCmdCopyBuffer(cmdBuffer->cmdBuffer, vertexStaging.buffer, vertexBuffer->dvkBuffer->buffer, 1, &copyRegion);
 
 		cmdBuffer->End();
 		cmdBuffer->Submit();
 
-		delete vertexStaging;
-
 		return vertexBuffer;
 	}
 
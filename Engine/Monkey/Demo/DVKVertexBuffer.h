@@ -6,6 +6,7 @@
 
 #include "Common/Common.h"
 #include "Math/Math.h"
+#include "Math/Vector3.h"
 
 #include "Vulkan/VulkanCommon.h"
 
@@ -67,6 +68,23 @@ namespace vk_demo
         else if (attribute == VertexAttribute::VA_InstanceFloat4) {
             return 4 * sizeof(float);
         }
+		else if (attribute == VertexAttribute::VA_PackedPosition) {
+			return 4 * sizeof(uint16);
+		}
+		else if (attribute == VertexAttribute::VA_PackedUV0 ||
+				 attribute == VertexAttribute::VA_PackedUV1 ||
+				 attribute == VertexAttribute::VA_PackedNormal ||
+				 attribute == VertexAttribute::VA_PackedTangent
+		)
+		{
+			return 2 * sizeof(uint16);
+		}
+		else if (attribute == VertexAttribute::VA_PackedSkinWeight ||
+				 attribute == VertexAttribute::VA_PackedSkinIndex
+		)
+		{
+			return 4 * sizeof(uint8);
+		}
         
 		return 0;
 	}
@@ -121,9 +139,40 @@ namespace vk_demo
         else if (attribute == VertexAttribute::VA_InstanceFloat4) {
             format = VK_FORMAT_R32G32B32A32_SFLOAT;
         }
+		else if (attribute == VertexAttribute::VA_PackedPosition) {
+			format = VK_FORMAT_R16G16B16A16_UNORM;
+		}
+		else if (attribute == VertexAttribute::VA_PackedUV0 || attribute == VertexAttribute::VA_PackedUV1) {
+			format = VK_FORMAT_R16G16_SFLOAT;
+		}
+		else if (attribute == VertexAttribute::VA_PackedNormal || attribute == VertexAttribute::VA_PackedTangent) {
+			format = VK_FORMAT_R16G16_SNORM;
+		}
+		else if (attribute == VertexAttribute::VA_PackedSkinWeight) {
+			format = VK_FORMAT_R8G8B8A8_UNORM;
+		}
+		else if (attribute == VertexAttribute::VA_PackedSkinIndex) {
+			format = VK_FORMAT_R8G8B8A8_UINT;
+		}
         
 		return format;
 	}
+
+	inline bool IsPackedVertexAttribute(VertexAttribute attribute)
+	{
+		return attribute >= VertexAttribute::VA_PackedPosition && attribute <= VertexAttribute::VA_PackedSkinIndex;
+	}
+
+	// 压缩顶点格式，结果按位写入vertices，每个属性都是4字节的整数倍。Shader中的解码：
+	// VA_PackedPosition   : RGBA16_UNORM，相对包围盒量化，position = boundsMin + inPackedPosition.xyz * (boundsMax - boundsMin)
+	// VA_PackedUV0/UV1    : RG16_SFLOAT，直接当作vec2使用
+	// VA_PackedNormal     : RG16_SNORM，八面体编码，见下方OctDecode
+	// VA_PackedTangent    : RG16_SNORM，八面体编码，y的符号为w：w = y < 0 ? -1 : 1; y = abs(y) * 2 - 1
+	// VA_PackedSkinWeight : RGBA8_UNORM，四个权重之和为1
+	// VA_PackedSkinIndex  : RGBA8_UINT，Shader中声明为uvec4，骨骼数量不能超过256
+	// vec3 OctDecode(vec2 e) { vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y)); float t = max(-n.z, 0.0); n.xy -= sign(n.xy) * t; return normalize(n); }
+	// values按属性提供3个(Position、Normal)、2个(UV)或者4个(Tangent、SkinWeight、SkinIndex)float
+	void PackVertexAttribute(VertexAttribute attribute, const float* values, const Vector3& boundsMin, const Vector3& boundsMax, std::vector<float>& vertices);
     
 	class DVKVertexBuffer
 	{
@@ -151,7 +200,10 @@ namespace vk_demo
 
 		std::vector<VkVertexInputAttributeDescription> GetInputAttributes(const std::vector<VertexAttribute>& shaderInputs);
 
-		static DVKVertexBuffer* Create(std::shared_ptr<VulkanDevice> device, DVKCommandBuffer* cmdBuffer, std::vector<float> vertices, const std::vector<VertexAttribute>& attributes);
+		static DVKVertexBuffer* Create(std::shared_ptr<VulkanDevice> device, DVKCommandBuffer* cmdBuffer, const std::vector<float>& vertices, const std::vector<VertexAttribute>& attributes);
+
+		// 数据直接拷贝进Staging，例如来自映射的文件
+		static DVKVertexBuffer* Create(std::shared_ptr<VulkanDevice> device, DVKCommandBuffer* cmdBuffer, const void* vertices, uint64 dataSize, const std::vector<VertexAttribute>& attributes);
 
 	public:
 		VkDevice						device = VK_NULL_HANDLE;
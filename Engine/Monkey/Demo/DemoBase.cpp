@@ -1,6 +1,8 @@
 ﻿#include "DemoBase.h"
 #include "DVKDefaultRes.h"
 #include "DVKCommand.h"
+#include "DVKMaterial.h"
+#include "DVKCompute.h"
 
 void DemoBase::Setup()
 {
@@ -21,6 +23,14 @@ void DemoBase::Setup()
 int32 DemoBase::AcquireBackbufferIndex()
 {
 	int32 backBufferIndex = m_SwapChain->AcquireImageIndex(&m_PresentComplete);
+
+	// 回收该帧上一次在RingBuffer中使用的Uniform数据
+	vk_demo::DVKMaterial::BeginRingBufferFrame(backBufferIndex, m_Fences[backBufferIndex]);
+	vk_demo::DVKCompute::BeginRingBufferFrame(backBufferIndex, m_Fences[backBufferIndex]);
+
+	// 推进资源堆的帧计数，释放已经过了GPU延迟的资源
+	m_VulkanDevice->GetResourceHeapManager().ReleaseFreedPages();
+
 	return backBufferIndex;
 }
 
@@ -6,11 +6,20 @@
 #if PLATFORM_WINDOWS
 
 #elif PLATFORM_MAC
-
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
 #elif PLATFORM_IOS
-
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
 #elif PLATFORM_LINUX
-
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
 #elif PLATFORM_ANDROID
 	#include "Application/Android/AndroidWindow.h"
 #endif
@@ -62,3 +71,99 @@ bool FileManager::ReadFile(const std::string& filepath, uint8*& dataPtr, uint32&
 
 	return true;
 }
+
+bool FileManager::WriteFile(const std::string& filepath, const uint8* dataPtr, uint32 dataSize)
+{
+	std::string finalPath = FileManager::GetFilePath(filepath);
+
+	FILE* file = fopen(finalPath.c_str(), "wb");
+	if (!file) {
+		MLOGE("Failed open file :%s", filepath.c_str());
+		return false;
+	}
+
+	bool success = fwrite(dataPtr, 1, dataSize, file) == dataSize;
+	fclose(file);
+
+	return success;
+}
+
+bool FileManager::FileExists(const std::string& filepath)
+{
+	std::string finalPath = FileManager::GetFilePath(filepath);
+
+#if PLATFORM_ANDROID
+
+	AAsset* asset = AAssetManager_open(g_AndroidApp->activity->assetManager, finalPath.c_str(), AASSET_MODE_UNKNOWN);
+	if (!asset) {
+		return false;
+	}
+	AAsset_close(asset);
+	return true;
+
+#else
+
+	FILE* file = fopen(finalPath.c_str(), "rb");
+	if (!file) {
+		return false;
+	}
+	fclose(file);
+	return true;
+
+#endif
+}
+
+#if PLATFORM_MAC || PLATFORM_IOS || PLATFORM_LINUX
+
+bool FileManager::MapFile(const std::string& filepath, uint8*& dataPtr, uint32& dataSize)
+{
+	std::string finalPath = FileManager::GetFilePath(filepath);
+
+	int fd = open(finalPath.c_str(), O_RDONLY);
+	if (fd < 0) {
+		MLOGE("File not found :%s", filepath.c_str());
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0) {
+		close(fd);
+		MLOGE("File has no data :%s", filepath.c_str());
+		return false;
+	}
+
+	void* mapped = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// 映射建立之后文件描述符就可以关闭了
+	close(fd);
+
+	if (mapped == MAP_FAILED) {
+		MLOGE("Failed map file :%s", filepath.c_str());
+		return false;
+	}
+
+	dataPtr  = (uint8*)mapped;
+	dataSize = (uint32)fileStat.st_size;
+
+	return true;
+}
+
+void FileManager::UnmapFile(uint8* dataPtr, uint32 dataSize)
+{
+	if (dataPtr) {
+		munmap(dataPtr, dataSize);
+	}
+}
+
+#else
+
+bool FileManager::MapFile(const std::string& filepath, uint8*& dataPtr, uint32& dataSize)
+{
+	return ReadFile(filepath, dataPtr, dataSize);
+}
+
+void FileManager::UnmapFile(uint8* dataPtr, uint32 dataSize)
+{
+	delete[] dataPtr;
+}
+
+#endif
@@ -9,5 +9,14 @@ class FileManager
 public:
 	static bool ReadFile(const std::string& filepath, uint8*& dataPtr, uint32& dataSize);
 
+	static bool WriteFile(const std::string& filepath, const uint8* dataPtr, uint32 dataSize);
+
+	static bool FileExists(const std::string& filepath);
+
+	// 把文件映射到内存，不支持mmap的平台退化为ReadFile。必须通过UnmapFile释放。
+	static bool MapFile(const std::string& filepath, uint8*& dataPtr, uint32& dataSize);
+
+	static void UnmapFile(uint8* dataPtr, uint32 dataSize);
+
 	static std::string GetFilePath(const std::string& filepath);
 };
\ No newline at end of file
@@ -91,7 +91,7 @@ ImageGUIContext::ImageGUIContext()
 	, m_PipelineCache(VK_NULL_HANDLE)
     , m_Pipeline(VK_NULL_HANDLE)
 	, m_LastRenderPass(VK_NULL_HANDLE)
-    , m_FontMemory(VK_NULL_HANDLE)
+    , m_FontMemory(nullptr)
     , m_FontImage(VK_NULL_HANDLE)
     , m_FontView(VK_NULL_HANDLE)
     , m_FontSampler(VK_NULL_HANDLE)
@@ -342,8 +342,8 @@ void ImageGUIContext::Destroy()
 	vkDestroyPipelineLayout(device, m_PipelineLayout, VULKAN_CPU_ALLOCATOR);
 	vkDestroyPipeline(device, m_Pipeline, VULKAN_CPU_ALLOCATOR);
 	vkDestroyPipelineCache(device, m_PipelineCache, VULKAN_CPU_ALLOCATOR);
-	vkFreeMemory(device, m_FontMemory, VULKAN_CPU_ALLOCATOR);
 	vkDestroyImage(device, m_FontImage, VULKAN_CPU_ALLOCATOR);
+	m_VulkanDevice->GetMemoryManager().Free(m_FontMemory);
 	vkDestroyImageView(device, m_FontView, VULKAN_CPU_ALLOCATOR);
 	vkDestroySampler(device, m_FontSampler, VULKAN_CPU_ALLOCATOR);
 }
@@ -370,10 +370,8 @@ void ImageGUIContext::PrepareFontResources()
 	VkDeviceSize uploadSize = texWidth * texHeight * 4 * sizeof(uint8);
 
 	// mem alloc info
-	uint32 memoryTypeIndex = 0;
+	VulkanDeviceMemoryManager& memoryManager = m_VulkanDevice->GetMemoryManager();
 	VkMemoryRequirements memReqs;
-	VkMemoryAllocateInfo memAllocInfo;
-	ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
 
 	// font image
 	{
@@ -397,14 +395,11 @@ void ImageGUIContext::PrepareFontResources()
 	// font memory
 	{
 		vkGetImageMemoryRequirements(device, m_FontImage, &memReqs);
-		m_VulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryTypeIndex);
-		memAllocInfo.allocationSize  = memReqs.size;
-		memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-		VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &m_FontMemory));
+		m_FontMemory = memoryManager.Alloc(false, memReqs.size, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, nullptr, __FILE__, __LINE__);
 	}
 
 	// bind memory to image
-	VERIFYVULKANRESULT(vkBindImageMemory(device, m_FontImage, m_FontMemory, 0));
+	VERIFYVULKANRESULT(vkBindImageMemory(device, m_FontImage, m_FontMemory->GetHandle(), 0));
 
 	// view info
 	{
@@ -437,8 +432,8 @@ void ImageGUIContext::PrepareFontResources()
 	}
 
 	// staging info
-	VkBuffer       stagingBuffer = VK_NULL_HANDLE;
-	VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+	VkBuffer                      stagingBuffer = VK_NULL_HANDLE;
+	VulkanDeviceMemoryAllocation* stagingMemory = nullptr;
 
 	// staging buffer
 	{
@@ -452,27 +447,18 @@ void ImageGUIContext::PrepareFontResources()
 	// staging memory
 	{
 		vkGetBufferMemoryRequirements(device, stagingBuffer, &memReqs);
-		m_VulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &memoryTypeIndex);
-		memAllocInfo.allocationSize  = memReqs.size;
-		memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-		VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &stagingMemory));
+		stagingMemory = memoryManager.Alloc(false, memReqs.size, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, nullptr, __FILE__, __LINE__);
 	}
 
 	// bind staging buffer to memory
-	VERIFYVULKANRESULT(vkBindBufferMemory(device, stagingBuffer, stagingMemory, 0));
+	VERIFYVULKANRESULT(vkBindBufferMemory(device, stagingBuffer, stagingMemory->GetHandle(), 0));
 
 	// copy data to staging memory
 	{
-		VkMappedMemoryRange flushRange;
-		ZeroVulkanStruct(flushRange, VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE);
-		flushRange.memory = stagingMemory;
-		flushRange.size   = uploadSize;
-
-		void* mappedPtr = nullptr;
-		VERIFYVULKANRESULT(vkMapMemory(device, stagingMemory, 0, uploadSize, 0, &mappedPtr));
+		void* mappedPtr = stagingMemory->Map(uploadSize, 0);
 		std::memcpy(mappedPtr, fontData, uploadSize);
-		vkFlushMappedMemoryRanges(device, 1, &flushRange);
-		vkUnmapMemory(device, stagingMemory);
+		stagingMemory->FlushMappedMemory(0, uploadSize);
+		stagingMemory->Unmap();
 	}
 
 	// prepare command
@@ -599,7 +585,7 @@ void ImageGUIContext::PrepareFontResources()
 	vkDestroyFence(device, fence, VULKAN_CPU_ALLOCATOR);
 	vkDestroyCommandPool(device, commandPool, VULKAN_CPU_ALLOCATOR);
 	vkDestroyBuffer(device, stagingBuffer, VULKAN_CPU_ALLOCATOR);
-	vkFreeMemory(device, stagingMemory, VULKAN_CPU_ALLOCATOR);
+	memoryManager.Free(stagingMemory);
 }
 
 void ImageGUIContext::Resize(uint32 width, uint32 height)
@@ -631,6 +617,67 @@ void ImageGUIContext::EndFrame()
 	ImGui::Render();
 }
 
+void ImageGUIContext::ShowMemoryStats(const VulkanMemoryStats& stats)
+{
+	const float toMB = 1.0f / 1024.0f / 1024.0f;
+
+	uint64 usedSize = 0;
+	for (int32 i = 0; i < stats.heaps.size(); ++i) {
+		usedSize += stats.heaps[i].usedSize;
+	}
+
+	m_MemoryHistory.push_back(usedSize * toMB);
+	if (m_MemoryHistory.size() > 120) {
+		m_MemoryHistory.erase(m_MemoryHistory.begin());
+	}
+
+	ImGui::Begin("Memory", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+
+	ImGui::PlotLines("Used MB", m_MemoryHistory.data(), m_MemoryHistory.size(), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+
+	for (int32 i = 0; i < stats.heaps.size(); ++i)
+	{
+		const VulkanMemoryStats::HeapStats& heap = stats.heaps[i];
+		char overlay[64];
+		sprintf(overlay, "%.1f / %.1f MB", heap.usedSize * toMB, heap.totalSize * toMB);
+		ImGui::Text("Heap %d: %d allocs, peak %.1f MB", i, heap.numAllocations, heap.peakSize * toMB);
+		ImGui::ProgressBar(heap.totalSize > 0 ? (float)((double)heap.usedSize / (double)heap.totalSize) : 0.0f, ImVec2(-1, 0), overlay);
+	}
+
+	if (ImGui::CollapsingHeader("Memory Types"))
+	{
+		for (int32 i = 0; i < stats.memoryTypes.size(); ++i)
+		{
+			const VulkanMemoryStats::MemoryTypeStats& type = stats.memoryTypes[i];
+			if (type.numAllocations == 0 && type.peakSize == 0) {
+				continue;
+			}
+			ImGui::Text("Type %d (Heap %d): %.1f MB, peak %.1f MB, %d allocs", i, type.heapIndex, type.usedSize * toMB, type.peakSize * toMB, type.numAllocations);
+			if (type.numPages > 0) {
+				ImGui::Text("    %d pages (%d free) %.1f / %.1f MB", type.numPages, type.numFreePages, type.pageUsedSize * toMB, type.pageSize * toMB);
+			}
+		}
+	}
+
+	if (ImGui::CollapsingHeader("Buffer Pools"))
+	{
+		for (int32 i = 0; i < stats.pools.size(); ++i)
+		{
+			const VulkanMemoryStats::PoolStats& pool = stats.pools[i];
+			if (pool.poolSize == 0) {
+				ImGui::Text("Large: %d used / %d free, %.1f%%", pool.numUsedBuffers, pool.numFreeBuffers, pool.maxSize > 0 ? 100.0f * pool.usedSize / pool.maxSize : 0.0f);
+			}
+			else {
+				ImGui::Text("%5d: %d used / %d free, %.1f%%", pool.poolSize, pool.numUsedBuffers, pool.numFreeBuffers, pool.maxSize > 0 ? 100.0f * pool.usedSize / pool.maxSize : 0.0f);
+			}
+		}
+	}
+
+	ImGui::Text("Fragmentation %.1f%%", stats.GetFragmentation() * 100.0f);
+
+	ImGui::End();
+}
+
 bool ImageGUIContext::Update()
 {
     ImDrawData* imDrawData = ImGui::GetDrawData();
@@ -698,21 +745,16 @@ void ImageGUIContext::CreateBuffer(UIBuffer& buffer, VkBufferUsageFlags usageFla
 	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	VERIFYVULKANRESULT(vkCreateBuffer(device, &bufferCreateInfo, VULKAN_CPU_ALLOCATOR, &buffer.buffer));
     
-	uint32 memoryTypeIndex = 0;
 	VkMemoryRequirements memReqs;
-	VkMemoryAllocateInfo memAllocInfo;
-	ZeroVulkanStruct(memAllocInfo, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO);
-
 	vkGetBufferMemoryRequirements(device, buffer.buffer, &memReqs);
-	m_VulkanDevice->GetMemoryManager().GetMemoryTypeFromProperties(memReqs.memoryTypeBits, memoryPropertyFlags, &memoryTypeIndex);
-	memAllocInfo.allocationSize  = memReqs.size;
-	memAllocInfo.memoryTypeIndex = memoryTypeIndex;
-	VERIFYVULKANRESULT(vkAllocateMemory(device, &memAllocInfo, VULKAN_CPU_ALLOCATOR, &buffer.memory));
 
-	VERIFYVULKANRESULT(vkBindBufferMemory(device, buffer.buffer, buffer.memory, 0));
+	buffer.memoryManager = &(m_VulkanDevice->GetMemoryManager());
+	buffer.allocation    = buffer.memoryManager->Alloc(false, memReqs.size, memReqs.memoryTypeBits, memoryPropertyFlags, nullptr, __FILE__, __LINE__);
+
+	VERIFYVULKANRESULT(vkBindBufferMemory(device, buffer.buffer, buffer.allocation->GetHandle(), 0));
 
 	buffer.device    = device;
-	buffer.size      = memAllocInfo.allocationSize;
+	buffer.size      = memReqs.size;
 	buffer.alignment = memReqs.alignment;
 }
 
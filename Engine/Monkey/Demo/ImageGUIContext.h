@@ -16,18 +16,21 @@ public:
     
 protected:
 
+    // 内存通过VulkanDeviceMemoryManager申请，这样UI占用的显存也会出现在统计里
     struct UIBuffer
     {
-        VkBuffer        buffer;
-        VkDeviceMemory  memory;
-		VkDevice		device;
-        void*			mapped;
-		VkDeviceSize	size;
-		VkDeviceSize	alignment;
+        VkBuffer						buffer;
+		VulkanDeviceMemoryManager*		memoryManager;
+		VulkanDeviceMemoryAllocation*	allocation;
+		VkDevice						device;
+        void*							mapped;
+		VkDeviceSize					size;
+		VkDeviceSize					alignment;
 
         UIBuffer()
             : buffer(VK_NULL_HANDLE)
-            , memory(VK_NULL_HANDLE)
+            , memoryManager(nullptr)
+			, allocation(nullptr)
 			, device(VK_NULL_HANDLE)
 			, mapped(nullptr)
 			, size(0)
@@ -40,14 +43,15 @@ protected:
 		{
 			if (mapped) 
 			{
-				vkUnmapMemory(device, memory);
+				allocation->Unmap();
 				mapped = nullptr;
 			}
 		}
 
 		VkResult Map(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0)
 		{
-			return vkMapMemory(device, memory, offset, size, 0, &mapped);
+			mapped = allocation->Map(size, offset);
+			return mapped ? VK_SUCCESS : VK_ERROR_MEMORY_MAP_FAILED;
 		}
 
 		void CopyFrom(void* data, VkDeviceSize size)
@@ -57,12 +61,10 @@ protected:
 
 		VkResult Flush(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0)
 		{
-			VkMappedMemoryRange mappedRange = {};
-			mappedRange.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-			mappedRange.memory = memory;
-			mappedRange.offset = offset;
-			mappedRange.size   = size;
-			return vkFlushMappedMemoryRanges(device, 1, &mappedRange);
+			if (!allocation) {
+				return VK_SUCCESS;
+			}
+			return allocation->FlushMappedMemory(offset, size);
 		}
 
 		void Destroy()
@@ -73,10 +75,10 @@ protected:
 				buffer = VK_NULL_HANDLE;
 			}
 
-			if (memory) 
+			if (allocation) 
 			{
-				vkFreeMemory(device, memory, VULKAN_CPU_ALLOCATOR);
-				memory = VK_NULL_HANDLE;
+				memoryManager->Free(allocation);
+				allocation = nullptr;
 			}
 
 			device = VK_NULL_HANDLE;
@@ -105,6 +107,9 @@ public:
 
     void BindDrawCmd(const VkCommandBuffer& commandBuffer, const VkRenderPass& renderPass, int32 subpass = 0, VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT);
     
+    // 在StartFrame与EndFrame之间调用，显示显存统计以及已用显存的历史曲线
+    void ShowMemoryStats(const VulkanMemoryStats& stats);
+    
 	inline float GetScale() const
 	{
 		return m_Scale;
@@ -145,7 +150,7 @@ protected:
 	int32					m_LastSubPass = -1;
 	VkSampleCountFlagBits	m_LastSampleCount = VK_SAMPLE_COUNT_1_BIT;
 
-    VkDeviceMemory          m_FontMemory;
+    VulkanDeviceMemoryAllocation* m_FontMemory;
     VkImage                 m_FontImage;
     VkImageView             m_FontView;
     VkSampler               m_FontSampler;
@@ -157,4 +162,6 @@ protected:
     float                   m_Scale;
     
     std::string             m_FontPath;
+    
+    std::vector<float>      m_MemoryHistory;
 };
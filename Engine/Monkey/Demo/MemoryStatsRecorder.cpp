@@ -0,0 +1,167 @@
+﻿#include "Common/Log.h"
+
+#include "MemoryStatsRecorder.h"
+
+MemoryStatsRecorder::MemoryStatsRecorder()
+	: m_File(nullptr)
+	, m_Format(Format::CSV)
+	, m_WroteHeader(false)
+	, m_NumRecords(0)
+{
+
+}
+
+MemoryStatsRecorder::~MemoryStatsRecorder()
+{
+	Close();
+}
+
+bool MemoryStatsRecorder::Open(const std::string& filepath)
+{
+	Close();
+
+	m_File = fopen(filepath.c_str(), "w");
+	if (!m_File) {
+		MLOGE("Failed open memory stats file :%s", filepath.c_str());
+		return false;
+	}
+
+	const std::string jsonExt = ".json";
+	if (filepath.size() >= jsonExt.size() && filepath.compare(filepath.size() - jsonExt.size(), jsonExt.size(), jsonExt) == 0) {
+		m_Format = Format::JSON;
+	}
+	else {
+		m_Format = Format::CSV;
+	}
+
+	if (m_Format == Format::JSON) {
+		fprintf(m_File, "[");
+	}
+
+	m_WroteHeader = false;
+	m_NumRecords  = 0;
+	return true;
+}
+
+void MemoryStatsRecorder::Close()
+{
+	if (m_File)
+	{
+		if (m_Format == Format::JSON) {
+			fprintf(m_File, "\n]\n");
+		}
+		fclose(m_File);
+		m_File = nullptr;
+	}
+}
+
+void MemoryStatsRecorder::WriteHeader(const VulkanMemoryStats& stats)
+{
+	fprintf(m_File, "frame");
+
+	for (int32 i = 0; i < stats.heaps.size(); ++i) {
+		fprintf(m_File, ",heap%d_used,heap%d_peak,heap%d_allocs", i, i, i);
+	}
+
+	for (int32 i = 0; i < stats.memoryTypes.size(); ++i) {
+		fprintf(m_File, ",type%d_used,type%d_peak,type%d_allocs,type%d_pages,type%d_page_used,type%d_page_size", i, i, i, i, i, i);
+	}
+
+	for (int32 i = 0; i < stats.pools.size(); ++i) {
+		fprintf(m_File, ",pool%d_%u_used,pool%d_%u_max", i, stats.pools[i].poolSize, i, stats.pools[i].poolSize);
+	}
+
+	fprintf(m_File, ",fragmentation\n");
+}
+
+void MemoryStatsRecorder::Record(uint64 frame, const VulkanMemoryStats& stats)
+{
+	if (!m_File) {
+		return;
+	}
+
+	if (m_Format == Format::JSON) {
+		RecordJSON(frame, stats);
+	}
+	else {
+		RecordCSV(frame, stats);
+	}
+
+	m_NumRecords += 1;
+}
+
+void MemoryStatsRecorder::RecordCSV(uint64 frame, const VulkanMemoryStats& stats)
+{
+	if (!m_WroteHeader)
+	{
+		WriteHeader(stats);
+		m_WroteHeader = true;
+	}
+
+	fprintf(m_File, "%llu", (unsigned long long)frame);
+
+	for (int32 i = 0; i < stats.heaps.size(); ++i)
+	{
+		const VulkanMemoryStats::HeapStats& heap = stats.heaps[i];
+		fprintf(m_File, ",%llu,%llu,%u", (unsigned long long)heap.usedSize, (unsigned long long)heap.peakSize, heap.numAllocations);
+	}
+
+	for (int32 i = 0; i < stats.memoryTypes.size(); ++i)
+	{
+		const VulkanMemoryStats::MemoryTypeStats& type = stats.memoryTypes[i];
+		fprintf(m_File, ",%llu,%llu,%u,%u,%llu,%llu", (unsigned long long)type.usedSize, (unsigned long long)type.peakSize, type.numAllocations, type.numPages, (unsigned long long)type.pageUsedSize, (unsigned long long)type.pageSize);
+	}
+
+	for (int32 i = 0; i < stats.pools.size(); ++i)
+	{
+		const VulkanMemoryStats::PoolStats& pool = stats.pools[i];
+		fprintf(m_File, ",%llu,%llu", (unsigned long long)pool.usedSize, (unsigned long long)pool.maxSize);
+	}
+
+	fprintf(m_File, ",%.4f\n", stats.GetFragmentation());
+}
+
+void MemoryStatsRecorder::RecordJSON(uint64 frame, const VulkanMemoryStats& stats)
+{
+	fprintf(m_File, "%s\n{\"frame\":%llu", m_NumRecords > 0 ? "," : "", (unsigned long long)frame);
+
+	fprintf(m_File, ",\"heaps\":[");
+	for (int32 i = 0; i < stats.heaps.size(); ++i)
+	{
+		const VulkanMemoryStats::HeapStats& heap = stats.heaps[i];
+		fprintf(
+			m_File,
+			"%s{\"total\":%llu,\"used\":%llu,\"peak\":%llu,\"allocs\":%u}",
+			i > 0 ? "," : "",
+			(unsigned long long)heap.totalSize, (unsigned long long)heap.usedSize, (unsigned long long)heap.peakSize, heap.numAllocations
+		);
+	}
+
+	fprintf(m_File, "],\"memoryTypes\":[");
+	for (int32 i = 0; i < stats.memoryTypes.size(); ++i)
+	{
+		const VulkanMemoryStats::MemoryTypeStats& type = stats.memoryTypes[i];
+		fprintf(
+			m_File,
+			"%s{\"heap\":%u,\"used\":%llu,\"peak\":%llu,\"allocs\":%u,\"pages\":%u,\"freePages\":%u,\"pageSize\":%llu,\"pageUsed\":%llu,\"pageFree\":%llu,\"pageLargestFree\":%llu}",
+			i > 0 ? "," : "",
+			type.heapIndex, (unsigned long long)type.usedSize, (unsigned long long)type.peakSize, type.numAllocations,
+			type.numPages, type.numFreePages, (unsigned long long)type.pageSize, (unsigned long long)type.pageUsedSize,
+			(unsigned long long)type.pageFreeSize, (unsigned long long)type.pageLargestFreeSize
+		);
+	}
+
+	fprintf(m_File, "],\"pools\":[");
+	for (int32 i = 0; i < stats.pools.size(); ++i)
+	{
+		const VulkanMemoryStats::PoolStats& pool = stats.pools[i];
+		fprintf(
+			m_File,
+			"%s{\"poolSize\":%u,\"usedBuffers\":%u,\"freeBuffers\":%u,\"used\":%llu,\"max\":%llu}",
+			i > 0 ? "," : "",
+			pool.poolSize, pool.numUsedBuffers, pool.numFreeBuffers, (unsigned long long)pool.usedSize, (unsigned long long)pool.maxSize
+		);
+	}
+
+	fprintf(m_File, "],\"fragmentation\":%.4f}", stats.GetFragmentation());
+}
@@ -0,0 +1,50 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+
+#include "Vulkan/VulkanMemory.h"
+
+#include <string>
+#include <cstdio>
+
+// 每帧把显存统计追加到文件，用于离线做容量规划
+// 扩展名为.json时输出一个JSON数组，每帧一个对象；否则每帧一行CSV
+class MemoryStatsRecorder
+{
+public:
+	enum class Format
+	{
+		CSV,
+		JSON,
+	};
+
+	MemoryStatsRecorder();
+
+	virtual ~MemoryStatsRecorder();
+
+	bool Open(const std::string& filepath);
+
+	void Close();
+
+	void Record(uint64 frame, const VulkanMemoryStats& stats);
+
+	inline bool IsOpen() const
+	{
+		return m_File != nullptr;
+	}
+
+private:
+
+	void WriteHeader(const VulkanMemoryStats& stats);
+
+	void RecordCSV(uint64 frame, const VulkanMemoryStats& stats);
+
+	void RecordJSON(uint64 frame, const VulkanMemoryStats& stats);
+
+private:
+
+	FILE*	m_File;
+	Format	m_Format;
+	bool	m_WroteHeader;
+	uint64	m_NumRecords;
+};
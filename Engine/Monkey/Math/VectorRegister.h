@@ -0,0 +1,494 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+
+#include <cstring>
+
+// 4个float的SIMD寄存器。x86使用SSE2，ARM使用NEON，其它平台退化为普通的数组。
+// 只封装批量计算(蒙皮、剔除、光线求交)需要的操作，比较结果为每个分量全1或全0的掩码。
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define PLATFORM_ENABLE_VECTORINTRINSICS		1
+	#define PLATFORM_ENABLE_VECTORINTRINSICS_NEON	0
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#define PLATFORM_ENABLE_VECTORINTRINSICS		0
+	#define PLATFORM_ENABLE_VECTORINTRINSICS_NEON	1
+	#include <arm_neon.h>
+#else
+	#define PLATFORM_ENABLE_VECTORINTRINSICS		0
+	#define PLATFORM_ENABLE_VECTORINTRINSICS_NEON	0
+#endif
+
+#if PLATFORM_ENABLE_VECTORINTRINSICS
+
+typedef __m128 VectorRegister;
+
+FORCEINLINE VectorRegister VectorZero()
+{
+	return _mm_setzero_ps();
+}
+
+FORCEINLINE VectorRegister VectorSetFloat1(float value)
+{
+	return _mm_set1_ps(value);
+}
+
+FORCEINLINE VectorRegister VectorSet(float x, float y, float z, float w)
+{
+	return _mm_setr_ps(x, y, z, w);
+}
+
+FORCEINLINE VectorRegister VectorLoad(const float* ptr)
+{
+	return _mm_loadu_ps(ptr);
+}
+
+// ptr必须16字节对齐
+FORCEINLINE VectorRegister VectorLoadAligned(const float* ptr)
+{
+	return _mm_load_ps(ptr);
+}
+
+FORCEINLINE VectorRegister VectorLoadFloat1(const float* ptr)
+{
+	return _mm_load1_ps(ptr);
+}
+
+FORCEINLINE void VectorStore(const VectorRegister& v, float* ptr)
+{
+	_mm_storeu_ps(ptr, v);
+}
+
+FORCEINLINE void VectorStoreAligned(const VectorRegister& v, float* ptr)
+{
+	_mm_store_ps(ptr, v);
+}
+
+FORCEINLINE VectorRegister VectorAdd(const VectorRegister& a, const VectorRegister& b)
+{
+	return _mm_add_ps(a, b);
+}
+
+FORCEINLINE VectorRegister VectorSubtract(const VectorRegister& a, const VectorRegister& b)
+{
+	return _mm_sub_ps(a, b);
+}
+
+FORCEINLINE VectorRegister VectorMultiply(const VectorRegister& a, const VectorRegister& b)
+{
+	return _mm_mul_ps(a, b);
+}
+
+// a * b + c
+FORCEINLINE VectorRegister VectorMultiplyAdd(const VectorRegister& a, const VectorRegister& b, const VectorRegister& c)
+{
+	return _mm_add_ps(_mm_mul_ps(a, b), c);
+}
+
+FORCEINLINE VectorRegister VectorDivide(const VectorRegister& a, const VectorRegister& b)
+{
+	return _mm_div_ps(a, b);
+}
+
+FORCEINLINE VectorRegister VectorMin(const VectorRegister& a, const VectorRegister& b)
+{
+	return _mm_min_ps(a, b);
+}
+
+FORCEINLINE VectorRegister VectorMax(const VectorRegister& a, const VectorRegister& b)
+{
+	return _mm_max_ps(a, b);
+}
+
+FORCEINLINE VectorRegister VectorSqrt(const VectorRegister& v)
+{
+	return _mm_sqrt_ps(v);
+}
+
+FORCEINLINE VectorRegister VectorReciprocalSqrt(const VectorRegister& v)
+{
+	return _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(v));
+}
+
+FORCEINLINE VectorRegister VectorCompareGT(const VectorRegister& a, const VectorRegister& b)
+{
+	return _mm_cmpgt_ps(a, b);
+}
+
+FORCEINLINE VectorRegister VectorCompareGE(const VectorRegister& a, const VectorRegister& b)
+{
+	return _mm_cmpge_ps(a, b);
+}
+
+FORCEINLINE VectorRegister VectorCompareLT(const VectorRegister& a, const VectorRegister& b)
+{
+	return _mm_cmplt_ps(a, b);
+}
+
+FORCEINLINE VectorRegister VectorCompareLE(const VectorRegister& a, const VectorRegister& b)
+{
+	return _mm_cmple_ps(a, b);
+}
+
+FORCEINLINE VectorRegister VectorBitwiseAnd(const VectorRegister& a, const VectorRegister& b)
+{
+	return _mm_and_ps(a, b);
+}
+
+FORCEINLINE VectorRegister VectorBitwiseOr(const VectorRegister& a, const VectorRegister& b)
+{
+	return _mm_or_ps(a, b);
+}
+
+FORCEINLINE VectorRegister VectorBitwiseXor(const VectorRegister& a, const VectorRegister& b)
+{
+	return _mm_xor_ps(a, b);
+}
+
+// mask的分量为全1时取a，否则取b
+FORCEINLINE VectorRegister VectorSelect(const VectorRegister& mask, const VectorRegister& a, const VectorRegister& b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// 每个分量的符号位组成的4位整数，x对应最低位
+FORCEINLINE int32 VectorMaskBits(const VectorRegister& mask)
+{
+	return _mm_movemask_ps(mask);
+}
+
+template<int32 Index>
+FORCEINLINE VectorRegister VectorReplicate(const VectorRegister& v)
+{
+	return _mm_shuffle_ps(v, v, _MM_SHUFFLE(Index, Index, Index, Index));
+}
+
+FORCEINLINE void VectorTranspose4(VectorRegister& r0, VectorRegister& r1, VectorRegister& r2, VectorRegister& r3)
+{
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+}
+
+#elif PLATFORM_ENABLE_VECTORINTRINSICS_NEON
+
+typedef float32x4_t VectorRegister;
+
+FORCEINLINE VectorRegister VectorZero()
+{
+	return vdupq_n_f32(0.0f);
+}
+
+FORCEINLINE VectorRegister VectorSetFloat1(float value)
+{
+	return vdupq_n_f32(value);
+}
+
+FORCEINLINE VectorRegister VectorSet(float x, float y, float z, float w)
+{
+	float values[4] = { x, y, z, w };
+	return vld1q_f32(values);
+}
+
+FORCEINLINE VectorRegister VectorLoad(const float* ptr)
+{
+	return vld1q_f32(ptr);
+}
+
+FORCEINLINE VectorRegister VectorLoadAligned(const float* ptr)
+{
+	return vld1q_f32(ptr);
+}
+
+FORCEINLINE VectorRegister VectorLoadFloat1(const float* ptr)
+{
+	return vld1q_dup_f32(ptr);
+}
+
+FORCEINLINE void VectorStore(const VectorRegister& v, float* ptr)
+{
+	vst1q_f32(ptr, v);
+}
+
+FORCEINLINE void VectorStoreAligned(const VectorRegister& v, float* ptr)
+{
+	vst1q_f32(ptr, v);
+}
+
+FORCEINLINE VectorRegister VectorAdd(const VectorRegister& a, const VectorRegister& b)
+{
+	return vaddq_f32(a, b);
+}
+
+FORCEINLINE VectorRegister VectorSubtract(const VectorRegister& a, const VectorRegister& b)
+{
+	return vsubq_f32(a, b);
+}
+
+FORCEINLINE VectorRegister VectorMultiply(const VectorRegister& a, const VectorRegister& b)
+{
+	return vmulq_f32(a, b);
+}
+
+FORCEINLINE VectorRegister VectorMultiplyAdd(const VectorRegister& a, const VectorRegister& b, const VectorRegister& c)
+{
+	return vmlaq_f32(c, a, b);
+}
+
+FORCEINLINE VectorRegister VectorReciprocal(const VectorRegister& v)
+{
+	// 两次牛顿迭代
+	float32x4_t estimate = vrecpeq_f32(v);
+	estimate = vmulq_f32(vrecpsq_f32(v, estimate), estimate);
+	estimate = vmulq_f32(vrecpsq_f32(v, estimate), estimate);
+	return estimate;
+}
+
+FORCEINLINE VectorRegister VectorDivide(const VectorRegister& a, const VectorRegister& b)
+{
+	return vmulq_f32(a, VectorReciprocal(b));
+}
+
+FORCEINLINE VectorRegister VectorMin(const VectorRegister& a, const VectorRegister& b)
+{
+	return vminq_f32(a, b);
+}
+
+FORCEINLINE VectorRegister VectorMax(const VectorRegister& a, const VectorRegister& b)
+{
+	return vmaxq_f32(a, b);
+}
+
+FORCEINLINE VectorRegister VectorReciprocalSqrt(const VectorRegister& v)
+{
+	// 两次牛顿迭代
+	float32x4_t estimate = vrsqrteq_f32(v);
+	estimate = vmulq_f32(vrsqrtsq_f32(vmulq_f32(v, estimate), estimate), estimate);
+	estimate = vmulq_f32(vrsqrtsq_f32(vmulq_f32(v, estimate), estimate), estimate);
+	return estimate;
+}
+
+FORCEINLINE VectorRegister VectorSqrt(const VectorRegister& v)
+{
+	// 0的倒数平方根为无穷大，单独处理
+	uint32x4_t zero = vceqq_f32(v, vdupq_n_f32(0.0f));
+	float32x4_t result = vmulq_f32(v, VectorReciprocalSqrt(v));
+	return vbslq_f32(zero, vdupq_n_f32(0.0f), result);
+}
+
+FORCEINLINE VectorRegister VectorCompareGT(const VectorRegister& a, const VectorRegister& b)
+{
+	return vreinterpretq_f32_u32(vcgtq_f32(a, b));
+}
+
+FORCEINLINE VectorRegister VectorCompareGE(const VectorRegister& a, const VectorRegister& b)
+{
+	return vreinterpretq_f32_u32(vcgeq_f32(a, b));
+}
+
+FORCEINLINE VectorRegister VectorCompareLT(const VectorRegister& a, const VectorRegister& b)
+{
+	return vreinterpretq_f32_u32(vcltq_f32(a, b));
+}
+
+FORCEINLINE VectorRegister VectorCompareLE(const VectorRegister& a, const VectorRegister& b)
+{
+	return vreinterpretq_f32_u32(vcleq_f32(a, b));
+}
+
+FORCEINLINE VectorRegister VectorBitwiseAnd(const VectorRegister& a, const VectorRegister& b)
+{
+	return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+
+FORCEINLINE VectorRegister VectorBitwiseOr(const VectorRegister& a, const VectorRegister& b)
+{
+	return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+
+FORCEINLINE VectorRegister VectorBitwiseXor(const VectorRegister& a, const VectorRegister& b)
+{
+	return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+
+FORCEINLINE VectorRegister VectorSelect(const VectorRegister& mask, const VectorRegister& a, const VectorRegister& b)
+{
+	return vbslq_f32(vreinterpretq_u32_f32(mask), a, b);
+}
+
+FORCEINLINE int32 VectorMaskBits(const VectorRegister& mask)
+{
+	uint32 bits[4];
+	vst1q_u32(bits, vshrq_n_u32(vreinterpretq_u32_f32(mask), 31));
+	return bits[0] | (bits[1] << 1) | (bits[2] << 2) | (bits[3] << 3);
+}
+
+template<int32 Index>
+FORCEINLINE VectorRegister VectorReplicate(const VectorRegister& v)
+{
+	return vdupq_n_f32(vgetq_lane_f32(v, Index));
+}
+
+FORCEINLINE void VectorTranspose4(VectorRegister& r0, VectorRegister& r1, VectorRegister& r2, VectorRegister& r3)
+{
+	float32x4x2_t t01 = vtrnq_f32(r0, r1);
+	float32x4x2_t t23 = vtrnq_f32(r2, r3);
+	r0 = vcombine_f32(vget_low_f32(t01.val[0]),  vget_low_f32(t23.val[0]));
+	r1 = vcombine_f32(vget_low_f32(t01.val[1]),  vget_low_f32(t23.val[1]));
+	r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+	r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+#else
+
+struct VectorRegister
+{
+	float v[4];
+};
+
+FORCEINLINE VectorRegister VectorSet(float x, float y, float z, float w)
+{
+	VectorRegister result = { { x, y, z, w } };
+	return result;
+}
+
+FORCEINLINE VectorRegister VectorZero()
+{
+	return VectorSet(0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+FORCEINLINE VectorRegister VectorSetFloat1(float value)
+{
+	return VectorSet(value, value, value, value);
+}
+
+FORCEINLINE VectorRegister VectorLoad(const float* ptr)
+{
+	return VectorSet(ptr[0], ptr[1], ptr[2], ptr[3]);
+}
+
+FORCEINLINE VectorRegister VectorLoadAligned(const float* ptr)
+{
+	return VectorLoad(ptr);
+}
+
+FORCEINLINE VectorRegister VectorLoadFloat1(const float* ptr)
+{
+	return VectorSetFloat1(ptr[0]);
+}
+
+FORCEINLINE void VectorStore(const VectorRegister& v, float* ptr)
+{
+	ptr[0] = v.v[0];
+	ptr[1] = v.v[1];
+	ptr[2] = v.v[2];
+	ptr[3] = v.v[3];
+}
+
+FORCEINLINE void VectorStoreAligned(const VectorRegister& v, float* ptr)
+{
+	VectorStore(v, ptr);
+}
+
+#define VECTOR_REGISTER_BINARY_OP(Name, Expression) \
+	FORCEINLINE VectorRegister Name(const VectorRegister& a, const VectorRegister& b) \
+	{ \
+		VectorRegister result; \
+		for (int32 i = 0; i < 4; ++i) { \
+			float x = a.v[i]; \
+			float y = b.v[i]; \
+			result.v[i] = (Expression); \
+		} \
+		return result; \
+	}
+
+FORCEINLINE float VectorMaskToFloat(bool value)
+{
+	uint32 bits = value ? 0xFFFFFFFF : 0;
+	float result;
+	memcpy(&result, &bits, sizeof(float));
+	return result;
+}
+
+FORCEINLINE uint32 VectorFloatToBits(float value)
+{
+	uint32 bits;
+	memcpy(&bits, &value, sizeof(float));
+	return bits;
+}
+
+FORCEINLINE float VectorBitsToFloat(uint32 bits)
+{
+	float value;
+	memcpy(&value, &bits, sizeof(float));
+	return value;
+}
+
+VECTOR_REGISTER_BINARY_OP(VectorAdd,		x + y)
+VECTOR_REGISTER_BINARY_OP(VectorSubtract,	x - y)
+VECTOR_REGISTER_BINARY_OP(VectorMultiply,	x * y)
+VECTOR_REGISTER_BINARY_OP(VectorDivide,		x / y)
+VECTOR_REGISTER_BINARY_OP(VectorMin,		x < y ? x : y)
+VECTOR_REGISTER_BINARY_OP(VectorMax,		x > y ? x : y)
+VECTOR_REGISTER_BINARY_OP(VectorCompareGT,	VectorMaskToFloat(x > y))
+VECTOR_REGISTER_BINARY_OP(VectorCompareGE,	VectorMaskToFloat(x >= y))
+VECTOR_REGISTER_BINARY_OP(VectorCompareLT,	VectorMaskToFloat(x < y))
+VECTOR_REGISTER_BINARY_OP(VectorCompareLE,	VectorMaskToFloat(x <= y))
+VECTOR_REGISTER_BINARY_OP(VectorBitwiseAnd,	VectorBitsToFloat(VectorFloatToBits(x) & VectorFloatToBits(y)))
+VECTOR_REGISTER_BINARY_OP(VectorBitwiseOr,	VectorBitsToFloat(VectorFloatToBits(x) | VectorFloatToBits(y)))
+VECTOR_REGISTER_BINARY_OP(VectorBitwiseXor,	VectorBitsToFloat(VectorFloatToBits(x) ^ VectorFloatToBits(y)))
+
+#undef VECTOR_REGISTER_BINARY_OP
+
+FORCEINLINE VectorRegister VectorMultiplyAdd(const VectorRegister& a, const VectorRegister& b, const VectorRegister& c)
+{
+	return VectorAdd(VectorMultiply(a, b), c);
+}
+
+FORCEINLINE VectorRegister VectorSqrt(const VectorRegister& v)
+{
+	return VectorSet(MMath::Sqrt(v.v[0]), MMath::Sqrt(v.v[1]), MMath::Sqrt(v.v[2]), MMath::Sqrt(v.v[3]));
+}
+
+FORCEINLINE VectorRegister VectorReciprocalSqrt(const VectorRegister& v)
+{
+	return VectorDivide(VectorSetFloat1(1.0f), VectorSqrt(v));
+}
+
+FORCEINLINE VectorRegister VectorSelect(const VectorRegister& mask, const VectorRegister& a, const VectorRegister& b)
+{
+	VectorRegister result;
+	for (int32 i = 0; i < 4; ++i) {
+		result.v[i] = VectorFloatToBits(mask.v[i]) ? a.v[i] : b.v[i];
+	}
+	return result;
+}
+
+FORCEINLINE int32 VectorMaskBits(const VectorRegister& mask)
+{
+	int32 bits = 0;
+	for (int32 i = 0; i < 4; ++i) {
+		bits |= (VectorFloatToBits(mask.v[i]) >> 31) << i;
+	}
+	return bits;
+}
+
+template<int32 Index>
+FORCEINLINE VectorRegister VectorReplicate(const VectorRegister& v)
+{
+	return VectorSetFloat1(v.v[Index]);
+}
+
+FORCEINLINE void VectorTranspose4(VectorRegister& r0, VectorRegister& r1, VectorRegister& r2, VectorRegister& r3)
+{
+	VectorRegister t0 = VectorSet(r0.v[0], r1.v[0], r2.v[0], r3.v[0]);
+	VectorRegister t1 = VectorSet(r0.v[1], r1.v[1], r2.v[1], r3.v[1]);
+	VectorRegister t2 = VectorSet(r0.v[2], r1.v[2], r2.v[2], r3.v[2]);
+	VectorRegister t3 = VectorSet(r0.v[3], r1.v[3], r2.v[3], r3.v[3]);
+	r0 = t0;
+	r1 = t1;
+	r2 = t2;
+	r3 = t3;
+}
+
+#endif
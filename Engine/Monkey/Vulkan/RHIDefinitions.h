@@ -55,6 +55,13 @@ enum VertexAttribute
 	VA_Custom1,
 	VA_Custom2,
 	VA_Custom3,
+	VA_PackedPosition,
+	VA_PackedUV0,
+	VA_PackedUV1,
+	VA_PackedNormal,
+	VA_PackedTangent,
+	VA_PackedSkinWeight,
+	VA_PackedSkinIndex,
 	VA_Count,
 };
 
@@ -139,6 +146,27 @@ FORCEINLINE VertexAttribute StringToVertexAttribute(const char* name)
 	else if (strcmp(name, "inCustom3") == 0) {
 		return VertexAttribute::VA_Custom3;
 	}
+	else if (strcmp(name, "inPackedPosition") == 0) {
+		return VertexAttribute::VA_PackedPosition;
+	}
+	else if (strcmp(name, "inPackedUV0") == 0) {
+		return VertexAttribute::VA_PackedUV0;
+	}
+	else if (strcmp(name, "inPackedUV1") == 0) {
+		return VertexAttribute::VA_PackedUV1;
+	}
+	else if (strcmp(name, "inPackedNormal") == 0) {
+		return VertexAttribute::VA_PackedNormal;
+	}
+	else if (strcmp(name, "inPackedTangent") == 0) {
+		return VertexAttribute::VA_PackedTangent;
+	}
+	else if (strcmp(name, "inPackedSkinWeight") == 0) {
+		return VertexAttribute::VA_PackedSkinWeight;
+	}
+	else if (strcmp(name, "inPackedSkinIndex") == 0) {
+		return VertexAttribute::VA_PackedSkinIndex;
+	}
 	
 	return VertexAttribute::VA_None;
 }
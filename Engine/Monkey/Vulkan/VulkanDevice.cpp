@@ -13,6 +13,7 @@ VulkanDevice::VulkanDevice(VkPhysicalDevice physicalDevice)
     , m_PresentQueue(nullptr)
     , m_FenceManager(nullptr)
     , m_MemoryManager(nullptr)
+    , m_ResourceHeapManager(nullptr)
 	, m_PhysicalDeviceFeatures2(nullptr)
 {
     
@@ -416,6 +417,9 @@ void VulkanDevice::InitGPU(int32 deviceIndex)
     m_MemoryManager = new VulkanDeviceMemoryManager();
     m_MemoryManager->Init(this);
     
+    m_ResourceHeapManager = new VulkanResourceHeapManager(this);
+    m_ResourceHeapManager->Init();
+    
     m_FenceManager = new VulkanFenceManager();
 	m_FenceManager->Init(this);
 }
@@ -425,6 +429,9 @@ void VulkanDevice::Destroy()
 	m_FenceManager->Destory();
 	delete m_FenceManager;
 
+	m_ResourceHeapManager->Destory();
+	delete m_ResourceHeapManager;
+
 	m_MemoryManager->Destory();
 	delete m_MemoryManager;
 
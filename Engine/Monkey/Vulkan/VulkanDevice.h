@@ -95,6 +95,11 @@ public:
         return *m_MemoryManager;
     }
     
+    inline VulkanResourceHeapManager& GetResourceHeapManager()
+    {
+        return *m_ResourceHeapManager;
+    }
+    
 	inline void AddAppDeviceExtensions(const char* name)
 	{
 		m_AppDeviceExtensions.push_back(name);
@@ -138,6 +143,7 @@ private:
 
     VulkanFenceManager*                     m_FenceManager;
     VulkanDeviceMemoryManager*              m_MemoryManager;
+    VulkanResourceHeapManager*              m_ResourceHeapManager;
 
 	std::vector<const char*>				m_AppDeviceExtensions;
 	VkPhysicalDeviceFeatures2*				m_PhysicalDeviceFeatures2;
@@ -10,45 +10,372 @@ enum
     GPU_ONLY_HEAP_PAGE_SIZE     = 256 * 1024 * 1024,
     STAGING_HEAP_PAGE_SIZE      = 32 * 1024 * 1024,
     ANDROID_MAX_HEAP_PAGE_SIZE  = 16 * 1024 * 1024,
+    
+    // 延迟释放需要等待的帧数，不小于飞行中的最大帧数
+    NUM_FRAMES_TO_WAIT_FOR_RESOURCE_DELETE      = 3,
+    // 空闲页至少闲置这么多帧才考虑归还给驱动
+    NUM_FRAMES_TO_WAIT_BEFORE_RELEASING_TO_OS   = 30,
+    // 堆使用率超过该百分比视为内存紧张
+    MEMORY_PRESSURE_PERCENT                     = 75,
 };
 
 constexpr uint32 VulkanResourceHeapManager::m_PoolSizes[(int32)VulkanResourceHeapManager::PoolSizes::SizesCount];
 constexpr uint32 VulkanResourceHeapManager::m_BufferSizes[(int32)VulkanResourceHeapManager::PoolSizes::SizesCount + 1];
 
-// VulkanRange
-void VulkanRange::JoinConsecutiveRanges(std::vector<VulkanRange>& ranges)
+// VulkanRangeAllocator
+VulkanRangeAllocator::VulkanRangeAllocator()
+    : m_FLBitmap(0)
+    , m_Size(0)
+    , m_FreeSize(0)
+    , m_NumFreeBlocks(0)
+{
+    Init(0);
+}
+
+void VulkanRangeAllocator::Init(uint32 size)
 {
-    if (ranges.size() == 0) {
+    m_Blocks.clear();
+    m_UnusedBlocks.clear();
+    m_UsedBlocks.clear();
+    
+    m_FLBitmap      = 0;
+    m_Size          = size;
+    m_FreeSize      = 0;
+    m_NumFreeBlocks = 0;
+    
+    for (int32 fl = 0; fl < FL_INDEX_COUNT; ++fl)
+    {
+        m_SLBitmap[fl] = 0;
+        for (int32 sl = 0; sl < SL_INDEX_COUNT; ++sl) {
+            m_FreeHeads[fl][sl] = -1;
+        }
+    }
+    
+    if (size == 0) {
         return;
     }
     
-    std::sort(ranges.begin(), ranges.end(), [](const VulkanRange& a, const VulkanRange& b) {
-        if (a.offset > b.offset) {
-            return 1;
+    int32 index = AcquireBlock();
+    Block& block = m_Blocks[index];
+    block.offset       = 0;
+    block.size         = size;
+    block.prevPhysical = -1;
+    block.nextPhysical = -1;
+    InsertFreeBlock(index);
+}
+
+void VulkanRangeAllocator::Mapping(uint32 size, int32& outFL, int32& outSL) const
+{
+    if (size < SL_INDEX_COUNT)
+    {
+        outFL = 0;
+        outSL = size;
+    }
+    else
+    {
+        uint32 log2 = MMath::FloorLog2(size);
+        outSL = (size >> (log2 - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+        outFL = log2 - SL_INDEX_COUNT_LOG2 + 1;
+    }
+}
+
+bool VulkanRangeAllocator::MappingSearch(uint64 size, int32& outFL, int32& outSL) const
+{
+    // 向上取整到下一个Bin，这样Bin里面的任意块都能满足需求
+    if (size >= SL_INDEX_COUNT) {
+        size += (1ULL << (MMath::FloorLog2_64(size) - SL_INDEX_COUNT_LOG2)) - 1;
+    }
+    
+    if (size > MAX_uint32) {
+        return false;
+    }
+    
+    Mapping((uint32)size, outFL, outSL);
+    return true;
+}
+
+int32 VulkanRangeAllocator::FindSuitableBlock(int32& fl, int32& sl) const
+{
+    uint32 slMap = m_SLBitmap[fl] & (~0u << sl);
+    if (slMap == 0)
+    {
+        uint32 flMap = m_FLBitmap & (~0u << (fl + 1));
+        if (flMap == 0) {
+            return -1;
         }
-        else if (a.offset == b.offset) {
-            return 0;
+        fl    = MMath::CountTrailingZeros(flMap);
+        slMap = m_SLBitmap[fl];
+    }
+    
+    sl = MMath::CountTrailingZeros(slMap);
+    return m_FreeHeads[fl][sl];
+}
+
+int32 VulkanRangeAllocator::FindFreeBlock(uint32 size, uint32 alignment) const
+{
+    int32 fl = 0;
+    int32 sl = 0;
+    
+    if (MappingSearch((uint64)size + alignment - 1, fl, sl))
+    {
+        int32 index = FindSuitableBlock(fl, sl);
+        if (index != -1) {
+            return index;
         }
-        else {
-            return -1;
+    }
+    
+    if (alignment <= 1) {
+        return -1;
+    }
+    
+    // 按最坏对齐情况找不到时，逐个检查可能容纳size的Bin，避免刚好对齐的块被漏掉。
+    // 这里会遍历Bin里的链表，不再是O(1)
+    Mapping(size, fl, sl);
+    while (fl < FL_INDEX_COUNT)
+    {
+        int32 index = FindSuitableBlock(fl, sl);
+        if (index == -1) {
+            break;
         }
-    });
+        
+        for (; index != -1; index = m_Blocks[index].nextFree)
+        {
+            const Block& block = m_Blocks[index];
+            uint32 alignedOffset = Align(block.offset, alignment);
+            if ((uint64)alignedOffset - block.offset + size <= block.size) {
+                return index;
+            }
+        }
+        
+        sl += 1;
+        if (sl == SL_INDEX_COUNT)
+        {
+            sl  = 0;
+            fl += 1;
+        }
+    }
+    
+    return -1;
+}
+
+bool VulkanRangeAllocator::Allocate(uint32 size, uint32 alignment, uint32& outAllocatedOffset, uint32& outAlignedOffset, uint32& outAllocatedSize)
+{
+    size      = MMath::Max(size, 1u);
+    alignment = MMath::Max(alignment, 1u);
     
-    for (int32 index = (int32)ranges.size() - 1; index > 0; --index)
+    int32 index = FindFreeBlock(size, alignment);
+    if (index == -1) {
+        return false;
+    }
+    
+    RemoveFreeBlock(index);
+    
+    uint32 allocatedOffset = m_Blocks[index].offset;
+    uint32 alignedOffset   = Align(allocatedOffset, alignment);
+    uint32 allocatedSize   = alignedOffset - allocatedOffset + size;
+    
+    // 剩余部分拆成新的空闲块
+    if (allocatedSize < m_Blocks[index].size)
     {
-        VulkanRange& current = ranges[index + 0];
-        VulkanRange& prev    = ranges[index - 1];
-        if (prev.offset + prev.size == current.offset)
+        int32 remainIndex = AcquireBlock();
+        Block& block  = m_Blocks[index];
+        Block& remain = m_Blocks[remainIndex];
+        remain.offset       = block.offset + allocatedSize;
+        remain.size         = block.size - allocatedSize;
+        remain.prevPhysical = index;
+        remain.nextPhysical = block.nextPhysical;
+        if (block.nextPhysical != -1) {
+            m_Blocks[block.nextPhysical].prevPhysical = remainIndex;
+        }
+        block.nextPhysical = remainIndex;
+        block.size         = allocatedSize;
+        InsertFreeBlock(remainIndex);
+    }
+    
+    m_UsedBlocks[allocatedOffset] = index;
+    
+    outAllocatedOffset = allocatedOffset;
+    outAlignedOffset   = alignedOffset;
+    outAllocatedSize   = allocatedSize;
+    
+    return true;
+}
+
+void VulkanRangeAllocator::Free(uint32 offset)
+{
+    auto it = m_UsedBlocks.find(offset);
+    if (it == m_UsedBlocks.end())
+    {
+        MLOGE("Free range failed, offset %u is not allocated.", offset);
+        return;
+    }
+    
+    int32 index = it->second;
+    m_UsedBlocks.erase(it);
+    
+    // 与物理上相邻的空闲块合并
+    int32 prevIndex = m_Blocks[index].prevPhysical;
+    if (prevIndex != -1 && m_Blocks[prevIndex].isFree)
+    {
+        RemoveFreeBlock(prevIndex);
+        Block& prev  = m_Blocks[prevIndex];
+        Block& block = m_Blocks[index];
+        prev.size        += block.size;
+        prev.nextPhysical = block.nextPhysical;
+        if (block.nextPhysical != -1) {
+            m_Blocks[block.nextPhysical].prevPhysical = prevIndex;
+        }
+        ReleaseBlock(index);
+        index = prevIndex;
+    }
+    
+    int32 nextIndex = m_Blocks[index].nextPhysical;
+    if (nextIndex != -1 && m_Blocks[nextIndex].isFree)
+    {
+        RemoveFreeBlock(nextIndex);
+        Block& block = m_Blocks[index];
+        Block& next  = m_Blocks[nextIndex];
+        block.size        += next.size;
+        block.nextPhysical = next.nextPhysical;
+        if (next.nextPhysical != -1) {
+            m_Blocks[next.nextPhysical].prevPhysical = index;
+        }
+        ReleaseBlock(nextIndex);
+    }
+    
+    InsertFreeBlock(index);
+}
+
+void VulkanRangeAllocator::InsertFreeBlock(int32 index)
+{
+    Block& block = m_Blocks[index];
+    
+    int32 fl = 0;
+    int32 sl = 0;
+    Mapping(block.size, fl, sl);
+    
+    int32 head = m_FreeHeads[fl][sl];
+    block.isFree   = true;
+    block.prevFree = -1;
+    block.nextFree = head;
+    if (head != -1) {
+        m_Blocks[head].prevFree = index;
+    }
+    
+    m_FreeHeads[fl][sl] = index;
+    m_FLBitmap     |= 1u << fl;
+    m_SLBitmap[fl] |= 1u << sl;
+    
+    m_FreeSize      += block.size;
+    m_NumFreeBlocks += 1;
+}
+
+void VulkanRangeAllocator::RemoveFreeBlock(int32 index)
+{
+    Block& block = m_Blocks[index];
+    
+    int32 fl = 0;
+    int32 sl = 0;
+    Mapping(block.size, fl, sl);
+    
+    if (block.prevFree != -1) {
+        m_Blocks[block.prevFree].nextFree = block.nextFree;
+    }
+    if (block.nextFree != -1) {
+        m_Blocks[block.nextFree].prevFree = block.prevFree;
+    }
+    
+    if (m_FreeHeads[fl][sl] == index)
+    {
+        m_FreeHeads[fl][sl] = block.nextFree;
+        if (block.nextFree == -1)
         {
-            prev.size += current.size;
-            ranges.erase(ranges.begin() + index);
+            m_SLBitmap[fl] &= ~(1u << sl);
+            if (m_SLBitmap[fl] == 0) {
+                m_FLBitmap &= ~(1u << fl);
+            }
         }
     }
+    
+    block.isFree   = false;
+    block.prevFree = -1;
+    block.nextFree = -1;
+    
+    m_FreeSize      -= block.size;
+    m_NumFreeBlocks -= 1;
+}
+
+uint32 VulkanRangeAllocator::GetLargestFreeBlock() const
+{
+    if (m_FLBitmap == 0) {
+        return 0;
+    }
+    
+    // 最大的块一定在最高的非空Bin里
+    int32 fl = MMath::FloorLog2(m_FLBitmap);
+    int32 sl = MMath::FloorLog2(m_SLBitmap[fl]);
+    
+    uint32 largest = 0;
+    for (int32 index = m_FreeHeads[fl][sl]; index != -1; index = m_Blocks[index].nextFree) {
+        largest = MMath::Max(largest, m_Blocks[index].size);
+    }
+    
+    return largest;
+}
+
+int32 VulkanRangeAllocator::AcquireBlock()
+{
+    int32 index = 0;
+    if (m_UnusedBlocks.size() > 0)
+    {
+        index = m_UnusedBlocks.back();
+        m_UnusedBlocks.pop_back();
+    }
+    else
+    {
+        index = (int32)m_Blocks.size();
+        m_Blocks.push_back(Block());
+    }
+    
+    Block& block = m_Blocks[index];
+    block.offset       = 0;
+    block.size         = 0;
+    block.prevPhysical = -1;
+    block.nextPhysical = -1;
+    block.prevFree     = -1;
+    block.nextFree     = -1;
+    block.isFree       = false;
+    
+    return index;
+}
+
+void VulkanRangeAllocator::ReleaseBlock(int32 index)
+{
+    m_UnusedBlocks.push_back(index);
+}
+
+// VulkanMemoryStats
+float VulkanMemoryStats::GetFragmentation() const
+{
+    uint64 freeSize    = 0;
+    uint64 largestSize = 0;
+    for (int32 index = 0; index < memoryTypes.size(); ++index)
+    {
+        freeSize    += memoryTypes[index].pageFreeSize;
+        largestSize += memoryTypes[index].pageLargestFreeSize;
+    }
+    
+    if (freeSize == 0) {
+        return 0.0f;
+    }
+    
+    return 1.0f - (float)((double)largestSize / (double)freeSize);
 }
 
 // VulkanDeviceMemoryAllocation
 VulkanDeviceMemoryAllocation::VulkanDeviceMemoryAllocation()
 	: m_Size(0)
+	, m_NonCoherentAtomSize(1)
 	, m_Device(VK_NULL_HANDLE)
 	, m_Handle(VK_NULL_HANDLE)
 	, m_MappedPointer(nullptr)
@@ -77,30 +404,42 @@ void VulkanDeviceMemoryAllocation::Unmap()
 	vkUnmapMemory(m_Device, m_Handle);
 }
 
-void VulkanDeviceMemoryAllocation::FlushMappedMemory(VkDeviceSize offset, VkDeviceSize size)
+void VulkanDeviceMemoryAllocation::GetMappedRange(VkDeviceSize offset, VkDeviceSize size, VkMappedMemoryRange& outRange) const
 {
-	if (!IsCoherent())
-	{
-		VkMappedMemoryRange range;
-		ZeroVulkanStruct(range, VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE);
-		range.memory = m_Handle;
-		range.offset = offset;
-		range.size   = size;
-		vkFlushMappedMemoryRanges(m_Device, 1, &range);
+	// 起点向下、终点向上对齐到nonCoherentAtomSize，终点不超过整块内存，到达末尾时不需要对齐
+	VkDeviceSize end = (size == VK_WHOLE_SIZE || size > m_Size - offset) ? m_Size : offset + size;
+	VkDeviceSize alignedOffset = offset / m_NonCoherentAtomSize * m_NonCoherentAtomSize;
+	VkDeviceSize alignedEnd    = (end + m_NonCoherentAtomSize - 1) / m_NonCoherentAtomSize * m_NonCoherentAtomSize;
+	if (alignedEnd > m_Size) {
+		alignedEnd = m_Size;
 	}
+
+	ZeroVulkanStruct(outRange, VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE);
+	outRange.memory = m_Handle;
+	outRange.offset = alignedOffset;
+	outRange.size   = alignedEnd - alignedOffset;
 }
 
-void VulkanDeviceMemoryAllocation::InvalidateMappedMemory(VkDeviceSize offset, VkDeviceSize size)
+VkResult VulkanDeviceMemoryAllocation::FlushMappedMemory(VkDeviceSize offset, VkDeviceSize size)
 {
-	if (!IsCoherent())
-	{
-		VkMappedMemoryRange range;
-		ZeroVulkanStruct(range, VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE);
-		range.memory = m_Handle;
-		range.offset = offset;
-		range.size   = size;
-		vkInvalidateMappedMemoryRanges(m_Device, 1, &range);
+	if (IsCoherent() || offset >= m_Size) {
+		return VK_SUCCESS;
 	}
+
+	VkMappedMemoryRange range;
+	GetMappedRange(offset, size, range);
+	return vkFlushMappedMemoryRanges(m_Device, 1, &range);
+}
+
+VkResult VulkanDeviceMemoryAllocation::InvalidateMappedMemory(VkDeviceSize offset, VkDeviceSize size)
+{
+	if (IsCoherent() || offset >= m_Size) {
+		return VK_SUCCESS;
+	}
+
+	VkMappedMemoryRange range;
+	GetMappedRange(offset, size, range);
+	return vkInvalidateMappedMemoryRanges(m_Device, 1, &range);
 }
 
 // VulkanDeviceMemoryManager
@@ -128,6 +467,7 @@ void VulkanDeviceMemoryManager::Init(VulkanDevice* device)
 
     vkGetPhysicalDeviceMemoryProperties(m_Device->GetPhysicalHandle(), &m_MemoryProperties);
     m_HeapInfos.resize(m_MemoryProperties.memoryHeapCount);
+    m_MemoryTypeInfos.resize(m_MemoryProperties.memoryTypeCount);
 
     SetupAndPrintMemInfo();
 }
@@ -169,6 +509,7 @@ VulkanDeviceMemoryAllocation* VulkanDeviceMemoryManager::Alloc(bool canFail, VkD
     VulkanDeviceMemoryAllocation* newAllocation = new VulkanDeviceMemoryAllocation();
     newAllocation->m_Device          = m_DeviceHandle;
     newAllocation->m_Size            = allocationSize;
+    newAllocation->m_NonCoherentAtomSize = MMath::Max<VkDeviceSize>(m_Device->GetLimits().nonCoherentAtomSize, 1);
     newAllocation->m_MemoryTypeIndex = memoryTypeIndex;
     newAllocation->m_CanBeMapped     = ((m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)  == VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
     newAllocation->m_IsCoherent      = ((m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
@@ -205,6 +546,8 @@ VulkanDeviceMemoryAllocation* VulkanDeviceMemoryManager::Alloc(bool canFail, VkD
         VERIFYVULKANRESULT(result);
     }
     
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+    
     m_NumAllocations     += 1;
     m_PeakNumAllocations = MMath::Max(m_NumAllocations, m_PeakNumAllocations);
     if (m_NumAllocations == m_Device->GetLimits().maxMemoryAllocationCount) {
@@ -216,17 +559,29 @@ VulkanDeviceMemoryAllocation* VulkanDeviceMemoryManager::Alloc(bool canFail, VkD
     m_HeapInfos[heapIndex].usedSize += allocationSize;
     m_HeapInfos[heapIndex].peakSize = MMath::Max(m_HeapInfos[heapIndex].peakSize, m_HeapInfos[heapIndex].usedSize);
     
+    MemoryTypeInfo& typeInfo = m_MemoryTypeInfos[memoryTypeIndex];
+    typeInfo.usedSize       += allocationSize;
+    typeInfo.peakSize        = MMath::Max(typeInfo.peakSize, typeInfo.usedSize);
+    typeInfo.numAllocations += 1;
+    
     return newAllocation;
 }
 
 void VulkanDeviceMemoryManager::Free(VulkanDeviceMemoryAllocation*& allocation)
 {
-    m_NumAllocations -= 1;
-
     vkFreeMemory(m_DeviceHandle, allocation->m_Handle, VULKAN_CPU_ALLOCATOR);
+    
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+    
+    m_NumAllocations -= 1;
+    
     uint32 heapIndex = m_MemoryProperties.memoryTypes[allocation->m_MemoryTypeIndex].heapIndex;
     m_HeapInfos[heapIndex].usedSize -= allocation->m_Size;
     
+    MemoryTypeInfo& typeInfo = m_MemoryTypeInfos[allocation->m_MemoryTypeIndex];
+    typeInfo.usedSize       -= allocation->m_Size;
+    typeInfo.numAllocations -= 1;
+    
     auto it = std::find(m_HeapInfos[heapIndex].allocations.begin(), m_HeapInfos[heapIndex].allocations.end(), allocation);
     if (it != m_HeapInfos[heapIndex].allocations.end()) {
         m_HeapInfos[heapIndex].allocations.erase(it);
@@ -271,6 +626,43 @@ uint64 VulkanDeviceMemoryManager::GetTotalMemory(bool gpu) const
     return totalMemory;
 }
 
+bool VulkanDeviceMemoryManager::IsUnderMemoryPressure(uint32 memoryTypeIndex)
+{
+    uint32 heapIndex = m_MemoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+    const HeapInfo& heapInfo = m_HeapInfos[heapIndex];
+    return heapInfo.usedSize * 100 >= heapInfo.totalSize * MEMORY_PRESSURE_PERCENT;
+}
+
+void VulkanDeviceMemoryManager::GetStats(VulkanMemoryStats& outStats)
+{
+    outStats.heaps.resize(m_MemoryProperties.memoryHeapCount);
+    outStats.memoryTypes.resize(m_MemoryProperties.memoryTypeCount);
+    
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+    
+    for (int32 index = 0; index < m_HeapInfos.size(); ++index)
+    {
+        VulkanMemoryStats::HeapStats& heapStats = outStats.heaps[index];
+        heapStats.totalSize      = m_HeapInfos[index].totalSize;
+        heapStats.usedSize       = m_HeapInfos[index].usedSize;
+        heapStats.peakSize       = m_HeapInfos[index].peakSize;
+        heapStats.numAllocations = (uint32)m_HeapInfos[index].allocations.size();
+    }
+    
+    for (int32 index = 0; index < m_MemoryTypeInfos.size(); ++index)
+    {
+        // 页相关的字段由ResourceHeap填充，这里一并清零，避免复用同一个outStats时残留上一次的值
+        VulkanMemoryStats::MemoryTypeStats& typeStats = outStats.memoryTypes[index];
+        typeStats                = VulkanMemoryStats::MemoryTypeStats();
+        typeStats.heapIndex      = m_MemoryProperties.memoryTypes[index].heapIndex;
+        typeStats.usedSize       = m_MemoryTypeInfos[index].usedSize;
+        typeStats.peakSize       = m_MemoryTypeInfos[index].peakSize;
+        typeStats.numAllocations = m_MemoryTypeInfos[index].numAllocations;
+    }
+}
+
 void VulkanDeviceMemoryManager::SetupAndPrintMemInfo()
 {
     const uint32 maxAllocations = m_Device->GetLimits().maxMemoryAllocationCount;
@@ -333,13 +725,15 @@ void VulkanDeviceMemoryManager::SetupAndPrintMemInfo()
 }
 
 // VulkanResourceAllocation
-VulkanResourceAllocation::VulkanResourceAllocation(VulkanResourceHeapPage* owner, VulkanDeviceMemoryAllocation* deviceMemoryAllocation, uint32 requestedSize, uint32 alignedOffset, uint32 allocationSize, uint32 allocationOffset, const char* file, uint32 line)
+VulkanResourceAllocation::VulkanResourceAllocation(VulkanResourceHeapPage* owner, VulkanDeviceMemoryAllocation* deviceMemoryAllocation, uint32 requestedSize, uint32 alignment, uint32 alignedOffset, uint32 allocationSize, uint32 allocationOffset, const char* file, uint32 line)
     : m_Owner(owner)
     , m_AllocationSize(allocationSize)
     , m_AllocationOffset(allocationOffset)
     , m_RequestedSize(requestedSize)
+    , m_Alignment(alignment)
     , m_AlignedOffset(alignedOffset)
     , m_DeviceMemoryAllocation(deviceMemoryAllocation)
+    , m_MoveHandler(nullptr)
 {
 
 }
@@ -384,11 +778,7 @@ VulkanResourceHeapPage::VulkanResourceHeapPage(VulkanResourceHeap* owner, Vulkan
     , m_ID(id)
 {
     m_MaxSize = (uint32)m_DeviceMemoryAllocation->GetSize();
-
-    VulkanRange fullRange;
-    fullRange.offset = 0;
-    fullRange.size   = m_MaxSize;
-    m_FreeList.push_back(fullRange);
+    m_FreeList.Init(m_MaxSize);
 }
 
 VulkanResourceHeapPage::~VulkanResourceHeapPage()
@@ -400,14 +790,13 @@ VulkanResourceHeapPage::~VulkanResourceHeapPage()
 
 void VulkanResourceHeapPage::ReleaseAllocation(VulkanResourceAllocation* allocation)
 {
+    std::lock_guard<std::mutex> lockGuard(m_Owner->m_Mutex);
+    
     auto it = std::find(m_ResourceAllocations.begin(), m_ResourceAllocations.end(), allocation);
     if (it != m_ResourceAllocations.end())
     {
         m_ResourceAllocations.erase(it);
-        VulkanRange newFree;
-        newFree.offset = allocation->m_AllocationOffset;
-        newFree.size   = allocation->m_AllocationSize;
-        m_FreeList.push_back(newFree);
+        m_FreeList.Free(allocation->m_AllocationOffset);
     }
     
     m_UsedSize -= allocation->m_AllocationSize;
@@ -422,47 +811,33 @@ void VulkanResourceHeapPage::ReleaseAllocation(VulkanResourceAllocation* allocat
 
 VulkanResourceAllocation* VulkanResourceHeapPage::TryAllocate(uint32 size, uint32 alignment, const char* file, uint32 line)
 {
-    for (int32 index = 0; index < m_FreeList.size(); ++index)
-    {
-        VulkanRange& entry         = m_FreeList[index];
-        uint32 allocatedOffset     = entry.offset;
-        uint32 alignedOffset       = Align(entry.offset, alignment);
-        uint32 alignmentAdjustment = alignedOffset - entry.offset;
-        uint32 allocatedSize       = alignmentAdjustment + size;
-
-        if (allocatedSize <= entry.size)
-        {
-            if (allocatedSize < entry.size) {
-                entry.size   -= allocatedSize;
-                entry.offset += allocatedSize;
-            }
-            else {
-                m_FreeList.erase(m_FreeList.begin() + index);
-            }
-            m_UsedSize += allocatedSize;
-            VulkanResourceAllocation* newResourceAllocation = new VulkanResourceAllocation(this, m_DeviceMemoryAllocation, size, alignedOffset, allocatedSize, allocatedOffset, file, line);
-            m_ResourceAllocations.push_back(newResourceAllocation);
-            m_PeakNumAllocations = MMath::Max((uint32)m_PeakNumAllocations, (uint32)m_ResourceAllocations.size());
-            
-            return newResourceAllocation;
-        }
+    uint32 allocatedOffset = 0;
+    uint32 alignedOffset   = 0;
+    uint32 allocatedSize   = 0;
+    if (!m_FreeList.Allocate(size, alignment, allocatedOffset, alignedOffset, allocatedSize)) {
+        return nullptr;
     }
     
-    return nullptr;
+    m_UsedSize += allocatedSize;
+    VulkanResourceAllocation* newResourceAllocation = new VulkanResourceAllocation(this, m_DeviceMemoryAllocation, size, alignment, alignedOffset, allocatedSize, allocatedOffset, file, line);
+    m_ResourceAllocations.push_back(newResourceAllocation);
+    m_PeakNumAllocations = MMath::Max((uint32)m_PeakNumAllocations, (uint32)m_ResourceAllocations.size());
+    
+    return newResourceAllocation;
 }
 
 bool VulkanResourceHeapPage::JoinFreeBlocks()
 {
-    VulkanRange::JoinConsecutiveRanges(m_FreeList);
-    if (m_FreeList.size() == 1)
+    // 空闲块在释放时已经合并，这里只检查整页是否空闲
+    if (m_FreeList.GetNumFreeBlocks() == 1)
     {
         if (m_ResourceAllocations.size() == 0)
         {
             if (m_UsedSize > 0) {
                 MLOGE("Memory leak, used size = %d", (int32)m_UsedSize);
             }
-            if (m_FreeList[0].offset != 0 || m_FreeList[0].size != m_MaxSize) {
-                MLOGE("Memory leak, should have %d free, only have %d; missing %d bytes", m_MaxSize, m_FreeList[0].size, m_MaxSize - m_FreeList[0].size);
+            if (m_FreeList.GetFreeSize() != m_MaxSize) {
+                MLOGE("Memory leak, should have %d free, only have %d; missing %d bytes", m_MaxSize, m_FreeList.GetFreeSize(), m_MaxSize - m_FreeList.GetFreeSize());
             }
             return true;
         }
@@ -548,22 +923,33 @@ void VulkanResourceHeap::FreePage(VulkanResourceHeapPage* page)
     
     if (removed)
     {
-        page->m_FrameFreed = 0;
+        page->m_FrameFreed = m_Owner->GetFrameCounter();
         m_FreePages.push_back(page);
     }
 }
 
 void VulkanResourceHeap::ReleaseFreedPages(bool immediately)
 {
-    for (int32 index = 0; index < m_FreePages.size(); ++index)
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+    
+    // 空闲页留着给后续分配复用，只有闲置足够久并且内存紧张时才归还给驱动
+    VulkanDeviceMemoryManager& memoryManager = m_Owner->GetVulkanDevice()->GetMemoryManager();
+    if (!immediately && (m_FreePages.size() == 0 || !memoryManager.IsUnderMemoryPressure(m_MemoryTypeIndex))) {
+        return;
+    }
+    
+    uint32 frameCounter = m_Owner->GetFrameCounter();
+    for (int32 index = (int32)m_FreePages.size() - 1; index >= 0; --index)
     {
         VulkanResourceHeapPage* page = m_FreePages[index];
-        m_UsedMemory -= page->m_MaxSize;
-        m_Owner->GetVulkanDevice()->GetMemoryManager().Free(page->m_DeviceMemoryAllocation);
-        delete page;
+        if (immediately || frameCounter >= page->m_FrameFreed + NUM_FRAMES_TO_WAIT_BEFORE_RELEASING_TO_OS)
+        {
+            m_UsedMemory -= page->m_MaxSize;
+            memoryManager.Free(page->m_DeviceMemoryAllocation);
+            delete page;
+            m_FreePages.erase(m_FreePages.begin() + index);
+        }
     }
-    
-    m_FreePages.clear();
 }
 
 #if MONKEY_DEBUG
@@ -582,7 +968,7 @@ void VulkanResourceHeap::DumpMemory()
             subAllocUsedMemory      += usedPages[index]->m_UsedSize;
             subAllocAllocatedMemory += usedPages[index]->m_MaxSize;
             numSubAllocations       += (uint32)usedPages[index]->m_ResourceAllocations.size();
-            MLOG("\t\t%d: ID %4d %4d suballocs, %4d free chunks (%d used/%d free/%d max) DeviceMemory %p", index, usedPages[index]->GetID(), (int32)usedPages[index]->m_ResourceAllocations.size(), (int32)usedPages[index]->m_FreeList.size(), usedPages[index]->m_UsedSize, usedPages[index]->m_MaxSize - usedPages[index]->m_UsedSize, usedPages[index]->m_MaxSize, (void*)usedPages[index]->m_DeviceMemoryAllocation->GetHandle());
+            MLOG("\t\t%d: ID %4d %4d suballocs, %4d free chunks (%d used/%d free/%d max) DeviceMemory %p", index, usedPages[index]->GetID(), (int32)usedPages[index]->m_ResourceAllocations.size(), (int32)usedPages[index]->m_FreeList.GetNumFreeBlocks(), usedPages[index]->m_UsedSize, usedPages[index]->m_MaxSize - usedPages[index]->m_UsedSize, usedPages[index]->m_MaxSize, (void*)usedPages[index]->m_DeviceMemoryAllocation->GetHandle());
         }
         
         MLOG("%d Suballocations for Used/Total: %d/%d = %.2f%%", numSubAllocations, (int32)subAllocUsedMemory, (int32)subAllocAllocatedMemory, subAllocAllocatedMemory > 0 ? 100.0f * (float)subAllocUsedMemory / (float)subAllocAllocatedMemory : 0.0f);
@@ -593,8 +979,181 @@ void VulkanResourceHeap::DumpMemory()
 }
 #endif
 
+void VulkanResourceHeap::GetStats(VulkanMemoryStats::MemoryTypeStats& outStats)
+{
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+    
+    outStats.numPages            = 0;
+    outStats.pageSize            = 0;
+    outStats.pageUsedSize        = 0;
+    outStats.pageFreeSize        = 0;
+    outStats.pageLargestFreeSize = 0;
+    
+    auto AddPages = [&](std::vector<VulkanResourceHeapPage*>& pages)
+    {
+        for (int32 index = 0; index < pages.size(); ++index)
+        {
+            VulkanResourceHeapPage* page = pages[index];
+            outStats.numPages            += 1;
+            outStats.pageSize            += page->m_MaxSize;
+            outStats.pageUsedSize        += page->m_UsedSize;
+            outStats.pageFreeSize        += page->m_FreeList.GetFreeSize();
+            outStats.pageLargestFreeSize += page->m_FreeList.GetLargestFreeBlock();
+        }
+    };
+    
+    AddPages(m_UsedBufferPages);
+    AddPages(m_UsedImagePages);
+    
+    outStats.numFreePages = (uint32)m_FreePages.size();
+}
+
+void VulkanResourceHeap::Defragment(VkCommandBuffer cmdBuffer, uint64 maxBytes, VulkanDefragmentStats& stats)
+{
+    struct Move
+    {
+        VulkanResourceAllocation*   oldAllocation;
+        VulkanResourceAllocation*   newAllocation;
+        int32                       sourceIndex;
+    };
+    
+    struct Source
+    {
+        uint32  pageSize;
+        bool    fullyMoved;
+    };
+    
+    std::vector<Move>   moves;
+    std::vector<Source> sources;
+    uint64              plannedBytes = 0;
+    
+    auto GetUtilization = [](VulkanResourceHeapPage* page) -> float
+    {
+        return (float)page->m_UsedSize / (float)page->m_MaxSize;
+    };
+    
+    // 只在锁内规划和分配目标，MoveHandler在锁外调用，这样Handler里可以正常分配和释放
+    auto PlanMoves = [&](std::vector<VulkanResourceHeapPage*>& usedPages)
+    {
+        if (usedPages.size() < 2) {
+            return;
+        }
+        
+        // 利用率最低并且所有分配都可以移动的页作为源页
+        VulkanResourceHeapPage* sourcePage = nullptr;
+        for (int32 index = 0; index < usedPages.size(); ++index)
+        {
+            VulkanResourceHeapPage* page = usedPages[index];
+            if (page->m_ResourceAllocations.size() == 0) {
+                continue;
+            }
+            
+            bool movable = true;
+            for (int32 i = 0; i < page->m_ResourceAllocations.size(); ++i)
+            {
+                if (page->m_ResourceAllocations[i]->m_MoveHandler == nullptr)
+                {
+                    movable = false;
+                    break;
+                }
+            }
+            
+            if (movable && (sourcePage == nullptr || GetUtilization(page) < GetUtilization(sourcePage))) {
+                sourcePage = page;
+            }
+        }
+        
+        if (sourcePage == nullptr) {
+            return;
+        }
+        
+        // 目标页按利用率从高到低，尽量把分配集中到少数页上
+        std::vector<VulkanResourceHeapPage*> targetPages;
+        for (int32 index = 0; index < usedPages.size(); ++index)
+        {
+            VulkanResourceHeapPage* page = usedPages[index];
+            if (page != sourcePage && page->m_DeviceMemoryAllocation->IsMapped() == sourcePage->m_DeviceMemoryAllocation->IsMapped()) {
+                targetPages.push_back(page);
+            }
+        }
+        std::sort(targetPages.begin(), targetPages.end(), [&](VulkanResourceHeapPage* a, VulkanResourceHeapPage* b) {
+            return GetUtilization(a) > GetUtilization(b);
+        });
+        
+        Source source;
+        source.pageSize   = sourcePage->m_MaxSize;
+        source.fullyMoved = false;
+        sources.push_back(source);
+        
+        int32 numMoved = 0;
+        for (int32 index = 0; index < sourcePage->m_ResourceAllocations.size(); ++index)
+        {
+            VulkanResourceAllocation* oldAllocation = sourcePage->m_ResourceAllocations[index];
+            if (plannedBytes + oldAllocation->m_AllocationSize > maxBytes) {
+                break;
+            }
+            
+            VulkanResourceAllocation* newAllocation = nullptr;
+            for (int32 i = 0; i < targetPages.size() && newAllocation == nullptr; ++i) {
+                newAllocation = targetPages[i]->TryAllocate(oldAllocation->m_RequestedSize, oldAllocation->m_Alignment, __FILE__, __LINE__);
+            }
+            
+            if (newAllocation == nullptr) {
+                break;
+            }
+            
+            newAllocation->m_MoveHandler = oldAllocation->m_MoveHandler;
+            
+            Move move;
+            move.oldAllocation = oldAllocation;
+            move.newAllocation = newAllocation;
+            move.sourceIndex   = (int32)sources.size() - 1;
+            moves.push_back(move);
+            
+            plannedBytes += oldAllocation->m_AllocationSize;
+            numMoved     += 1;
+        }
+        
+        sources.back().fullyMoved = numMoved == sourcePage->m_ResourceAllocations.size();
+    };
+    
+    {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+        PlanMoves(m_UsedBufferPages);
+        PlanMoves(m_UsedImagePages);
+    }
+    
+    for (int32 index = 0; index < moves.size(); ++index)
+    {
+        Move& move = moves[index];
+        if (move.oldAllocation->m_MoveHandler->OnMove(move.oldAllocation, move.newAllocation, cmdBuffer))
+        {
+            stats.numMoves   += 1;
+            stats.bytesMoved += move.oldAllocation->m_AllocationSize;
+            // 拷贝命令还没有执行，旧的分配需要等GPU用完
+            m_Owner->ReleaseDeferred(move.oldAllocation);
+        }
+        else
+        {
+            // 回滚：析构时在目标页的锁内归还空闲块并扣除m_UsedSize，目标页因此整页空闲时会回到空闲页，
+            // 旧的分配一直留在源页上没有动过
+            sources[move.sourceIndex].fullyMoved = false;
+            delete move.newAllocation;
+        }
+    }
+    
+    for (int32 index = 0; index < sources.size(); ++index)
+    {
+        if (sources[index].fullyMoved) {
+            stats.bytesFreedToPool += sources[index].pageSize;
+        }
+    }
+}
+
 VulkanResourceAllocation* VulkanResourceHeap::AllocateResource(Type type, uint32 size, uint32 alignment, bool mapAllocation, const char* file, uint32 line)
 {
+    std::lock_guard<std::mutex> lockGuard(m_Mutex);
+    
     std::vector<VulkanResourceHeapPage*>& usedPages = type == Type::Image ? m_UsedImagePages : m_UsedBufferPages;
     uint32 targetDefaultPageSize = m_DefaultPageSize;
     
@@ -693,11 +1252,7 @@ VulkanSubResourceAllocator::VulkanSubResourceAllocator(VulkanResourceHeapManager
     , m_UsedSize(0)
 {
     m_MaxSize = (uint32)deviceMemoryAllocation->GetSize();
-
-    VulkanRange fullRange;
-    fullRange.offset = 0;
-    fullRange.size   = m_MaxSize;
-    m_FreeList.push_back(fullRange);
+    m_FreeList.Init(m_MaxSize);
 }
 
 VulkanSubResourceAllocator::~VulkanSubResourceAllocator()
@@ -708,43 +1263,28 @@ VulkanSubResourceAllocator::~VulkanSubResourceAllocator()
 VulkanResourceSubAllocation* VulkanSubResourceAllocator::TryAllocateNoLocking(uint32 size, uint32 alignment, const char* file, uint32 line)
 {
     m_Alignment = MMath::Max(m_Alignment, alignment);
-    for (int32 index = 0; index < m_FreeList.size(); ++index)
-    {
-        VulkanRange& entry         = m_FreeList[index];
-        uint32 allocatedOffset     = entry.offset;
-        uint32 alignedOffset       = Align(entry.offset, m_Alignment);
-        uint32 alignmentAdjustment = alignedOffset - entry.offset;
-        uint32 allocatedSize       = alignmentAdjustment + size;
-
-        if (allocatedSize <= entry.size)
-        {
-            if (allocatedSize < entry.size)
-            {
-                entry.size   -= allocatedSize;
-                entry.offset += allocatedSize;
-            }
-            else {
-                m_FreeList.erase(m_FreeList.begin() + index);
-            }
-            m_UsedSize += allocatedSize;
-            VulkanResourceSubAllocation* newSubAllocation = CreateSubAllocation(size, alignedOffset, allocatedSize, allocatedOffset);
-            m_SubAllocations.push_back(newSubAllocation);
-            return newSubAllocation;
-        }
+    
+    uint32 allocatedOffset = 0;
+    uint32 alignedOffset   = 0;
+    uint32 allocatedSize   = 0;
+    if (!m_FreeList.Allocate(size, m_Alignment, allocatedOffset, alignedOffset, allocatedSize)) {
+        return nullptr;
     }
     
-    return nullptr;
+    m_UsedSize += allocatedSize;
+    VulkanResourceSubAllocation* newSubAllocation = CreateSubAllocation(size, alignedOffset, allocatedSize, allocatedOffset);
+    m_SubAllocations.push_back(newSubAllocation);
+    return newSubAllocation;
 }
 
 bool VulkanSubResourceAllocator::JoinFreeBlocks()
 {
-    VulkanRange::JoinConsecutiveRanges(m_FreeList);
-    if (m_FreeList.size() == 1)
+    if (m_FreeList.GetNumFreeBlocks() == 1)
     {
         if (m_SubAllocations.size() == 0)
         {
-            if (m_UsedSize != 0 || m_FreeList[0].offset != 0 || m_FreeList[0].size != m_MaxSize) {
-                MLOG("Resource Suballocation leak, should have %d free, only have %d; missing %d bytes", m_MaxSize, m_FreeList[0].size, m_MaxSize - m_FreeList[0].size);
+            if (m_UsedSize != 0 || m_FreeList.GetFreeSize() != m_MaxSize) {
+                MLOG("Resource Suballocation leak, should have %d free, only have %d; missing %d bytes", m_MaxSize, m_FreeList.GetFreeSize(), m_MaxSize - m_FreeList.GetFreeSize());
             }
             return true;
         }
@@ -783,27 +1323,33 @@ VulkanResourceSubAllocation* VulkanSubBufferAllocator::CreateSubAllocation(uint3
 
 void VulkanSubBufferAllocator::Release(VulkanBufferSubAllocation* subAllocation)
 {
-    bool released = false;
-    for (int32 index = 0; index < m_SubAllocations.size(); ++index)
+    bool empty = false;
+    
     {
-        if (m_SubAllocations[index] == subAllocation)
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+        
+        bool released = false;
+        for (int32 index = 0; index < m_SubAllocations.size(); ++index)
         {
-            released = true;
-            m_SubAllocations.erase(m_SubAllocations.begin() + index);
-            break;
+            if (m_SubAllocations[index] == subAllocation)
+            {
+                released = true;
+                m_SubAllocations.erase(m_SubAllocations.begin() + index);
+                break;
+            }
         }
+        
+        if (released)
+        {
+            m_FreeList.Free(subAllocation->m_AllocationOffset);
+            m_UsedSize -= subAllocation->m_AllocationSize;
+        }
+        
+        empty = JoinFreeBlocks();
     }
     
-    if (released)
-    {
-        VulkanRange newFree;
-        newFree.offset = subAllocation->m_AllocationOffset;
-        newFree.size   = subAllocation->m_AllocationSize;
-        m_FreeList.push_back(newFree);
-        m_UsedSize -= subAllocation->m_AllocationSize;
-    }
-    
-    if (JoinFreeBlocks()) {
+    // 先释放自身的锁再进入Pool的锁，加锁顺序与AllocateBuffer保持一致(Pool -> Allocator)
+    if (empty) {
         m_Owner->ReleaseBuffer(this);
     }
 }
@@ -813,6 +1359,7 @@ void VulkanSubBufferAllocator::Release(VulkanBufferSubAllocation* subAllocation)
 VulkanResourceHeapManager::VulkanResourceHeapManager(VulkanDevice* device)
     : m_VulkanDevice(device)
     , m_DeviceMemoryManager(&device->GetMemoryManager())
+    , m_FrameCounter(0)
 {
     
 }
@@ -891,10 +1438,31 @@ void VulkanResourceHeapManager::Init()
         }
         m_ResourceTypeHeaps[typeIndex] = new VulkanResourceHeap(this, typeIndex, STAGING_HEAP_PAGE_SIZE);
     }
+    
+    // 资源的memoryTypeBits可能排除了上面挑选的类型，剩下的类型也各建一个Heap，第一次分配之前不占用内存
+    for (uint32 typeIndex = 0; typeIndex < memoryProperties.memoryTypeCount; ++typeIndex)
+    {
+        if (m_ResourceTypeHeaps[typeIndex]) {
+            continue;
+        }
+        VkDeviceSize pageSize = STAGING_HEAP_PAGE_SIZE;
+        if ((memoryProperties.memoryTypes[typeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0)
+        {
+            VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[typeIndex].heapIndex].size;
+            pageSize = MMath::Min<VkDeviceSize>(heapSize / 8, GPU_ONLY_HEAP_PAGE_SIZE);
+        }
+        m_ResourceTypeHeaps[typeIndex] = new VulkanResourceHeap(this, typeIndex, uint32(pageSize));
+    }
 }
 
 void VulkanResourceHeapManager::Destory()
 {
+    // VulkanDevice::Destroy和析构函数各会调用一次，第二次什么都不做
+    if (m_DeviceMemoryManager == nullptr) {
+        return;
+    }
+    
+    ProcessDeferredReleases(true);
     DestroyResourceAllocations();
     for (int32 index = 0; index < m_ResourceTypeHeaps.size(); ++index)
     {
@@ -902,6 +1470,8 @@ void VulkanResourceHeapManager::Destory()
         m_ResourceTypeHeaps[index] = nullptr;
     }
     m_ResourceTypeHeaps.clear();
+    
+    m_DeviceMemoryManager = nullptr;
 }
 
 VulkanResourceAllocation* VulkanResourceHeapManager::AllocateBufferMemory(const VkMemoryRequirements& memoryReqs, VkMemoryPropertyFlags memoryPropertyFlags, const char* file, uint32 line)
@@ -993,13 +1563,15 @@ VulkanBufferSubAllocation* VulkanResourceHeapManager::AllocateBuffer(uint32 size
         size = m_PoolSizes[poolSize];
     }
     
+    std::lock_guard<std::mutex> lockGuard(m_BufferAllocationsMutex[poolSize]);
+    
     for (int32 index = 0; index < m_UsedBufferAllocations[poolSize].size(); ++index)
     {
         VulkanSubBufferAllocator* bufferAllocation = m_UsedBufferAllocations[poolSize][index];
         if ((bufferAllocation->m_BufferUsageFlags & bufferUsageFlags) == bufferUsageFlags &&
             (bufferAllocation->m_MemoryPropertyFlags & memoryPropertyFlags) == memoryPropertyFlags)
         {
-            VulkanBufferSubAllocation* subAllocation = (VulkanBufferSubAllocation*)bufferAllocation->TryAllocateNoLocking(size, alignment, file, line);
+            VulkanBufferSubAllocation* subAllocation = (VulkanBufferSubAllocation*)bufferAllocation->TryAllocateLocking(size, alignment, file, line);
             if (subAllocation) {
                 return subAllocation;
             }
@@ -1012,7 +1584,7 @@ VulkanBufferSubAllocation* VulkanResourceHeapManager::AllocateBuffer(uint32 size
         if ((bufferAllocation->m_BufferUsageFlags & bufferUsageFlags) == bufferUsageFlags &&
             (bufferAllocation->m_MemoryPropertyFlags & memoryPropertyFlags) == memoryPropertyFlags)
         {
-            VulkanBufferSubAllocation* subAllocation = (VulkanBufferSubAllocation*)bufferAllocation->TryAllocateNoLocking(size, alignment, file, line);
+            VulkanBufferSubAllocation* subAllocation = (VulkanBufferSubAllocation*)bufferAllocation->TryAllocateLocking(size, alignment, file, line);
             if (subAllocation)
             {
                 m_FreeBufferAllocations[poolSize].erase(m_FreeBufferAllocations[poolSize].begin() + index);
@@ -1047,34 +1619,159 @@ VulkanBufferSubAllocation* VulkanResourceHeapManager::AllocateBuffer(uint32 size
     VulkanSubBufferAllocator* bufferAllocation = new VulkanSubBufferAllocator(this, deviceMemoryAllocation, memoryTypeIndex, memoryPropertyFlags, uint32(memReqs.alignment), buffer, bufferUsageFlags, poolSize);
     m_UsedBufferAllocations[poolSize].push_back(bufferAllocation);
     
-    return (VulkanBufferSubAllocation*)bufferAllocation->TryAllocateNoLocking(size, alignment, file, line);
+    return (VulkanBufferSubAllocation*)bufferAllocation->TryAllocateLocking(size, alignment, file, line);
 }
 
 void VulkanResourceHeapManager::ReleaseBuffer(VulkanSubBufferAllocator* bufferAllocator)
 {
-    bufferAllocator->JoinFreeBlocks();
-    for (int32 index = 0; index < m_UsedBufferAllocations[bufferAllocator->m_PoolSizeIndex].size(); ++index)
+    std::lock_guard<std::mutex> lockGuard(m_BufferAllocationsMutex[bufferAllocator->m_PoolSizeIndex]);
+    
+    // Release解锁之后到这里之间，其它线程可能又从该Allocator分配了内存或者已经把它回收了
     {
-        if (m_UsedBufferAllocations[bufferAllocator->m_PoolSizeIndex][index] == bufferAllocator) {
-            m_UsedBufferAllocations[bufferAllocator->m_PoolSizeIndex].erase(m_UsedBufferAllocations[bufferAllocator->m_PoolSizeIndex].begin() + index);
+        std::lock_guard<std::mutex> allocatorLockGuard(bufferAllocator->m_Mutex);
+        if (!bufferAllocator->JoinFreeBlocks()) {
+            return;
         }
     }
-    bufferAllocator->m_FrameFreed = 0;
+    
+    std::vector<VulkanSubBufferAllocator*>& usedAllocations = m_UsedBufferAllocations[bufferAllocator->m_PoolSizeIndex];
+    auto it = std::find(usedAllocations.begin(), usedAllocations.end(), bufferAllocator);
+    if (it == usedAllocations.end()) {
+        return;
+    }
+    
+    usedAllocations.erase(it);
+    bufferAllocator->m_FrameFreed = m_FrameCounter.load();
     m_FreeBufferAllocations[bufferAllocator->m_PoolSizeIndex].push_back(bufferAllocator);
 }
 
 void VulkanResourceHeapManager::ReleaseFreedPages()
 {
+    m_FrameCounter.fetch_add(1);
+    
+    ProcessDeferredReleases(false);
+    
     for (int32 index = 0; index < m_ResourceTypeHeaps.size(); ++index)
     {
         VulkanResourceHeap* heap = m_ResourceTypeHeaps[index];
         if (heap) {
-            heap->ReleaseFreedPages(true);
+            heap->ReleaseFreedPages(false);
         }
     }
     ReleaseFreedResources(false);
 }
 
+void VulkanResourceHeapManager::FlushDeferredReleases()
+{
+    ProcessDeferredReleases(true);
+}
+
+void VulkanResourceHeapManager::GetStats(VulkanMemoryStats& outStats)
+{
+    m_DeviceMemoryManager->GetStats(outStats);
+    
+    for (int32 index = 0; index < m_ResourceTypeHeaps.size(); ++index)
+    {
+        if (m_ResourceTypeHeaps[index]) {
+            m_ResourceTypeHeaps[index]->GetStats(outStats.memoryTypes[index]);
+        }
+    }
+    
+    outStats.pools.resize((int32)PoolSizes::SizesCount + 1);
+    for (int32 poolSizeIndex = 0; poolSizeIndex < (int32)PoolSizes::SizesCount + 1; ++poolSizeIndex)
+    {
+        std::lock_guard<std::mutex> lockGuard(m_BufferAllocationsMutex[poolSizeIndex]);
+        
+        VulkanMemoryStats::PoolStats& poolStats = outStats.pools[poolSizeIndex];
+        poolStats                = VulkanMemoryStats::PoolStats();
+        poolStats.poolSize       = poolSizeIndex == (int32)PoolSizes::SizesCount ? 0 : m_PoolSizes[poolSizeIndex];
+        poolStats.numUsedBuffers = (uint32)m_UsedBufferAllocations[poolSizeIndex].size();
+        poolStats.numFreeBuffers = (uint32)m_FreeBufferAllocations[poolSizeIndex].size();
+        for (int32 index = 0; index < m_UsedBufferAllocations[poolSizeIndex].size(); ++index)
+        {
+            VulkanSubBufferAllocator* bufferAllocation = m_UsedBufferAllocations[poolSizeIndex][index];
+            std::lock_guard<std::mutex> allocatorLockGuard(bufferAllocation->m_Mutex);
+            poolStats.usedSize += bufferAllocation->m_UsedSize;
+            poolStats.maxSize  += bufferAllocation->m_MaxSize;
+        }
+    }
+}
+
+VulkanDefragmentStats VulkanResourceHeapManager::Defragment(VkCommandBuffer cmdBuffer, uint64 maxBytes)
+{
+    VulkanDefragmentStats stats;
+    
+    for (int32 index = 0; index < m_ResourceTypeHeaps.size(); ++index)
+    {
+        VulkanResourceHeap* heap = m_ResourceTypeHeaps[index];
+        if (heap == nullptr || stats.bytesMoved >= maxBytes) {
+            continue;
+        }
+        heap->Defragment(cmdBuffer, maxBytes - stats.bytesMoved, stats);
+    }
+    
+    if (stats.numMoves > 0) {
+        MLOG("Defragment moved %d allocations (%llu bytes), %llu bytes of pages freed to pool", stats.numMoves, stats.bytesMoved, stats.bytesFreedToPool);
+    }
+    
+    return stats;
+}
+
+void VulkanResourceHeapManager::ReleaseDeferred(VulkanResourceAllocation* allocation)
+{
+    ReleaseDeferred((RefCount*)allocation);
+}
+
+void VulkanResourceHeapManager::ReleaseDeferred(VulkanBufferSubAllocation* subAllocation)
+{
+    ReleaseDeferred((RefCount*)subAllocation);
+}
+
+void VulkanResourceHeapManager::ReleaseDeferred(RefCount* resource)
+{
+    // Heap已经销毁，资源里引用的页也已经不存在了，只能放弃
+    if (m_DeviceMemoryManager == nullptr)
+    {
+        MLOGE("Deferred release after resource heap manager destroyed.");
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lockGuard(m_DeferredReleasesMutex);
+    
+    DeferredRelease deferred;
+    deferred.resource    = resource;
+    deferred.frameNumber = m_FrameCounter.load();
+    m_DeferredReleases.push_back(deferred);
+}
+
+void VulkanResourceHeapManager::ProcessDeferredReleases(bool immediately)
+{
+    std::vector<RefCount*> expired;
+    uint32 frameCounter = m_FrameCounter.load();
+    
+    {
+        std::lock_guard<std::mutex> lockGuard(m_DeferredReleasesMutex);
+        
+        // 队列按入队帧号有序，遇到未到期的即可停止
+        int32 count = 0;
+        while (count < m_DeferredReleases.size())
+        {
+            const DeferredRelease& deferred = m_DeferredReleases[count];
+            if (!immediately && frameCounter < deferred.frameNumber + NUM_FRAMES_TO_WAIT_FOR_RESOURCE_DELETE) {
+                break;
+            }
+            expired.push_back(deferred.resource);
+            count += 1;
+        }
+        m_DeferredReleases.erase(m_DeferredReleases.begin(), m_DeferredReleases.begin() + count);
+    }
+    
+    // 析构时会进入Heap/Pool的锁，所以放在队列锁之外
+    for (int32 index = 0; index < expired.size(); ++index) {
+        delete expired[index];
+    }
+}
+
 #if MONKEY_DEBUG
 void VulkanResourceHeapManager::DumpMemory()
 {
@@ -1116,7 +1813,7 @@ void VulkanResourceHeapManager::DumpMemory()
             for (int32 index = 0; index < usedAllocations.size(); ++index)
             {
                 VulkanSubBufferAllocator* bufferAllocation = usedAllocations[index];
-                MLOG("%6d %p %p 0x%06x 0x%08x %6d   %6d    %d/%d", index, (void*)bufferAllocation->m_Buffer, (void*)bufferAllocation->m_DeviceMemoryAllocation->GetHandle(), bufferAllocation->m_MemoryPropertyFlags, bufferAllocation->m_BufferUsageFlags, (int32)bufferAllocation->m_SubAllocations.size(), (int32)bufferAllocation->m_FreeList.size(), (int32)bufferAllocation->m_UsedSize, bufferAllocation->m_MaxSize);
+                MLOG("%6d %p %p 0x%06x 0x%08x %6d   %6d    %d/%d", index, (void*)bufferAllocation->m_Buffer, (void*)bufferAllocation->m_DeviceMemoryAllocation->GetHandle(), bufferAllocation->m_MemoryPropertyFlags, bufferAllocation->m_BufferUsageFlags, (int32)bufferAllocation->m_SubAllocations.size(), (int32)bufferAllocation->m_FreeList.GetNumFreeBlocks(), (int32)bufferAllocation->m_UsedSize, bufferAllocation->m_MaxSize);
                 
                 if (poolSizeIndex == (int32)PoolSizes::SizesCount)
                 {
@@ -1151,16 +1848,25 @@ void VulkanResourceHeapManager::DumpMemory()
 
 void VulkanResourceHeapManager::ReleaseFreedResources(bool immediately)
 {
-    for (auto& freeAllocations : m_FreeBufferAllocations)
+    uint32 frameCounter = m_FrameCounter.load();
+    for (int32 poolSizeIndex = 0; poolSizeIndex < (int32)PoolSizes::SizesCount + 1; ++poolSizeIndex)
     {
-        for (int32 index = 0; index < freeAllocations.size(); ++index)
+        std::lock_guard<std::mutex> lockGuard(m_BufferAllocationsMutex[poolSizeIndex]);
+        std::vector<VulkanSubBufferAllocator*>& freeAllocations = m_FreeBufferAllocations[poolSizeIndex];
+        for (int32 index = (int32)freeAllocations.size() - 1; index >= 0; --index)
         {
             VulkanSubBufferAllocator* bufferAllocation = freeAllocations[index];
+            if (!immediately)
+            {
+                if (frameCounter < bufferAllocation->m_FrameFreed + NUM_FRAMES_TO_WAIT_BEFORE_RELEASING_TO_OS || !m_DeviceMemoryManager->IsUnderMemoryPressure(bufferAllocation->m_MemoryTypeIndex)) {
+                    continue;
+                }
+            }
             bufferAllocation->Destroy(m_VulkanDevice);
             m_VulkanDevice->GetMemoryManager().Free(bufferAllocation->m_DeviceMemoryAllocation);
             delete bufferAllocation;
+            freeAllocations.erase(freeAllocations.begin() + index);
         }
-        freeAllocations.clear();
     }
 }
 
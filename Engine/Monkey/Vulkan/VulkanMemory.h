@@ -7,6 +7,9 @@
 
 #include <memory>
 #include <vector>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
 
 class VulkanDevice;
 class VulkanDeviceMemoryManager;
@@ -62,14 +65,176 @@ struct VulkanRange
     uint32 offset;
     uint32 size;
     
-    static void JoinConsecutiveRanges(std::vector<VulkanRange>& ranges);
-    
     inline bool operator<(const VulkanRange& vulkanRange) const
     {
         return offset < vulkanRange.offset;
     }
 };
 
+// TLSF(Two-Level Segregated Fit)区间分配器
+// 空闲块按大小分到两级Bin里，通过位图查找，释放以及相邻空闲块合并都是O(1)。
+// 分配按size + alignment - 1向上取整查找Bin，命中时是O(1)；找不到时对齐大于1的请求会退回到
+// 逐个检查可能放下size的Bin里的空闲块，这条路径最坏与空闲块数量成正比。
+// 只管理Offset，不涉及任何Vulkan对象。
+class VulkanRangeAllocator
+{
+public:
+    VulkanRangeAllocator();
+    
+    void Init(uint32 size);
+    
+    // 成功时返回块起始位置、对齐之后的位置以及包含对齐填充的大小
+    bool Allocate(uint32 size, uint32 alignment, uint32& outAllocatedOffset, uint32& outAlignedOffset, uint32& outAllocatedSize);
+    
+    // offset为Allocate返回的outAllocatedOffset
+    void Free(uint32 offset);
+    
+    inline uint32 GetNumFreeBlocks() const
+    {
+        return m_NumFreeBlocks;
+    }
+    
+    inline uint32 GetFreeSize() const
+    {
+        return m_FreeSize;
+    }
+    
+    inline uint32 GetSize() const
+    {
+        return m_Size;
+    }
+    
+    uint32 GetLargestFreeBlock() const;
+    
+private:
+    
+    enum
+    {
+        SL_INDEX_COUNT_LOG2 = 4,
+        SL_INDEX_COUNT      = 1 << SL_INDEX_COUNT_LOG2,
+        FL_INDEX_COUNT      = 32 - SL_INDEX_COUNT_LOG2 + 1,
+    };
+    
+    struct Block
+    {
+        uint32  offset;
+        uint32  size;
+        int32   prevPhysical;
+        int32   nextPhysical;
+        int32   prevFree;
+        int32   nextFree;
+        bool    isFree;
+    };
+    
+    void Mapping(uint32 size, int32& outFL, int32& outSL) const;
+    
+    bool MappingSearch(uint64 size, int32& outFL, int32& outSL) const;
+    
+    int32 FindSuitableBlock(int32& fl, int32& sl) const;
+    
+    int32 FindFreeBlock(uint32 size, uint32 alignment) const;
+    
+    void InsertFreeBlock(int32 index);
+    
+    void RemoveFreeBlock(int32 index);
+    
+    int32 AcquireBlock();
+    
+    void ReleaseBlock(int32 index);
+    
+private:
+    std::vector<Block>                  m_Blocks;
+    std::vector<int32>                  m_UnusedBlocks;
+    std::unordered_map<uint32, int32>   m_UsedBlocks;
+    
+    uint32                              m_FLBitmap;
+    uint32                              m_SLBitmap[FL_INDEX_COUNT];
+    int32                               m_FreeHeads[FL_INDEX_COUNT][SL_INDEX_COUNT];
+    
+    uint32                              m_Size;
+    uint32                              m_FreeSize;
+    uint32                              m_NumFreeBlocks;
+};
+
+// 内存统计的快照，Release版本同样可用
+struct VulkanMemoryStats
+{
+    struct HeapStats
+    {
+        HeapStats()
+            : totalSize(0)
+            , usedSize(0)
+            , peakSize(0)
+            , numAllocations(0)
+        {
+            
+        }
+        
+        uint64  totalSize;
+        uint64  usedSize;
+        uint64  peakSize;
+        uint32  numAllocations;
+    };
+    
+    struct MemoryTypeStats
+    {
+        MemoryTypeStats()
+            : heapIndex(0)
+            , usedSize(0)
+            , peakSize(0)
+            , numAllocations(0)
+            , numPages(0)
+            , numFreePages(0)
+            , pageSize(0)
+            , pageUsedSize(0)
+            , pageFreeSize(0)
+            , pageLargestFreeSize(0)
+        {
+            
+        }
+        
+        uint32  heapIndex;
+        // 直接向驱动申请的内存
+        uint64  usedSize;
+        uint64  peakSize;
+        uint32  numAllocations;
+        // ResourceHeap页内的子分配
+        uint32  numPages;
+        uint32  numFreePages;
+        uint64  pageSize;
+        uint64  pageUsedSize;
+        uint64  pageFreeSize;
+        uint64  pageLargestFreeSize;
+    };
+    
+    struct PoolStats
+    {
+        PoolStats()
+            : poolSize(0)
+            , numUsedBuffers(0)
+            , numFreeBuffers(0)
+            , usedSize(0)
+            , maxSize(0)
+        {
+            
+        }
+        
+        // 0表示大尺寸分配
+        uint32  poolSize;
+        uint32  numUsedBuffers;
+        uint32  numFreeBuffers;
+        uint64  usedSize;
+        uint64  maxSize;
+    };
+    
+    // 页内空闲空间的碎片率：1 - 各页最大空闲块之和 / 空闲总量，0表示空闲空间都是连续的
+    float GetFragmentation() const;
+    
+    std::vector<HeapStats>          heaps;
+    std::vector<MemoryTypeStats>    memoryTypes;
+    std::vector<PoolStats>          pools;
+};
+
 class VulkanDeviceMemoryAllocation
 {
 public:
@@ -79,9 +244,10 @@ public:
 
 	void Unmap();
 
-	void FlushMappedMemory(VkDeviceSize offset, VkDeviceSize size);
+	// 非Coherent内存会把范围扩展到nonCoherentAtomSize的整数倍，size可以为VK_WHOLE_SIZE
+	VkResult FlushMappedMemory(VkDeviceSize offset, VkDeviceSize size);
 
-	void InvalidateMappedMemory(VkDeviceSize offset, VkDeviceSize size);
+	VkResult InvalidateMappedMemory(VkDeviceSize offset, VkDeviceSize size);
 
 	inline bool CanBeMapped() const
 	{
@@ -121,9 +287,12 @@ public:
 protected:
 	virtual ~VulkanDeviceMemoryAllocation();
 
+	void GetMappedRange(VkDeviceSize offset, VkDeviceSize size, VkMappedMemoryRange& outRange) const;
+
     friend class VulkanDeviceMemoryManager;
 protected:
 	VkDeviceSize    m_Size;
+	VkDeviceSize    m_NonCoherentAtomSize;
 	VkDevice        m_Device;
 	VkDeviceMemory  m_Handle;
 	void*           m_MappedPointer;
@@ -157,6 +326,12 @@ public:
     
     uint64 GetTotalMemory(bool gpu) const;
     
+    // 该内存类型所在的堆已用超过总量的一定比例时视为内存紧张
+    bool IsUnderMemoryPressure(uint32 memoryTypeIndex);
+    
+    // 填充heaps以及memoryTypes中直接分配的部分
+    void GetStats(VulkanMemoryStats& outStats);
+    
     inline bool HasUnifiedMemory() const
     {
         return m_HasUnifiedMemory;
@@ -232,6 +407,21 @@ protected:
         std::vector<VulkanDeviceMemoryAllocation*> allocations;
     };
     
+    struct MemoryTypeInfo
+    {
+        MemoryTypeInfo()
+            : usedSize(0)
+            , peakSize(0)
+            , numAllocations(0)
+        {
+            
+        }
+        
+        VkDeviceSize usedSize;
+        VkDeviceSize peakSize;
+        uint32       numAllocations;
+    };
+    
     void SetupAndPrintMemInfo();
     
 protected:
@@ -243,12 +433,48 @@ protected:
     uint32                           m_NumAllocations;
     uint32                           m_PeakNumAllocations;
     std::vector<HeapInfo>            m_HeapInfos;
+    std::vector<MemoryTypeInfo>      m_MemoryTypeInfos;
+    std::mutex                       m_Mutex;
+};
+
+class VulkanResourceAllocation;
+
+// 碎片整理时由分配的使用者实现：在newAllocation上重新创建Buffer/Image，
+// 把数据拷贝过去的命令录制到cmdBuffer，然后替换自己持有的句柄。
+// 成功后oldAllocation由Heap走延迟释放，旧的句柄由使用者自己延迟销毁。
+// 返回false表示放弃本次移动，此时不能录制任何命令，也不能修改自己持有的句柄和分配。
+class VulkanResourceMoveHandler
+{
+public:
+    virtual ~VulkanResourceMoveHandler()
+    {
+        
+    }
+    
+    virtual bool OnMove(VulkanResourceAllocation* oldAllocation, VulkanResourceAllocation* newAllocation, VkCommandBuffer cmdBuffer) = 0;
+};
+
+struct VulkanDefragmentStats
+{
+    VulkanDefragmentStats()
+        : numMoves(0)
+        , bytesMoved(0)
+        , bytesFreedToPool(0)
+    {
+        
+    }
+    
+    uint32  numMoves;
+    uint64  bytesMoved;
+    // 所有分配都被移走的页的大小。这些页在延迟释放之后回到Heap的空闲页，
+    // 只有内存紧张时才会真正归还给驱动，所以不等于释放掉的显存
+    uint64  bytesFreedToPool;
 };
 
 class VulkanResourceAllocation : public RefCount
 {
 public:
-    VulkanResourceAllocation(VulkanResourceHeapPage* owner, VulkanDeviceMemoryAllocation* deviceMemoryAllocation, uint32 requestedSize, uint32 alignedOffset, uint32 allocationSize, uint32 allocationOffset, const char* file, uint32 line);
+    VulkanResourceAllocation(VulkanResourceHeapPage* owner, VulkanDeviceMemoryAllocation* deviceMemoryAllocation, uint32 requestedSize, uint32 alignment, uint32 alignedOffset, uint32 allocationSize, uint32 allocationOffset, const char* file, uint32 line);
     
     virtual ~VulkanResourceAllocation();
     
@@ -295,17 +521,50 @@ public:
     {
         m_DeviceMemoryAllocation->InvalidateMappedMemory(m_AllocationOffset, m_AllocationSize);
     }
+    
+    // offset相对于GetMappedPointer()，超出分配的部分会被截掉
+    inline VkResult FlushMappedMemory(VkDeviceSize offset, VkDeviceSize size)
+    {
+        if (offset >= m_RequestedSize) {
+            return VK_SUCCESS;
+        }
+        size = size > m_RequestedSize - offset ? m_RequestedSize - offset : size;
+        return m_DeviceMemoryAllocation->FlushMappedMemory(m_AlignedOffset + offset, size);
+    }
+    
+    inline VkResult InvalidateMappedMemory(VkDeviceSize offset, VkDeviceSize size)
+    {
+        if (offset >= m_RequestedSize) {
+            return VK_SUCCESS;
+        }
+        size = size > m_RequestedSize - offset ? m_RequestedSize - offset : size;
+        return m_DeviceMemoryAllocation->InvalidateMappedMemory(m_AlignedOffset + offset, size);
+    }
+    
+    // 设置之后该分配才允许被碎片整理移动
+    inline void SetMoveHandler(VulkanResourceMoveHandler* moveHandler)
+    {
+        m_MoveHandler = moveHandler;
+    }
+    
+    inline VulkanResourceMoveHandler* GetMoveHandler() const
+    {
+        return m_MoveHandler;
+    }
 
 private:
     friend class VulkanResourceHeapPage;
+    friend class VulkanResourceHeap;
     
 private:
     VulkanResourceHeapPage*         m_Owner;
     uint32                          m_AllocationSize;
     uint32                          m_AllocationOffset;
     uint32                          m_RequestedSize;
+    uint32                          m_Alignment;
     uint32                          m_AlignedOffset;
     VulkanDeviceMemoryAllocation*   m_DeviceMemoryAllocation;
+    VulkanResourceMoveHandler*      m_MoveHandler;
 };
 
 class VulkanResourceHeapPage
@@ -344,7 +603,7 @@ protected:
     VulkanResourceHeap*                     m_Owner;
     VulkanDeviceMemoryAllocation*           m_DeviceMemoryAllocation;
     std::vector<VulkanResourceAllocation*>  m_ResourceAllocations;
-    std::vector<VulkanRange>                m_FreeList;
+    VulkanRangeAllocator                    m_FreeList;
     
     uint32                                  m_MaxSize;
     uint32                                  m_UsedSize;
@@ -419,6 +678,7 @@ public:
     
     inline VulkanResourceSubAllocation* TryAllocateLocking(uint32 size, uint32 alignment, const char* file, uint32 line)
     {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
         return TryAllocateNoLocking(size, alignment, file, line);
     }
     
@@ -444,8 +704,9 @@ protected:
     uint32                                      m_Alignment;
     uint32                                      m_FrameFreed;
     int64                                       m_UsedSize;
-    std::vector<VulkanRange>                    m_FreeList;
+    VulkanRangeAllocator                        m_FreeList;
     std::vector<VulkanResourceSubAllocation*>   m_SubAllocations;
+    std::mutex                                  m_Mutex;
 };
 
 class VulkanSubBufferAllocator : public VulkanSubResourceAllocator
@@ -488,6 +749,7 @@ public:
     
     virtual ~VulkanResourceHeap();
     
+    // 调用者需要持有m_Mutex
     void FreePage(VulkanResourceHeapPage* page);
     
     void ReleaseFreedPages(bool immediately);
@@ -517,9 +779,14 @@ public:
 #endif
     
 protected:
+    void Defragment(VkCommandBuffer cmdBuffer, uint64 maxBytes, VulkanDefragmentStats& stats);
+    
+    void GetStats(VulkanMemoryStats::MemoryTypeStats& outStats);
+    
     VulkanResourceAllocation* AllocateResource(Type type, uint32 size, uint32 alignment, bool mapAllocation, const char* file, uint32 line);
     
     friend class VulkanResourceHeapManager;
+    friend class VulkanResourceHeapPage;
     
 protected:
     VulkanResourceHeapManager*              m_Owner;
@@ -533,8 +800,17 @@ protected:
     std::vector<VulkanResourceHeapPage*>    m_UsedBufferPages;
     std::vector<VulkanResourceHeapPage*>    m_UsedImagePages;
     std::vector<VulkanResourceHeapPage*>    m_FreePages;
+    std::mutex                              m_Mutex;
 };
 
+// 加锁顺序，只能按箭头方向嵌套，反过来会死锁：
+//     Pool(m_BufferAllocationsMutex) -> SubBufferAllocator(m_Mutex)
+//     Pool(m_BufferAllocationsMutex) -> DeviceMemoryManager(m_Mutex)
+//     ResourceHeap(m_Mutex)          -> DeviceMemoryManager(m_Mutex)
+// VulkanSubBufferAllocator::Release先放开自己的锁再调用ReleaseBuffer，由ReleaseBuffer按Pool -> Allocator重新加锁。
+// VulkanResourceHeapPage::ReleaseAllocation在所属Heap的锁内执行(m_Owner->m_Mutex)，
+// 所以释放VulkanResourceAllocation时不能持有任何Pool、Allocator或者Heap的锁。
+// 延迟释放队列的锁(m_DeferredReleasesMutex)不与其它锁嵌套，到期的资源在锁外析构。
 class VulkanResourceHeapManager
 {
 public:
@@ -550,8 +826,33 @@ public:
     
     void ReleaseBuffer(VulkanSubBufferAllocator* bufferAllocator);
     
+    // 每帧调用一次：推进帧计数，处理延迟释放队列，空闲页在内存紧张时归还给驱动
     void ReleaseFreedPages();
     
+    // 给没有帧循环(不调用ReleaseFreedPages)的工具和基准测试使用，否则延迟释放的资源要等到退出才会释放。
+    // 调用者保证GPU已经空闲，例如刚调用过vkDeviceWaitIdle，队列里的资源全部立即释放。
+    void FlushDeferredReleases();
+    
+    // GPU可能仍在使用的分配，所有权交给队列，若干帧之后再真正释放
+    void ReleaseDeferred(VulkanResourceAllocation* allocation);
+    
+    void ReleaseDeferred(VulkanBufferSubAllocation* subAllocation);
+    
+    // 到期之后直接delete，可以用来延迟销毁VkBuffer/VkImage等句柄
+    void ReleaseDeferred(RefCount* resource);
+    
+    // 增量碎片整理：把利用率最低的页上的分配移动到其它页，拷贝命令录制到cmdBuffer，
+    // 每次调用最多移动maxBytes字节。被移走的旧分配走延迟释放。
+    VulkanDefragmentStats Defragment(VkCommandBuffer cmdBuffer, uint64 maxBytes);
+    
+    // 每个锁只持有很短的时间，可以每帧调用
+    void GetStats(VulkanMemoryStats& outStats);
+    
+    inline uint32 GetFrameCounter() const
+    {
+        return m_FrameCounter.load();
+    }
+    
 #if MONKEY_DEBUG
     void DumpMemory();
 #endif
@@ -566,6 +867,14 @@ public:
     }
 
 protected:
+    struct DeferredRelease
+    {
+        RefCount*   resource;
+        uint32      frameNumber;
+    };
+    
+    void ProcessDeferredReleases(bool immediately);
+    
     void ReleaseFreedResources(bool immediately);
     
     void DestroyResourceAllocations();
@@ -639,4 +948,11 @@ protected:
     std::vector<VulkanResourceHeap*>        m_ResourceTypeHeaps;
     std::vector<VulkanSubBufferAllocator*>  m_UsedBufferAllocations[(int32)PoolSizes::SizesCount + 1];
     std::vector<VulkanSubBufferAllocator*>  m_FreeBufferAllocations[(int32)PoolSizes::SizesCount + 1];
+    // 每个PoolSize一把锁，不同尺寸的分配互不阻塞
+    std::mutex                              m_BufferAllocationsMutex[(int32)PoolSizes::SizesCount + 1];
+    
+    // 主线程每帧递增，ReleaseDeferred/ReleaseBuffer在工作线程中读取
+    std::atomic<uint32>                     m_FrameCounter;
+    std::vector<DeferredRelease>            m_DeferredReleases;
+    std::mutex                              m_DeferredReleasesMutex;
 };
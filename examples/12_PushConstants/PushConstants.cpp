@@ -290,6 +290,7 @@ private:
 	{
 		if (m_AutoRotate) {
 			m_Model->rootNode->localMatrix.AppendRotation(30.0f * delta, Vector3::UpVector);
+			m_Model->rootNode->MarkDirty();
 		}
 
         m_ViewProjData.view = m_ViewCamera.GetView();
@@ -149,6 +149,7 @@ private:
 				m_ModelRole->rootNode->localMatrix.SetIdentity();
 				m_ModelRole->rootNode->localMatrix.AppendScale(scale);
 				m_ModelRole->rootNode->localMatrix.AppendTranslation(position);
+				m_ModelRole->rootNode->MarkDirty();
 			}
 
 			{
@@ -189,6 +190,7 @@ private:
 		);
 		m_ModelRole->rootNode->localMatrix.AppendScale(Vector3(100.0f, 100.0f, 100.0f));
 		m_ModelRole->rootNode->localMatrix.AppendTranslation(Vector3(-15.0f, 300.0f, 500.0f));
+		m_ModelRole->rootNode->MarkDirty();
 		// Role diffuse
 		m_RoleDiffuse = vk_demo::DVKTexture::Create2D(
 			"assets/models/LizardMage/Body_colors1.jpg",
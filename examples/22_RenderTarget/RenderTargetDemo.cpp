@@ -383,6 +383,7 @@ private:
 
 		// 设置Room参数
 		m_ModelScene->rootNode->localMatrix.AppendRotation(delta * 90.0f, Vector3::UpVector);
+		m_ModelScene->rootNode->MarkDirty();
 		for (int32 i = 0; i < m_SceneMatMeshes.size(); ++i)
 		{
 			m_SceneMaterials[i]->BeginFrame();
@@ -218,6 +218,7 @@ private:
 			{ VertexAttribute::VA_Position, VertexAttribute::VA_UV0, VertexAttribute::VA_Normal }
 		);
 		m_ModelScene->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
+		m_ModelScene->rootNode->MarkDirty();
 
 		// room shader
 		m_SceneShader = vk_demo::DVKShader::Create(
@@ -286,6 +287,7 @@ private:
 			}
 			else if (diffuseName == "Spark_Diff") {
 				mesh->linkNode->localMatrix.AppendScale(Vector3(2.5f, 2.5f, 2.5f));
+				mesh->linkNode->MarkDirty();
 				m_SceneMatMeshes[3].push_back(mesh);
 			}
 		}
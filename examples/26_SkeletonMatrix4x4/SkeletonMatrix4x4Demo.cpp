@@ -2,6 +2,7 @@
 #include "Common/Log.h"
 
 #include "Demo/DVKCommon.h"
+#include "Demo/DVKAnimationSystem.h"
 
 #include "Math/Vector4.h"
 #include "Math/Matrix4x4.h"
@@ -96,15 +97,15 @@ private:
 			// model data
             m_MVPData.model = mesh->linkNode->GetGlobalMatrix();
             
-			// bones data
+			// bones data，来自DVKAnimationSystem计算的骨骼矩阵，按模型的骨骼序号排列
+			const Matrix4x4* palette = m_AnimSystem->GetPalette(0);
 			for (int32 j = 0; j < mesh->bones.size(); ++j) 
 			{
 				int32 boneIndex = mesh->bones[j];
-				vk_demo::DVKBone* bone = m_RoleModel->bones[boneIndex];
-				m_BonesData.bones[j] = bone->finalTransform;
+				m_BonesData.bones[j] = palette[boneIndex];
 				// 这里要注意，我们的Bone动画使用的是全局变化矩阵，变换矩阵一直延续到了aiScene->mRoot节点。
 				// 因此我们需要将Bone变换矩阵与mesh的全局变化矩阵的逆矩阵做运算，来抵消掉mesh父节点之上的变换操作。
-				m_BonesData.bones[j].Append(mesh->linkNode->GetGlobalMatrix().Inverse());
+				m_BonesData.bones[j].Append(mesh->linkNode->GetInverseGlobalMatrix());
 			}
             
             if (mesh->bones.size() == 0) {
@@ -126,10 +127,12 @@ private:
 	void UpdateAnimation(float time, float delta)
 	{
         if (m_AutoAnimation) {
-            m_RoleModel->Update(time, delta);
+			m_AnimSystem->SetSpeed(0, m_RoleModel->GetAnimation().speed);
+			m_AnimSystem->Update(delta);
         }
         else {
-            m_RoleModel->GotoAnimation(m_AnimTime);
+			m_AnimSystem->SetAnimation(0, m_AnimIndex, m_AnimTime);
+			m_AnimSystem->Update(0.0f);
         }
 	}
     
@@ -144,6 +147,7 @@ private:
             
             if (ImGui::SliderInt("Anim", &m_AnimIndex, 0, m_RoleModel->animations.size() - 1)) {
                 SetAnimation(m_AnimIndex);
+				m_AnimSystem->CrossFade(0, m_AnimIndex, 0.25f);
             }
 
 			ImGui::SliderFloat("Speed", &(m_RoleModel->GetAnimation().speed), 0.0f, 10.0f);
@@ -153,6 +157,18 @@ private:
             if (!m_AutoAnimation) {
                 ImGui::SliderFloat("Time", &m_AnimTime, 0.0f, m_AnimDuration);
             }
+
+			if (ImGui::Checkbox("Compressed", &m_Compressed)) {
+				SetCompressed(m_Compressed);
+			}
+
+			if (m_AnimIndex < m_CompressionStats.size())
+			{
+				const vk_demo::DVKAnimCompressionStats& stats = m_CompressionStats[m_AnimIndex];
+				ImGui::Text("Keys:%u -> %u", stats.rawKeys, stats.compressedKeys);
+				ImGui::Text("Bytes:%u -> %u", stats.rawSize, stats.compressedSize);
+				ImGui::Text("MaxError:%.4f", stats.maxError);
+			}
             
 			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 			ImGui::End();
@@ -173,6 +189,18 @@ private:
         m_AnimTime     = 0.0f;
         m_AnimIndex    = index;
     }
+
+	// 压缩数据不为空时采样走smallest-three解码，关闭时把压缩数据挪开，回到原始关键帧
+	void SetCompressed(bool compressed)
+	{
+		for (int32 i = 0; i < m_RoleModel->animations.size(); ++i)
+		{
+			vk_demo::DVKAnimation& animation = m_RoleModel->animations[i];
+			if ((animation.compressedClips.size() > 0) != compressed) {
+				animation.compressedClips.swap(m_CompressedClips[i]);
+			}
+		}
+	}
     
 	void LoadAssets()
 	{
@@ -192,8 +220,18 @@ private:
             }
 		);
 		m_RoleModel->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
+		m_RoleModel->rootNode->MarkDirty();
+
+		// 保留原始关键帧，界面上可以切换
+		m_CompressionStats = m_RoleModel->CompressAnimations();
+		m_CompressedClips.resize(m_RoleModel->animations.size());
+		SetCompressed(m_Compressed);
         
         SetAnimation(0);
+
+		// 只有一个实例，骨骼矩阵留在内存里，每帧拷贝到bonesData
+		m_AnimSystem = vk_demo::DVKAnimationSystem::Create(m_RoleModel, nullptr, 1);
+		m_AnimSystem->AddInstance(0);
         
 		// shader
 		m_RoleShader = vk_demo::DVKShader::Create(
@@ -228,6 +266,7 @@ private:
 		delete m_RoleShader;
         delete m_RoleDiffuse;
         delete m_RoleMaterial;
+		delete m_AnimSystem;
 		delete m_RoleModel;
 	}
 
@@ -320,6 +359,7 @@ private:
 	BonesTransformBlock			m_BonesData;
 
 	vk_demo::DVKModel*			m_RoleModel = nullptr;
+	vk_demo::DVKAnimationSystem*	m_AnimSystem = nullptr;
 	vk_demo::DVKShader*			m_RoleShader = nullptr;
 	vk_demo::DVKTexture*		m_RoleDiffuse = nullptr;
     vk_demo::DVKMaterial*       m_RoleMaterial = nullptr;
@@ -330,6 +370,10 @@ private:
     float                       m_AnimDuration = 0.0f;
     float                       m_AnimTime = 0.0f;
     int32                       m_AnimIndex = 0;
+
+	bool						m_Compressed = true;
+	std::vector<vk_demo::DVKAnimCompressionStats>		m_CompressionStats;
+	std::vector<std::vector<vk_demo::DVKCompressedClip>>	m_CompressedClips;
 };
 
 std::shared_ptr<AppModuleBase> CreateAppMode(const std::vector<std::string>& cmdLine)
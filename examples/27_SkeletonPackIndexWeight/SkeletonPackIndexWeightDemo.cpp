@@ -104,7 +104,7 @@ private:
 				m_BonesData.bones[j] = bone->finalTransform;
 				// 这里要注意，我们的Bone动画使用的是全局变化矩阵，变换矩阵一直延续到了aiScene->mRoot节点。
 				// 因此我们需要将Bone变换矩阵与mesh的全局变化矩阵的逆矩阵做运算，来抵消掉mesh父节点之上的变换操作。
-				m_BonesData.bones[j].Append(mesh->linkNode->GetGlobalMatrix().Inverse());
+				m_BonesData.bones[j].Append(mesh->linkNode->GetInverseGlobalMatrix());
 			}
             
             if (mesh->bones.size() == 0) {
@@ -192,6 +192,7 @@ private:
             }
 		);
 		m_RoleModel->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
+		m_RoleModel->rootNode->MarkDirty();
 
 		// 索引一般不会超过255，因此可以将四个索引打包到一个UInt32里面。
 		// 权重信息范围[0, 1]也可以压缩为16个Bit，打包到两个UInt32里面，动作可能会有抖动。
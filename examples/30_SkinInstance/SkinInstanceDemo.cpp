@@ -222,7 +222,7 @@ private:
 				// 获取骨骼的最终Transform矩阵
 				// 也可以使用对偶四元素来替换矩阵的计算
 				Matrix4x4 boneTransform = bone->finalTransform;
-				boneTransform.Append(mesh->linkNode->GetGlobalMatrix().Inverse());
+				boneTransform.Append(mesh->linkNode->GetInverseGlobalMatrix());
 				boneTransform.AppendRotation(180, Vector3::ForwardVector);
 				// 从Transform矩阵中获取四元数以及位移信息
 				Quat quat   = boneTransform.ToQuat();
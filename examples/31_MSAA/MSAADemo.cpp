@@ -262,6 +262,7 @@ private:
 		m_MVPData.projection = m_ViewCamera.GetProjection();
         
         m_LineModel->rootNode->localMatrix.AppendRotation(delta * 15.0f, Vector3::UpVector);
+        m_LineModel->rootNode->MarkDirty();
 
 		vk_demo::DVKMaterial* material = m_MSAAEnable ? m_MSAAMaterial : m_NoneMaterial;
 		material->BeginFrame();
@@ -100,6 +100,7 @@ private:
         
 		if (m_AutoRotate) {
 			m_LineModel->rootNode->localMatrix.AppendRotation(delta * 15.0f, Vector3::UpVector);
+			m_LineModel->rootNode->MarkDirty();
 		}
 
 		// model
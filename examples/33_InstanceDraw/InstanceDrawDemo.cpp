@@ -2,6 +2,7 @@
 #include "Common/Log.h"
 
 #include "Demo/DVKCommon.h"
+#include "Demo/DVKStreaming.h"
 
 #include "Math/Vector4.h"
 #include "Math/Matrix4x4.h"
@@ -45,9 +46,10 @@ public:
 
 	virtual void Exist() override
 	{
+		// 流式加载的CommandBuffer来自m_CommandPool，需要在DemoBase::Release之前销毁
+		DestroyAssets();
 		DemoBase::Release();
 
-		DestroyAssets();
 		DestroyGUI();
 	}
 
@@ -83,6 +85,9 @@ private:
 			m_ViewCamera.Update(time, delta);
 		}
 
+		UpdateStreaming();
+		UpdateInstanceLods();
+
 		m_MVPData.view = m_ViewCamera.GetView();
 		m_MVPData.projection = m_ViewCamera.GetProjection();
         
@@ -105,11 +110,76 @@ private:
         m_MVPData.model.AppendRotation(60.0f * delta, Vector3::ForwardVector);
     }
 
+	// 模型和贴图在后台加载，完成之后把替身换成真实的资源
+	void UpdateStreaming()
+	{
+		m_Streaming->Update(m_ViewCamera.GetTransform().GetOrigin());
+
+		vk_demo::DVKModel* drawModel = m_RoleStream->GetDrawModel();
+		if (drawModel != m_RoleModel)
+		{
+			m_RoleModel = drawModel;
+			BuildInstanceDatas();
+		}
+
+		// Present会等待Fence，此时可以直接更新DescriptorSet
+		vk_demo::DVKTexture* drawTexture = m_TextureStream->GetDrawTexture();
+		if (drawTexture != m_RoleTexture)
+		{
+			m_RoleTexture = drawTexture;
+			m_RoleMaterial->SetTexture("diffuseMap", m_RoleTexture);
+		}
+	}
+
+	// 每个实例按屏幕空间误差选择LOD，实例数据按LOD分组后每一级LOD一次Instance绘制
+	void UpdateInstanceLods()
+	{
+		vk_demo::DVKPrimitive* primitive = m_RoleModel->meshes[0]->primitives[0];
+		vk_demo::DVKLodSelector selector(m_ViewCamera.GetFov(), m_FrameHeight, m_LodThreshold);
+		Vector3 eye = m_ViewCamera.GetTransform().GetOrigin();
+
+		int32 lodCount = primitive->GetLodCount();
+		m_LodBuckets.resize(lodCount);
+		m_LodFirstInstance.resize(lodCount);
+		for (int32 lod = 0; lod < lodCount; ++lod) {
+			m_LodBuckets[lod].clear();
+		}
+
+		for (int32 i = 0; i < m_InstanceCount; ++i)
+		{
+			Vector3 position = m_MVPData.model.TransformPosition(m_InstanceOrigins[i]);
+			float   distance = (position - eye).Size() - m_RoleRadius;
+			m_LodBuckets[selector.Select(primitive->lods, distance, m_RoleScale)].push_back(i);
+		}
+
+		m_LodInstanceDatas.clear();
+		m_LodTriangles = 0;
+		for (int32 lod = 0; lod < lodCount; ++lod)
+		{
+			const std::vector<int32>& bucket = m_LodBuckets[lod];
+			m_LodFirstInstance[lod] = m_LodInstanceDatas.size() / 8;
+			m_LodTriangles += primitive->GetLod(lod).indexCount / 3 * bucket.size();
+			for (int32 i = 0; i < bucket.size(); ++i)
+			{
+				const float* data = m_InstanceDatas.data() + bucket[i] * 8;
+				m_LodInstanceDatas.insert(m_LodInstanceDatas.end(), data, data + 8);
+			}
+		}
+
+		// Present会等待Fence，此时GPU已经不再读取InstanceBuffer
+		m_InstanceBuffer->CopyFrom(m_LodInstanceDatas.data(), m_LodInstanceDatas.size() * sizeof(float));
+	}
+
 	bool UpdateUI(float time, float delta)
 	{
 		m_GUI->StartFrame();
         
         vk_demo::DVKPrimitive* primitive = m_RoleModel->meshes[0]->primitives[0];
+
+		int32 drawCall = 0;
+		for (int32 lod = 0; lod < m_LodBuckets.size(); ++lod) {
+			drawCall += m_LodBuckets[lod].size() > 0 ? 1 : 0;
+		}
         
 		{
 			ImGui::SetNextWindowPos(ImVec2(0, 0));
@@ -117,10 +187,12 @@ private:
 			ImGui::Begin("InstanceDrawDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
             
             ImGui::Checkbox("AutoSpin", &m_AutoSpin);
-            ImGui::SliderInt("Instance", &(primitive->indexBuffer->instanceCount), 1, INSTANCE_COUNT);
+            ImGui::SliderInt("Instance", &m_InstanceCount, 1, INSTANCE_COUNT);
+			ImGui::SliderFloat("LOD Pixel Error", &m_LodThreshold, 0.0f, 8.0f);
             
-            ImGui::Text("DrawCall:1");
-			ImGui::Text("Triangle:%d", primitive->triangleNum * primitive->indexBuffer->instanceCount);
+            ImGui::Text("DrawCall:%d", drawCall);
+			ImGui::Text("Triangle:%d/%d", m_LodTriangles, primitive->GetLod(0).indexCount / 3 * m_InstanceCount);
+			ImGui::Text("Model:%s Texture:%s", m_RoleStream->IsReady() ? "Ready" : "Loading", m_TextureStream->IsReady() ? "Ready" : "Loading");
 			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
 			ImGui::End();
 		}
@@ -135,13 +207,15 @@ private:
 
 	void LoadAssets()
 	{
-		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
-        
-        m_RoleTexture = vk_demo::DVKTexture::Create2D(
+		m_Streaming = vk_demo::DVKStreamingManager::Create(m_VulkanDevice, m_CommandPool);
+
+		// 加载完成之前使用默认贴图
+        m_TextureStream = m_Streaming->LoadTexture(
             "assets/models/LizardMage/Body_colors1.jpg",
-            m_VulkanDevice,
-            cmdBuffer
+            Vector3(0, 0, 0),
+            vk_demo::DVKDefaultRes::texture2D
         );
+        m_RoleTexture = m_TextureStream->GetDrawTexture();
         
         m_RoleShader = vk_demo::DVKShader::Create(
             m_VulkanDevice,
@@ -159,33 +233,61 @@ private:
         m_RoleMaterial->PreparePipeline();
         m_RoleMaterial->SetTexture("diffuseMap", m_RoleTexture);
         
-        m_RoleModel = vk_demo::DVKModel::LoadFromFile(
+        // 包围盒相当于场景数据中记录的信息，加载完成之前绘制包围盒。LOD在工作线程上生成。
+        m_RoleStream = m_Streaming->LoadModel(
             "assets/models/LizardMage/LizardMage_Lowpoly.obj",
-            m_VulkanDevice,
-            cmdBuffer,
             {
                 VertexAttribute::VA_Position,
                 VertexAttribute::VA_Normal,
                 VertexAttribute::VA_UV0
+            },
+            Vector3(0, 0, 0),
+            vk_demo::DVKBoundingBox(Vector3(-3.6f, -3.2f, -1.6f), Vector3(1.5f, 0.8f, 1.9f)),
+            [](vk_demo::DVKModel* model) {
+                model->BuildLods();
             }
         );
+        m_RoleModel = m_RoleStream->GetDrawModel();
+
+        // 实例的随机变换与模型无关，替身换成模型之后用同样的变换重新生成实例数据
+        m_InstanceRotations.resize(INSTANCE_COUNT);
+        m_InstanceTranslates.resize(INSTANCE_COUNT);
+        for (int32 i = 0; i < INSTANCE_COUNT; ++i)
+        {
+            m_InstanceTranslates[i].x = MMath::RandRange(-100.0f, 100.0f);
+            m_InstanceTranslates[i].y = MMath::RandRange(-100.0f, 100.0f);
+            m_InstanceTranslates[i].z = MMath::RandRange(-100.0f, 100.0f);
+            m_InstanceRotations[i]    = MMath::RandRange(0.0f, 360.0f);
+        }
+
+        BuildInstanceDatas();
         
-        // instance data
+        // 实例每帧按LOD重新排列，放在HostVisible的Buffer中
+        m_InstanceBuffer = vk_demo::DVKBuffer::CreateBuffer(
+            m_VulkanDevice,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            m_InstanceDatas.size() * sizeof(float)
+        );
+        m_InstanceBuffer->Map();
+	}
+
+	void BuildInstanceDatas()
+	{
         vk_demo::DVKMesh* mesh = m_RoleModel->meshes[0];
         Matrix4x4 meshGlobal = mesh->linkNode->GetGlobalMatrix();
-        vk_demo::DVKPrimitive* primitive = m_RoleModel->meshes[0]->primitives[0];
-        primitive->instanceDatas.resize(8 * INSTANCE_COUNT);
+        m_InstanceDatas.resize(8 * INSTANCE_COUNT);
+        m_InstanceOrigins.resize(INSTANCE_COUNT);
+
+        // LOD误差在Mesh空间，距离按包围球表面计算
+        m_RoleScale  = meshGlobal.GetMaximumAxisScale();
+        m_RoleRadius = (mesh->bounding.max - mesh->bounding.min).Size() * 0.5f * m_RoleScale;
         
         for (int32 i = 0; i < INSTANCE_COUNT; ++i)
         {
-            Vector3 translate;
-            translate.x = MMath::RandRange(-100.0f, 100.0f);
-            translate.y = MMath::RandRange(-100.0f, 100.0f);
-            translate.z = MMath::RandRange(-100.0f, 100.0f);
-            
             Matrix4x4 matrix = meshGlobal;
-            matrix.AppendRotation(MMath::RandRange(0.0f, 360.0f), Vector3::UpVector);
-            matrix.AppendTranslation(translate);
+            matrix.AppendRotation(m_InstanceRotations[i], Vector3::UpVector);
+            matrix.AppendTranslation(m_InstanceTranslates[i]);
             
             Quat quat   = matrix.ToQuat();
             Vector3 pos = matrix.GetOrigin();
@@ -195,28 +297,28 @@ private:
             float dw = (-0.5) * ( pos.x * quat.x + pos.y * quat.y + pos.z * quat.z);
 
             int32 index = i * 8;
-            primitive->instanceDatas[index + 0] = quat.x;
-            primitive->instanceDatas[index + 1] = quat.y;
-            primitive->instanceDatas[index + 2] = quat.z;
-            primitive->instanceDatas[index + 3] = quat.w;
-            primitive->instanceDatas[index + 4] = dx;
-            primitive->instanceDatas[index + 5] = dy;
-            primitive->instanceDatas[index + 6] = dz;
-            primitive->instanceDatas[index + 7] = dw;
+            m_InstanceDatas[index + 0] = quat.x;
+            m_InstanceDatas[index + 1] = quat.y;
+            m_InstanceDatas[index + 2] = quat.z;
+            m_InstanceDatas[index + 3] = quat.w;
+            m_InstanceDatas[index + 4] = dx;
+            m_InstanceDatas[index + 5] = dy;
+            m_InstanceDatas[index + 6] = dz;
+            m_InstanceDatas[index + 7] = dw;
+
+            m_InstanceOrigins[i] = matrix.TransformPosition(mesh->bounding.min + (mesh->bounding.max - mesh->bounding.min) * 0.5f);
         }
-        
-        primitive->indexBuffer->instanceCount = INSTANCE_COUNT;
-        primitive->instanceBuffer = vk_demo::DVKVertexBuffer::Create(m_VulkanDevice, cmdBuffer, primitive->instanceDatas, m_RoleShader->instancesAttributes);
-        
-		delete cmdBuffer;
 	}
 
 	void DestroyAssets()
 	{
-        delete m_RoleModel;
+        vkDeviceWaitIdle(m_Device);
+
+        // 模型、替身以及贴图由StreamingManager持有
+        delete m_Streaming;
+        delete m_InstanceBuffer;
         delete m_RoleShader;
         delete m_RoleMaterial;
-        delete m_RoleTexture;
 	}
 
 	void SetupCommandBuffers(int32 backBufferIndex)
@@ -263,11 +365,20 @@ private:
 			vkCmdSetScissor(commandBuffer,  0, 1, &scissor);
             
             vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_RoleMaterial->GetPipeline());
-			for (int32 i = 0; i < m_RoleModel->meshes.size(); ++i)
-			{
-                m_RoleMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, i);
-                m_RoleModel->meshes[i]->BindDrawCmd(commandBuffer);
-			}
+            m_RoleMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
+
+            vk_demo::DVKPrimitive* primitive = m_RoleModel->meshes[0]->primitives[0];
+            primitive->BindOnly(commandBuffer);
+
+            VkDeviceSize offset = 0;
+            vkCmdBindVertexBuffers(commandBuffer, 1, 1, &(m_InstanceBuffer->buffer), &offset);
+
+            for (int32 lod = 0; lod < m_LodBuckets.size(); ++lod)
+            {
+                if (m_LodBuckets[lod].size() > 0) {
+                    primitive->DrawLod(commandBuffer, lod, m_LodBuckets[lod].size(), m_LodFirstInstance[lod]);
+                }
+            }
 
 			m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
 
@@ -279,7 +390,7 @@ private:
 
 	void InitParmas()
 	{
-        vk_demo::DVKBoundingBox bounds = m_RoleModel->rootNode->GetBounds();
+        vk_demo::DVKBoundingBox bounds = m_RoleStream->GetBounds();
         Vector3 boundSize   = bounds.max - bounds.min;
         Vector3 boundCenter = bounds.min + boundSize * 0.5f;
         boundCenter.z -= boundSize.Size() * 20.0f;
@@ -307,6 +418,10 @@ private:
 
 	ModelViewProjectionBlock	m_MVPData;
 
+	vk_demo::DVKStreamingManager*	m_Streaming = nullptr;
+	vk_demo::DVKStreamingModel*		m_RoleStream = nullptr;
+	vk_demo::DVKStreamingTexture*	m_TextureStream = nullptr;
+
 	vk_demo::DVKModel*			m_RoleModel = nullptr;
 	vk_demo::DVKShader*			m_RoleShader = nullptr;
     vk_demo::DVKMaterial*       m_RoleMaterial = nullptr;
@@ -314,6 +429,21 @@ private:
     
     bool                        m_AutoSpin = false;
 
+    int32                       m_InstanceCount = INSTANCE_COUNT;
+    std::vector<float>          m_InstanceDatas;
+    std::vector<Vector3>        m_InstanceOrigins;
+    std::vector<float>          m_InstanceRotations;
+    std::vector<Vector3>        m_InstanceTranslates;
+    vk_demo::DVKBuffer*         m_InstanceBuffer = nullptr;
+
+    float                       m_RoleRadius = 0.0f;
+    float                       m_RoleScale = 1.0f;
+    float                       m_LodThreshold = 1.0f;
+    int32                       m_LodTriangles = 0;
+    std::vector<float>          m_LodInstanceDatas;
+    std::vector<int32>          m_LodFirstInstance;
+    std::vector<std::vector<int32>> m_LodBuckets;
+
 	ImageGUIContext*			m_GUI = nullptr;
 };
 
@@ -657,6 +657,7 @@ private:
 				VertexAttribute::VA_Normal
 			}
 		);
+		m_ModelScene->BuildSceneIndex();
 
 		// depth
 		m_DepthShader = vk_demo::DVKShader::Create(
@@ -802,8 +803,12 @@ private:
 			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 			vkCmdSetScissor(commandBuffer,  0, 1, &scissor);
 
+			// 只绘制在这一级阴影相机视锥内的投射物，整棵子树在视锥外时直接跳过
 			vk_demo::DVKCamera* activeCamera = &(m_CascadeCamera[cascade]);
-			for (int32 j = 0; j < m_ModelScene->meshes.size(); ++j) {
+			m_ModelScene->sceneIndex.QueryFrustum(vk_demo::DVKFrustum(activeCamera->GetViewProjection()), m_VisibleMeshes);
+
+			for (int32 i = 0; i < m_VisibleMeshes.size(); ++i) {
+				int32 j = m_VisibleMeshes[i];
 				m_MVPParam.model = m_ModelScene->meshes[j]->linkNode->GetGlobalMatrix();
 				m_MVPParam.view  = activeCamera->GetView();
 				m_MVPParam.proj  = activeCamera->GetProjection();
@@ -856,8 +861,11 @@ private:
 			m_CascadeParam.cascadeProj[i] = m_CascadeCamera[i].GetProjection();
 		}
 
-		for (int32 j = 0; j < m_ModelScene->meshes.size(); ++j) 
+		m_ModelScene->sceneIndex.QueryFrustum(vk_demo::DVKFrustum(activeCamera->GetViewProjection()), m_VisibleMeshes);
+
+		for (int32 i = 0; i < m_VisibleMeshes.size(); ++i) 
 		{
+			int32 j = m_VisibleMeshes[i];
 			m_MVPParam.model = m_ModelScene->meshes[j]->linkNode->GetGlobalMatrix();
 			m_MVPParam.view  = activeCamera->GetView();
 			m_MVPParam.proj  = activeCamera->GetProjection();
@@ -867,7 +875,7 @@ private:
 			shadowMaterial->SetLocalUniform("lightMVP",    &m_CascadeParam,     sizeof(CascadeParamBlock));
 			shadowMaterial->EndObject();
 
-			shadowMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, j);
+			shadowMaterial->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, i);
 			m_ModelScene->meshes[j]->BindDrawCmd(commandBuffer);
 		}
 
@@ -1018,6 +1026,7 @@ private:
 
 	// scene
 	vk_demo::DVKModel*			m_ModelScene = nullptr;
+	std::vector<int32>			m_VisibleMeshes;
 
 	// view
 	vk_demo::DVKCamera		    m_ViewCamera;
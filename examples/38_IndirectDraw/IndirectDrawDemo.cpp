@@ -11,6 +11,7 @@
 #define SHADOW_TEX_SIZE 2048
 #define INSTANCE_COUNT  512
 #define GROUND_RADIUS   15000.0f
+#define INSTANCE_STRIDE 10
 
 class IndirectDrawDemo : public DemoBase
 {
@@ -540,6 +541,72 @@ private:
 		}
 	}
 
+	// 每个实例按屏幕空间误差选择LOD，同一Primitive同一LOD的实例合并为一条Indirect命令
+	void UpdateIndirectCommands()
+	{
+		vk_demo::DVKLodSelector selector(m_ViewCamera.GetFov(), m_FrameHeight, m_LodThreshold);
+		Vector3 eye = m_ViewCamera.GetTransform().GetOrigin();
+
+		m_IndirectCommands.clear();
+		m_InstanceDatas.clear();
+		m_LodTriangles = 0;
+
+		for (int32 i = 0; i < m_PlantPrimitives.size(); ++i)
+		{
+			const PlantPrimitive& plant = m_PlantPrimitives[i];
+
+			m_LodBuckets.resize(MMath::Max<int32>(m_LodBuckets.size(), plant.primitive->GetLodCount()));
+			for (int32 lod = 0; lod < m_LodBuckets.size(); ++lod) {
+				m_LodBuckets[lod].clear();
+			}
+
+			for (int32 n = 0; n < INSTANCE_COUNT; ++n)
+			{
+				float distance = (m_InstanceOrigins[n] - eye).Size() - m_PlantsRadius * m_InstanceScales[n];
+				int32 lod = selector.Select(plant.primitive->lods, distance, m_InstanceScales[n]);
+				m_LodBuckets[lod].push_back(n);
+			}
+
+			for (int32 lod = 0; lod < plant.primitive->GetLodCount(); ++lod)
+			{
+				const std::vector<int32>& bucket = m_LodBuckets[lod];
+				if (bucket.empty()) {
+					continue;
+				}
+
+				VkDrawIndexedIndirectCommand indirectCommand = plant.primitive->GetLodDrawCommand(lod, bucket.size(), m_InstanceDatas.size() / INSTANCE_STRIDE);
+				indirectCommand.firstIndex  += plant.firstIndex;
+				indirectCommand.vertexOffset = plant.vertexOffset;
+				m_IndirectCommands.push_back(indirectCommand);
+
+				m_LodTriangles += indirectCommand.indexCount / 3 * bucket.size();
+
+				for (int32 n = 0; n < bucket.size(); ++n)
+				{
+					const Quat&    quat = m_InstanceRotations[bucket[n]];
+					const Vector4& pos  = m_InstancePositions[bucket[n]];
+
+					m_InstanceDatas.push_back(quat.x);
+					m_InstanceDatas.push_back(quat.y);
+					m_InstanceDatas.push_back(quat.z);
+					m_InstanceDatas.push_back(quat.w);
+
+					m_InstanceDatas.push_back(pos.x);
+					m_InstanceDatas.push_back(pos.y);
+					m_InstanceDatas.push_back(pos.z);
+					m_InstanceDatas.push_back(pos.w);
+
+					m_InstanceDatas.push_back(m_InstanceScales[bucket[n]]);
+					m_InstanceDatas.push_back(plant.layer);
+				}
+			}
+		}
+
+		// Present会等待Fence，此时GPU已经不再读取这两个Buffer
+		m_IndirectInstanceBuffer->CopyFrom(m_InstanceDatas.data(), m_InstanceDatas.size() * sizeof(float));
+		m_IndirectCmdBuffer->CopyFrom(m_IndirectCommands.data(), m_IndirectCommands.size() * sizeof(VkDrawIndexedIndirectCommand));
+	}
+
 	void Draw(float time, float delta)
 	{
 		int32 bufferIndex = DemoBase::AcquireBackbufferIndex();
@@ -552,6 +619,7 @@ private:
 		}
 
 		UpdateCascade();
+		UpdateIndirectCommands();
 
 		SetupCommandBuffers(bufferIndex);
 
@@ -585,6 +653,11 @@ private:
             
             ImGui::Separator();
 
+			// LOD
+			ImGui::SliderFloat("LOD Pixel Error", &m_LodThreshold, 0.0f, 8.0f);
+			ImGui::Text("Draws:%d Triangles:%d", (int32)m_IndirectCommands.size(), m_LodTriangles);
+			ImGui::Separator();
+
 			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
 			ImGui::End();
 		}
@@ -689,6 +762,7 @@ private:
 		m_GroundModel->rootNode->localMatrix.AppendScale(Vector3(GROUND_RADIUS, GROUND_RADIUS, GROUND_RADIUS));
 		m_GroundModel->rootNode->localMatrix.AppendRotation(270.0f, Vector3::RightVector);
 		m_GroundModel->rootNode->localMatrix.AppendTranslation(Vector3(0, -0.0f, 0));
+		m_GroundModel->rootNode->MarkDirty();
 
 		m_GroundShader = vk_demo::DVKShader::Create(
 			m_VulkanDevice,
@@ -734,17 +808,18 @@ private:
 		m_PlantsMaterial->pipelineInfo.rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 		m_PlantsMaterial->PreparePipeline();
 
+		// 生成LOD链。树是硬边法线，每个面的顶点都是独立的副本，需要允许跨法线接缝折叠。
+		m_PlantsModel->BuildLods(4, 0.5f, 0.05f, false);
+
 		// indirect
 		std::vector<float> vertices;
-		std::vector<float> instanceDatas;
 		std::vector<uint32> indices;
-		int32 objCount = 0;
-		int32 triFirst = 0;
-		m_IndirectCommands.clear();
+		int32 commandCapacity = 0;
 
-		std::vector<Vector4> instancePositions(INSTANCE_COUNT);
-		std::vector<Quat> instanceRotations(INSTANCE_COUNT);
-		std::vector<float> instanceScales(INSTANCE_COUNT);
+		m_InstanceOrigins.resize(INSTANCE_COUNT);
+		m_InstancePositions.resize(INSTANCE_COUNT);
+		m_InstanceRotations.resize(INSTANCE_COUNT);
+		m_InstanceScales.resize(INSTANCE_COUNT);
 		for (int32 i = 0; i < INSTANCE_COUNT; ++i)
 		{
 			float radius = MMath::FRandRange(0.0f, GROUND_RADIUS);
@@ -763,70 +838,64 @@ private:
 
 			float scale = 10.0f + MMath::FRandRange(0.0f, 5.0f);
 
-			instancePositions[i] = Vector4(dx, dy, dz, dw);
-			instanceRotations[i] = quat;
-			instanceScales[i]    = scale;
+			m_InstanceOrigins[i]   = pos;
+			m_InstancePositions[i] = Vector4(dx, dy, dz, dw);
+			m_InstanceRotations[i] = quat;
+			m_InstanceScales[i]    = scale;
+		}
+
+		// 所有Mesh的包围球，用于计算实例到相机的距离
+		vk_demo::DVKBoundingBox bounds;
+		bounds.min.Set( MAX_flt,  MAX_flt,  MAX_flt);
+		bounds.max.Set(-MAX_flt, -MAX_flt, -MAX_flt);
+		for (int32 i = 0; i < m_PlantsModel->meshes.size(); ++i)
+		{
+			bounds.min = Vector3::Min(bounds.min, m_PlantsModel->meshes[i]->bounding.min);
+			bounds.max = Vector3::Max(bounds.max, m_PlantsModel->meshes[i]->bounding.max);
 		}
+		m_PlantsRadius = ((bounds.max + bounds.min) * 0.5f).Size() + (bounds.max - bounds.min).Size() * 0.5f;
 
-		// 准备Buffer
+		// 准备Buffer，每个Primitive的所有LOD索引连续存放，通过vertexOffset共用顶点
 		for (int32 i = 0; i < m_PlantsModel->meshes.size(); ++i)
 		{
 			for (int32 p = 0; p < m_PlantsModel->meshes[i]->primitives.size(); ++p)
 			{
 				vk_demo::DVKPrimitive* primitive = m_PlantsModel->meshes[i]->primitives[p];
 
-				// vertices
-				for (int32 n = 0; n < primitive->vertices.size(); ++n) {
-					vertices.push_back(primitive->vertices[n]);
-				}
-
-				// indices
-				for (int32 n = 0; n < primitive->indices.size(); ++n) {
-					indices.push_back(primitive->indices[n] + triFirst);
-				}
+				PlantPrimitive plant;
+				plant.primitive    = primitive;
+				plant.firstIndex   = indices.size();
+				plant.vertexOffset = vertices.size() / (primitive->vertices.size() / primitive->vertexCount);
+				plant.layer        = i;
+				m_PlantPrimitives.push_back(plant);
 
-				// instance
-				for (int32 n = 0; n < INSTANCE_COUNT; ++n)
-				{
-					Quat quat   = instanceRotations[n];
-					Vector4 pos = instancePositions[n];
+				vertices.insert(vertices.end(), primitive->vertices.begin(), primitive->vertices.end());
+				indices.insert(indices.end(), primitive->indices.begin(), primitive->indices.end());
+				indices.insert(indices.end(), primitive->lodIndices.begin(), primitive->lodIndices.end());
 
-					instanceDatas.push_back(quat.x);
-					instanceDatas.push_back(quat.y);
-					instanceDatas.push_back(quat.z);
-					instanceDatas.push_back(quat.w);
-
-					instanceDatas.push_back(pos.x);
-					instanceDatas.push_back(pos.y);
-					instanceDatas.push_back(pos.z);
-					instanceDatas.push_back(pos.w);
-
-					instanceDatas.push_back(instanceScales[n]);
-					instanceDatas.push_back(i);
-				}
-
-				VkDrawIndexedIndirectCommand indirectCommand = {};
-				indirectCommand.instanceCount = INSTANCE_COUNT;
-				indirectCommand.firstInstance = INSTANCE_COUNT * objCount;
-				indirectCommand.firstIndex    = triFirst;
-				indirectCommand.indexCount    = primitive->triangleNum * 3;
-				m_IndirectCommands.push_back(indirectCommand);
-
-				objCount += 1;
-				triFirst += indirectCommand.indexCount;
+				commandCapacity += primitive->GetLodCount();
 			}
 		}
+
+		// 实例数据和Indirect命令每帧按LOD重新分组，放在HostVisible的Buffer中
+		m_IndirectInstanceBuffer = vk_demo::DVKBuffer::CreateBuffer(
+			m_VulkanDevice,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			m_PlantPrimitives.size() * INSTANCE_COUNT * INSTANCE_STRIDE * sizeof(float)
+		);
+		m_IndirectInstanceBuffer->Map();
+
+		m_IndirectCmdBuffer = vk_demo::DVKBuffer::CreateBuffer(
+			m_VulkanDevice,
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			commandCapacity * sizeof(VkDrawIndexedIndirectCommand)
+		);
+		m_IndirectCmdBuffer->Map();
 		
 		// 创建上传Buffer
 		{
-			vk_demo::DVKBuffer* instanceStagingBuffer = vk_demo::DVKBuffer::CreateBuffer(
-				m_VulkanDevice,
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				instanceDatas.size() * sizeof(float),
-				instanceDatas.data()
-			);
-
 			vk_demo::DVKBuffer* vertStagingBuffer = vk_demo::DVKBuffer::CreateBuffer(
 				m_VulkanDevice,
 				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
@@ -843,14 +912,6 @@ private:
 				indices.data()
 			);
 
-			vk_demo::DVKBuffer* cmdStagingBuffer = vk_demo::DVKBuffer::CreateBuffer(
-				m_VulkanDevice,
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				m_IndirectCommands.size() * sizeof(VkDrawIndexedIndirectCommand),
-				m_IndirectCommands.data()
-			);
-
 			m_IndirectVertexBuffer = vk_demo::DVKBuffer::CreateBuffer(
 				m_VulkanDevice,
 				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
@@ -858,13 +919,6 @@ private:
 				vertStagingBuffer->size
 			);
 
-			m_IndirectInstanceBuffer = vk_demo::DVKBuffer::CreateBuffer(
-				m_VulkanDevice,
-				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				instanceStagingBuffer->size
-			);
-
 			m_IndirectIndexBuffer = vk_demo::DVKBuffer::CreateBuffer(
 				m_VulkanDevice,
 				VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
@@ -872,13 +926,6 @@ private:
 				indexStagingBuffer->size
 			);
 
-			m_IndirectCmdBuffer = vk_demo::DVKBuffer::CreateBuffer(
-				m_VulkanDevice,
-				VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				cmdStagingBuffer->size
-			);
-
 			cmdBuffer->Begin();
 
 			VkBufferCopy copyRegion = {};
@@ -886,24 +933,18 @@ private:
 			copyRegion.size = vertices.size() * sizeof(float);
 			vkCmdCopyBuffer(cmdBuffer->cmdBuffer, vertStagingBuffer->buffer, m_IndirectVertexBuffer->buffer, 1, &copyRegion);
 
-			copyRegion.size = instanceDatas.size() * sizeof(float);
-			vkCmdCopyBuffer(cmdBuffer->cmdBuffer, instanceStagingBuffer->buffer, m_IndirectInstanceBuffer->buffer, 1, &copyRegion);
-			
 			copyRegion.size = indices.size() * sizeof(uint32),
 			vkCmdCopyBuffer(cmdBuffer->cmdBuffer, indexStagingBuffer->buffer, m_IndirectIndexBuffer->buffer, 1, &copyRegion);
 
-			copyRegion.size = m_IndirectCommands.size() * sizeof(VkDrawIndexedIndirectCommand),
-			vkCmdCopyBuffer(cmdBuffer->cmdBuffer, cmdStagingBuffer->buffer, m_IndirectCmdBuffer->buffer, 1, &copyRegion);
-
 			cmdBuffer->End();
 			cmdBuffer->Submit();
 
 			delete vertStagingBuffer;
-			delete instanceStagingBuffer;
 			delete indexStagingBuffer;
-			delete cmdStagingBuffer;
 		}
 
+		UpdateIndirectCommands();
+
 		delete cmdBuffer;
 	}
 
@@ -1217,6 +1258,14 @@ private:
 	typedef std::vector<std::vector<vk_demo::DVKMesh*>> MatMeshArray;
 	typedef std::vector<VkDrawIndexedIndirectCommand>   IndirectCommandArray;
 
+	struct PlantPrimitive
+	{
+		vk_demo::DVKPrimitive*	primitive = nullptr;
+		int32					firstIndex = 0;
+		int32					vertexOffset = 0;
+		float					layer = 0.0f;
+	};
+
 	bool 						m_Ready = false;
 
     // Debug
@@ -1248,6 +1297,18 @@ private:
 	vk_demo::DVKShader*			m_PlantsShader = nullptr;
 	vk_demo::DVKMaterial*		m_PlantsMaterial = nullptr;
 
+	std::vector<PlantPrimitive>	m_PlantPrimitives;
+	float						m_PlantsRadius = 0.0f;
+	float						m_LodThreshold = 1.0f;
+	int32						m_LodTriangles = 0;
+	std::vector<std::vector<int32>>	m_LodBuckets;
+
+	std::vector<Vector3>		m_InstanceOrigins;
+	std::vector<Vector4>		m_InstancePositions;
+	std::vector<Quat>			m_InstanceRotations;
+	std::vector<float>			m_InstanceScales;
+	std::vector<float>			m_InstanceDatas;
+
 	IndirectCommandArray		m_IndirectCommands;
 	vk_demo::DVKBuffer*			m_IndirectCmdBuffer = nullptr;
 	vk_demo::DVKBuffer*			m_IndirectVertexBuffer = nullptr;
@@ -147,6 +147,7 @@ private:
 		);
 		m_ModelGround->rootNode->localMatrix.AppendRotation(270.0f, Vector3::RightVector);
 		m_ModelGround->rootNode->localMatrix.AppendScale(Vector3(500, 500, 500));
+		m_ModelGround->rootNode->MarkDirty();
 
 		vk_demo::DVKBoundingBox bounds = m_ModelSphere->rootNode->GetBounds();
 		Vector3 boundSize   = bounds.max - bounds.min;
@@ -155,6 +156,7 @@ private:
 		m_SphereRadius = boundSize.Size();
 
 		m_ModelSphere->rootNode->localMatrix.AppendTranslation(Vector3(0, 19.73f, 0));
+		m_ModelSphere->rootNode->MarkDirty();
 
 		for (int32 i = 0; i < OBJECT_COUNT; ++i)
 		{
@@ -325,6 +325,7 @@ private:
 			}
 		);
 		m_ModelPlane->rootNode->localMatrix.AppendScale(Vector3(2, 1, 1));
+		m_ModelPlane->rootNode->MarkDirty();
 
 		m_Texture = vk_demo::DVKTexture::Create2D(
 			"assets/textures/game0.jpg", 
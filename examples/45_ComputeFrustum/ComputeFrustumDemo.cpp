@@ -2,6 +2,8 @@
 #include "Common/Log.h"
 
 #include "Demo/DVKCommon.h"
+#include "Demo/DVKCulling.h"
+#include "Demo/DVKJobPool.h"
 
 #include "Math/Vector4.h"
 #include "Math/Matrix4x4.h"
@@ -91,6 +93,9 @@ private:
 		if (m_UseGPU) {
 			SetupComputeCommand();
 		}
+		else {
+			m_CullingSet.Cull(m_Frustum, m_VisibleList, m_JobPool);
+		}
         
 		SetupGfxCommand(bufferIndex);
 
@@ -154,6 +159,13 @@ private:
 			));
 		}
 
+		// CPU剔除使用的包围球
+		m_CullingSet.Reserve(OBJECT_COUNT);
+		for (int32 i = 0; i < OBJECT_COUNT; ++i) {
+			m_CullingSet.AddSphere(m_ObjModels[i].GetOrigin(), m_Radius);
+		}
+		m_JobPool = vk_demo::DVKJobPool::Create();
+
 		m_Shader = vk_demo::DVKShader::Create(
 			m_VulkanDevice,
 			true,
@@ -233,6 +245,7 @@ private:
 
 	void DestroyAssets()
 	{
+		delete m_JobPool;
 		delete m_ModelSphere;
 
         delete m_MatrixBuffer;
@@ -246,59 +259,49 @@ private:
         delete m_ComputeCommand;
 	}
     
-	bool IsInFrustum(int32 index)
+	void RenderSpheres(VkCommandBuffer commandBuffer, vk_demo::DVKCamera& camera)
 	{
+		m_Material->BeginFrame();
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Material->GetPipeline());
+		m_ModelSphere->meshes[0]->BindOnly(commandBuffer);
+		
+		int32 count = 0;
 		if (m_UseGPU)
 		{
 			Vector4* cullData = (Vector4*)m_CullingBuffer->mapped;
-			return cullData[index].x > 0.0f;
+			for (int32 i = 0; i < OBJECT_COUNT; ++i)
+			{
+				if (cullData[i].x > 0.0f) {
+					RenderSphere(commandBuffer, camera, i, count);
+				}
+			}
 		}
 		else
 		{
-			Vector3 pos = m_ObjModels[index].GetOrigin();
-
-			for (int32 i = 0; i < 6; ++i) 
-			{
-				Vector4& plane = m_FrustumParam.frustumPlanes[i];
-				float projDist = (plane.x * pos.x) + (plane.y * pos.y) + (plane.z * pos.z) + plane.w + m_Radius;
-				if (projDist <= 0) {
-					return false;
-				}
+			for (int32 i = 0; i < m_VisibleList.size(); ++i) {
+				RenderSphere(commandBuffer, camera, m_VisibleList[i], count);
 			}
-
-			return true;
 		}
+
+		m_Material->EndFrame();
 	}
 
-	void RenderSpheres(VkCommandBuffer commandBuffer, vk_demo::DVKCamera& camera)
+	void RenderSphere(VkCommandBuffer commandBuffer, vk_demo::DVKCamera& camera, int32 index, int32& count)
 	{
-		m_Material->BeginFrame();
+		m_MVPParam.model = m_ObjModels[index];
+		m_MVPParam.view  = camera.GetView();
+		m_MVPParam.proj  = camera.GetProjection();
 
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Material->GetPipeline());
-		m_ModelSphere->meshes[0]->BindOnly(commandBuffer);
-		
-		int32 count = 0;
-		for (int32 i = 0; i < OBJECT_COUNT; ++i)
-		{
-			if (IsInFrustum(i)) 
-			{
-				m_MVPParam.model = m_ObjModels[i];
-				m_MVPParam.view  = camera.GetView();
-				m_MVPParam.proj  = camera.GetProjection();
-
-				m_Material->BeginObject();
-				m_Material->SetLocalUniform("uboMVP",      &m_MVPParam,         sizeof(ModelViewProjectionBlock));
-				m_Material->EndObject();
+		m_Material->BeginObject();
+		m_Material->SetLocalUniform("uboMVP",      &m_MVPParam,         sizeof(ModelViewProjectionBlock));
+		m_Material->EndObject();
 
-				m_Material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, count);
-				m_ModelSphere->meshes[0]->DrawOnly(commandBuffer);
-
-				count++;
-				m_DrawCall += 1;
-			}
-		}
+		m_Material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, count);
+		m_ModelSphere->meshes[0]->DrawOnly(commandBuffer);
 
-		m_Material->EndFrame();
+		count++;
+		m_DrawCall += 1;
 	}
 
     void SetupComputeCommand()
@@ -380,51 +383,9 @@ private:
 	{
 		Matrix4x4 matrix = m_ViewCamera.GetViewProjection();
         
-        Vector4* frustumPlanes = &(m_FrustumParam.frustumPlanes[0]);
-        
-		// left
-		frustumPlanes[0].x = matrix.m[0][3] + matrix.m[0][0];
-		frustumPlanes[0].y = matrix.m[1][3] + matrix.m[1][0];
-		frustumPlanes[0].z = matrix.m[2][3] + matrix.m[2][0];
-		frustumPlanes[0].w = matrix.m[3][3] + matrix.m[3][0];
-
-		// right
-		frustumPlanes[1].x = matrix.m[0][3] - matrix.m[0][0];
-		frustumPlanes[1].y = matrix.m[1][3] - matrix.m[1][0];
-		frustumPlanes[1].z = matrix.m[2][3] - matrix.m[2][0];
-		frustumPlanes[1].w = matrix.m[3][3] - matrix.m[3][0];
-
-		// top
-		frustumPlanes[2].x = matrix.m[0][3] + matrix.m[0][1];
-		frustumPlanes[2].y = matrix.m[1][3] + matrix.m[1][1];
-		frustumPlanes[2].z = matrix.m[2][3] + matrix.m[2][1];
-		frustumPlanes[2].w = matrix.m[3][3] + matrix.m[3][1];
-
-		// bottom
-		frustumPlanes[3].x = matrix.m[0][3] - matrix.m[0][1];
-		frustumPlanes[3].y = matrix.m[1][3] - matrix.m[1][1];
-		frustumPlanes[3].z = matrix.m[2][3] - matrix.m[2][1];
-		frustumPlanes[3].w = matrix.m[3][3] - matrix.m[3][1];
-
-		// near
-		frustumPlanes[4].x = matrix.m[0][2];
-		frustumPlanes[4].y = matrix.m[1][2];
-		frustumPlanes[4].z = matrix.m[2][2];
-		frustumPlanes[4].w = matrix.m[3][2];
-
-		// far
-		frustumPlanes[5].x = matrix.m[0][3] - matrix.m[0][2];
-		frustumPlanes[5].y = matrix.m[1][3] - matrix.m[1][2];
-		frustumPlanes[5].z = matrix.m[2][3] - matrix.m[2][2];
-		frustumPlanes[5].w = matrix.m[3][3] - matrix.m[3][2];
-
-		for (auto i = 0; i < 6; i++)
-		{
-			float length = MMath::Sqrt(frustumPlanes[i].x * frustumPlanes[i].x + frustumPlanes[i].y * frustumPlanes[i].y + frustumPlanes[i].z * frustumPlanes[i].z);
-			frustumPlanes[i].x /= length;
-			frustumPlanes[i].y /= length;
-			frustumPlanes[i].z /= length;
-			frustumPlanes[i].w /= length;
+		m_Frustum.FromMatrix(matrix);
+		for (int32 i = 0; i < 6; ++i) {
+			m_FrustumParam.frustumPlanes[i] = m_Frustum.planes[i];
 		}
 	}
 
@@ -473,6 +434,10 @@ private:
 	vk_demo::DVKCamera			    m_TopCamera;
     
     FrustumParamBlock               m_FrustumParam;
+	vk_demo::DVKFrustum				m_Frustum;
+	vk_demo::DVKCullingSet			m_CullingSet;
+	std::vector<uint32>				m_VisibleList;
+	vk_demo::DVKJobPool*			m_JobPool = nullptr;
     vk_demo::DVKShader*             m_ComputeShader = nullptr;
     vk_demo::DVKCompute*   m_ComputeProcessor = nullptr;
     vk_demo::DVKCommandBuffer*      m_ComputeCommand = nullptr;
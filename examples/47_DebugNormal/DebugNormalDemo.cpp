@@ -117,6 +117,7 @@ private:
 			}
 		);
 		m_Model->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
+		m_Model->rootNode->MarkDirty();
 
 		m_Shader = vk_demo::DVKShader::Create(
 			m_VulkanDevice,
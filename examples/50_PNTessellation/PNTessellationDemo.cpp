@@ -126,6 +126,7 @@ private:
 			}
 		);
 		m_Model->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
+		m_Model->rootNode->MarkDirty();
 
 		m_Shader = vk_demo::DVKShader::Create(
 			m_VulkanDevice,
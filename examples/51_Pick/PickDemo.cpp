@@ -154,52 +154,6 @@ private:
 		return hovered;
 	}
 
-	bool IntersectTriangle(const Vector3& orig, const Vector3& dir, Vector3& v0, Vector3& v1, Vector3& v2, float* t, float* u, float* v)
-	{
-		Vector3 edge1 = v1 - v0;
-		Vector3 edge2 = v2 - v0;
-
-		Vector3 pvec = Vector3::CrossProduct(dir, edge2);
-
-		float det = Vector3::DotProduct(edge1, pvec);
-
-		Vector3 tvec;
-		if (det > 0) 
-		{
-			tvec = orig - v0;
-		}
-		else
-		{
-			tvec = v0 - orig;
-			det = -det;
-		}
-
-		if (det < 0.0001f) {
-			return false;
-		}
-		
-		*u = Vector3::DotProduct(tvec, pvec);
-		if (*u < 0.0f || *u > det) {
-			return false;
-		}
-		
-		Vector3 qvec = Vector3::CrossProduct(tvec, edge1);
-
-		*v = Vector3::DotProduct(dir, qvec);
-		if (*v < 0.0f || *u + *v > det) {
-			return false;
-		}
-		
-		*t = Vector3::DotProduct(edge2, qvec);
-
-		float fInvDet = 1.0f / det;
-		*t *= fInvDet;
-		*u *= fInvDet;
-		*v *= fInvDet;
-
-		return true;
-	}
-
 	void UpdateLine(float time, float delta)
 	{
 		Matrix4x4 invProj = m_ViewCamera.GetProjection();
@@ -231,16 +185,13 @@ private:
 		Vector3 v1;
 		Vector3 v2;
 		float dist = MAX_flt;
-		float t = 0;
-		float u = 0;
-		float v = 0;
 
 		bool found = false;
 		Vector3 triV0;
 		Vector3 triV1;
 		Vector3 triV2;
 
-		// collision test
+		// collision test，每个Primitive的BVH只访问射线经过的节点
 		for (int32 meshID = 0; meshID < m_Model->meshes.size(); ++meshID)
 		{
 			auto mesh = m_Model->meshes[meshID];
@@ -249,29 +200,24 @@ private:
 				auto pritimive = mesh->primitives[primitiveID];
 				int32 stride   = pritimive->vertices.size() / pritimive->vertexCount;
 
-				// test per triangle
-				for (int32 idx = 0; idx < pritimive->indices.size(); idx += 3)
-				{
-					int32 index0 = pritimive->indices[idx + 0] * stride;
-					int32 index1 = pritimive->indices[idx + 1] * stride;
-					int32 index2 = pritimive->indices[idx + 2] * stride;
-
-					v0.Set(pritimive->vertices[index0 + 0], pritimive->vertices[index0 + 1], pritimive->vertices[index0 + 2]);
-					v1.Set(pritimive->vertices[index1 + 0], pritimive->vertices[index1 + 1], pritimive->vertices[index1 + 2]);
-					v2.Set(pritimive->vertices[index2 + 0], pritimive->vertices[index2 + 1], pritimive->vertices[index2 + 2]);
-
-					if (IntersectTriangle(pos, ray, v0, v1, v2, &t, &u, &v))
-					{
-						if (t <= dist)
-						{
-							dist  = t;
-							found = true;
-							triV0 = v0;
-							triV1 = v1;
-							triV2 = v2;
-						}
-					}
+				vk_demo::DVKTriangleHit hit;
+				if (!pritimive->triangleBVH.RayCast(pos, ray, dist, hit)) {
+					continue;
 				}
+
+				int32 index0 = pritimive->indices[hit.triangle * 3 + 0] * stride;
+				int32 index1 = pritimive->indices[hit.triangle * 3 + 1] * stride;
+				int32 index2 = pritimive->indices[hit.triangle * 3 + 2] * stride;
+
+				v0.Set(pritimive->vertices[index0 + 0], pritimive->vertices[index0 + 1], pritimive->vertices[index0 + 2]);
+				v1.Set(pritimive->vertices[index1 + 0], pritimive->vertices[index1 + 1], pritimive->vertices[index1 + 2]);
+				v2.Set(pritimive->vertices[index2 + 0], pritimive->vertices[index2 + 1], pritimive->vertices[index2 + 2]);
+
+				dist  = hit.distance;
+				found = true;
+				triV0 = v0;
+				triV1 = v1;
+				triV2 = v2;
 			}
 		}
 
@@ -306,6 +252,7 @@ private:
 				VertexAttribute::VA_Normal
 			}
 		);
+		m_Model->BuildTriangleBVHs();
 
 		m_Shader = vk_demo::DVKShader::Create(
 			m_VulkanDevice,
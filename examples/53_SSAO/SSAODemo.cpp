@@ -184,6 +184,7 @@ private:
 			}
 		);
 		m_SceneModel->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
+		m_SceneModel->rootNode->MarkDirty();
 
 		m_SceneShader = vk_demo::DVKShader::Create(
 			m_VulkanDevice,
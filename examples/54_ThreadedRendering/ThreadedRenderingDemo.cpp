@@ -2,10 +2,15 @@
 #include "Common/Log.h"
 
 #include "Demo/DVKCommon.h"
+#include "Demo/MemoryStatsRecorder.h"
+#include "Demo/DVKSkinning.h"
+#include "Demo/DVKJobPool.h"
 
 #include "Math/Vector4.h"
 #include "Math/Matrix4x4.h"
 
+#include "GenericPlatform/GenericPlatformTime.h"
+
 #include <functional>
 #include <vector>
 #include <thread>
@@ -38,8 +43,6 @@ struct ModelViewProjectionBlock
 	Matrix4x4 proj;
 };
 
-std::mutex writeMutex;
-
 class ParticleModel
 {
 public:
@@ -54,7 +57,7 @@ public:
 
 	}
 
-	void Draw(VkCommandBuffer commandBuffer, vk_demo::DVKCamera& camera)
+	void Draw(VkCommandBuffer commandBuffer, vk_demo::DVKCamera& camera, vk_demo::DVKMaterialContext& context)
 	{
 		vk_demo::DVKPrimitive* primitive = m_Model->meshes[0]->primitives[0];
 
@@ -64,20 +67,11 @@ public:
 		m_MVPParam.view  = camera.GetView();
 		m_MVPParam.proj  = camera.GetProjection();
 
-		{
-			std::lock_guard<std::mutex> lockGuard(writeMutex);
-
-			m_Material->BeginFrame();
-
-			m_Material->BeginObject();
-			m_Material->SetLocalUniform("uboMVP",		&m_MVPParam,		sizeof(ModelViewProjectionBlock));
-			m_Material->SetLocalUniform("uboTransform", &m_InstanceData,	sizeof(InstanceData));
-			m_Material->EndObject();
-
-			m_Material->EndFrame();
-
-			m_Material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
-		}
+		// 每个线程使用自己的context，不再需要全局锁
+		m_Material->BeginObject(context);
+		m_Material->SetLocalUniform(context, "uboMVP",		&m_MVPParam,		sizeof(ModelViewProjectionBlock));
+		m_Material->SetLocalUniform(context, "uboTransform", &m_InstanceData,	sizeof(InstanceData));
+		m_Material->BindDescriptorSets(context, commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
 		
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &(primitive->vertexBuffer->dvkBuffer->buffer), &(primitive->vertexBuffer->offset));
 		vkCmdBindVertexBuffers(commandBuffer, 1, 1, &(primitive->instanceBuffer->dvkBuffer->buffer), &(primitive->instanceBuffer->offset));
@@ -86,7 +80,7 @@ public:
 		
 	}
 
-	void Update(std::vector<Matrix4x4>& bonesData, vk_demo::DVKCamera& camera, float time, float delta)
+	void Update(const vk_demo::DVKSkinVertices& skinVertices, vk_demo::DVKCamera& camera, float time, float delta)
 	{
 		// ring buffer
 		if (m_UpdateIndex + m_Count > m_Model->meshes[0]->primitives[0]->indexBuffer->instanceCount) {
@@ -113,38 +107,12 @@ public:
 			m_InstanceData.transforms[index] = matrix;
 		}
 
-		// init particle
-		vk_demo::DVKPrimitive* primitive = m_Template->meshes[0]->primitives[0];
-		int32 stride    = primitive->vertices.size() / primitive->vertexCount;
-		int32 vertBegin = m_BaseIndex * stride;
-		int32 vertEnd   = (m_BaseIndex + m_Count) * stride;
-		int32 objIndex  = m_UpdateIndex;
+		// init particle，顶点已经在UpdateAnimation中蒙皮完成
+		int32 objIndex = m_UpdateIndex;
 
-		for (int32 index = vertBegin; index < vertEnd; index += stride)
+		for (int32 index = m_BaseIndex; index < m_BaseIndex + m_Count; ++index)
 		{
-			Vector3 position(
-				primitive->vertices[index + 0],
-				primitive->vertices[index + 1],
-				primitive->vertices[index + 2]
-			);
-			IntVector4 skinIndices(
-				primitive->vertices[index + 6],
-				primitive->vertices[index + 7],
-				primitive->vertices[index + 8],
-				primitive->vertices[index + 9]
-			);
-			Vector4 skinWeights(
-				primitive->vertices[index + 10],
-				primitive->vertices[index + 11],
-				primitive->vertices[index + 12],
-				primitive->vertices[index + 13]
-			);
-
-			Vector3 finalPos = 
-				bonesData[skinIndices.x].TransformPosition(position) * skinWeights.x + 
-				bonesData[skinIndices.y].TransformPosition(position) * skinWeights.y + 
-				bonesData[skinIndices.z].TransformPosition(position) * skinWeights.z + 
-				bonesData[skinIndices.w].TransformPosition(position) * skinWeights.w;
+			Vector3 finalPos = skinVertices.GetPosition(index);
 
 			Matrix4x4 matrix;
 			matrix.SetPosition(finalPos);
@@ -184,7 +152,7 @@ struct ThreadData
 	int32 index;
 	int32 frameID;
 	VkCommandPool commandPool;
-	std::vector<ParticleModel*> particles;
+	vk_demo::DVKMaterialContext materialContext;
 	std::vector<vk_demo::DVKCommandBuffer*> threadCommandBuffers;
 };
 
@@ -284,6 +252,18 @@ private:
 
 		UpdateAnimation(time, delta);
 
+		// UI可能修改线程数，本帧的工作线程和SetupCommandBuffers都使用这份快照
+		m_FrameThreads = m_ActiveThreads;
+
+		// 多线程录制之前预留好RingBuffer空间，录制过程中不能扩容；之后再BeginFrame，保证DescriptorSet指向最新的Buffer
+		vk_demo::DVKRingBuffer* ringBuffer = vk_demo::DVKMaterial::GetRingBuffer();
+		uint64 uniformSize = Align<uint64>(sizeof(ModelViewProjectionBlock), ringBuffer->GetMinAlignment()) + Align<uint64>(sizeof(InstanceData), ringBuffer->GetMinAlignment());
+		ringBuffer->Reserve(uniformSize * m_Particles.size() * 5 / 4 + ringBuffer->GetChunkSize() * m_FrameThreads);
+
+		m_ParticleMaterial->BeginFrame();
+
+		double recordStart = GenericPlatformTime::Seconds();
+
 		// notify fram start
 		{
 			std::lock_guard<std::mutex> lockGuard(m_FrameStartLock);
@@ -300,6 +280,11 @@ private:
 			}
 		}
 
+		m_ParticleMaterial->EndFrame();
+
+		float recordTime = (GenericPlatformTime::Seconds() - recordStart) * 1000.0f;
+		m_RecordTime = m_RecordTime * 0.95f + recordTime * 0.05f;
+
 		SetupCommandBuffers(bufferIndex);
 
 		DemoBase::Present(bufferIndex);
@@ -314,10 +299,47 @@ private:
 			ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
 			ImGui::Begin("ThreadedRenderingDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
 
+			ImGui::SliderInt("Threads", &m_ActiveThreads, 1, m_Threads.size());
+			ImGui::Text("Record %.3f ms", m_RecordTime);
+
 			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
+
+			ImGui::Checkbox("Memory Stats", &m_ShowMemoryStats);
+			if (ImGui::Checkbox("Record Memory CSV", &m_RecordMemoryStats))
+			{
+				if (m_RecordMemoryStats) {
+					m_RecordMemoryStats = m_MemoryStatsRecorder.Open("MemoryStats.csv");
+				}
+				else {
+					m_MemoryStatsRecorder.Close();
+				}
+			}
+			if (ImGui::Checkbox("Record Memory JSON", &m_RecordMemoryJSON))
+			{
+				if (m_RecordMemoryJSON) {
+					m_RecordMemoryJSON = m_MemoryJSONRecorder.Open("MemoryStats.json");
+				}
+				else {
+					m_MemoryJSONRecorder.Close();
+				}
+			}
+
 			ImGui::End();
 		}
 
+		if (m_ShowMemoryStats || m_MemoryStatsRecorder.IsOpen() || m_MemoryJSONRecorder.IsOpen())
+		{
+			VulkanResourceHeapManager& heapManager = m_VulkanDevice->GetResourceHeapManager();
+			VulkanMemoryStats memoryStats;
+			heapManager.GetStats(memoryStats);
+
+			if (m_ShowMemoryStats) {
+				m_GUI->ShowMemoryStats(memoryStats);
+			}
+			m_MemoryStatsRecorder.Record(heapManager.GetFrameCounter(), memoryStats);
+			m_MemoryJSONRecorder.Record(heapManager.GetFrameCounter(), memoryStats);
+		}
+
 		bool hovered = ImGui::IsAnyWindowHovered() || ImGui::IsAnyItemHovered() || ImGui::IsRootWindowOrAnyChildHovered();
 
 		m_GUI->EndFrame();
@@ -330,12 +352,9 @@ private:
 	{
 		m_RoleModel->Update(time, delta);
 
-		vk_demo::DVKMesh* mesh = m_RoleModel->meshes[0];
-		for (int32 i = 0; i < mesh->bones.size(); ++i)
-		{
-			int32 index = mesh->bones[i];
-			m_BonesData[index] = m_RoleModel->bones[index]->finalTransform;
-		}
+		// 整个网格一次蒙皮，粒子只读取结果
+		vk_demo::DVKSkinning::BuildPalette(m_RoleModel, m_RoleModel->meshes[0], m_BonesData);
+		vk_demo::DVKSkinning::Skin(m_SkinSource, m_BonesData.data(), m_SkinVertices, m_SkinJobPool);
 	}
 
 	void LoadAnimModel()
@@ -353,7 +372,10 @@ private:
 		);
 
 		m_RoleModel->SetAnimation(0);
-		m_BonesData.resize(m_RoleModel->meshes[0]->bones.size());
+
+		vk_demo::DVKMesh* mesh = m_RoleModel->meshes[0];
+		vk_demo::DVKSkinSource::Build(m_RoleModel->attributes, mesh, mesh->primitives[0], m_SkinSource);
+		m_SkinJobPool = vk_demo::DVKJobPool::Create();
 	}
 
 	void LoadAssets()
@@ -439,6 +461,7 @@ private:
 		vkQueueWaitIdle(m_VulkanDevice->GetPresentQueue()->GetHandle());
 		m_FrameStartCV.notify_all();
 
+		delete m_SkinJobPool;
 		delete m_RoleModel;
 		delete m_ParticleModel;
 		delete m_ParticleShader;
@@ -523,7 +546,7 @@ private:
 
 		RenderUI(cmdBufferInheritanceInfo, backBufferIndex);
 
-		for (int32 i = 0; i < m_ThreadDatas.size(); ++i) {
+		for (int32 i = 0; i < m_FrameThreads; ++i) {
 			vkCmdExecuteCommands(commandBuffer, 1, &(m_ThreadDatas[i]->threadCommandBuffers[backBufferIndex]->cmdBuffer));
 		}
 		vkCmdExecuteCommands(commandBuffer, 1, &(m_UICommandBuffers[backBufferIndex]->cmdBuffer));
@@ -620,10 +643,8 @@ private:
 		// thread task
 		m_MainFrameID      = 0;
 		m_ThreadRunning    = true;
-
-		perThread = m_Particles.size() / numThreads;
-		remainNum = m_Particles.size() - perThread * numThreads;
-		dataIndex = 0;
+		m_ActiveThreads    = numThreads;
+		m_FrameThreads     = numThreads;
 
 		m_ThreadDatas.resize(numThreads);
 		m_Threads.resize(numThreads);
@@ -633,16 +654,6 @@ private:
 			// prepare thread data
 			m_ThreadDatas[i] = new ThreadData();
 
-			// thread particles
-			int32 count = remainNum > 0 ? perThread + 1 : perThread;
-			remainNum -= 1;
-
-			for (int32 index = dataIndex; index < dataIndex + count; ++index) {
-				m_ThreadDatas[i]->particles.push_back(m_Particles[index]);
-			}
-
-			dataIndex += count;
-
 			// command pool per thread
 			VkCommandPoolCreateInfo cmdPoolInfo;
 			ZeroVulkanStruct(cmdPoolInfo, VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO);
@@ -684,9 +695,18 @@ private:
 				break;
 			}
 
-			// update particles
-			for (int32 i = 0; i < threadData->particles.size(); ++i) {
-				threadData->particles[i]->Update(m_BonesData, m_ViewCamera, m_FrameTime, m_FrameDelta);
+			// 未启用的线程直接结束
+			if (threadData->index >= m_FrameThreads)
+			{
+				std::lock_guard<std::mutex> lockGuard(m_ThreadDoneLock);
+				m_ThreadDoneCount  += 1;
+				m_ThreadDoneCV.notify_one();
+				continue;
+			}
+
+			// update particles，按启用的线程数交错分配
+			for (int32 i = threadData->index; i < m_Particles.size(); i += m_FrameThreads) {
+				m_Particles[i]->Update(m_SkinVertices, m_ViewCamera, m_FrameTime, m_FrameDelta);
 			}
 
 			// record commands
@@ -726,8 +746,8 @@ private:
 			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-			for (int32 i = 0; i < threadData->particles.size(); ++i) {
-				threadData->particles[i]->Draw(commandBuffer, m_ViewCamera);
+			for (int32 i = threadData->index; i < m_Particles.size(); i += m_FrameThreads) {
+				m_Particles[i]->Draw(commandBuffer, m_ViewCamera, threadData->materialContext);
 			}
 
 			VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
@@ -740,10 +760,7 @@ private:
 			}
 		}
 
-		{
-			std::lock_guard<std::mutex> lockGuard(writeMutex);
-			MLOG("Thread exist -> index = %d", threadData->index);
-		}
+		MLOG("Thread exist -> index = %d", threadData->index);
 	}
 
 	void CreateGUI()
@@ -785,18 +802,30 @@ private:
 
 	ModelViewProjectionBlock	m_MVPParam;
 	std::vector<Matrix4x4>		m_BonesData;
+	vk_demo::DVKSkinSource		m_SkinSource;
+	vk_demo::DVKSkinVertices	m_SkinVertices;
+	vk_demo::DVKJobPool*		m_SkinJobPool = nullptr;
 
 	std::vector<ParticleModel*> m_Particles;
 	std::vector<ThreadData*>	m_ThreadDatas;
 	std::vector<MyThread*>		m_Threads;
 	bool						m_ThreadRunning;
 	int32						m_MainFrameID;
+	int32						m_ActiveThreads;
+	int32						m_FrameThreads;
+	float						m_RecordTime = 0.0f;
 
 	float						m_FrameTime;
 	float						m_FrameDelta;
 	int32						m_bufferIndex;
 
 	ImageGUIContext*			m_GUI = nullptr;
+
+	bool						m_ShowMemoryStats = false;
+	bool						m_RecordMemoryStats = false;
+	MemoryStatsRecorder			m_MemoryStatsRecorder;
+	bool						m_RecordMemoryJSON = false;
+	MemoryStatsRecorder			m_MemoryJSONRecorder;
 };
 
 std::shared_ptr<AppModuleBase> CreateAppMode(const std::vector<std::string>& cmdLine)
@@ -85,6 +85,7 @@ private:
 
 		m_PBRParam.cameraPos = m_ViewCamera.GetTransform().GetOrigin();
 
+		CullMeshlets();
 		SetupCommandBuffers(bufferIndex);
 		DemoBase::Present(bufferIndex);
 	}
@@ -121,6 +122,12 @@ private:
 			ImGui::Combo("Debug", &debug, models, 6);
 			m_PBRParam.param.w = debug;
 
+			ImGui::Separator();
+
+			ImGui::Checkbox("Meshlet Culling", &m_MeshletCulling);
+			ImGui::Text("Meshlet:%d/%d", m_VisibleMeshlets, m_TotalMeshlets);
+			ImGui::Text("Triangle:%d/%d DrawCall:%d", m_VisibleTriangles, m_TotalTriangles, m_NumDraws);
+
 			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
 			ImGui::End();
 		}
@@ -149,6 +156,10 @@ private:
 			}
 		);
 		m_Model->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
+		m_Model->rootNode->MarkDirty();
+
+		// 索引按Meshlet重排，需要在cmdBuffer销毁之前调用以便重建IndexBuffer
+		m_Model->BuildMeshlets();
 
 		m_TexAlbedo = vk_demo::DVKTexture::Create2D(
 			"assets/models/leather-shoes/RootNode_baseColor.jpg",
@@ -201,6 +212,53 @@ private:
 		delete m_TexORMParam;
 	}
 
+	// 在每个Mesh的局部空间里按视锥和法线锥剔除Meshlet，结果在SetupCommandBuffers中直接绘制
+	void CullMeshlets()
+	{
+		const Matrix4x4& viewProj = m_ViewCamera.GetViewProjection();
+		Vector3 eye = m_ViewCamera.GetTransform().GetOrigin();
+
+		m_VisibleMeshlets  = 0;
+		m_TotalMeshlets    = 0;
+		m_VisibleTriangles = 0;
+		m_TotalTriangles   = 0;
+		m_NumDraws         = 0;
+
+		m_MeshletDraws.resize(m_Model->meshes.size());
+		for (int32 i = 0; i < m_Model->meshes.size(); ++i)
+		{
+			vk_demo::DVKMesh* mesh = m_Model->meshes[i];
+			vk_demo::DVKFrustum frustum(mesh->linkNode->GetGlobalMatrix() * viewProj);
+			Vector3 localEye = mesh->linkNode->GetInverseGlobalMatrix().TransformPosition(eye);
+
+			m_MeshletDraws[i].resize(mesh->primitives.size());
+			for (int32 j = 0; j < mesh->primitives.size(); ++j)
+			{
+				vk_demo::DVKPrimitive* primitive = mesh->primitives[j];
+				std::vector<VkDrawIndexedIndirectCommand>& draws = m_MeshletDraws[i][j];
+				draws.clear();
+
+				// 没有Meshlet的Primitive整体绘制
+				if (!m_MeshletCulling || primitive->meshlets.empty())
+				{
+					draws.push_back(primitive->GetLodDrawCommand(0));
+					m_VisibleMeshlets += primitive->meshlets.size();
+				}
+				else
+				{
+					m_VisibleMeshlets += vk_demo::DVKMeshletCuller::Cull(primitive->meshlets, frustum, localEye, draws);
+				}
+
+				for (int32 k = 0; k < draws.size(); ++k) {
+					m_VisibleTriangles += draws[k].indexCount / 3;
+				}
+				m_TotalMeshlets  += primitive->meshlets.size();
+				m_TotalTriangles += primitive->GetLod(0).indexCount / 3;
+				m_NumDraws       += draws.size();
+			}
+		}
+	}
+
 	void SetupCommandBuffers(int32 backBufferIndex)
 	{
 		VkCommandBuffer commandBuffer = m_CommandBuffers[backBufferIndex];
@@ -258,7 +316,12 @@ private:
 			m_Material->EndObject();
 
 			m_Material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
-			m_Model->meshes[i]->BindDrawCmd(commandBuffer);
+			for (int32 j = 0; j < m_Model->meshes[i]->primitives.size(); ++j)
+			{
+				vk_demo::DVKPrimitive* primitive = m_Model->meshes[i]->primitives[j];
+				primitive->BindOnly(commandBuffer);
+				primitive->DrawRanges(commandBuffer, m_MeshletDraws[i][j]);
+			}
 
 			m_Material->EndFrame();
 		}
@@ -318,6 +381,14 @@ private:
 	ModelViewProjectionBlock	m_MVPParam;
 	PBRParamBlock				m_PBRParam;
 
+	bool						m_MeshletCulling = true;
+	std::vector<std::vector<std::vector<VkDrawIndexedIndirectCommand>>> m_MeshletDraws;
+	int32						m_VisibleMeshlets = 0;
+	int32						m_TotalMeshlets = 0;
+	int32						m_VisibleTriangles = 0;
+	int32						m_TotalTriangles = 0;
+	int32						m_NumDraws = 0;
+
 	ImageGUIContext*			m_GUI = nullptr;
 };
 
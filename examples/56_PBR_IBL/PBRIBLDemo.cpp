@@ -210,6 +210,7 @@ private:
 			}
 		);
 		m_Model->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
+		m_Model->rootNode->MarkDirty();
 
 		m_TexAlbedo = vk_demo::DVKTexture::Create2D(
 			"assets/models/leather-shoes/RootNode_baseColor.jpg",
@@ -186,6 +186,7 @@ private:
 			}
 		);
 		m_Model->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
+		m_Model->rootNode->MarkDirty();
 
 		m_TexAlbedo = vk_demo::DVKTexture::Create2D(
 			"assets/models/halloween-pumpkin/BaseColor.jpg",
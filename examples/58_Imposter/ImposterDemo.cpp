@@ -158,6 +158,7 @@ private:
 			}
 		);
 		model->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
+		model->rootNode->MarkDirty();
 
 		vk_demo::DVKTexture* texAlbedo = vk_demo::DVKTexture::Create2D(
 			"assets/models/halloween-pumpkin/BaseColor.jpg",
@@ -85,6 +85,7 @@ private:
 		auto bounds = m_Model->meshes[5]->bounding;
 		Vector3 center = (bounds.max - bounds.min) * 0.5f + bounds.min;
 		m_Model->meshes[5]->linkNode->localMatrix.RotateZ(360 * delta * m_Speed, true, &center);
+		m_Model->meshes[5]->linkNode->MarkDirty();
 
 		SetupCommandBuffers(bufferIndex);
 		DemoBase::Present(bufferIndex);
@@ -265,6 +265,7 @@ private:
 		m_Model->rootNode->localMatrix.AppendScale(Vector3(5, 5, 5));
 		m_Model->rootNode->localMatrix.AppendRotation(180.0f, Vector3::UpVector);
 		m_Model->rootNode->localMatrix.AppendTranslation(Vector3(0, 0, 2.5f));
+		m_Model->rootNode->MarkDirty();
 
 		m_Shader = vk_demo::DVKShader::Create(
 			m_VulkanDevice,
@@ -289,6 +290,7 @@ private:
 			{ VertexAttribute::VA_Position, VertexAttribute::VA_UV0, VertexAttribute::VA_Normal }
 		);
 		m_SuzanneModel->rootNode->localMatrix.AppendRotation(180.0f, Vector3::UpVector);
+		m_SuzanneModel->rootNode->MarkDirty();
 		
 		m_PeelShader = vk_demo::DVKShader::Create(
 			m_VulkanDevice,
@@ -8,9 +8,9 @@
 
 #include "Loader/ImageLoader.h"
 
-#include "TaskThread.h"
-#include "ThreadTask.h"
-#include "TaskThreadPool.h"
+#include "GenericPlatform/GenericPlatformTime.h"
+
+#include "TileScheduler.h"
 #include "RayTracing.h"
 
 #include <vector>
@@ -19,6 +19,7 @@
 #define WIDTH   1400
 #define HEIGHT  900
 #define EPSILON 0.0001
+#define MAX_SAMPLES 256
 
 class CPURayTracingDemo : public DemoBase
 {
@@ -69,93 +70,100 @@ public:
 
 private:
 
-	uint8 ToUint8(float f)
-	{
-		if (f < 0.0f) {
-			f = 0.0f;
-		}
-		if (f >= 1.0f) {
-			f = 1.0f;
-		}
-		return 255 * f;
-	}
-
-	Vector4 ToGammaSpace(Vector4 color)
-	{
-		Vector4 ret;
-		ret.x = MMath::Pow(color.x, 1.0f / 2.2f);
-		ret.y = MMath::Pow(color.y, 1.0f / 2.2f);
-		ret.z = MMath::Pow(color.z, 1.0f / 2.2f);
-		ret.w = MMath::Pow(color.w, 1.0f / 2.2f);
-		return ret;
-	}
-
 	void CPURayTracing()
 	{
 		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
 
 		// camera
-		vk_demo::DVKCamera camera;
-		camera.Perspective(PI / 4, WIDTH, HEIGHT, 0.01f, 100.0f);
-		
-		// tracing
-		std::vector<Raytracing*> raytracings;
-		raytracings.resize(WIDTH * HEIGHT);
-		
+		m_Camera.Perspective(PI / 4, WIDTH, HEIGHT, 0.01f, 100.0f);
+
 		// scene
-		Scene scene;
-		scene.spheres.push_back(Sphere(Vector3(0, 0, 5), 0.5f, new DiffuseMaterial(Vector4(0.8f, 0.3f, 0.3f, 1.0f))));
-		scene.spheres.push_back(Sphere(Vector3(0, -100.5f, 5), 100.0f, new MetalMaterial(Vector4(0.8f, 0.8f, 0.0f, 1.0f), 0.0f)));
-		scene.spheres.push_back(Sphere(Vector3(-1, 0, 5), 0.5f, new MetalMaterial(Vector4(0.8f, 0.8f, 0.8f, 1.0f), 0.2f)));
-		scene.spheres.push_back(Sphere(Vector3(1, 0, 5), 0.5f, new MetalMaterial(Vector4(0.8f, 0.6f, 0.2f, 1.0f), 0.2f)));
-
-		// prepare work
-		for (int32 h = 0; h < HEIGHT; ++h)
-		{
-			for (int32 w = 0; w < WIDTH; ++w)
-			{
-				int32 index = (h * WIDTH + w);
-				raytracings[index] = new Raytracing(&scene, &camera, w, h, index * 4, WIDTH, HEIGHT);
+		m_Scene.spheres.push_back(Sphere(Vector3(0, 0, 5), 0.5f, new DiffuseMaterial(Vector4(0.8f, 0.3f, 0.3f, 1.0f))));
+		m_Scene.spheres.push_back(Sphere(Vector3(0, -100.5f, 5), 100.0f, new MetalMaterial(Vector4(0.8f, 0.8f, 0.0f, 1.0f), 0.0f)));
+		m_Scene.spheres.push_back(Sphere(Vector3(-1, 0, 5), 0.5f, new MetalMaterial(Vector4(0.8f, 0.8f, 0.8f, 1.0f), 0.2f)));
+		m_Scene.spheres.push_back(Sphere(Vector3(1, 0, 5), 0.5f, new MetalMaterial(Vector4(0.8f, 0.6f, 0.2f, 1.0f), 0.2f)));
+
+		// 模型只在CPU端使用，不需要创建GPU Buffer
+		m_SceneModel = vk_demo::DVKModel::LoadFromFile(
+			"assets/models/suzanne.obj",
+			m_VulkanDevice,
+			nullptr,
+			{ 
+				VertexAttribute::VA_Position
 			}
-		}
+		);
 
-		// start work
-		TaskThreadPool* taskPool = new TaskThreadPool();
-		taskPool->Create(MMath::Max<int32>(std::thread::hardware_concurrency(), 8));
-		
-		for (int32 i = 0; i < raytracings.size(); ++i) {
-			taskPool->AddTask(raytracings[i]);
-		}
+		Matrix4x4 transform;
+		transform.AppendScale(Vector3(0.1f, 0.1f, 0.1f));
+		transform.AppendRotation(180, Vector3::UpVector);
+		transform.AppendTranslation(Vector3(0, 0.45f, 8.0f));
 
-		while (taskPool->GetNumQueuedJobs() != 0) {
-			// wait
-		}
+		m_MeshMaterial = new DiffuseMaterial(Vector4(0.7f, 0.7f, 0.7f, 1.0f));
+		m_Scene.AddModel(m_SceneModel, transform, m_MeshMaterial);
+		m_Scene.BuildBVH();
 
-		// output color
-		uint8* rgba = new uint8[WIDTH * HEIGHT * 4];
+		// tracing
+		m_Raytracing = new Raytracing(&m_Scene, WIDTH, HEIGHT, 16);
 
-		for (int32 i = 0; i < raytracings.size(); ++i)
-		{
-			Raytracing* tracing = raytracings[i];
-			tracing->color = ToGammaSpace(tracing->color);
+		// 当前线程也参与执行
+		int32 numThreads = MMath::Max<int32>(std::thread::hardware_concurrency(), 1) - 1;
+		m_Scheduler = new TileScheduler();
+		m_Scheduler->Create(numThreads);
+
+		// 每帧把结果写入staging buffer，然后拷贝到贴图
+		m_Texture = vk_demo::DVKTexture::Create2D(
+			m_VulkanDevice,
+			cmdBuffer,
+			VK_FORMAT_R8G8B8A8_UNORM,
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			WIDTH, HEIGHT,
+			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+			VK_SAMPLE_COUNT_1_BIT,
+			ImageLayoutBarrier::PixelShaderRead
+		);
+		m_Texture->UpdateSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+		m_StagingBuffer = vk_demo::DVKBuffer::CreateBuffer(
+			m_VulkanDevice,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			WIDTH * HEIGHT * 4
+		);
+		m_StagingBuffer->Map();
 
-			rgba[tracing->index + 0] = ToUint8(tracing->color.x);
-			rgba[tracing->index + 1] = ToUint8(tracing->color.y);
-			rgba[tracing->index + 2] = ToUint8(tracing->color.z);
-			rgba[tracing->index + 3] = ToUint8(tracing->color.w);
+		delete cmdBuffer;
+	}
 
-			delete tracing;
+	void TraceFrame()
+	{
+		if (m_Raytracing->GetSampleCount() >= MAX_SAMPLES) {
+			m_Upload = false;
+			return;
 		}
 
-		m_Texture = vk_demo::DVKTexture::Create2D(rgba, WIDTH * HEIGHT * 4, VK_FORMAT_R8G8B8A8_UNORM, WIDTH, HEIGHT, m_VulkanDevice, cmdBuffer);
-		m_Texture->UpdateSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+		double startTime = GenericPlatformTime::Seconds();
 
-		delete[] rgba;
-		delete cmdBuffer;
+		m_Raytracing->BeginFrame(m_Camera);
+		m_Scheduler->Run(m_Raytracing->GetNumTiles(), [this](int32 tile) {
+			m_Raytracing->RenderTile(tile);
+		});
+		m_Raytracing->EndFrame();
+
+		m_TraceTime += GenericPlatformTime::Seconds() - startTime;
+		m_StagingBuffer->CopyFrom((void*)m_Raytracing->GetPixels(), WIDTH * HEIGHT * 4);
+		m_Upload = true;
+
+		int32 sampleCount = m_Raytracing->GetSampleCount();
+		if (sampleCount % 16 == 0)
+		{
+			MLOG("Samples:%d, %.2f Mrays/s, Workers:%d, Steals:%d", sampleCount, m_Raytracing->GetNumRays() / m_TraceTime / 1000000.0f, m_Scheduler->GetNumWorkers(), m_Scheduler->GetNumSteals());
+		}
 	}
 
 	void Draw(float time, float delta)
 	{
+		TraceFrame();
+
 		int32 bufferIndex = DemoBase::AcquireBackbufferIndex();
 
 		SetupGfxCommand(bufferIndex);
@@ -184,16 +192,7 @@ private:
 		);
 		m_Material->pipelineInfo.rasterizationState.cullMode = VK_CULL_MODE_NONE;
 		m_Material->PreparePipeline();
-		
-		m_SceneModel = vk_demo::DVKModel::LoadFromFile(
-			"assets/models/simplescene.obj",
-			m_VulkanDevice,
-			nullptr,
-			{ 
-				VertexAttribute::VA_Position
-			}
-		);
-        
+
 		m_Material->SetTexture("diffuseMap", m_Texture);
 
 		delete cmdBuffer;
@@ -201,6 +200,17 @@ private:
 
 	void DestroyAssets()
 	{
+		delete m_Scheduler;
+		delete m_Raytracing;
+
+		for (int32 i = 0; i < m_Scene.spheres.size(); ++i) {
+			delete m_Scene.spheres[i].material;
+		}
+		delete m_MeshMaterial;
+
+		m_StagingBuffer->UnMap();
+		delete m_StagingBuffer;
+
 		delete m_Texture;
 		delete m_Material;
 		delete m_Shader;
@@ -229,6 +239,27 @@ private:
 		ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
 		VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
 
+		if (m_Upload)
+		{
+			VkImageSubresourceRange subresourceRange = {};
+			subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+			subresourceRange.levelCount     = 1;
+			subresourceRange.layerCount     = 1;
+			subresourceRange.baseArrayLayer = 0;
+			subresourceRange.baseMipLevel   = 0;
+
+			VkBufferImageCopy bufferCopyRegion = {};
+			bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			bufferCopyRegion.imageSubresource.layerCount = 1;
+			bufferCopyRegion.imageExtent.width  = WIDTH;
+			bufferCopyRegion.imageExtent.height = HEIGHT;
+			bufferCopyRegion.imageExtent.depth  = 1;
+
+			vk_demo::ImagePipelineBarrier(commandBuffer, m_Texture->image, ImageLayoutBarrier::PixelShaderRead, ImageLayoutBarrier::TransferDest, subresourceRange);
+			vkCmdCopyBufferToImage(commandBuffer, m_StagingBuffer->buffer, m_Texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+			vk_demo::ImagePipelineBarrier(commandBuffer, m_Texture->image, ImageLayoutBarrier::TransferDest, ImageLayoutBarrier::PixelShaderRead, subresourceRange);
+		}
+
 		VkClearValue clearValues[2];
 		clearValues[0].color        = { { 0.2f, 0.2f, 0.2f, 1.0f } };
 		clearValues[1].depthStencil = { 1.0f, 0 };
@@ -271,6 +302,16 @@ private:
 
 	bool 						    m_Ready = false;
 
+	vk_demo::DVKCamera				m_Camera;
+	Scene							m_Scene;
+	Material*						m_MeshMaterial = nullptr;
+	Raytracing*						m_Raytracing = nullptr;
+	TileScheduler*					m_Scheduler = nullptr;
+	double							m_TraceTime = 0.0;
+
+	vk_demo::DVKBuffer*				m_StagingBuffer = nullptr;
+	bool							m_Upload = false;
+
 	vk_demo::DVKModel*				m_SceneModel = nullptr;
 
 	vk_demo::DVKTexture*			m_Texture = nullptr;
@@ -7,17 +7,48 @@
 struct Ray;
 struct HitInfo;
 
+// xorshift32随机数，每个tile单独一个，不再共用全局的rand()
+struct RandomStream
+{
+	uint32 seed;
+
+	RandomStream(uint32 inSeed)
+		: seed(inSeed != 0 ? inSeed : 0x9E3779B9)
+	{
+
+	}
+
+	uint32 Next()
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	}
+
+	// [0, 1)
+	float GetFraction()
+	{
+		return (Next() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	float RandRange(float minValue, float maxValue)
+	{
+		return minValue + (maxValue - minValue) * GetFraction();
+	}
+};
+
 class Material
 {
 public:
 
-	virtual bool Scatter(const Ray& ray, const HitInfo& hitInfo, Vector4& attenuation, Ray& reflect) const = 0;
+	virtual bool Scatter(const Ray& ray, const HitInfo& hitInfo, RandomStream& random, Vector4& attenuation, Ray& reflect) const = 0;
 
 protected:
 
-	const Vector3 RandomUnit() const
+	const Vector3 RandomUnit(RandomStream& random) const
 	{
-		Vector3 vec3(MMath::FRandRange(-1.0f, 1.0f), MMath::FRandRange(-1.0f, 1.0f), MMath::FRandRange(-1.0f, 1.0f));
+		Vector3 vec3(random.RandRange(-1.0f, 1.0f), random.RandRange(-1.0f, 1.0f), random.RandRange(-1.0f, 1.0f));
 		vec3 = vec3.GetSafeNormal();
 		return vec3;
 	}
@@ -34,7 +65,7 @@ public:
 
 	}
 
-	bool Scatter(const Ray& ray, const HitInfo& hitInfo, Vector4& attenuation, Ray& reflect) const override;
+	bool Scatter(const Ray& ray, const HitInfo& hitInfo, RandomStream& random, Vector4& attenuation, Ray& reflect) const override;
 
 	Vector4 albedo;
 
@@ -54,7 +85,7 @@ public:
 
 	}
 
-	bool Scatter(const Ray& ray, const HitInfo& hitInfo, Vector4& attenuation, Ray& reflect) const override;
+	bool Scatter(const Ray& ray, const HitInfo& hitInfo, RandomStream& random, Vector4& attenuation, Ray& reflect) const override;
 
 	Vector4 albedo;
 
@@ -0,0 +1,121 @@
+﻿#include "PrimitiveBVH.h"
+
+#include <algorithm>
+
+void PrimitiveBVH::Build(const std::vector<Vector3>& boundsMins, const std::vector<Vector3>& boundsMaxs)
+{
+	m_Nodes.clear();
+
+	int32 count = boundsMins.size();
+	if (count == 0) {
+		return;
+	}
+
+	std::vector<Vector3> centers(count);
+	std::vector<int32> primitives(count);
+	for (int32 i = 0; i < count; ++i)
+	{
+		centers[i]    = (boundsMins[i] + boundsMaxs[i]) * 0.5f;
+		primitives[i] = i;
+	}
+
+	BuildNode(primitives, 0, count, centers, boundsMins, boundsMaxs);
+}
+
+uint32 PrimitiveBVH::BuildNode(std::vector<int32>& primitives, int32 first, int32 count, const std::vector<Vector3>& centers, const std::vector<Vector3>& boundsMins, const std::vector<Vector3>& boundsMaxs)
+{
+	uint32 nodeIndex = m_Nodes.size();
+	m_Nodes.push_back(Node());
+
+	// 按中心点最长的轴在中位数处切分，切两次得到最多4组
+	auto split = [&](int32 start, int32 num) -> int32
+	{
+		Vector3 centerMin = centers[primitives[start]];
+		Vector3 centerMax = centerMin;
+		for (int32 i = start + 1; i < start + num; ++i)
+		{
+			centerMin = Vector3::Min(centerMin, centers[primitives[i]]);
+			centerMax = Vector3::Max(centerMax, centers[primitives[i]]);
+		}
+
+		Vector3 extent = centerMax - centerMin;
+		int32 axis = 0;
+		if (extent.y > extent[axis]) {
+			axis = 1;
+		}
+		if (extent.z > extent[axis]) {
+			axis = 2;
+		}
+
+		int32 half = num / 2;
+		std::nth_element(
+			primitives.begin() + start, 
+			primitives.begin() + start + half, 
+			primitives.begin() + start + num, 
+			[&](int32 a, int32 b) {
+				return centers[a][axis] < centers[b][axis];
+			}
+		);
+
+		return half;
+	};
+
+	int32 groupFirsts[4];
+	int32 groupCounts[4];
+	int32 groupNum = 0;
+
+	if (count <= 4)
+	{
+		for (int32 i = 0; i < count; ++i)
+		{
+			groupFirsts[groupNum] = first + i;
+			groupCounts[groupNum] = 1;
+			groupNum += 1;
+		}
+	}
+	else
+	{
+		int32 half = split(first, count);
+		int32 halfFirsts[2] = { first, first + half };
+		int32 halfCounts[2] = { half, count - half };
+
+		for (int32 i = 0; i < 2; ++i)
+		{
+			int32 quarter = split(halfFirsts[i], halfCounts[i]);
+			groupFirsts[groupNum] = halfFirsts[i];
+			groupCounts[groupNum] = quarter;
+			groupNum += 1;
+			groupFirsts[groupNum] = halfFirsts[i] + quarter;
+			groupCounts[groupNum] = halfCounts[i] - quarter;
+			groupNum += 1;
+		}
+	}
+
+	// 递归之后m_Nodes可能已经重新分配，每次都重新取节点
+	for (int32 i = groupNum; i < 4; ++i) {
+		m_Nodes[nodeIndex].SetEmpty(i);
+	}
+
+	for (int32 i = 0; i < groupNum; ++i)
+	{
+		Vector3 boundsMin( MAX_flt,  MAX_flt,  MAX_flt);
+		Vector3 boundsMax(-MAX_flt, -MAX_flt, -MAX_flt);
+		for (int32 j = groupFirsts[i]; j < groupFirsts[i] + groupCounts[i]; ++j)
+		{
+			boundsMin = Vector3::Min(boundsMin, boundsMins[primitives[j]]);
+			boundsMax = Vector3::Max(boundsMax, boundsMaxs[primitives[j]]);
+		}
+
+		uint32 child = 0;
+		if (groupCounts[i] == 1) {
+			child = LeafFlag | primitives[groupFirsts[i]];
+		}
+		else {
+			child = BuildNode(primitives, groupFirsts[i], groupCounts[i], centers, boundsMins, boundsMaxs);
+		}
+
+		m_Nodes[nodeIndex].SetChild(i, child, boundsMin, boundsMax);
+	}
+
+	return nodeIndex;
+}
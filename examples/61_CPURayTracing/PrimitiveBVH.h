@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+#include "Math/Math.h"
+#include "Math/Vector3.h"
+
+#include "Demo/DVKBVHNode.h"
+#include "Demo/DVKTraversalStack.h"
+
+#include <vector>
+
+// 场景图元(球、三角形网格)的4叉BVH，每个叶子对应一个图元。
+// 节点和遍历时的包围盒测试与DVKTriangleBVH共用DVKBVHNode。
+// 图元的数量一般不多，按中位数切分构建即可。
+class PrimitiveBVH
+{
+public:
+
+	void Build(const std::vector<Vector3>& boundsMins, const std::vector<Vector3>& boundsMaxs);
+
+	void Clear()
+	{
+		m_Nodes.clear();
+	}
+
+	bool IsEmpty() const
+	{
+		return m_Nodes.empty();
+	}
+
+	// 由近到远访问图元，func(primitive, maxDistance)返回比maxDistance更近的交点距离，没有时返回负数。
+	// 返回最近的距离，没有相交时返回负数。
+	template<typename RayFunc>
+	float RayCast(const Vector3& origin, const Vector3& direction, float maxDistance, RayFunc& func) const;
+
+private:
+
+	// 叶子的编码：其余位为图元序号
+	typedef vk_demo::DVKBVHNode Node;
+
+	enum : uint32
+	{
+		LeafFlag = vk_demo::DVKBVHNode::LeafFlag,
+	};
+
+	uint32 BuildNode(std::vector<int32>& primitives, int32 first, int32 count, const std::vector<Vector3>& centers, const std::vector<Vector3>& boundsMins, const std::vector<Vector3>& boundsMaxs);
+
+private:
+
+	std::vector<Node>	m_Nodes;
+
+};
+
+template<typename RayFunc>
+float PrimitiveBVH::RayCast(const Vector3& origin, const Vector3& direction, float maxDistance, RayFunc& func) const
+{
+	if (m_Nodes.empty()) {
+		return -1.0f;
+	}
+
+	const vk_demo::DVKBVHRay ray(origin, direction);
+
+	vk_demo::DVKTraversalStack<vk_demo::DVKBVHEntry> stack;
+	stack.Push({ 0, 0.0f });
+
+	float closest = maxDistance;
+	bool  hit     = false;
+
+	while (!stack.IsEmpty())
+	{
+		vk_demo::DVKBVHEntry entry = stack.Pop();
+		if (entry.distance > closest) {
+			continue;
+		}
+
+		if (entry.child & LeafFlag)
+		{
+			float distance = func((int32)(entry.child & ~LeafFlag), closest);
+			if (distance >= 0.0f && distance <= closest)
+			{
+				closest = distance;
+				hit     = true;
+			}
+			continue;
+		}
+
+		// 按距离从远到近入栈，近的先出栈
+		vk_demo::DVKBVHEntry hits[4];
+		int32 hitCount = m_Nodes[entry.child].IntersectChildren(ray, closest, hits);
+		for (int32 i = 0; i < hitCount; ++i) {
+			stack.Push(hits[i]);
+		}
+	}
+
+	return hit ? closest : -1.0f;
+}
@@ -1,22 +1,31 @@
 #include "RayTracing.h"
 
-HitInfo Sphere::HitTest(const Ray& ray)
+float Sphere::Intersect(const Ray& ray) const
 {
 	Vector3 oc = ray.start - center;
 	float b = 2.0f * Vector3::DotProduct(oc, ray.direction);
 	float c = Vector3::DotProduct(oc, oc) - radius * radius;
 	float h = b * b - 4.0f * c;
 
+	if (h < 0.0f) {
+		return -1.0f;
+	}
+
+	float t = (-b - MMath::Sqrt(h)) / 2.0f;
+	return t > EPSILON ? t : -1.0f;
+}
+
+HitInfo Sphere::HitTest(const Ray& ray) const
+{
 	HitInfo hitInfo;
 	hitInfo.hit = false;
 
-	if (h < 0.0f) {
+	float t = Intersect(ray);
+	if (t < 0.0f) {
 		return hitInfo;
 	}
 
-	float t = (-b - MMath::Sqrt(h)) / 2.0f;
-
-	hitInfo.hit      = t > EPSILON;
+	hitInfo.hit      = true;
 	hitInfo.dist     = t;
 	hitInfo.inside   = false;
 	hitInfo.pos      = ray.start + ray.direction * t;
@@ -26,89 +35,305 @@ HitInfo Sphere::HitTest(const Ray& ray)
 	return hitInfo;
 }
 
-Vector4 Raytracing::HitScene()
+Scene::~Scene()
 {
-	color.Set(0, 0, 0, 0);
+	for (int32 i = 0; i < meshes.size(); ++i) {
+		delete meshes[i];
+	}
+	meshes.clear();
+}
+
+void Scene::AddModel(vk_demo::DVKModel* model, const Matrix4x4& transform, Material* material)
+{
+	std::vector<Vector3> positions;
+
+	for (int32 i = 0; i < model->meshes.size(); ++i)
+	{
+		vk_demo::DVKMesh* mesh = model->meshes[i];
+
+		Matrix4x4 matrix = mesh->linkNode ? mesh->linkNode->GetGlobalMatrix() : Matrix4x4::Identity;
+		matrix.Append(transform);
+
+		TriangleMesh* triangleMesh = new TriangleMesh();
+		triangleMesh->material = material;
+
+		// 所有Primitive合并为一个网格
+		for (int32 j = 0; j < mesh->primitives.size(); ++j)
+		{
+			vk_demo::DVKPrimitive* primitive = mesh->primitives[j];
+			if (!model->GetPositions(mesh, primitive, positions)) {
+				continue;
+			}
+
+			uint32 baseVertex = triangleMesh->positions.size();
+			for (int32 v = 0; v < positions.size(); ++v) {
+				triangleMesh->positions.push_back(matrix.TransformPosition(positions[v]));
+			}
+			for (int32 k = 0; k < primitive->indices.size(); ++k) {
+				triangleMesh->indices.push_back(baseVertex + primitive->indices[k]);
+			}
+		}
+
+		if (triangleMesh->indices.empty())
+		{
+			delete triangleMesh;
+			continue;
+		}
+
+		triangleMesh->bvh.Build(triangleMesh->positions, triangleMesh->indices);
+		meshes.push_back(triangleMesh);
+	}
+}
+
+void Scene::BuildBVH()
+{
+	// 图元序号小于球的数量时为球，否则为网格
+	std::vector<Vector3> boundsMins;
+	std::vector<Vector3> boundsMaxs;
+
+	for (int32 i = 0; i < spheres.size(); ++i)
+	{
+		const Sphere& sphere = spheres[i];
+		Vector3 extent(sphere.radius, sphere.radius, sphere.radius);
+		boundsMins.push_back(sphere.center - extent);
+		boundsMaxs.push_back(sphere.center + extent);
+	}
+
+	for (int32 i = 0; i < meshes.size(); ++i)
+	{
+		const TriangleMesh* mesh = meshes[i];
+		Vector3 boundsMin = mesh->positions[0];
+		Vector3 boundsMax = mesh->positions[0];
+		for (int32 v = 1; v < mesh->positions.size(); ++v)
+		{
+			boundsMin = Vector3::Min(boundsMin, mesh->positions[v]);
+			boundsMax = Vector3::Max(boundsMax, mesh->positions[v]);
+		}
+		boundsMins.push_back(boundsMin);
+		boundsMaxs.push_back(boundsMax);
+	}
+
+	bvh.Build(boundsMins, boundsMaxs);
+}
+
+HitInfo Scene::Intersect(const Ray& ray) const
+{
+	// 遍历时只记录最近的图元，最后再计算交点的位置和法线
+	struct Query
+	{
+		const Scene*	scene;
+		const Ray&		ray;
+		int32			primitive;
+		uint32			triangle;
+
+		float operator()(int32 index, float maxDistance)
+		{
+			int32 numSpheres = scene->spheres.size();
+			float distance = -1.0f;
+
+			if (index < numSpheres)
+			{
+				distance = scene->spheres[index].Intersect(ray);
+				if (distance < 0.0f || distance > maxDistance) {
+					return -1.0f;
+				}
+			}
+			else
+			{
+				vk_demo::DVKTriangleHit triangleHit;
+				// 跳过起点附近的交点，避免反弹的射线与自身相交
+				if (!scene->meshes[index - numSpheres]->bvh.RayCast(ray.start, ray.direction, maxDistance, triangleHit) || triangleHit.distance <= EPSILON) {
+					return -1.0f;
+				}
+				distance = triangleHit.distance;
+				triangle = triangleHit.triangle;
+			}
+
+			primitive = index;
+			return distance;
+		}
+	};
+
+	Query query = { this, ray, -1, 0 };
+	float distance = bvh.RayCast(ray.start, ray.direction, MAX_flt, query);
 
+	HitInfo hitInfo;
+	if (distance < 0.0f) {
+		return hitInfo;
+	}
+
+	int32 numSpheres = spheres.size();
+	if (query.primitive < numSpheres) {
+		return spheres[query.primitive].HitTest(ray);
+	}
+
+	// 法线朝向射线的一侧
+	const TriangleMesh* mesh = meshes[query.primitive - numSpheres];
+	const Vector3& v0 = mesh->positions[mesh->indices[query.triangle * 3 + 0]];
+	const Vector3& v1 = mesh->positions[mesh->indices[query.triangle * 3 + 1]];
+	const Vector3& v2 = mesh->positions[mesh->indices[query.triangle * 3 + 2]];
+
+	hitInfo.normal = Vector3::CrossProduct(v1 - v0, v2 - v0).GetSafeNormal();
+	if (Vector3::DotProduct(hitInfo.normal, ray.direction) > 0.0f) {
+		hitInfo.normal = -hitInfo.normal;
+	}
+
+	hitInfo.hit      = true;
+	hitInfo.dist     = distance;
+	hitInfo.pos      = ray.start + ray.direction * distance + hitInfo.normal * EPSILON;
+	hitInfo.inside   = false;
+	hitInfo.material = mesh->material;
+
+	return hitInfo;
+}
+void CameraRays::Setup(vk_demo::DVKCamera& camera)
+{
 	// inv transform
-	Matrix4x4 invProj = camera->GetProjection();
+	Matrix4x4 invProj = camera.GetProjection();
 	invProj.SetInverse();
-	Matrix4x4 invView = camera->GetView();
+	Matrix4x4 invView = camera.GetView();
 	invView.SetInverse();
 
-	int32 sample = 10;
-
-	for (int32 i = 0; i < sample; ++i)
+	// 屏幕坐标到方向的变换是仿射的，三个点就能确定
+	auto direction = [&](float x, float y) -> Vector3
 	{
-		// clip space
-		Vector2 clip = Vector2((w + MMath::FRandRange(0.0f, 1.0f)) / width, (h + MMath::FRandRange(0.0f, 1.0f)) / height);
-		// camera position
-		Vector3 pos  = camera->GetTransform().GetOrigin();
 		// clip space ray
-		Vector3 dir  = Vector3(clip.x * 2.0 - 1.0, -(clip.y * 2.0 - 1.0), 1.0);
+		Vector3 dir = Vector3(x * 2.0f - 1.0f, -(y * 2.0f - 1.0f), 1.0f);
 		// clip space to viewspace
 		dir = invProj.TransformPosition(dir);
 		dir.x = dir.x * dir.z;
 		dir.y = dir.y * dir.z;
 		// view space to world space
-		dir = invView.TransformVector(dir);
-		dir.Normalize();
-
-		Ray ray;
-		ray.start = pos;
-		ray.direction = dir;
-		
-		color += RayHitScene(ray, 25);
+		return invView.TransformVector(dir);
+	};
+
+	origin = camera.GetTransform().GetOrigin();
+	base   = direction(0.0f, 0.0f);
+	dx     = direction(1.0f, 0.0f) - base;
+	dy     = direction(0.0f, 1.0f) - base;
+}
+
+Raytracing::Raytracing(Scene* inScene, int32 inWidth, int32 inHeight, int32 inTileSize, int32 inMaxDepth)
+	: scene(inScene)
+	, width(inWidth)
+	, height(inHeight)
+	, tileSize(inTileSize)
+	, maxDepth(inMaxDepth)
+	, sampleCount(0)
+	, numRays(0)
+{
+	numTilesX = (width  + tileSize - 1) / tileSize;
+	numTilesY = (height + tileSize - 1) / tileSize;
+
+	accumulation.resize(width * height);
+	pixels.resize(width * height * 4);
+
+	Reset();
+}
+
+void Raytracing::Reset()
+{
+	sampleCount = 0;
+	numRays.store(0);
+
+	for (int32 i = 0; i < accumulation.size(); ++i) {
+		accumulation[i].Set(0, 0, 0, 0);
 	}
+}
+
+void Raytracing::BeginFrame(vk_demo::DVKCamera& camera)
+{
+	cameraRays.Setup(camera);
+}
 
-	color = color / 15;
+void Raytracing::EndFrame()
+{
+	sampleCount += 1;
+}
 
-	return color;
+static uint32 HashSeed(uint32 a, uint32 b)
+{
+	uint32 hash = a * 0x9E3779B1 ^ (b + 0x7F4A7C15) * 0x85EBCA77;
+	hash ^= hash >> 16;
+	hash *= 0x7FEB352D;
+	hash ^= hash >> 15;
+	hash *= 0x846CA68B;
+	hash ^= hash >> 16;
+	return hash;
 }
 
-HitInfo Raytracing::IntersectScene(Scene* scene, const Ray& ray)
+void Raytracing::RenderTile(int32 tile)
 {
-	HitInfo info;
-	info.dist = MAX_int32;
-	info.hit  = false;
+	// tile和采样序号决定随机数，结果与由哪个线程执行无关
+	RandomStream random(HashSeed(tile, sampleCount));
 
-	for (int32 i = 0; i < scene->spheres.size(); ++i)
-	{
-		Sphere& sphere  = scene->spheres[i];
-		HitInfo tempHit = sphere.HitTest(ray);
+	int32 x0 = (tile % numTilesX) * tileSize;
+	int32 y0 = (tile / numTilesX) * tileSize;
+	int32 x1 = MMath::Min(x0 + tileSize, width);
+	int32 y1 = MMath::Min(y0 + tileSize, height);
 
-		if (tempHit.hit && tempHit.dist < info.dist)
+	float invWidth  = 1.0f / width;
+	float invHeight = 1.0f / height;
+	float invCount  = 1.0f / (sampleCount + 1);
+	int32 rayCount  = 0;
+
+	for (int32 y = y0; y < y1; ++y)
+	{
+		for (int32 x = x0; x < x1; ++x)
 		{
-			info = tempHit;
+			float u = (x + random.GetFraction()) * invWidth;
+			float v = (y + random.GetFraction()) * invHeight;
+
+			Ray ray;
+			ray.start     = cameraRays.origin;
+			ray.direction = cameraRays.base + cameraRays.dx * u + cameraRays.dy * v;
+			ray.direction.Normalize();
+
+			int32 index = y * width + x;
+			Vector4& sum = accumulation[index];
+			sum += TraceRay(ray, random, rayCount);
+
+			// to gamma space
+			uint8* rgba = &pixels[index * 4];
+			rgba[0] = 255 * MMath::Clamp(MMath::Pow(sum.x * invCount, 1.0f / 2.2f), 0.0f, 1.0f);
+			rgba[1] = 255 * MMath::Clamp(MMath::Pow(sum.y * invCount, 1.0f / 2.2f), 0.0f, 1.0f);
+			rgba[2] = 255 * MMath::Clamp(MMath::Pow(sum.z * invCount, 1.0f / 2.2f), 0.0f, 1.0f);
+			rgba[3] = 255;
 		}
 	}
 
-	return info;
+	numRays.fetch_add(rayCount, std::memory_order_relaxed);
 }
 
-Vector4 Raytracing::RayHitScene(const Ray& ray, int32 depth)
+Vector4 Raytracing::TraceRay(const Ray& ray, RandomStream& random, int32& rayCount) const
 {
-	HitInfo hitInfo = IntersectScene(scene, ray);
+	Vector4 throughput(1.0f, 1.0f, 1.0f, 1.0f);
+	Ray current = ray;
 
-	if (hitInfo.hit)
+	for (int32 depth = maxDepth; ; --depth)
 	{
+		rayCount += 1;
+
+		HitInfo hitInfo = scene->Intersect(current);
+
+		if (!hitInfo.hit)
+		{
+			float t = (current.direction.y + 1.0f) * 0.5f;
+			return throughput * ((1.0f - t) * Vector4(1.0f, 1.0f, 1.0f, 1.0f) + t * Vector4(0.5f, 0.7f, 1.0f, 1.0f));
+		}
+
 		if (depth <= 0) {
-			return Vector4(0, 0, 0, 1.0);
+			return throughput * Vector4(0, 0, 0, 1.0);
 		}
 
 		Vector4 attenuation;
 		Ray reflect;
 
-		if (hitInfo.material->Scatter(ray, hitInfo, attenuation, reflect)) {
-			return attenuation * RayHitScene(reflect, depth - 1);
-		}
-		else {
-			return Vector4(0.1, 0.1, 0.1, 1.0);
+		if (!hitInfo.material->Scatter(current, hitInfo, random, attenuation, reflect)) {
+			return throughput * Vector4(0.1, 0.1, 0.1, 1.0);
 		}
+
+		throughput = throughput * attenuation;
+		current    = reflect;
 	}
-	else 
-	{
-		float t = (ray.direction.y + 1.0f) * 0.5f;
-		return (1.0f - t) * Vector4(1.0f, 1.0f, 1.0f, 1.0f) + t * Vector4(0.5f, 0.7f, 1.0f, 1.0f);
-	}
-}
\ No newline at end of file
+}
@@ -3,8 +3,13 @@
 #include "Common/Common.h"
 #include "Math/Vector3.h"
 #include "Demo/DVKCamera.h"
-#include "ThreadTask.h"
+#include "Demo/DVKModel.h"
+#include "Demo/DVKTriangleBVH.h"
 #include "Material.h"
+#include "PrimitiveBVH.h"
+
+#include <vector>
+#include <atomic>
 
 #define EPSILON 0.0001
 
@@ -41,61 +46,114 @@ struct Sphere
 
 	}
 
-	HitInfo HitTest(const Ray& ray);
+	// 只计算距离，未命中时返回负数
+	float Intersect(const Ray& ray) const;
+
+	HitInfo HitTest(const Ray& ray) const;
 };
 
+// 世界空间的三角形网格，相交由DVKTriangleBVH完成(SIMD一次测试4个包围盒)
+struct TriangleMesh
+{
+	std::vector<Vector3>		positions;
+	std::vector<uint32>			indices;
+	vk_demo::DVKTriangleBVH		bvh;
+	Material*					material = nullptr;
+};
+
+// 球和三角形网格都作为叶子放在一棵PrimitiveBVH中，射线由近到远访问，跳过比已有交点更远的物体
 struct Scene
 {
-	std::vector<Sphere> spheres;
+	std::vector<Sphere>			spheres;
+	std::vector<TriangleMesh*>	meshes;
+	PrimitiveBVH				bvh;
+
+	~Scene();
+
+	// 每个DVKMesh变换到世界空间之后生成一个TriangleMesh，模型需要保留CPU端的顶点数据
+	void AddModel(vk_demo::DVKModel* model, const Matrix4x4& transform, Material* material);
+
+	// 修改spheres、meshes之后需要调用
+	void BuildBVH();
+
+	HitInfo Intersect(const Ray& ray) const;
 };
 
-class Raytracing : public ThreadTask
+// 每帧的相机数据，只计算一次。
+// 像素(x, y)的方向为base + dx * x + dy * y，x、y为[0, 1]之间的屏幕坐标，使用之前需要归一化。
+struct CameraRays
 {
-public:
+	Vector3		origin;
+	Vector3		base;
+	Vector3		dx;
+	Vector3		dy;
 
-	Raytracing(Scene* inScene, vk_demo::DVKCamera* inCamera, float iw, float ih, int32 idx, int32 inWidth, int32 inHeight)
-		: scene(inScene)
-		, w(iw)
-		, h(ih)
-		, index(idx)
-		, camera(inCamera)
-		, width(inWidth)
-		, height(inHeight)
-	{
+	void Setup(vk_demo::DVKCamera& camera);
+};
 
-	}
+// 按tile渐进式渲染：每帧每个像素追踪一条射线，累加到之前的结果上。
+// 每个tile只写自己的像素，不同的tile可以在不同的线程中并行执行。
+class Raytracing
+{
+public:
+
+	Raytracing(Scene* inScene, int32 inWidth, int32 inHeight, int32 inTileSize = 16, int32 inMaxDepth = 25);
 
 	~Raytracing()
 	{
 
 	}
 
-	Vector4 HitScene();
+	// 清空累加的结果，相机或者场景改变之后调用
+	void Reset();
+
+	void BeginFrame(vk_demo::DVKCamera& camera);
+
+	void RenderTile(int32 tile);
 
-	virtual void DoThreadedWork() override
+	void EndFrame();
+
+	int32 GetNumTiles() const
 	{
-		HitScene();
+		return numTilesX * numTilesY;
 	}
 
-	virtual void Abandon() override
+	int32 GetSampleCount() const
 	{
+		return sampleCount;
+	}
 
+	// 从Reset之后追踪的射线数量，包括反射的射线
+	uint64 GetNumRays() const
+	{
+		return numRays.load();
+	}
+
+	// RGBA8，已经转换到Gamma空间
+	const uint8* GetPixels() const
+	{
+		return pixels.data();
 	}
 
 private:
 
-	HitInfo IntersectScene(Scene* scene, const Ray& ray);
+	// 循环代替递归，每次反弹把衰减乘到throughput上
+	Vector4 TraceRay(const Ray& ray, RandomStream& random, int32& rayCount) const;
 
-	Vector4 RayHitScene(const Ray& ray, int32 depth);
+private:
 
-public:
+	Scene*					scene;
+	int32					width;
+	int32					height;
+	int32					tileSize;
+	int32					numTilesX;
+	int32					numTilesY;
+	int32					maxDepth;
+
+	CameraRays				cameraRays;
+	int32					sampleCount;
+	std::atomic<uint64>		numRays;
 
-	Scene* scene;
-	float w;
-	float h;
-	int32 index;
-	vk_demo::DVKCamera* camera;
-	int32 width;
-	int32 height;
-	Vector4 color;
+	std::vector<Vector4>	accumulation;
+	std::vector<uint8>		pixels;
 };
@@ -0,0 +1,167 @@
+﻿#include "TileScheduler.h"
+#include "TaskThreadPool.h"
+#include "ThreadTask.h"
+
+#include <thread>
+
+class TileWorkerTask : public ThreadTask
+{
+public:
+
+	TileWorkerTask(TileScheduler* scheduler, int32 worker)
+		: m_Scheduler(scheduler)
+		, m_Worker(worker)
+	{
+
+	}
+
+	virtual void DoThreadedWork() override
+	{
+		m_Scheduler->WorkerLoop(m_Worker);
+		// 最后一步，之后不能再访问scheduler
+		m_Scheduler->m_NumActiveTasks.fetch_sub(1);
+	}
+
+	virtual void Abandon() override
+	{
+		m_Scheduler->m_NumActiveTasks.fetch_sub(1);
+	}
+
+private:
+
+	TileScheduler*	m_Scheduler;
+	int32			m_Worker;
+
+};
+
+TileScheduler::TileScheduler()
+	: m_ThreadPool(nullptr)
+	, m_TileFunc(nullptr)
+	, m_NumRemaining(0)
+	, m_NumActiveTasks(0)
+	, m_NumSteals(0)
+{
+
+}
+
+TileScheduler::~TileScheduler()
+{
+	Destroy();
+}
+
+bool TileScheduler::Create(int32 numThreads)
+{
+	Destroy();
+
+	if (numThreads > 0)
+	{
+		m_ThreadPool = TaskThreadPool::Allocate();
+		if (!m_ThreadPool->Create(numThreads))
+		{
+			delete m_ThreadPool;
+			m_ThreadPool = nullptr;
+			return false;
+		}
+	}
+
+	// 0号为调用Run的线程
+	for (int32 i = 0; i <= numThreads; ++i) 
+	{
+		m_Queues.push_back(new WorkStealingQueue());
+		if (i > 0) {
+			m_WorkerTasks.push_back(new TileWorkerTask(this, i));
+		}
+	}
+
+	return true;
+}
+
+void TileScheduler::Destroy()
+{
+	if (m_ThreadPool)
+	{
+		delete m_ThreadPool;
+		m_ThreadPool = nullptr;
+	}
+
+	for (int32 i = 0; i < (int32)m_Queues.size(); ++i) {
+		delete m_Queues[i];
+	}
+	m_Queues.clear();
+
+	for (int32 i = 0; i < (int32)m_WorkerTasks.size(); ++i) {
+		delete m_WorkerTasks[i];
+	}
+	m_WorkerTasks.clear();
+}
+
+void TileScheduler::Run(int32 numTiles, const TileFunc& func)
+{
+	int32 numWorkers = m_Queues.size();
+	if (numTiles <= 0 || numWorkers == 0) {
+		return;
+	}
+
+	// 每个线程分到连续的一段tile，倒序压入，所有者从前往后执行，窃取者从末尾拿走
+	for (int32 i = 0; i < numWorkers; ++i)
+	{
+		int32 first = (int64)numTiles * i / numWorkers;
+		int32 last  = (int64)numTiles * (i + 1) / numWorkers;
+
+		m_Queues[i]->Reset(last - first);
+		for (int32 tile = last - 1; tile >= first; --tile) {
+			m_Queues[i]->Push(tile);
+		}
+	}
+
+	m_TileFunc = &func;
+	m_NumSteals.store(0);
+	m_NumRemaining.store(numTiles);
+	m_NumActiveTasks.store(m_WorkerTasks.size());
+
+	for (int32 i = 0; i < (int32)m_WorkerTasks.size(); ++i) {
+		m_ThreadPool->AddTask(m_WorkerTasks[i]);
+	}
+
+	WorkerLoop(0);
+
+	// 所有tile都完成之后还要等其它线程退出WorkerLoop，才能开始下一次Run
+	while (m_NumActiveTasks.load() != 0) {
+		std::this_thread::yield();
+	}
+
+	m_TileFunc = nullptr;
+}
+
+void TileScheduler::WorkerLoop(int32 worker)
+{
+	int32 numWorkers = m_Queues.size();
+	WorkStealingQueue* queue = m_Queues[worker];
+
+	while (m_NumRemaining.load(std::memory_order_acquire) > 0)
+	{
+		int32 tile = -1;
+		bool found = queue->Pop(tile);
+
+		// 从下一个线程开始依次尝试窃取
+		for (int32 i = 1; !found && i < numWorkers; ++i)
+		{
+			int32 victim = (worker + i) % numWorkers;
+			if (m_Queues[victim]->Steal(tile)) 
+			{
+				found = true;
+				m_NumSteals.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		if (!found) 
+		{
+			// 剩下的tile都在其它线程手中执行
+			std::this_thread::yield();
+			continue;
+		}
+
+		(*m_TileFunc)(tile);
+		m_NumRemaining.fetch_sub(1, std::memory_order_acq_rel);
+	}
+}
@@ -0,0 +1,62 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+
+#include "WorkStealingQueue.h"
+
+#include <vector>
+#include <atomic>
+#include <functional>
+
+class TaskThreadPool;
+class TileWorkerTask;
+
+// 把一帧的tile分给每个工作线程的双端队列，自己的队列空了之后从其它线程的队列顶部窃取。
+// 调用Run的线程也作为0号工作线程参与执行。
+class TileScheduler
+{
+public:
+
+	typedef std::function<void(int32 tile)> TileFunc;
+
+	TileScheduler();
+
+	virtual ~TileScheduler();
+
+	// numThreads为额外创建的线程数量，可以为0
+	bool Create(int32 numThreads);
+
+	void Destroy();
+
+	// 执行[0, numTiles)所有的tile，全部完成之后返回
+	void Run(int32 numTiles, const TileFunc& func);
+
+	int32 GetNumWorkers() const
+	{
+		return m_Queues.size();
+	}
+
+	// 上一次Run中窃取的次数
+	int32 GetNumSteals() const
+	{
+		return m_NumSteals.load();
+	}
+
+protected:
+
+	friend class TileWorkerTask;
+
+	void WorkerLoop(int32 worker);
+
+protected:
+
+	TaskThreadPool*						m_ThreadPool;
+	std::vector<WorkStealingQueue*>		m_Queues;
+	std::vector<TileWorkerTask*>		m_WorkerTasks;
+
+	const TileFunc*						m_TileFunc;
+	std::atomic<int32>					m_NumRemaining;
+	std::atomic<int32>					m_NumActiveTasks;
+	std::atomic<int32>					m_NumSteals;
+
+};
@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#include "Common/Common.h"
+
+#include <vector>
+#include <atomic>
+
+// 固定容量的Chase-Lev双端队列。
+// 所有者在开始执行之前Push，执行时所有者从底部Pop，其它线程从顶部Steal，只有争抢最后一个元素时才需要CAS。
+// 执行期间不能再Push，所以不需要扩容，元素本身也不需要原子访问。
+class WorkStealingQueue
+{
+public:
+
+	WorkStealingQueue()
+		: m_Top(0)
+		, m_Bottom(0)
+	{
+
+	}
+
+	// 不能与Pop/Steal并发调用
+	void Reset(int32 capacity)
+	{
+		m_Items.resize(capacity);
+		m_Top.store(0);
+		m_Bottom.store(0);
+	}
+
+	// 只能由所有者在执行之前调用，总数不能超过Reset的容量
+	void Push(int32 item)
+	{
+		int32 bottom = m_Bottom.load(std::memory_order_relaxed);
+		m_Items[bottom] = item;
+		m_Bottom.store(bottom + 1, std::memory_order_release);
+	}
+
+	// 只能由所有者调用，取出最后Push的元素
+	bool Pop(int32& outItem)
+	{
+		int32 bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+		m_Bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int32 top = m_Top.load(std::memory_order_relaxed);
+
+		if (top > bottom)
+		{
+			m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+			return false;
+		}
+
+		outItem = m_Items[bottom];
+		if (top == bottom)
+		{
+			// 最后一个元素，与Steal竞争
+			bool success = m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+			return success;
+		}
+
+		return true;
+	}
+
+	// 任意线程调用，取出最早Push的元素。与其它线程竞争失败时返回false，队列可能仍不为空。
+	bool Steal(int32& outItem)
+	{
+		int32 top = m_Top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int32 bottom = m_Bottom.load(std::memory_order_acquire);
+
+		if (top >= bottom) {
+			return false;
+		}
+
+		outItem = m_Items[top];
+		return m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+	}
+
+	bool IsEmpty() const
+	{
+		return m_Top.load(std::memory_order_acquire) >= m_Bottom.load(std::memory_order_acquire);
+	}
+
+protected:
+
+	std::vector<int32>		m_Items;
+	std::atomic<int32>		m_Top;
+	std::atomic<int32>		m_Bottom;
+
+};
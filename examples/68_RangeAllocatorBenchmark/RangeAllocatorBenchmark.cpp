@@ -0,0 +1,489 @@
+﻿#include "Common/Common.h"
+#include "Common/Log.h"
+#include "Math/Math.h"
+#include "Utils/Alignment.h"
+#include "Vulkan/VulkanMemory.h"
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+
+// 回放分配Trace，对比VulkanRangeAllocator(TLSF)与按Offset有序的首次适配，输出耗时以及碎片率。
+// 不需要Vulkan设备。用法：
+//     68_RangeAllocatorBenchmark                      回放内置的Trace
+//     68_RangeAllocatorBenchmark a.trace b.trace      回放Trace文件
+//     68_RangeAllocatorBenchmark --save dir           把内置的Trace写到dir下
+// Trace为文本格式，第一行"size <字节数>"指定区间大小，之后每行一个操作：
+//     a <id> <size> <alignment>
+//     f <id>
+
+struct TraceOp
+{
+	bool	alloc;
+	uint32	id;
+	uint32	size;
+	uint32	alignment;
+};
+
+struct Trace
+{
+	std::string				name;
+	uint32					rangeSize = 0;
+	std::vector<TraceOp>	ops;
+};
+
+struct ReplayStats
+{
+	double	seconds = 0;
+	int32	numAllocs = 0;
+	int32	numFrees = 0;
+	int32	numFailed = 0;
+	uint32	peakUsed = 0;
+	double	avgFragmentation = 0;
+	float	maxFragmentation = 0;
+	uint32	maxFreeBlocks = 0;
+};
+
+class RandomStream
+{
+public:
+	explicit RandomStream(uint32 seed)
+		: m_State(seed)
+	{
+
+	}
+
+	uint32 Next()
+	{
+		m_State ^= m_State << 13;
+		m_State ^= m_State >> 17;
+		m_State ^= m_State << 5;
+		return m_State;
+	}
+
+	uint32 Range(uint32 minValue, uint32 maxValue)
+	{
+		return minValue + Next() % (maxValue - minValue + 1);
+	}
+
+	// 按对数均匀分布，小块多大块少
+	uint32 LogRange(uint32 minValue, uint32 maxValue)
+	{
+		float t = (Next() & 0xFFFF) / 65535.0f;
+		return (uint32)(minValue * MMath::Pow((float)maxValue / (float)minValue, t));
+	}
+
+private:
+	uint32 m_State;
+};
+
+// 改动之前的做法：空闲区间按Offset有序存放，分配时线性查找第一个能放下的区间，释放时二分插入并合并
+class LinearRangeAllocator
+{
+public:
+	void Init(uint32 size)
+	{
+		m_FreeRanges.clear();
+		m_UsedRanges.clear();
+		m_FreeSize = size;
+
+		VulkanRange range;
+		range.offset = 0;
+		range.size   = size;
+		m_FreeRanges.push_back(range);
+	}
+
+	bool Allocate(uint32 size, uint32 alignment, uint32& outAllocatedOffset, uint32& outAlignedOffset, uint32& outAllocatedSize)
+	{
+		for (int32 index = 0; index < m_FreeRanges.size(); ++index)
+		{
+			VulkanRange& range = m_FreeRanges[index];
+			uint32 alignedOffset = Align(range.offset, alignment);
+			uint32 allocatedSize = alignedOffset - range.offset + size;
+			if (allocatedSize > range.size) {
+				continue;
+			}
+
+			outAllocatedOffset = range.offset;
+			outAlignedOffset   = alignedOffset;
+			outAllocatedSize   = allocatedSize;
+
+			range.offset += allocatedSize;
+			range.size   -= allocatedSize;
+			if (range.size == 0) {
+				m_FreeRanges.erase(m_FreeRanges.begin() + index);
+			}
+
+			m_UsedRanges[outAllocatedOffset] = allocatedSize;
+			m_FreeSize -= allocatedSize;
+			return true;
+		}
+		return false;
+	}
+
+	void Free(uint32 offset)
+	{
+		auto it = m_UsedRanges.find(offset);
+		VulkanRange range;
+		range.offset = offset;
+		range.size   = it->second;
+		m_UsedRanges.erase(it);
+		m_FreeSize += range.size;
+
+		int32 index = (int32)(std::lower_bound(m_FreeRanges.begin(), m_FreeRanges.end(), range) - m_FreeRanges.begin());
+		m_FreeRanges.insert(m_FreeRanges.begin() + index, range);
+
+		if (index + 1 < m_FreeRanges.size() && m_FreeRanges[index].offset + m_FreeRanges[index].size == m_FreeRanges[index + 1].offset)
+		{
+			m_FreeRanges[index].size += m_FreeRanges[index + 1].size;
+			m_FreeRanges.erase(m_FreeRanges.begin() + index + 1);
+		}
+		if (index > 0 && m_FreeRanges[index - 1].offset + m_FreeRanges[index - 1].size == m_FreeRanges[index].offset)
+		{
+			m_FreeRanges[index - 1].size += m_FreeRanges[index].size;
+			m_FreeRanges.erase(m_FreeRanges.begin() + index);
+		}
+	}
+
+	uint32 GetNumFreeBlocks() const
+	{
+		return (uint32)m_FreeRanges.size();
+	}
+
+	uint32 GetFreeSize() const
+	{
+		return m_FreeSize;
+	}
+
+	uint32 GetLargestFreeBlock() const
+	{
+		uint32 largest = 0;
+		for (int32 index = 0; index < m_FreeRanges.size(); ++index) {
+			largest = MMath::Max(largest, m_FreeRanges[index].size);
+		}
+		return largest;
+	}
+
+private:
+	std::vector<VulkanRange>			m_FreeRanges;
+	std::unordered_map<uint32, uint32>	m_UsedRanges;
+	uint32								m_FreeSize = 0;
+};
+
+// 常驻的小Buffer随机申请释放
+Trace GenerateBufferTrace()
+{
+	Trace trace;
+	trace.name      = "buffers";
+	trace.rangeSize = 64 * 1024 * 1024;
+
+	RandomStream random(1);
+	std::vector<uint32> live;
+	uint32 nextID = 0;
+	for (int32 i = 0; i < 200000; ++i)
+	{
+		if (live.size() < 800 || (live.size() < 1200 && (random.Next() & 1)))
+		{
+			TraceOp op = { true, nextID, random.LogRange(256, 256 * 1024), 256 };
+			trace.ops.push_back(op);
+			live.push_back(nextID++);
+		}
+		else
+		{
+			int32 index = random.Next() % live.size();
+			TraceOp op = { false, live[index], 0, 0 };
+			trace.ops.push_back(op);
+			live[index] = live.back();
+			live.pop_back();
+		}
+	}
+
+	return trace;
+}
+
+// 贴图大小不一，对齐要求较大，会走到对齐的回退查找
+Trace GenerateImageTrace()
+{
+	Trace trace;
+	trace.name      = "images";
+	trace.rangeSize = 256 * 1024 * 1024;
+
+	const uint32 alignments[3] = { 1024, 4096, 64 * 1024 };
+
+	RandomStream random(2);
+	std::vector<uint32> live;
+	uint32 nextID = 0;
+	for (int32 i = 0; i < 50000; ++i)
+	{
+		if (live.size() < 60 || (live.size() < 150 && (random.Next() & 1)))
+		{
+			uint32 alignment = alignments[random.Next() % 3];
+			TraceOp op = { true, nextID, Align(random.LogRange(16 * 1024, 8 * 1024 * 1024), 1024), alignment };
+			trace.ops.push_back(op);
+			live.push_back(nextID++);
+		}
+		else
+		{
+			int32 index = random.Next() % live.size();
+			TraceOp op = { false, live[index], 0, 0 };
+			trace.ops.push_back(op);
+			live[index] = live.back();
+			live.pop_back();
+		}
+	}
+
+	return trace;
+}
+
+// 每帧大量临时分配，三帧之后整体释放，期间夹杂少量常驻分配
+Trace GenerateFrameTrace()
+{
+	Trace trace;
+	trace.name      = "frames";
+	trace.rangeSize = 32 * 1024 * 1024;
+
+	RandomStream random(3);
+	std::vector<std::vector<uint32>> frames(3);
+	std::vector<uint32> persistent;
+	uint32 nextID = 0;
+	for (int32 frame = 0; frame < 2000; ++frame)
+	{
+		std::vector<uint32>& transient = frames[frame % 3];
+		for (int32 i = 0; i < transient.size(); ++i)
+		{
+			TraceOp op = { false, transient[i], 0, 0 };
+			trace.ops.push_back(op);
+		}
+		transient.clear();
+
+		int32 count = random.Range(100, 300);
+		for (int32 i = 0; i < count; ++i)
+		{
+			TraceOp op = { true, nextID, random.LogRange(64, 16 * 1024), 256 };
+			trace.ops.push_back(op);
+			transient.push_back(nextID++);
+		}
+
+		if (random.Next() % 8 == 0)
+		{
+			TraceOp op = { true, nextID, random.LogRange(4 * 1024, 512 * 1024), 256 };
+			trace.ops.push_back(op);
+			persistent.push_back(nextID++);
+		}
+
+		if (persistent.size() > 0 && random.Next() % 10 == 0)
+		{
+			int32 index = random.Next() % persistent.size();
+			TraceOp op = { false, persistent[index], 0, 0 };
+			trace.ops.push_back(op);
+			persistent[index] = persistent.back();
+			persistent.pop_back();
+		}
+	}
+
+	return trace;
+}
+
+bool LoadTrace(const std::string& path, Trace& outTrace)
+{
+	std::ifstream file(path.c_str());
+	if (!file.is_open())
+	{
+		MLOGE("Failed open trace %s", path.c_str());
+		return false;
+	}
+
+	outTrace.name = path;
+	outTrace.ops.clear();
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream stream(line);
+		std::string command;
+		if (!(stream >> command) || command[0] == '#') {
+			continue;
+		}
+
+		TraceOp op = { false, 0, 0, 1 };
+		if (command == "size") {
+			stream >> outTrace.rangeSize;
+		}
+		else if (command == "a")
+		{
+			op.alloc = true;
+			stream >> op.id >> op.size >> op.alignment;
+			outTrace.ops.push_back(op);
+		}
+		else if (command == "f")
+		{
+			stream >> op.id;
+			outTrace.ops.push_back(op);
+		}
+	}
+
+	if (outTrace.rangeSize == 0)
+	{
+		MLOGE("Trace %s missing size.", path.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void SaveTrace(const std::string& path, const Trace& trace)
+{
+	std::ofstream file(path.c_str());
+	file << "size " << trace.rangeSize << "\n";
+	for (int32 i = 0; i < trace.ops.size(); ++i)
+	{
+		const TraceOp& op = trace.ops[i];
+		if (op.alloc) {
+			file << "a " << op.id << " " << op.size << " " << op.alignment << "\n";
+		}
+		else {
+			file << "f " << op.id << "\n";
+		}
+	}
+	MLOG("Saved trace %s, %d ops", path.c_str(), (int32)trace.ops.size());
+}
+
+template<typename AllocatorType>
+void Replay(const Trace& trace, bool collectStats, ReplayStats& outStats)
+{
+	AllocatorType allocator;
+	allocator.Init(trace.rangeSize);
+
+	std::unordered_map<uint32, uint32> offsets;
+	offsets.reserve(trace.ops.size());
+
+	ReplayStats stats;
+	int32 numSamples = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int32 i = 0; i < trace.ops.size(); ++i)
+	{
+		const TraceOp& op = trace.ops[i];
+		if (op.alloc)
+		{
+			uint32 allocatedOffset = 0;
+			uint32 alignedOffset   = 0;
+			uint32 allocatedSize   = 0;
+			if (allocator.Allocate(op.size, op.alignment, allocatedOffset, alignedOffset, allocatedSize))
+			{
+				offsets[op.id] = allocatedOffset;
+				stats.numAllocs += 1;
+			}
+			else {
+				stats.numFailed += 1;
+			}
+		}
+		else
+		{
+			auto it = offsets.find(op.id);
+			if (it != offsets.end())
+			{
+				allocator.Free(it->second);
+				offsets.erase(it);
+				stats.numFrees += 1;
+			}
+		}
+
+		// 统计只在单独的一遍里做，避免影响计时
+		if (collectStats && (i % 64) == 0)
+		{
+			uint32 freeSize = allocator.GetFreeSize();
+			float fragmentation = freeSize > 0 ? 1.0f - (float)allocator.GetLargestFreeBlock() / (float)freeSize : 0.0f;
+			stats.peakUsed          = MMath::Max(stats.peakUsed, trace.rangeSize - freeSize);
+			stats.avgFragmentation += fragmentation;
+			stats.maxFragmentation  = MMath::Max(stats.maxFragmentation, fragmentation);
+			stats.maxFreeBlocks     = MMath::Max(stats.maxFreeBlocks, allocator.GetNumFreeBlocks());
+			numSamples += 1;
+		}
+	}
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (numSamples > 0) {
+		stats.avgFragmentation /= numSamples;
+	}
+
+	outStats = stats;
+}
+
+template<typename AllocatorType>
+void RunBenchmark(const Trace& trace, const char* allocatorName)
+{
+	// 取多次回放中最快的一次，减少调度带来的抖动
+	double bestSeconds = 0;
+	for (int32 i = 0; i < 5; ++i)
+	{
+		ReplayStats timing;
+		Replay<AllocatorType>(trace, false, timing);
+		bestSeconds = i == 0 ? timing.seconds : MMath::Min(bestSeconds, timing.seconds);
+	}
+
+	ReplayStats stats;
+	Replay<AllocatorType>(trace, true, stats);
+
+	MLOG(
+		"%-8s %-8s %8.1f ns/op  allocs=%d frees=%d failed=%d peak=%.2fMB frag avg=%.3f max=%.3f freeBlocks max=%u",
+		trace.name.c_str(),
+		allocatorName,
+		bestSeconds * 1e9 / trace.ops.size(),
+		stats.numAllocs,
+		stats.numFrees,
+		stats.numFailed,
+		stats.peakUsed / 1024.0f / 1024.0f,
+		stats.avgFragmentation,
+		stats.maxFragmentation,
+		stats.maxFreeBlocks
+	);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<Trace> traces;
+	std::string saveDir;
+
+	for (int32 i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--save" && i + 1 < argc) {
+			saveDir = argv[++i];
+		}
+		else
+		{
+			Trace trace;
+			if (LoadTrace(arg, trace)) {
+				traces.push_back(trace);
+			}
+		}
+	}
+
+	if (traces.size() == 0)
+	{
+		traces.push_back(GenerateBufferTrace());
+		traces.push_back(GenerateImageTrace());
+		traces.push_back(GenerateFrameTrace());
+	}
+
+	if (saveDir.size() > 0)
+	{
+		for (int32 i = 0; i < traces.size(); ++i) {
+			SaveTrace(saveDir + "/" + traces[i].name + ".trace", traces[i]);
+		}
+		return 0;
+	}
+
+	for (int32 i = 0; i < traces.size(); ++i)
+	{
+		RunBenchmark<VulkanRangeAllocator>(traces[i], "tlsf");
+		RunBenchmark<LinearRangeAllocator>(traces[i], "linear");
+	}
+
+	return 0;
+}
@@ -0,0 +1,294 @@
+﻿#include "Common/Common.h"
+#include "Common/Log.h"
+
+#include "Demo/DVKCommon.h"
+#include "GenericPlatform/GenericPlatformTime.h"
+
+#include <vector>
+#include <thread>
+#include <atomic>
+
+// 多线程同时调用VulkanResourceHeapManager::AllocateBuffer/Release的压力测试。
+// 每个线程维护一个固定大小的存活窗口，不断随机申请新Buffer并释放最早的Buffer，
+// 申请后在映射内存里写入标记，释放前校验标记，用于发现不同线程拿到重叠区间的情况。
+// 启动时按1/2/4/8个线程各跑一遍，界面上可以重新运行。
+class HeapStressBenchmarkDemo : public DemoBase
+{
+public:
+	HeapStressBenchmarkDemo(int32 width, int32 height, const char* title, const std::vector<std::string>& cmdLine)
+		: DemoBase(width, height, title, cmdLine)
+	{
+
+	}
+
+	virtual ~HeapStressBenchmarkDemo()
+	{
+
+	}
+
+	virtual bool PreInit() override
+	{
+		return true;
+	}
+
+	virtual bool Init() override
+	{
+		DemoBase::Setup();
+		DemoBase::Prepare();
+
+		CreateGUI();
+		RunBenchmarks();
+
+		m_Ready = true;
+
+		return true;
+	}
+
+	virtual void Exist() override
+	{
+		DemoBase::Release();
+
+		DestroyGUI();
+	}
+
+	virtual void Loop(float time, float delta) override
+	{
+		if (!m_Ready) {
+			return;
+		}
+		Draw(time, delta);
+	}
+
+private:
+
+	enum
+	{
+		ITERATIONS_PER_THREAD	= 20000,
+		LIVE_WINDOW				= 64,
+	};
+
+	struct BenchmarkResult
+	{
+		int32	numThreads = 0;
+		double	milliseconds = 0;
+		double	nsPerOp = 0;
+		int32	numErrors = 0;
+		int32	numLeakedBuffers = 0;
+	};
+
+	class RandomStream
+	{
+	public:
+		explicit RandomStream(uint32 seed)
+			: m_State(seed * 2654435761u + 1)
+		{
+
+		}
+
+		uint32 Next()
+		{
+			m_State ^= m_State << 13;
+			m_State ^= m_State >> 17;
+			m_State ^= m_State << 5;
+			return m_State;
+		}
+
+	private:
+		uint32 m_State;
+	};
+
+	void Draw(float time, float delta)
+	{
+		int32 bufferIndex = DemoBase::AcquireBackbufferIndex();
+
+		UpdateFPS(time, delta);
+		UpdateUI(time, delta);
+
+		SetupCommandBuffers(bufferIndex);
+
+		DemoBase::Present(bufferIndex);
+	}
+
+	void UpdateUI(float time, float delta)
+	{
+		bool rerun = false;
+
+		m_GUI->StartFrame();
+
+		{
+			ImGui::SetNextWindowPos(ImVec2(0, 0));
+			ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
+			ImGui::Begin("HeapStressBenchmarkDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
+
+			ImGui::Text("%d iterations per thread, %d live buffers per thread", (int32)ITERATIONS_PER_THREAD, (int32)LIVE_WINDOW);
+			for (int32 i = 0; i < m_Results.size(); ++i)
+			{
+				const BenchmarkResult& result = m_Results[i];
+				ImGui::Text("%d threads: %.2f ms, %.1f ns/op, errors=%d, leaked=%d", result.numThreads, result.milliseconds, result.nsPerOp, result.numErrors, result.numLeakedBuffers);
+			}
+
+			rerun = ImGui::Button("Run");
+
+			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
+			ImGui::End();
+		}
+
+		m_GUI->EndFrame();
+		m_GUI->Update();
+
+		if (rerun) {
+			RunBenchmarks();
+		}
+	}
+
+	void RunBenchmarks()
+	{
+		m_Results.clear();
+
+		// 测试期间不推进帧，先等GPU空闲并清空延迟释放队列，统计里只剩测试自己的分配
+		vkDeviceWaitIdle(m_Device);
+		m_VulkanDevice->GetResourceHeapManager().FlushDeferredReleases();
+
+		const int32 threadCounts[4] = { 1, 2, 4, 8 };
+		for (int32 i = 0; i < 4; ++i) {
+			m_Results.push_back(RunBenchmark(threadCounts[i]));
+		}
+	}
+
+	BenchmarkResult RunBenchmark(int32 numThreads)
+	{
+		VulkanResourceHeapManager& heapManager = m_VulkanDevice->GetResourceHeapManager();
+
+		// 覆盖所有Pool以及超出Pool的大尺寸分配
+		const uint32 sizes[8] = { 64, 200, 1000, 4096, 16 * 1024, 60 * 1024, 200 * 1024, 1024 * 1024 };
+
+		std::atomic<int32> numErrors(0);
+		std::atomic<int32> numReady(0);
+		std::atomic<bool>  start(false);
+
+		auto Worker = [&](int32 threadIndex)
+		{
+			RandomStream random(threadIndex + 1);
+			std::vector<VulkanBufferSubAllocation*> live(LIVE_WINDOW, nullptr);
+			std::vector<uint32> stamps(LIVE_WINDOW, 0);
+
+			numReady.fetch_add(1);
+			while (!start.load()) {
+				std::this_thread::yield();
+			}
+
+			for (int32 i = 0; i < ITERATIONS_PER_THREAD; ++i)
+			{
+				int32 slot = i % LIVE_WINDOW;
+				if (live[slot])
+				{
+					if (*(uint32*)live[slot]->GetMappedPointer() != stamps[slot]) {
+						numErrors.fetch_add(1);
+					}
+					delete live[slot];
+				}
+
+				uint32 size = sizes[random.Next() % 8];
+				live[slot]  = heapManager.AllocateBuffer(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, __FILE__, __LINE__);
+				stamps[slot] = (threadIndex << 24) | i;
+				*(uint32*)live[slot]->GetMappedPointer() = stamps[slot];
+			}
+
+			for (int32 i = 0; i < LIVE_WINDOW; ++i)
+			{
+				if (live[i] && *(uint32*)live[i]->GetMappedPointer() != stamps[i]) {
+					numErrors.fetch_add(1);
+				}
+				delete live[i];
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (int32 i = 0; i < numThreads; ++i) {
+			threads.push_back(std::thread(Worker, i));
+		}
+
+		while (numReady.load() != numThreads) {
+			std::this_thread::yield();
+		}
+
+		double startTime = GenericPlatformTime::Seconds();
+		start.store(true);
+		for (int32 i = 0; i < numThreads; ++i) {
+			threads[i].join();
+		}
+		double endTime = GenericPlatformTime::Seconds();
+
+		// 所有分配都已释放，Pool里不应该再有正在使用的Buffer
+		VulkanMemoryStats memoryStats;
+		heapManager.GetStats(memoryStats);
+
+		BenchmarkResult result;
+		result.numThreads   = numThreads;
+		result.milliseconds = (endTime - startTime) * 1000.0;
+		result.nsPerOp      = (endTime - startTime) * 1e9 / ((double)numThreads * ITERATIONS_PER_THREAD);
+		result.numErrors    = numErrors.load();
+		for (int32 i = 0; i < memoryStats.pools.size(); ++i) {
+			result.numLeakedBuffers += memoryStats.pools[i].numUsedBuffers;
+		}
+
+		MLOG("HeapStress %d threads: %.2f ms, %.1f ns/op, errors=%d, leaked=%d", result.numThreads, result.milliseconds, result.nsPerOp, result.numErrors, result.numLeakedBuffers);
+
+		return result;
+	}
+
+	void SetupCommandBuffers(int32 backBufferIndex)
+	{
+		VkCommandBuffer commandBuffer = m_CommandBuffers[backBufferIndex];
+
+		VkCommandBufferBeginInfo cmdBeginInfo;
+		ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
+		VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
+
+		VkClearValue clearValues[2];
+		clearValues[0].color        = { { 0.2f, 0.2f, 0.2f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo;
+		ZeroVulkanStruct(renderPassBeginInfo, VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO);
+		renderPassBeginInfo.renderPass               = m_RenderPass;
+		renderPassBeginInfo.framebuffer              = m_FrameBuffers[backBufferIndex];
+		renderPassBeginInfo.clearValueCount          = 2;
+		renderPassBeginInfo.pClearValues             = clearValues;
+		renderPassBeginInfo.renderArea.offset.x      = 0;
+		renderPassBeginInfo.renderArea.offset.y      = 0;
+		renderPassBeginInfo.renderArea.extent.width  = m_FrameWidth;
+		renderPassBeginInfo.renderArea.extent.height = m_FrameHeight;
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
+
+		vkCmdEndRenderPass(commandBuffer);
+		VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
+	}
+
+	void CreateGUI()
+	{
+		m_GUI = new ImageGUIContext();
+		m_GUI->Init("assets/fonts/Ubuntu-Regular.ttf");
+	}
+
+	void DestroyGUI()
+	{
+		m_GUI->Destroy();
+		delete m_GUI;
+	}
+
+private:
+
+	bool 							m_Ready = false;
+
+	std::vector<BenchmarkResult>	m_Results;
+
+	ImageGUIContext*				m_GUI = nullptr;
+};
+
+std::shared_ptr<AppModuleBase> CreateAppMode(const std::vector<std::string>& cmdLine)
+{
+	return std::make_shared<HeapStressBenchmarkDemo>(1400, 900, "HeapStressBenchmarkDemo", cmdLine);
+}
@@ -0,0 +1,446 @@
+﻿#include "Common/Common.h"
+#include "Common/Log.h"
+
+#include "Demo/DVKCommon.h"
+
+#include "Math/Vector4.h"
+#include "Math/Matrix4x4.h"
+
+#include <vector>
+
+// 每帧在绘制之前调用一次VulkanResourceHeapManager::Defragment，拷贝命令录制在本帧CommandBuffer的RenderPass之前。
+// 模型的VertexBuffer/IndexBuffer、三张贴图以及用来制造碎片的Buffer都允许被移动；
+// 点击Fragment申请一批大Buffer然后释放其中的大部分，Device Local的页上就会留下很多空洞。
+class HeapDefragmentDemo : public DemoBase
+{
+public:
+	HeapDefragmentDemo(int32 width, int32 height, const char* title, const std::vector<std::string>& cmdLine)
+		: DemoBase(width, height, title, cmdLine)
+	{
+
+	}
+
+	virtual ~HeapDefragmentDemo()
+	{
+
+	}
+
+	virtual bool PreInit() override
+	{
+		return true;
+	}
+
+	virtual bool Init() override
+	{
+		DemoBase::Setup();
+		DemoBase::Prepare();
+
+		CreateGUI();
+		LoadAssets();
+		InitParmas();
+
+		m_Ready = true;
+		return true;
+	}
+
+	virtual void Exist() override
+	{
+		DestroyAssets();
+		DestroyGUI();
+		DemoBase::Release();
+	}
+
+	virtual void Loop(float time, float delta) override
+	{
+		if (!m_Ready) {
+			return;
+		}
+		Draw(time, delta);
+	}
+
+private:
+
+	enum
+	{
+		JUNK_BUFFER_SIZE	= 8 * 1024 * 1024,
+		JUNK_BUFFER_COUNT	= 48,
+	};
+
+	struct ModelViewProjectionBlock
+	{
+		Matrix4x4 model;
+		Matrix4x4 view;
+		Matrix4x4 proj;
+	};
+
+	struct PBRParamBlock
+	{
+		Vector4 param;
+		Vector4 cameraPos;
+		Vector4 lightColor;
+	};
+
+	void Draw(float time, float delta)
+	{
+		int32 bufferIndex = DemoBase::AcquireBackbufferIndex();
+
+		UpdateFPS(time, delta);
+
+		bool hovered = UpdateUI(time, delta);
+		if (!hovered) {
+			m_ViewCamera.Update(time, delta);
+		}
+
+		m_PBRParam.cameraPos = m_ViewCamera.GetTransform().GetOrigin();
+
+		SetupCommandBuffers(bufferIndex);
+		DemoBase::Present(bufferIndex);
+	}
+
+	bool UpdateUI(float time, float delta)
+	{
+		VulkanMemoryStats memoryStats;
+		m_VulkanDevice->GetResourceHeapManager().GetStats(memoryStats);
+
+		uint32 numPages     = 0;
+		uint32 numFreePages = 0;
+		uint64 pageSize     = 0;
+		uint64 pageUsedSize = 0;
+		for (int32 i = 0; i < memoryStats.memoryTypes.size(); ++i)
+		{
+			numPages     += memoryStats.memoryTypes[i].numPages;
+			numFreePages += memoryStats.memoryTypes[i].numFreePages;
+			pageSize     += memoryStats.memoryTypes[i].pageSize;
+			pageUsedSize += memoryStats.memoryTypes[i].pageUsedSize;
+		}
+
+		m_GUI->StartFrame();
+
+		{
+			ImGui::SetNextWindowPos(ImVec2(0, 0));
+			ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
+			ImGui::Begin("HeapDefragmentDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
+
+			if (ImGui::Button("Fragment")) {
+				Fragment();
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Free Junk")) {
+				FreeJunkBuffers();
+			}
+
+			ImGui::Checkbox("Defragment", &m_Defragment);
+			ImGui::SliderInt("MB/Frame", &m_DefragmentMB, 1, 64);
+
+			ImGui::Separator();
+
+			ImGui::Text("Junk Buffers: %d", (int32)m_JunkBuffers.size());
+			ImGui::Text("Pages: %d used, %d free", numPages, numFreePages);
+			ImGui::Text("Page Used: %.1f / %.1f MB", pageUsedSize / (1024.0f * 1024.0f), pageSize / (1024.0f * 1024.0f));
+			ImGui::Text("Fragmentation: %.1f%%", memoryStats.GetFragmentation() * 100.0f);
+			ImGui::Text("Moves: %d, Moved: %.1f MB", m_NumMoves, m_BytesMoved / (1024.0f * 1024.0f));
+
+			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
+			ImGui::End();
+		}
+
+		bool hovered = ImGui::IsAnyWindowHovered() || ImGui::IsAnyItemHovered() || ImGui::IsRootWindowOrAnyChildHovered();
+
+		m_GUI->EndFrame();
+		m_GUI->Update();
+
+		return hovered;
+	}
+
+	// 申请一批大Buffer，再释放其中四分之三，留下分散在各页上的空洞
+	void Fragment()
+	{
+		for (int32 i = 0; i < JUNK_BUFFER_COUNT; ++i)
+		{
+			vk_demo::DVKBuffer* buffer = vk_demo::DVKBuffer::CreateBuffer(
+				m_VulkanDevice,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				JUNK_BUFFER_SIZE
+			);
+			buffer->EnableDefragment();
+			m_JunkBuffers.push_back(buffer);
+		}
+
+		std::vector<vk_demo::DVKBuffer*> keeps;
+		for (int32 i = 0; i < m_JunkBuffers.size(); ++i)
+		{
+			if (i % 4 == 0) {
+				keeps.push_back(m_JunkBuffers[i]);
+			}
+			else {
+				delete m_JunkBuffers[i];
+			}
+		}
+		m_JunkBuffers.swap(keeps);
+	}
+
+	void FreeJunkBuffers()
+	{
+		for (int32 i = 0; i < m_JunkBuffers.size(); ++i) {
+			delete m_JunkBuffers[i];
+		}
+		m_JunkBuffers.clear();
+	}
+
+	void DefragmentResources(VkCommandBuffer commandBuffer)
+	{
+		if (!m_Defragment) {
+			return;
+		}
+
+		VulkanDefragmentStats stats = m_VulkanDevice->GetResourceHeapManager().Defragment(commandBuffer, (uint64)m_DefragmentMB * 1024 * 1024);
+		m_NumMoves   += stats.numMoves;
+		m_BytesMoved += stats.bytesMoved;
+
+		if (stats.numMoves == 0) {
+			return;
+		}
+
+		// 贴图被移动之后View变了，描述符可能正被之前提交的帧使用，移动很少发生，等GPU空闲之后再重写
+		bool textureMoved = false;
+		for (int32 i = 0; i < 3; ++i) {
+			textureMoved = textureMoved || m_Textures[i]->imageView != m_TextureViews[i];
+		}
+
+		if (textureMoved)
+		{
+			vkDeviceWaitIdle(m_Device);
+			for (int32 i = 0; i < 3; ++i)
+			{
+				m_Material->SetTexture(m_TextureNames[i], m_Textures[i]);
+				m_TextureViews[i] = m_Textures[i]->imageView;
+			}
+		}
+	}
+
+	void LoadAssets()
+	{
+		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+
+		m_Model = vk_demo::DVKModel::LoadFromFile(
+			"assets/models/leather-shoes/model.fbx",
+			m_VulkanDevice,
+			cmdBuffer,
+			{
+				VertexAttribute::VA_Position,
+				VertexAttribute::VA_UV0,
+				VertexAttribute::VA_Normal,
+				VertexAttribute::VA_Tangent
+			}
+		);
+		m_Model->rootNode->localMatrix.AppendRotation(180, Vector3::UpVector);
+		m_Model->rootNode->MarkDirty();
+
+		// 每帧重新录制命令，所以模型的Buffer可以被移动
+		for (int32 i = 0; i < m_Model->meshes.size(); ++i)
+		{
+			vk_demo::DVKMesh* mesh = m_Model->meshes[i];
+			for (int32 j = 0; j < mesh->primitives.size(); ++j)
+			{
+				vk_demo::DVKPrimitive* primitive = mesh->primitives[j];
+				if (primitive->vertexBuffer) {
+					primitive->vertexBuffer->dvkBuffer->EnableDefragment();
+				}
+				if (primitive->indexBuffer) {
+					primitive->indexBuffer->dvkBuffer->EnableDefragment();
+				}
+			}
+		}
+
+		m_Textures[0] = vk_demo::DVKTexture::Create2D(
+			"assets/models/leather-shoes/RootNode_baseColor.jpg",
+			m_VulkanDevice,
+			cmdBuffer
+		);
+
+		m_Textures[1] = vk_demo::DVKTexture::Create2D(
+			"assets/models/leather-shoes/RootNode_normal.jpg",
+			m_VulkanDevice,
+			cmdBuffer
+		);
+
+		m_Textures[2] = vk_demo::DVKTexture::Create2D(
+			"assets/models/leather-shoes/RootNode_occlusionRoughnessMetallic.jpg",
+			m_VulkanDevice,
+			cmdBuffer
+		);
+
+		m_Shader = vk_demo::DVKShader::Create(
+			m_VulkanDevice,
+			true,
+			"assets/shaders/55_PBR_DirectLighting/obj.vert.spv",
+			"assets/shaders/55_PBR_DirectLighting/obj.frag.spv"
+		);
+
+		m_Material = vk_demo::DVKMaterial::Create(
+			m_VulkanDevice,
+			m_RenderPass,
+			m_PipelineCache,
+			m_Shader
+		);
+		m_Material->PreparePipeline();
+
+		for (int32 i = 0; i < 3; ++i)
+		{
+			m_Textures[i]->EnableDefragment();
+			m_Material->SetTexture(m_TextureNames[i], m_Textures[i]);
+			m_TextureViews[i] = m_Textures[i]->imageView;
+		}
+
+		delete cmdBuffer;
+	}
+
+	void DestroyAssets()
+	{
+		FreeJunkBuffers();
+
+		delete m_Model;
+
+		delete m_Shader;
+		delete m_Material;
+
+		for (int32 i = 0; i < 3; ++i) {
+			delete m_Textures[i];
+		}
+	}
+
+	void SetupCommandBuffers(int32 backBufferIndex)
+	{
+		VkCommandBuffer commandBuffer = m_CommandBuffers[backBufferIndex];
+
+		VkCommandBufferBeginInfo cmdBeginInfo;
+		ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
+		VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
+
+		// 拷贝命令不能出现在RenderPass里
+		DefragmentResources(commandBuffer);
+
+		VkClearValue clearValues[2];
+		clearValues[0].color        = { { 0.2f, 0.2f, 0.2f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo;
+		ZeroVulkanStruct(renderPassBeginInfo, VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO);
+		renderPassBeginInfo.renderPass               = m_RenderPass;
+		renderPassBeginInfo.framebuffer              = m_FrameBuffers[backBufferIndex];
+		renderPassBeginInfo.clearValueCount          = 2;
+		renderPassBeginInfo.pClearValues             = clearValues;
+		renderPassBeginInfo.renderArea.offset.x      = 0;
+		renderPassBeginInfo.renderArea.offset.y      = 0;
+		renderPassBeginInfo.renderArea.extent.width  = m_FrameWidth;
+		renderPassBeginInfo.renderArea.extent.height = m_FrameHeight;
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		VkViewport viewport = {};
+		viewport.x        = 0;
+		viewport.y        = m_FrameHeight;
+		viewport.width    = m_FrameWidth;
+		viewport.height   = -m_FrameHeight;    // flip y axis
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+
+		VkRect2D scissor = {};
+		scissor.extent.width  = m_FrameWidth;
+		scissor.extent.height = m_FrameHeight;
+		scissor.offset.x = 0;
+		scissor.offset.y = 0;
+
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer,  0, 1, &scissor);
+
+		for (int32 i = 0; i < m_Model->meshes.size(); ++i)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Material->GetPipeline());
+
+			m_Material->BeginFrame();
+
+			m_MVPParam.model = m_Model->meshes[i]->linkNode->GetGlobalMatrix();
+			m_MVPParam.view  = m_ViewCamera.GetView();
+			m_MVPParam.proj  = m_ViewCamera.GetProjection();
+
+			m_Material->BeginObject();
+			m_Material->SetLocalUniform("uboMVP",   &m_MVPParam, sizeof(ModelViewProjectionBlock));
+			m_Material->SetLocalUniform("uboParam", &m_PBRParam, sizeof(PBRParamBlock));
+			m_Material->EndObject();
+
+			m_Material->BindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
+			m_Model->meshes[i]->BindDrawCmd(commandBuffer);
+
+			m_Material->EndFrame();
+		}
+
+		m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
+
+		vkCmdEndRenderPass(commandBuffer);
+		VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
+	}
+
+	void InitParmas()
+	{
+		vk_demo::DVKBoundingBox bounds = m_Model->rootNode->GetBounds();
+		Vector3 boundSize   = bounds.max - bounds.min;
+		Vector3 boundCenter = bounds.min + boundSize * 0.5f;
+
+		m_ViewCamera.SetPosition(boundCenter.x, boundCenter.y, boundCenter.z - 500.0f);
+		m_ViewCamera.LookAt(boundCenter);
+		m_ViewCamera.Perspective(PI / 4, (float)GetWidth(), (float)GetHeight(), 1.0f, 3000.0f);
+
+		m_PBRParam.param.x = 1.0f; // ao
+		m_PBRParam.param.y = 1.0f; // roughness
+		m_PBRParam.param.z = 1.0f; // metallic
+		m_PBRParam.param.w = 0.0f; // debug
+
+		m_PBRParam.cameraPos = m_ViewCamera.GetTransform().GetOrigin();
+
+		m_PBRParam.lightColor = Vector4(1, 1, 1, 10);
+	}
+
+	void CreateGUI()
+	{
+		m_GUI = new ImageGUIContext();
+		m_GUI->Init("assets/fonts/Ubuntu-Regular.ttf");
+	}
+
+	void DestroyGUI()
+	{
+		m_GUI->Destroy();
+		delete m_GUI;
+	}
+
+private:
+
+	bool 								m_Ready = false;
+
+	vk_demo::DVKModel*					m_Model = nullptr;
+	vk_demo::DVKShader*					m_Shader = nullptr;
+	vk_demo::DVKMaterial*				m_Material = nullptr;
+
+	const char*							m_TextureNames[3] = { "texAlbedo", "texNormal", "texORMParam" };
+	vk_demo::DVKTexture*				m_Textures[3] = { nullptr, nullptr, nullptr };
+	VkImageView							m_TextureViews[3] = { VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE };
+
+	std::vector<vk_demo::DVKBuffer*>	m_JunkBuffers;
+
+	bool								m_Defragment = true;
+	int32								m_DefragmentMB = 16;
+	int32								m_NumMoves = 0;
+	uint64								m_BytesMoved = 0;
+
+	vk_demo::DVKCamera					m_ViewCamera;
+
+	ModelViewProjectionBlock			m_MVPParam;
+	PBRParamBlock						m_PBRParam;
+
+	ImageGUIContext*					m_GUI = nullptr;
+};
+
+std::shared_ptr<AppModuleBase> CreateAppMode(const std::vector<std::string>& cmdLine)
+{
+	return std::make_shared<HeapDefragmentDemo>(1400, 900, "HeapDefragmentDemo", cmdLine);
+}
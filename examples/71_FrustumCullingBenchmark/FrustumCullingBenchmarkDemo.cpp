@@ -0,0 +1,410 @@
+﻿#include "Common/Common.h"
+#include "Common/Log.h"
+
+#include "Demo/DVKCommon.h"
+#include "Demo/DVKCulling.h"
+#include "Demo/DVKJobPool.h"
+#include "GenericPlatform/GenericPlatformTime.h"
+
+#include "Math/Vector4.h"
+#include "Math/Matrix4x4.h"
+
+#include <vector>
+
+#define OBJECT_COUNT 1024 * 256
+
+// 对比三种视锥剔除的耗时，场景与ComputeFrustumDemo相同：1024个物体在视野附近，其余散布在很远的地方。
+//     Scalar   逐个物体测试6个平面，ComputeFrustumDemo原来的CPU实现
+//     SoA      DVKCullingSet单线程，以及交给DVKJobPool并行
+//     Compute  Frustum.comp，包含提交、等待以及CPU扫描输出标记得到可见列表的时间
+// 每种方法的可见列表都与Scalar比较，不一致时记为错误。启动时跑一遍，界面上可以重新运行。
+class FrustumCullingBenchmarkDemo : public DemoBase
+{
+public:
+	FrustumCullingBenchmarkDemo(int32 width, int32 height, const char* title, const std::vector<std::string>& cmdLine)
+		: DemoBase(width, height, title, cmdLine)
+	{
+
+	}
+
+	virtual ~FrustumCullingBenchmarkDemo()
+	{
+
+	}
+
+	virtual bool PreInit() override
+	{
+		return true;
+	}
+
+	virtual bool Init() override
+	{
+		DemoBase::Setup();
+		DemoBase::Prepare();
+
+		CreateGUI();
+		LoadAssets();
+		RunBenchmarks();
+
+		m_Ready = true;
+
+		return true;
+	}
+
+	virtual void Exist() override
+	{
+		DestroyAssets();
+		DestroyGUI();
+		DemoBase::Release();
+	}
+
+	virtual void Loop(float time, float delta) override
+	{
+		if (!m_Ready) {
+			return;
+		}
+		Draw(time, delta);
+	}
+
+private:
+
+	enum
+	{
+		ITERATIONS = 50,
+	};
+
+	struct FrustumParamBlock
+	{
+		Vector4 count;
+		Vector4 frustumPlanes[6];
+	};
+
+	struct BenchmarkResult
+	{
+		const char*	name = "";
+		double		milliseconds = 0;
+		int32		numVisible = 0;
+		bool		match = false;
+	};
+
+	void Draw(float time, float delta)
+	{
+		int32 bufferIndex = DemoBase::AcquireBackbufferIndex();
+
+		UpdateFPS(time, delta);
+		UpdateUI(time, delta);
+
+		SetupCommandBuffers(bufferIndex);
+
+		DemoBase::Present(bufferIndex);
+	}
+
+	void UpdateUI(float time, float delta)
+	{
+		bool rerun = false;
+
+		m_GUI->StartFrame();
+
+		{
+			ImGui::SetNextWindowPos(ImVec2(0, 0));
+			ImGui::SetNextWindowSize(ImVec2(0, 0), ImGuiSetCond_FirstUseEver);
+			ImGui::Begin("FrustumCullingBenchmarkDemo", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
+
+			ImGui::Text("%d objects, %d iterations, %d worker threads", (int32)OBJECT_COUNT, (int32)ITERATIONS, m_JobPool->GetNumWorkers());
+			for (int32 i = 0; i < m_Results.size(); ++i)
+			{
+				const BenchmarkResult& result = m_Results[i];
+				ImGui::Text("%-12s %8.3f ms  %5.1fx  visible=%d  %s", result.name, result.milliseconds, m_Results[0].milliseconds / result.milliseconds, result.numVisible, result.match ? "ok" : "MISMATCH");
+			}
+
+			rerun = ImGui::Button("Run");
+
+			ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / m_LastFPS, m_LastFPS);
+			ImGui::End();
+		}
+
+		m_GUI->EndFrame();
+		m_GUI->Update();
+
+		if (rerun) {
+			RunBenchmarks();
+		}
+	}
+
+	void RunBenchmarks()
+	{
+		m_Results.clear();
+
+		// 测试期间不推进帧，先等GPU空闲并释放加载时留在延迟队列里的Staging Buffer
+		vkDeviceWaitIdle(m_Device);
+		m_VulkanDevice->GetResourceHeapManager().FlushDeferredReleases();
+
+		std::vector<uint32> reference;
+		m_Results.push_back(Measure("Scalar", reference, [&](std::vector<uint32>& outVisible) {
+			CullScalar(outVisible);
+		}));
+		m_Results.back().match = true;
+
+		std::vector<uint32> visible;
+		m_Results.push_back(Measure("SoA", visible, [&](std::vector<uint32>& outVisible) {
+			m_CullingSet.Cull(m_Frustum, outVisible);
+		}));
+		m_Results.back().match = visible == reference;
+
+		m_Results.push_back(Measure("SoA JobPool", visible, [&](std::vector<uint32>& outVisible) {
+			m_CullingSet.Cull(m_Frustum, outVisible, m_JobPool);
+		}));
+		m_Results.back().match = visible == reference;
+
+		m_Results.push_back(Measure("Compute", visible, [&](std::vector<uint32>& outVisible) {
+			CullCompute(outVisible);
+		}));
+		m_Results.back().match = visible == reference;
+
+		for (int32 i = 0; i < m_Results.size(); ++i)
+		{
+			const BenchmarkResult& result = m_Results[i];
+			MLOG("FrustumCulling %s: %.3f ms, %.1fx, visible=%d, match=%d", result.name, result.milliseconds, m_Results[0].milliseconds / result.milliseconds, result.numVisible, result.match);
+		}
+	}
+
+	template<class CullFunc>
+	BenchmarkResult Measure(const char* name, std::vector<uint32>& outVisible, CullFunc func)
+	{
+		// 预热一次，线程池启动以及首次提交不计入
+		func(outVisible);
+
+		double startTime = GenericPlatformTime::Seconds();
+		for (int32 i = 0; i < ITERATIONS; ++i) {
+			func(outVisible);
+		}
+		double endTime = GenericPlatformTime::Seconds();
+
+		BenchmarkResult result;
+		result.name         = name;
+		result.milliseconds = (endTime - startTime) * 1000.0 / ITERATIONS;
+		result.numVisible   = outVisible.size();
+		return result;
+	}
+
+	void CullScalar(std::vector<uint32>& outVisible)
+	{
+		outVisible.clear();
+		for (int32 i = 0; i < OBJECT_COUNT; ++i)
+		{
+			Vector3 pos  = m_ObjModels[i].GetOrigin();
+			bool visible = true;
+			for (int32 j = 0; j < 6; ++j)
+			{
+				const Vector4& plane = m_Frustum.planes[j];
+				float projDist = plane.x * pos.x + plane.y * pos.y + plane.z * pos.z + plane.w + m_Radius;
+				if (projDist <= 0) {
+					visible = false;
+					break;
+				}
+			}
+			if (visible) {
+				outVisible.push_back(i);
+			}
+		}
+	}
+
+	void CullCompute(std::vector<uint32>& outVisible)
+	{
+		m_ComputeCommand->Begin();
+		m_ComputeProcessor->SetUniform("paramData", &m_FrustumParam, sizeof(FrustumParamBlock));
+		m_ComputeProcessor->BindDispatch(m_ComputeCommand->cmdBuffer, 32, 32, 1);
+		m_ComputeCommand->Submit();
+
+		// 结果是每个物体一个标记，绘制前还需要扫描一遍
+		outVisible.clear();
+		Vector4* cullData = (Vector4*)m_CullingBuffer->mapped;
+		for (int32 i = 0; i < OBJECT_COUNT; ++i)
+		{
+			if (cullData[i].x > 0.0f) {
+				outVisible.push_back(i);
+			}
+		}
+	}
+
+	void LoadAssets()
+	{
+		vk_demo::DVKCommandBuffer* cmdBuffer = vk_demo::DVKCommandBuffer::Create(m_VulkanDevice, m_CommandPool);
+
+		m_ObjModels.resize(OBJECT_COUNT);
+		for (int32 i = 0; i < 1024; ++i)
+		{
+			m_ObjModels[i].AppendTranslation(Vector3(
+				MMath::FRandRange(-450.0f, 450.0f),
+				MMath::FRandRange(-100.0f, 100.0f),
+				MMath::FRandRange(-450.0f, 450.0f)
+			));
+		}
+		for (int32 i = 1024; i < OBJECT_COUNT; ++i)
+		{
+			m_ObjModels[i].AppendTranslation(Vector3(
+				MMath::FRandRange(-100000.0f, 100000.0f),
+				MMath::FRandRange(-100000.0f, 100000.0f),
+				MMath::FRandRange(-100000.0f, 100000.0f)
+			));
+		}
+
+		m_CullingSet.Reserve(OBJECT_COUNT);
+		for (int32 i = 0; i < OBJECT_COUNT; ++i) {
+			m_CullingSet.AddSphere(m_ObjModels[i].GetOrigin(), m_Radius);
+		}
+		m_JobPool = vk_demo::DVKJobPool::Create();
+
+		// 与ComputeFrustumDemo相同的相机
+		vk_demo::DVKCamera camera;
+		camera.SetPosition(0, 19.73f, -200.0f);
+		camera.LookAt(0, 19.73f, 0);
+		camera.Perspective(PI / 4, (float)GetWidth(), (float)GetHeight() * 0.5f, 1.0f, 1500.0f);
+		m_Frustum.FromMatrix(camera.GetViewProjection());
+
+		m_FrustumParam.count.x = OBJECT_COUNT;
+		m_FrustumParam.count.y = m_Radius;
+		for (int32 i = 0; i < 6; ++i) {
+			m_FrustumParam.frustumPlanes[i] = m_Frustum.planes[i];
+		}
+
+		{
+			m_CullingBuffer = vk_demo::DVKBuffer::CreateBuffer(
+				m_VulkanDevice, 
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
+				OBJECT_COUNT * sizeof(Vector4)
+			);
+			m_CullingBuffer->Map();
+
+			vk_demo::DVKBuffer* stagingBuffer = vk_demo::DVKBuffer::CreateBuffer(
+				m_VulkanDevice, 
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
+				OBJECT_COUNT * sizeof(Matrix4x4),
+				m_ObjModels.data()
+			);
+
+			m_MatrixBuffer = vk_demo::DVKBuffer::CreateBuffer(
+				m_VulkanDevice, 
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+				OBJECT_COUNT * sizeof(Matrix4x4)
+			);
+
+			cmdBuffer->Begin();
+
+			VkBufferCopy copyRegion = {};
+			copyRegion.size = OBJECT_COUNT * sizeof(Matrix4x4);
+			vkCmdCopyBuffer(cmdBuffer->cmdBuffer, stagingBuffer->buffer, m_MatrixBuffer->buffer, 1, &copyRegion);
+
+			cmdBuffer->End();
+			cmdBuffer->Submit();
+
+			delete stagingBuffer;
+		}
+
+		m_ComputeShader = vk_demo::DVKShader::Create(
+			m_VulkanDevice, 
+			"assets/shaders/45_ComputeFrustum/Frustum.comp.spv"
+		);
+
+		m_ComputeProcessor = vk_demo::DVKCompute::Create(
+			m_VulkanDevice, 
+			m_PipelineCache, 
+			m_ComputeShader
+		);
+		m_ComputeProcessor->SetStorageBuffer("inMatrix",   m_MatrixBuffer);
+		m_ComputeProcessor->SetStorageBuffer("outCulling", m_CullingBuffer);
+
+		m_ComputeCommand = vk_demo::DVKCommandBuffer::Create(
+			m_VulkanDevice, 
+			m_ComputeCommandPool,
+			VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			m_VulkanDevice->GetComputeQueue()
+		);
+
+		delete cmdBuffer;
+	}
+
+	void DestroyAssets()
+	{
+		delete m_JobPool;
+
+		delete m_MatrixBuffer;
+		delete m_CullingBuffer;
+
+		delete m_ComputeShader;
+		delete m_ComputeProcessor;
+		delete m_ComputeCommand;
+	}
+
+	void SetupCommandBuffers(int32 backBufferIndex)
+	{
+		VkCommandBuffer commandBuffer = m_CommandBuffers[backBufferIndex];
+
+		VkCommandBufferBeginInfo cmdBeginInfo;
+		ZeroVulkanStruct(cmdBeginInfo, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO);
+		VERIFYVULKANRESULT(vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo));
+
+		VkClearValue clearValues[2];
+		clearValues[0].color        = { { 0.2f, 0.2f, 0.2f, 1.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		VkRenderPassBeginInfo renderPassBeginInfo;
+		ZeroVulkanStruct(renderPassBeginInfo, VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO);
+		renderPassBeginInfo.renderPass               = m_RenderPass;
+		renderPassBeginInfo.framebuffer              = m_FrameBuffers[backBufferIndex];
+		renderPassBeginInfo.clearValueCount          = 2;
+		renderPassBeginInfo.pClearValues             = clearValues;
+		renderPassBeginInfo.renderArea.offset.x      = 0;
+		renderPassBeginInfo.renderArea.offset.y      = 0;
+		renderPassBeginInfo.renderArea.extent.width  = m_FrameWidth;
+		renderPassBeginInfo.renderArea.extent.height = m_FrameHeight;
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		m_GUI->BindDrawCmd(commandBuffer, m_RenderPass);
+
+		vkCmdEndRenderPass(commandBuffer);
+		VERIFYVULKANRESULT(vkEndCommandBuffer(commandBuffer));
+	}
+
+	void CreateGUI()
+	{
+		m_GUI = new ImageGUIContext();
+		m_GUI->Init("assets/fonts/Ubuntu-Regular.ttf");
+	}
+
+	void DestroyGUI()
+	{
+		m_GUI->Destroy();
+		delete m_GUI;
+	}
+
+private:
+
+	bool 							m_Ready = false;
+
+	std::vector<Matrix4x4>			m_ObjModels;
+	float							m_Radius = 2.0f;
+
+	vk_demo::DVKFrustum				m_Frustum;
+	vk_demo::DVKCullingSet			m_CullingSet;
+	vk_demo::DVKJobPool*			m_JobPool = nullptr;
+
+	FrustumParamBlock				m_FrustumParam;
+	vk_demo::DVKBuffer*				m_MatrixBuffer = nullptr;
+	vk_demo::DVKBuffer*				m_CullingBuffer = nullptr;
+	vk_demo::DVKShader*				m_ComputeShader = nullptr;
+	vk_demo::DVKCompute*			m_ComputeProcessor = nullptr;
+	vk_demo::DVKCommandBuffer*		m_ComputeCommand = nullptr;
+
+	std::vector<BenchmarkResult>	m_Results;
+
+	ImageGUIContext*				m_GUI = nullptr;
+};
+
+std::shared_ptr<AppModuleBase> CreateAppMode(const std::vector<std::string>& cmdLine)
+{
+	return std::make_shared<FrustumCullingBenchmarkDemo>(1400, 900, "FrustumCullingBenchmarkDemo", cmdLine);
+}